@@ -0,0 +1,138 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <thread>
+#define CATCH_CONFIG_NO_MAIN
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "dnsdist.hh"
+#include "dnsdist-cache.hh"
+#include "dnswriter.hh"
+
+struct CachedQuery
+{
+  DNSName qname;
+  PacketBuffer query;
+};
+
+static void initQueryState(InternalQueryState& ids)
+{
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+}
+
+static std::vector<CachedQuery> fillCache(DNSDistPacketCache& cache, size_t numberOfEntries)
+{
+  std::vector<CachedQuery> queries;
+  queries.reserve(numberOfEntries);
+
+  InternalQueryState ids;
+  initQueryState(ids);
+
+  for (size_t counter = 0; counter < numberOfEntries; counter++) {
+    CachedQuery entry;
+    entry.qname = DNSName(std::to_string(counter)) + DNSName("cache.powerdns.com.");
+    ids.qname = entry.qname;
+
+    GenericDNSPacketWriter<PacketBuffer> pwQ(entry.query, entry.qname, QType::A, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+    pwQ.commit();
+
+    PacketBuffer response;
+    GenericDNSPacketWriter<PacketBuffer> pwR(response, entry.qname, QType::A, QClass::IN, 0);
+    pwR.getHeader()->rd = 1;
+    pwR.getHeader()->ra = 1;
+    pwR.getHeader()->qr = 1;
+    pwR.startRecord(entry.qname, QType::A, 3600, QClass::IN, DNSResourceRecord::ANSWER);
+    pwR.xfr32BitInt(0x01020304);
+    pwR.commit();
+
+    uint32_t key = 0;
+    std::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, entry.query);
+    cache.get(dnsQuestion, 0, &key, subnet, false, true);
+    cache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), false, entry.qname, QType::A, QClass::IN, response, true, RCode::NoError, std::nullopt);
+    queries.push_back(std::move(entry));
+  }
+
+  return queries;
+}
+
+static size_t lookupAll(DNSDistPacketCache& cache, const std::vector<CachedQuery>& queries, size_t offset)
+{
+  size_t hits = 0;
+  InternalQueryState ids;
+  initQueryState(ids);
+  PacketBuffer buffer;
+  for (size_t idx = 0; idx < queries.size(); idx++) {
+    const auto& entry = queries.at((idx + offset) % queries.size());
+    ids.qname = entry.qname;
+    /* the query is replaced by the response on a hit */
+    buffer = entry.query;
+    uint32_t key = 0;
+    std::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, buffer);
+    if (cache.get(dnsQuestion, 0, &key, subnet, false, true)) {
+      ++hits;
+    }
+  }
+  return hits;
+}
+
+TEST_CASE("PacketCache/get")
+{
+  const size_t numberOfEntries = 10000;
+
+  for (const auto lockFree : {false, true}) {
+    DNSDistPacketCache::CacheSettings settings{
+      .d_maxEntries = numberOfEntries * 2,
+      .d_shardCount = 20,
+      .d_lockFreeLookups = lockFree,
+    };
+    DNSDistPacketCache cache(settings);
+    auto queries = fillCache(cache, numberOfEntries);
+
+    std::string benchName = std::string("lockFree=") + (lockFree ? "true" : "false");
+    BENCHMARK(benchName.c_str())
+    {
+      return lookupAll(cache, queries, 0);
+    };
+
+    for (const size_t numberOfThreads : {4, 16}) {
+      std::string threadedBenchName = benchName + ",threads=" + std::to_string(numberOfThreads);
+      BENCHMARK(threadedBenchName.c_str())
+      {
+        std::vector<std::thread> threads;
+        threads.reserve(numberOfThreads);
+        for (size_t idx = 0; idx < numberOfThreads; idx++) {
+          threads.emplace_back([&cache, &queries, idx]() {
+            lookupAll(cache, queries, idx * 100);
+          });
+        }
+        for (auto& thread : threads) {
+          thread.join();
+        }
+      };
+    }
+  }
+}
@@ -24,6 +24,7 @@
 #include <catch2/benchmark/catch_benchmark.hpp>
 
 #include "dnsdist-dnsparser.hh"
+#include "burtle.hh"
 
 TEST_CASE("dnsdist-dnsparser")
 {
@@ -42,3 +43,52 @@ TEST_CASE("dnsdist-dnsparser")
     dnsdist::changeNameInDNSPacket(query, target, newTarget);
   };
 }
+
+TEST_CASE("dnsdist-question-parsing")
+{
+  const DNSName target("a-Rather-Long-Label.www.Sub-Domain.PowerDNS.com.");
+  const auto& storage = target.getStorage();
+  const auto lowered = target.makeLowerCase();
+  const auto& loweredStorage = lowered.getStorage();
+
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pw(query, target, QType::A, QClass::IN, 0);
+  pw.getHeader()->rd = 1;
+  pw.getHeader()->id = htons(42);
+  pw.commit();
+
+  BENCHMARK("DNSName from packet")
+  {
+    uint16_t qtype{0};
+    uint16_t qclass{0};
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    DNSName qname(reinterpret_cast<const char*>(query.data()), query.size(), sizeof(dnsheader), false, &qtype, &qclass);
+    return qname.hash();
+  };
+
+  BENCHMARK("QuestionParsing::parse")
+  {
+    return dnsdist::QuestionParsing::parse(query);
+  };
+
+  BENCHMARK("burtleCI")
+  {
+    return burtleCI(storage, 0);
+  };
+
+  BENCHMARK("QuestionParsing::hashNameCI")
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    return dnsdist::QuestionParsing::hashNameCI(reinterpret_cast<const uint8_t*>(storage.data()), storage.size(), 0);
+  };
+
+  BENCHMARK("DNSName::operator==")
+  {
+    return target == lowered;
+  };
+
+  BENCHMARK("QuestionParsing::namesEqualCI")
+  {
+    return dnsdist::QuestionParsing::namesEqualCI(std::string_view(storage.data(), storage.size()), std::string_view(loweredStorage.data(), loweredStorage.size()));
+  };
+}
@@ -0,0 +1,154 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <limits>
+#include <string>
+#include <thread>
+#define CATCH_CONFIG_NO_MAIN
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "dnsdist-idstate.hh"
+#include "dnsdist-doh-common.hh"
+#include "doh3.hh"
+#include "doq.hh"
+
+/* IDs sent to a backend are 16-bit, so this is the maximum number of outstanding queries per backend */
+static const size_t s_maxOutstanding = std::numeric_limits<uint16_t>::max();
+
+static uint16_t saveState(IDStateTable& table, std::atomic<uint64_t>& idOffset, InternalQueryState&& state)
+{
+  do {
+    auto selectedID = static_cast<uint16_t>((idOffset++) % table.size());
+    auto slot = table.tryAcquire(selectedID);
+    if (!slot) {
+      continue;
+    }
+    slot->getState() = std::move(state);
+    slot->markInUse();
+    return selectedID;
+  } while (true);
+}
+
+static std::optional<InternalQueryState> getState(IDStateTable& table, uint16_t queryID)
+{
+  std::optional<InternalQueryState> result = std::nullopt;
+  auto slot = table.tryAcquire(queryID);
+  if (!slot) {
+    return result;
+  }
+  if (slot->isInUse()) {
+    result = std::move(slot->getState());
+  }
+  slot->markFree();
+  return result;
+}
+
+static void fillTable(IDStateTable& table, std::atomic<uint64_t>& idOffset, const DNSName& qname)
+{
+  for (size_t idx = 0; idx < table.size(); idx++) {
+    InternalQueryState ids;
+    ids.qname = qname;
+    ids.origID = idx;
+    saveState(table, idOffset, std::move(ids));
+  }
+}
+
+TEST_CASE("IDStateTable/churn")
+{
+  const DNSName qname("idstate.powerdns.com.");
+  IDStateTable table;
+  table.resize(s_maxOutstanding);
+  std::atomic<uint64_t> idOffset{0};
+  /* every slot holds an outstanding query, so every new query replaces the oldest one */
+  fillTable(table, idOffset, qname);
+
+  string benchName = "outstanding=" + std::to_string(s_maxOutstanding);
+  BENCHMARK(benchName.c_str())
+  {
+    /* a response for the oldest query, then a new query */
+    auto oldest = static_cast<uint16_t>(idOffset.load() % table.size());
+    auto ids = getState(table, oldest);
+    if (ids) {
+      ids->origID++;
+      return saveState(table, idOffset, std::move(*ids));
+    }
+    return oldest;
+  };
+}
+
+TEST_CASE("IDStateTable/churn/threaded")
+{
+  const size_t operationsPerThread = 10000;
+  const DNSName qname("idstate.powerdns.com.");
+
+  for (const size_t numberOfThreads : {4, 16}) {
+    IDStateTable table;
+    table.resize(s_maxOutstanding);
+    std::atomic<uint64_t> idOffset{0};
+    fillTable(table, idOffset, qname);
+
+    string benchName = "threads=" + std::to_string(numberOfThreads);
+    BENCHMARK(benchName.c_str())
+    {
+      std::vector<std::thread> threads;
+      threads.reserve(numberOfThreads);
+      for (size_t idx = 0; idx < numberOfThreads; idx++) {
+        threads.emplace_back([&]() {
+          for (size_t counter = 0; counter < operationsPerThread; counter++) {
+            auto oldest = static_cast<uint16_t>(idOffset.load() % table.size());
+            auto ids = getState(table, oldest);
+            if (!ids) {
+              ids = InternalQueryState();
+              ids->qname = qname;
+            }
+            saveState(table, idOffset, std::move(*ids));
+          }
+        });
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    };
+  }
+}
+
+TEST_CASE("IDStateTable/expire")
+{
+  const DNSName qname("idstate.powerdns.com.");
+  IDStateTable table;
+  table.resize(s_maxOutstanding);
+  std::atomic<uint64_t> idOffset{0};
+  fillTable(table, idOffset, qname);
+
+  /* the timeout scan done every second by the health-check thread, with all the slots
+     in use but none of them old enough to be expired, so we only look at the headers */
+  string benchName = "outstanding=" + std::to_string(s_maxOutstanding);
+  BENCHMARK(benchName.c_str())
+  {
+    size_t expired = 0;
+    table.expire(std::numeric_limits<uint16_t>::max(), [&expired](IDStateTable::LockedSlot& slot) {
+      slot.markFree();
+      expired++;
+    });
+    return expired;
+  };
+}
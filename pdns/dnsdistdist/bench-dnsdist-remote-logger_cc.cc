@@ -0,0 +1,155 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef DISABLE_PROTOBUF
+#define CATCH_CONFIG_NO_MAIN
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <array>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "remote_logger.hh"
+#include "sstuff.hh"
+
+/* accepts connections on a local port and discards everything it receives */
+class RemoteLoggerSink
+{
+public:
+  RemoteLoggerSink() :
+    d_socket(AF_INET, SOCK_STREAM, 0)
+  {
+    d_socket.bind(ComboAddress("127.0.0.1", 0));
+    d_socket.listen(16);
+    d_address = ComboAddress("127.0.0.1", 0);
+    socklen_t addrLen = d_address.getSocklen();
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    if (getsockname(d_socket.getHandle(), reinterpret_cast<struct sockaddr*>(&d_address), &addrLen) != 0) {
+      throw std::runtime_error("Unable to get the address of the remote logger sink");
+    }
+    d_thread = std::thread([this]() {
+      std::vector<std::thread> readers;
+      for (;;) {
+        auto conn = d_socket.accept();
+        if (!conn || d_exiting) {
+          break;
+        }
+        readers.emplace_back([conn = std::move(conn)]() {
+          std::array<char, 65536> buffer{};
+          while (::read(conn->getHandle(), buffer.data(), buffer.size()) > 0) {
+          }
+        });
+      }
+      for (auto& reader : readers) {
+        reader.join();
+      }
+    });
+  }
+  RemoteLoggerSink(const RemoteLoggerSink&) = delete;
+  RemoteLoggerSink(RemoteLoggerSink&&) = delete;
+  RemoteLoggerSink& operator=(const RemoteLoggerSink&) = delete;
+  RemoteLoggerSink& operator=(RemoteLoggerSink&&) = delete;
+
+  ~RemoteLoggerSink()
+  {
+    d_exiting = true;
+    /* wake up the accepting thread */
+    Socket wakeUp(AF_INET, SOCK_STREAM, 0);
+    wakeUp.connect(d_address);
+    d_thread.join();
+  }
+
+  [[nodiscard]] const ComboAddress& getAddress() const
+  {
+    return d_address;
+  }
+
+private:
+  Socket d_socket;
+  ComboAddress d_address;
+  std::thread d_thread;
+  std::atomic<bool> d_exiting{false};
+};
+
+static const std::string s_message(300, 'a');
+
+/* the messages are dropped once the queue is full, so these measure the cost of
+   submitting a message, not how fast they can be sent to the remote end */
+TEST_CASE("RemoteLogger-submit")
+{
+  RemoteLoggerSink sink;
+  RemoteLogger shared(sink.getAddress(), 2, 100 * 10000, 1, false, 0);
+  RemoteLogger perThread(sink.getAddress(), 2, 100 * 10000, 1, false, 10000);
+
+  BENCHMARK("RemoteLogger::queueData shared buffer")
+  {
+    return shared.queueData(s_message);
+  };
+
+  BENCHMARK("RemoteLogger::queueData per-thread queues")
+  {
+    return perThread.queueData(s_message);
+  };
+
+  std::string data;
+  BENCHMARK("RemoteLogger::queueOwnedData per-thread queues")
+  {
+    data.assign(s_message);
+    return perThread.queueOwnedData(data);
+  };
+}
+
+static void submitFromThreads(RemoteLoggerInterface& logger, size_t threadsCount, size_t messagesPerThread)
+{
+  std::vector<std::thread> threads;
+  threads.reserve(threadsCount);
+  for (size_t idx = 0; idx < threadsCount; idx++) {
+    threads.emplace_back([&logger, messagesPerThread]() {
+      std::string data;
+      for (size_t count = 0; count < messagesPerThread; count++) {
+        data.assign(s_message);
+        (void)logger.queueOwnedData(data);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST_CASE("RemoteLogger-contention")
+{
+  RemoteLoggerSink sink;
+  RemoteLogger shared(sink.getAddress(), 2, 100 * 10000, 1, false, 0);
+  RemoteLogger perThread(sink.getAddress(), 2, 100 * 10000, 1, false, 10000);
+
+  BENCHMARK("RemoteLogger 4 threads x 10000 messages, shared buffer")
+  {
+    submitFromThreads(shared, 4, 10000);
+  };
+
+  BENCHMARK("RemoteLogger 4 threads x 10000 messages, per-thread queues")
+  {
+    submitFromThreads(perThread, 4, 10000);
+  };
+}
+#endif /* DISABLE_PROTOBUF */
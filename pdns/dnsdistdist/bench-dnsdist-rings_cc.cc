@@ -20,6 +20,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <string>
+#include <thread>
 #define CATCH_CONFIG_NO_MAIN
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
@@ -67,3 +68,55 @@ TEST_CASE("Rings/insert")
     };
   }
 }
+
+TEST_CASE("Rings/insert/threaded")
+{
+  const size_t maxEntries = 100000;
+  const size_t insertionsPerThread = 10000;
+
+  dnsheader dnsheader{};
+  memset(&dnsheader, 0, sizeof(dnsheader));
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor1("192.0.2.1");
+  uint16_t qtype = QType::AAAA;
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  struct timespec now{};
+  gettime(&now);
+
+  for (const size_t numberOfThreads : {4, 16}) {
+    for (const auto perThread : {false, true}) {
+      Rings rings;
+      rings.init(maxEntries, numberOfThreads, 5, true, true, perThread);
+
+      string benchName = "threads=" + std::to_string(numberOfThreads) + ",perThread=" + (perThread ? "true" : "false");
+      BENCHMARK(benchName.c_str())
+      {
+        std::vector<std::thread> threads;
+        threads.reserve(numberOfThreads);
+        for (size_t idx = 0; idx < numberOfThreads; idx++) {
+          threads.emplace_back([&]() {
+            for (size_t counter = 0; counter < insertionsPerThread; counter++) {
+              rings.insertQuery(now, requestor1, qname, qtype, size, dnsheader, protocol);
+              rings.insertResponse(now, requestor1, qname, qtype, 100, size, dnsheader, requestor1, protocol);
+            }
+          });
+        }
+        for (auto& thread : threads) {
+          thread.join();
+        }
+      };
+
+      /* the cost of reading the content of the rings, as done by the dynamic blocks */
+      std::string readBenchName = benchName + ",read";
+      BENCHMARK(readBenchName.c_str())
+      {
+        size_t count = 0;
+        rings.forEachQuery([&count](const Rings::Query& entry) {
+          count += entry.size;
+        });
+        return count;
+      };
+    }
+  }
+}
@@ -1494,9 +1494,10 @@ static std::tuple<DnstapMessage::ProtocolType, std::optional<DnstapMessage::Http
   throw std::runtime_error("Unhandled protocol for dnstap: " + protocol.toPrettyString());
 }
 
-static void remoteLoggerQueueData(RemoteLoggerInterface& remoteLogger, const std::string& data)
+/* the logger might take the content of data instead of copying it */
+static void remoteLoggerQueueData(RemoteLoggerInterface& remoteLogger, std::string& data)
 {
-  auto ret = remoteLogger.queueData(data);
+  auto ret = remoteLogger.queueOwnedData(data);
 
   switch (ret) {
   case RemoteLoggerInterface::Result::Queued:
@@ -1932,7 +1933,7 @@ public:
       response->ids.delayedResponseMsgs.emplace_back(data, std::shared_ptr<RemoteLoggerInterface>(d_logger));
     }
     else {
-      d_logger->queueData(data);
+      d_logger->queueOwnedData(data);
     }
 
     return Action::None;
@@ -2173,7 +2174,6 @@ private:
 };
 #endif /* HAVE_DNS_OVER_HTTPS || HAVE_DNS_OVER_HTTP3 */
 
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
 class KeyValueStoreLookupAction : public DNSAction
 {
 public:
@@ -2245,7 +2245,6 @@ private:
   std::shared_ptr<KeyValueLookupKey> d_key;
   std::string d_tag;
 };
-#endif /* defined(HAVE_LMDB) || defined(HAVE_CDB) */
 
 class SetMaxReturnedTTLAction : public DNSAction
 {
@@ -2596,7 +2595,6 @@ std::shared_ptr<DNSResponseAction> getDnstapLogResponseAction(const std::string&
 }
 #endif /* DISABLE_PROTOBUF */
 
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
 std::shared_ptr<DNSAction> getKeyValueStoreLookupAction(std::shared_ptr<KeyValueStore>& kvs, std::shared_ptr<KeyValueLookupKey>& lookupKey, const std::string& destinationTag)
 {
   return std::shared_ptr<DNSAction>(new KeyValueStoreLookupAction(kvs, lookupKey, destinationTag));
@@ -2606,7 +2604,6 @@ std::shared_ptr<DNSAction> getKeyValueStoreRangeLookupAction(std::shared_ptr<Key
 {
   return std::shared_ptr<DNSAction>(new KeyValueStoreRangeLookupAction(kvs, lookupKey, destinationTag));
 }
-#endif /* defined(HAVE_LMDB) || defined(HAVE_CDB) */
 
 std::shared_ptr<DNSAction> getHTTPStatusAction([[maybe_unused]] uint16_t status, [[maybe_unused]] PacketBuffer&& body, [[maybe_unused]] const std::string& contentType, [[maybe_unused]] const dnsdist::ResponseConfig& responseConfig)
 {
@@ -20,6 +20,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include "dnsdist-async.hh"
+#include "dnsdist-cache.hh"
 #include "dnsdist-internal-queries.hh"
 #include "dolog.hh"
 #include "mplexer.hh"
@@ -28,18 +29,27 @@
 namespace dnsdist
 {
 
-AsynchronousHolder::Data::Data(bool failOpen) :
-  d_failOpen(failOpen)
+AsynchronousHolder::Data::Data(bool failOpen, size_t shards) :
+  d_shards(shards > 0 ? shards : 1), d_failOpen(failOpen)
 {
   auto [notifier, waiter] = pdns::channel::createNotificationQueue(true);
   // NOLINTNEXTLINE(cppcoreguidelines-prefer-member-initializer): how I am supposed to do that?
   d_waiter = std::move(waiter);
   // NOLINTNEXTLINE(cppcoreguidelines-prefer-member-initializer): how I am supposed to do that?
   d_notifier = std::move(notifier);
+
+  struct timeval now{};
+  gettimeofday(&now, nullptr);
+  const auto currentTick = getTick(now);
+  for (auto& lockedShard : d_shards) {
+    auto shard = lockedShard.lock();
+    shard->d_wheel.resize(s_timerWheelSlots);
+    shard->d_lastTick = currentTick - 1;
+  }
 }
 
-AsynchronousHolder::AsynchronousHolder(bool failOpen) :
-  d_data(std::make_shared<Data>(failOpen))
+AsynchronousHolder::AsynchronousHolder(bool failOpen, size_t shards) :
+  d_data(std::make_shared<Data>(failOpen, shards))
 {
   std::thread main([data = this->d_data] { mainThread(data); });
   main.detach();
@@ -74,11 +84,7 @@ bool AsynchronousHolder::wait(AsynchronousHolder::Data& data, FDMultiplexer& mpl
 
 void AsynchronousHolder::stop()
 {
-  {
-    auto content = d_data->d_content.lock();
-    d_data->d_done = true;
-  }
-
+  d_data->d_done.store(true);
   notify();
 }
 
@@ -87,48 +93,40 @@ void AsynchronousHolder::mainThread(std::shared_ptr<Data> data)
 {
   setThreadName("dnsdist/async");
   struct timeval now{};
-  std::list<std::pair<uint16_t, std::unique_ptr<CrossProtocolQuery>>> expiredEvents;
+  expired_t expiredEvents;
 
   auto mplexer = std::unique_ptr<FDMultiplexer>(FDMultiplexer::getMultiplexerSilent(1));
   mplexer->addReadFD(data->d_waiter.getDescriptor(), [](int, FDMultiplexer::funcparam_t&) {});
   std::vector<int> readyFDs;
 
   while (true) {
-    bool shouldWait = true;
-    int timeout = -1;
     dnsdist::configuration::refreshLocalRuntimeConfiguration();
+    if (data->d_done.load()) {
+      return;
+    }
 
-    {
-      auto content = data->d_content.lock();
-      if (data->d_done) {
-        return;
-      }
+    int timeout = -1;
+    if (data->d_entriesCount.load() > 0) {
+      /* we do not keep track of the next TTD, so wake up at the end of the current tick,
+         as long as there is at least one query waiting */
+      gettimeofday(&now, nullptr);
+      const auto nowMs = static_cast<uint64_t>(now.tv_sec) * 1000U + static_cast<uint64_t>(now.tv_usec) / 1000U;
+      timeout = static_cast<int>(s_timerWheelTickMs - (nowMs % s_timerWheelTickMs));
+    }
 
-      if (!content->empty()) {
-        gettimeofday(&now, nullptr);
-        struct timeval next = getNextTTD(*content);
-        if (next <= now) {
-          pickupExpired(*content, now, expiredEvents);
-          shouldWait = false;
-        }
-        else {
-          auto remainingUsec = uSec(next - now);
-          timeout = static_cast<int>(std::round(static_cast<double>(remainingUsec) / 1000.0));
-          if (timeout == 0 && remainingUsec > 0) {
-            /* if we have less than 1 ms, let's wait at least 1 ms */
-            timeout = 1;
-          }
-        }
-      }
+    wait(*data, *mplexer, readyFDs, timeout);
+
+    if (data->d_entriesCount.load() == 0) {
+      continue;
     }
 
-    if (shouldWait) {
-      auto timedOut = wait(*data, *mplexer, readyFDs, timeout);
-      if (timedOut) {
-        auto content = data->d_content.lock();
-        gettimeofday(&now, nullptr);
-        pickupExpired(*content, now, expiredEvents);
-      }
+    gettimeofday(&now, nullptr);
+    const auto currentTick = getTick(now);
+    for (auto& lockedShard : data->d_shards) {
+      auto shard = lockedShard.lock();
+      const auto before = expiredEvents.size();
+      pickupExpired(*shard, currentTick, expiredEvents);
+      data->d_entriesCount -= expiredEvents.size() - before;
     }
 
     while (!expiredEvents.empty()) {
@@ -152,22 +150,23 @@ void AsynchronousHolder::mainThread(std::shared_ptr<Data> data)
 
 void AsynchronousHolder::push(uint16_t asyncID, uint16_t queryID, const struct timeval& ttd, std::unique_ptr<CrossProtocolQuery>&& query)
 {
+  const auto key = getKey(asyncID, queryID);
   bool needNotify = false;
   {
-    auto content = d_data->d_content.lock();
-    if (!content->empty()) {
-      /* the thread is already waiting on a TTD expiry in addition to notifications,
-         let's not wake it unless our TTD comes before the current one */
-      const struct timeval next = getNextTTD(*content);
-      if (ttd < next) {
-        needNotify = true;
-      }
-    }
-    else {
-      /* the thread is currently only waiting for a notify */
-      needNotify = true;
+    auto shard = d_data->d_shards.at(d_data->getShardIndex(key)).lock();
+    auto generation = ++shard->d_generation;
+    auto [entryIt, inserted] = shard->d_entries.try_emplace(key, Entry{std::move(query), ttd, generation});
+    if (!inserted) {
+      /* there is already a query suspended with the same IDs */
+      return;
     }
-    content->insert({std::move(query), ttd, asyncID, queryID});
+
+    /* a TTD that is already in the past is handled with the next slot to be processed */
+    auto tick = std::max(getTick(ttd), shard->d_lastTick + 1);
+    shard->d_wheel.at(tick % s_timerWheelSlots).push_back({tick, generation, key});
+    /* the thread only waits for a notification when the holder is empty, otherwise
+       it will wake up at the end of the current tick anyway */
+    needNotify = d_data->d_entriesCount++ == 0;
   }
 
   if (needNotify) {
@@ -177,42 +176,99 @@ void AsynchronousHolder::push(uint16_t asyncID, uint16_t queryID, const struct t
 
 std::unique_ptr<CrossProtocolQuery> AsynchronousHolder::get(uint16_t asyncID, uint16_t queryID)
 {
-  /* no need to notify, worst case the thread wakes up for nothing because this was the next TTD */
-  auto content = d_data->d_content.lock();
-  auto contentIt = content->find(std::tie(queryID, asyncID));
-  if (contentIt == content->end()) {
+  /* no need to notify, worst case the thread wakes up for nothing */
+  const auto key = getKey(asyncID, queryID);
+  std::unique_ptr<CrossProtocolQuery> result;
+  {
+    auto shard = d_data->d_shards.at(d_data->getShardIndex(key)).lock();
+    auto entryIt = shard->d_entries.find(key);
+    if (entryIt != shard->d_entries.end()) {
+      result = std::move(entryIt->second.d_query);
+      shard->d_entries.erase(entryIt);
+      --d_data->d_entriesCount;
+    }
+  }
+
+  if (!result) {
     struct timeval now{};
     gettimeofday(&now, nullptr);
     vinfolog("Asynchronous object %d not found at %d.%d", queryID, now.tv_sec, now.tv_usec);
     return nullptr;
   }
 
-  auto result = std::move(contentIt->d_query);
-  content->erase(contentIt);
   return result;
 }
 
-void AsynchronousHolder::pickupExpired(content_t& content, const struct timeval& now, std::list<std::pair<uint16_t, std::unique_ptr<CrossProtocolQuery>>>& events)
+std::vector<std::unique_ptr<CrossProtocolQuery>> AsynchronousHolder::get(const std::vector<std::pair<uint16_t, uint16_t>>& ids)
 {
-  auto& idx = content.get<TTDTag>();
-  for (auto contentIt = idx.begin(); contentIt != idx.end() && contentIt->d_ttd < now;) {
-    events.emplace_back(contentIt->d_queryID, std::move(contentIt->d_query));
-    contentIt = idx.erase(contentIt);
+  std::vector<std::unique_ptr<CrossProtocolQuery>> results(ids.size());
+
+  /* visit the requested IDs shard by shard, so that we take each lock only once */
+  std::vector<std::pair<size_t, size_t>> order;
+  order.reserve(ids.size());
+  for (size_t idx = 0; idx < ids.size(); idx++) {
+    order.emplace_back(d_data->getShardIndex(getKey(ids.at(idx).first, ids.at(idx).second)), idx);
+  }
+  std::sort(order.begin(), order.end());
+
+  for (auto orderIt = order.begin(); orderIt != order.end();) {
+    const auto shardIndex = orderIt->first;
+    auto shard = d_data->d_shards.at(shardIndex).lock();
+    for (; orderIt != order.end() && orderIt->first == shardIndex; ++orderIt) {
+      const auto& [asyncID, queryID] = ids.at(orderIt->second);
+      auto entryIt = shard->d_entries.find(getKey(asyncID, queryID));
+      if (entryIt == shard->d_entries.end()) {
+        continue;
+      }
+      results.at(orderIt->second) = std::move(entryIt->second.d_query);
+      shard->d_entries.erase(entryIt);
+      --d_data->d_entriesCount;
+    }
   }
+
+  return results;
 }
 
-struct timeval AsynchronousHolder::getNextTTD(const content_t& content)
+void AsynchronousHolder::pickupExpired(Shard& shard, uint64_t currentTick, expired_t& events)
 {
-  if (content.empty()) {
-    throw std::runtime_error("AsynchronousHolder::getNextTTD() called on an empty holder");
+  /* only process the slots whose time range is entirely in the past. After a long sleep
+     there is no need to go over the same slot more than once */
+  const auto lastTickToProcess = currentTick - 1;
+  if (lastTickToProcess <= shard.d_lastTick) {
+    return;
+  }
+  auto firstTick = shard.d_lastTick + 1;
+  if (lastTickToProcess - firstTick >= s_timerWheelSlots) {
+    firstTick = lastTickToProcess - s_timerWheelSlots + 1;
+  }
+
+  for (auto tick = firstTick; tick <= lastTickToProcess; tick++) {
+    auto& slot = shard.d_wheel.at(tick % s_timerWheelSlots);
+    for (auto slotIt = slot.begin(); slotIt != slot.end();) {
+      if (slotIt->d_tick > lastTickToProcess) {
+        /* not this round */
+        ++slotIt;
+        continue;
+      }
+
+      auto entryIt = shard.d_entries.find(slotIt->d_key);
+      if (entryIt != shard.d_entries.end() && entryIt->second.d_generation == slotIt->d_generation) {
+        events.emplace_back(static_cast<uint16_t>(slotIt->d_key >> 16), std::move(entryIt->second.d_query));
+        shard.d_entries.erase(entryIt);
+      }
+
+      /* order does not matter */
+      *slotIt = slot.back();
+      slot.pop_back();
+    }
   }
 
-  return content.get<TTDTag>().begin()->d_ttd;
+  shard.d_lastTick = lastTickToProcess;
 }
 
 bool AsynchronousHolder::empty()
 {
-  return d_data->d_content.read_only_lock()->empty();
+  return d_data->d_entriesCount.load() == 0;
 }
 
 static bool resumeResponse(std::unique_ptr<CrossProtocolQuery>&& response)
@@ -253,6 +309,17 @@ bool queueQueryResumptionEvent(std::unique_ptr<CrossProtocolQuery>&& query)
   return true;
 }
 
+bool queueQueryResumptionEvents(std::vector<std::unique_ptr<CrossProtocolQuery>>&& queries)
+{
+  auto queue = s_asynchronousEventsQueue.lock();
+  for (auto& query : queries) {
+    if (query) {
+      queue->push_back(std::move(query));
+    }
+  }
+  return true;
+}
+
 void handleQueuedAsynchronousEvents()
 {
   while (true) {
@@ -280,6 +347,8 @@ bool resumeQuery(std::unique_ptr<CrossProtocolQuery>&& query)
   }
 
   DNSQuestion dnsQuestion = query->getDQ();
+  /* a resumed query cannot be suspended again, so it should not wait for an identical one either */
+  dnsQuestion.ids.coalesced = true;
 
   auto result = processQueryAfterRules(dnsQuestion, query->downstream);
   if (result == ProcessQueryResult::Drop) {
@@ -339,12 +408,8 @@ bool resumeQuery(std::unique_ptr<CrossProtocolQuery>&& query)
   return false;
 }
 
-bool suspendQuery(DNSQuestion& dnsQuestion, uint16_t asyncID, uint16_t queryID, uint32_t timeoutMs)
+static bool suspendQueryInto(AsynchronousHolder& holder, DNSQuestion& dnsQuestion, uint16_t asyncID, uint16_t queryID, uint32_t timeoutMs)
 {
-  if (!g_asyncHolder) {
-    return false;
-  }
-
   struct timeval now{};
   gettimeofday(&now, nullptr);
   struct timeval ttd = now;
@@ -355,10 +420,19 @@ bool suspendQuery(DNSQuestion& dnsQuestion, uint16_t asyncID, uint16_t queryID,
   vinfolog("Suspending asynchronous query %d at %d.%d until %d.%d", queryID, now.tv_sec, now.tv_usec, ttd.tv_sec, ttd.tv_usec);
   auto query = getInternalQueryFromDQ(dnsQuestion, false);
 
-  g_asyncHolder->push(asyncID, queryID, ttd, std::move(query));
+  holder.push(asyncID, queryID, ttd, std::move(query));
   return true;
 }
 
+bool suspendQuery(DNSQuestion& dnsQuestion, uint16_t asyncID, uint16_t queryID, uint32_t timeoutMs)
+{
+  if (!g_asyncHolder) {
+    return false;
+  }
+
+  return suspendQueryInto(*g_asyncHolder, dnsQuestion, asyncID, queryID, timeoutMs);
+}
+
 bool suspendResponse(DNSResponse& dnsResponse, uint16_t asyncID, uint16_t queryID, uint32_t timeoutMs)
 {
   if (!g_asyncHolder) {
@@ -381,5 +455,57 @@ bool suspendResponse(DNSResponse& dnsResponse, uint16_t asyncID, uint16_t queryI
   return true;
 }
 
+static std::atomic<uint32_t> s_coalescingFollowerID{0};
+
+bool coalesceQuery(DNSQuestion& dnsQuestion, DNSDistPacketCache& cache, uint32_t key)
+{
+  /* queries received via XSK cannot be suspended */
+  if (!g_coalescingHolder || dnsQuestion.ids.coalesced || dnsQuestion.ids.isXSK()) {
+    return false;
+  }
+
+  /* whatever happens, it will not try again if it is resumed */
+  dnsQuestion.ids.coalesced = true;
+  const auto timeoutMs = cache.getCoalescingTimeout();
+  auto result = cache.joinInFlightQuery(key, time(nullptr), s_coalescingFollowerID++, [&dnsQuestion, timeoutMs](uint32_t followerID) {
+    dnsQuestion.asynchronous = true;
+    return suspendQueryInto(*g_coalescingHolder, dnsQuestion, static_cast<uint16_t>(followerID & 0xffff), static_cast<uint16_t>(followerID >> 16), timeoutMs);
+  });
+
+  if (result == DNSDistPacketCache::CoalescingResult::Leader) {
+    dnsQuestion.ids.coalescingLeader = true;
+    dnsQuestion.ids.coalescingKey = key;
+  }
+  return result == DNSDistPacketCache::CoalescingResult::Follower;
+}
+
+void releaseCoalescedQueries(DNSDistPacketCache& cache, InternalQueryState& ids)
+{
+  if (!ids.coalescingLeader) {
+    return;
+  }
+  ids.coalescingLeader = false;
+
+  auto followers = cache.releaseInFlightQuery(ids.coalescingKey);
+  if (followers.empty() || !g_coalescingHolder) {
+    return;
+  }
+
+  std::vector<std::pair<uint16_t, uint16_t>> toResume;
+  toResume.reserve(followers.size());
+  for (const auto followerID : followers) {
+    toResume.emplace_back(static_cast<uint16_t>(followerID & 0xffff), static_cast<uint16_t>(followerID >> 16));
+  }
+
+  /* the ones that are no longer there have timed out, and have been forwarded already */
+  auto queries = g_coalescingHolder->get(toResume);
+  for (auto& query : queries) {
+    if (query && !resumeQuery(std::move(query))) {
+      vinfolog("Unable to resume a query waiting for an identical one");
+    }
+  }
+}
+
 std::unique_ptr<AsynchronousHolder> g_asyncHolder;
+std::unique_ptr<AsynchronousHolder> g_coalescingHolder;
 }
@@ -22,71 +22,92 @@
 #pragma once
 
 #include <thread>
-
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
-#include <boost/multi_index/key_extractors.hpp>
+#include <unordered_map>
 
 #include "channel.hh"
 #include "dnsdist-tcp.hh"
 
+class DNSDistPacketCache;
+
 namespace dnsdist
 {
 class AsynchronousHolder
 {
 public:
-  AsynchronousHolder(bool failOpen = true);
+  /* the suspended queries are spread over several shards, each one protected by its own lock,
+     and expire via a timer wheel whose granularity is s_timerWheelTickMs */
+  static constexpr size_t s_defaultShards{16};
+  static constexpr uint64_t s_timerWheelTickMs{5};
+  static constexpr size_t s_timerWheelSlots{1024};
+
+  AsynchronousHolder(bool failOpen = true, size_t shards = s_defaultShards);
   ~AsynchronousHolder();
   void push(uint16_t asyncID, uint16_t queryID, const struct timeval& ttd, std::unique_ptr<CrossProtocolQuery>&& query);
   std::unique_ptr<CrossProtocolQuery> get(uint16_t asyncID, uint16_t queryID);
+  /* retrieve several queries at once, taking the lock of a given shard only once. The returned vector
+     has the same size than 'ids', holding a nullptr for every query that could not be found */
+  std::vector<std::unique_ptr<CrossProtocolQuery>> get(const std::vector<std::pair<uint16_t, uint16_t>>& ids);
   bool empty();
   void stop();
 
 private:
-  struct TTDTag
+  struct Entry
   {
+    std::unique_ptr<CrossProtocolQuery> d_query;
+    struct timeval d_ttd;
+    uint64_t d_generation;
   };
-  struct IDTag
+
+  /* entries removed by get() are not removed from the wheel right away but skipped
+     when their slot is processed, the generation telling us whether a key has been reused */
+  struct WheelEntry
   {
+    uint64_t d_tick;
+    uint64_t d_generation;
+    uint32_t d_key;
   };
 
-  struct Entry
+  struct Shard
   {
-    /* not used by any of the indexes, so mutable */
-    mutable std::unique_ptr<CrossProtocolQuery> d_query;
-    struct timeval d_ttd;
-    uint16_t d_asyncID;
-    uint16_t d_queryID;
+    std::unordered_map<uint32_t, Entry> d_entries;
+    std::vector<std::vector<WheelEntry>> d_wheel;
+    /* every slot up to this tick has already been processed */
+    uint64_t d_lastTick{0};
+    uint64_t d_generation{0};
   };
 
-  using content_t = multi_index_container<
-    Entry,
-    indexed_by<
-      ordered_unique<tag<IDTag>,
-                     composite_key<
-                       Entry,
-                       member<Entry, uint16_t, &Entry::d_queryID>,
-                       member<Entry, uint16_t, &Entry::d_asyncID>>>,
-      ordered_non_unique<tag<TTDTag>,
-                         member<Entry, struct timeval, &Entry::d_ttd>>>>;
+  using expired_t = std::list<std::pair<uint16_t, std::unique_ptr<CrossProtocolQuery>>>;
 
-  static void pickupExpired(content_t&, const struct timeval& now, std::list<std::pair<uint16_t, std::unique_ptr<CrossProtocolQuery>>>& expiredEvents);
-  static struct timeval getNextTTD(const content_t&);
+  static uint32_t getKey(uint16_t asyncID, uint16_t queryID)
+  {
+    return (static_cast<uint32_t>(queryID) << 16) | asyncID;
+  }
+  static uint64_t getTick(const struct timeval& tv)
+  {
+    return (static_cast<uint64_t>(tv.tv_sec) * 1000U + static_cast<uint64_t>(tv.tv_usec) / 1000U) / s_timerWheelTickMs;
+  }
+  static void pickupExpired(Shard& shard, uint64_t currentTick, expired_t& expiredEvents);
 
   struct Data
   {
-    Data(bool failOpen);
+    Data(bool failOpen, size_t shards);
     Data(const Data&) = delete;
     Data(Data&&) = delete;
     Data& operator=(const Data&) = delete;
     Data& operator=(Data&&) = delete;
     ~Data() = default;
 
-    LockGuarded<content_t> d_content;
+    size_t getShardIndex(uint32_t key) const
+    {
+      return (key * 2654435761U) % d_shards.size();
+    }
+
+    std::vector<LockGuarded<Shard>> d_shards;
     pdns::channel::Notifier d_notifier;
     pdns::channel::Waiter d_waiter;
+    std::atomic<size_t> d_entriesCount{0};
     bool d_failOpen{true};
-    bool d_done{false};
+    std::atomic<bool> d_done{false};
   };
   std::shared_ptr<Data> d_data{nullptr};
 
@@ -98,8 +119,18 @@ private:
 bool suspendQuery(DNSQuestion& dnsQuestion, uint16_t asyncID, uint16_t queryID, uint32_t timeoutMs);
 bool suspendResponse(DNSResponse& dnsResponse, uint16_t asyncID, uint16_t queryID, uint32_t timeoutMs);
 bool queueQueryResumptionEvent(std::unique_ptr<CrossProtocolQuery>&& query);
+bool queueQueryResumptionEvents(std::vector<std::unique_ptr<CrossProtocolQuery>>&& queries);
 bool resumeQuery(std::unique_ptr<CrossProtocolQuery>&& query);
 void handleQueuedAsynchronousEvents();
 
+/* in-flight query coalescing: returns true if the query has been suspended until the response to an identical
+   query, its leader, has been received, false if it should be forwarded, possibly becoming the leader */
+bool coalesceQuery(DNSQuestion& dnsQuestion, DNSDistPacketCache& cache, uint32_t key);
+/* resumes the queries waiting for the response to this one, if any, so that they can be answered from the cache */
+void releaseCoalescedQueries(DNSDistPacketCache& cache, InternalQueryState& ids);
+
 extern std::unique_ptr<AsynchronousHolder> g_asyncHolder;
+/* holds the queries waiting for an identical one to be answered, kept apart from the ones suspended
+   from Lua so that their identifiers cannot collide */
+extern std::unique_ptr<AsynchronousHolder> g_coalescingHolder;
 }
@@ -21,6 +21,7 @@
  */
 
 // for OpenBSD, sys/socket.h needs to come before net/if.h
+#include <cmath>
 #include <sys/socket.h>
 #include <net/if.h>
 
@@ -258,6 +259,10 @@ void DownstreamState::hash()
   auto weight = d_config.d_weight;
   auto idStr = boost::str(boost::format("%s") % *d_config.id);
   auto lockedHashes = hashes.write_lock();
+  if (hashesComputed) {
+    /* the consistent hashing rings built from the existing hashes are now stale */
+    ++s_hashesGeneration;
+  }
   lockedHashes->clear();
   lockedHashes->reserve(weight);
   while (weight > 0) {
@@ -271,6 +276,42 @@ void DownstreamState::hash()
   hashesComputed = true;
 }
 
+static int64_t timespecToUsec(const struct timespec& when)
+{
+  return (static_cast<int64_t>(when.tv_sec) * 1000000) + (when.tv_nsec / 1000);
+}
+
+void DownstreamState::updatePeakLatency(double udiff, const struct timespec& queryTime)
+{
+  /* concurrent updates might overwrite each other, which is fine for an estimate */
+  const auto now = timespecToUsec(queryTime) + static_cast<int64_t>(udiff);
+  const auto lastUpdate = d_peakLatencyLastUpdate.exchange(now, std::memory_order_relaxed);
+  const auto current = d_peakLatencyUsec.load(std::memory_order_relaxed);
+  if (udiff >= current || lastUpdate == 0) {
+    d_peakLatencyUsec.store(udiff, std::memory_order_relaxed);
+    return;
+  }
+
+  const auto elapsed = std::max(now - lastUpdate, static_cast<int64_t>(0));
+  const double weight = std::exp(-static_cast<double>(elapsed) / s_peakLatencyDecayUsec);
+  d_peakLatencyUsec.store((current * weight) + (udiff * (1.0 - weight)), std::memory_order_relaxed);
+}
+
+double DownstreamState::getPeakLatencyUsec(const struct timespec& now) const
+{
+  const auto current = d_peakLatencyUsec.load(std::memory_order_relaxed);
+  if (current == 0.0) {
+    return current;
+  }
+  /* decay towards zero when we have not heard from the backend in a while,
+     so that a server which was slow once gets a chance to be selected again */
+  const auto elapsed = timespecToUsec(now) - d_peakLatencyLastUpdate.load(std::memory_order_relaxed);
+  if (elapsed <= 0) {
+    return current;
+  }
+  return current * std::exp(-static_cast<double>(elapsed) / s_peakLatencyDecayUsec);
+}
+
 void DownstreamState::setId(const boost::uuids::uuid& newId)
 {
   d_config.id = newId;
@@ -442,22 +483,20 @@ static bool isIDSExpired(const IDState& ids, uint8_t udpTimeout)
   return age > udpTimeout;
 }
 
-void DownstreamState::handleUDPTimeout(IDState& ids)
+void DownstreamState::handleUDPTimeout(InternalQueryState& ids)
 {
-  ids.age = 0;
-  ids.inUse = false;
   ++reuseds;
   --outstanding;
   ++dnsdist::metrics::g_stats.downstreamTimeouts; // this is an 'actively' discovered timeout
   vinfolog("Had a downstream timeout from %s (%s) for query for %s|%s from %s",
            d_config.remote.toStringWithPort(), getName(),
-           ids.internal.qname.toLogString(), QType(ids.internal.qtype).toString(), ids.internal.origRemote.toStringWithPort());
+           ids.qname.toLogString(), QType(ids.qtype).toString(), ids.origRemote.toStringWithPort());
 
   const auto& chains = dnsdist::configuration::getCurrentRuntimeConfiguration().d_ruleChains;
   const auto& timeoutRespRules = dnsdist::rules::getResponseRuleChain(chains, dnsdist::rules::ResponseRuleChain::TimeoutResponseRules);
-  auto sender = ids.internal.du == nullptr ? nullptr : ids.internal.du->getQuerySender();
-  if (!handleTimeoutResponseRules(timeoutRespRules, ids.internal, shared_from_this(), sender)) {
-    DOHUnitInterface::handleTimeout(std::move(ids.internal.du));
+  auto sender = ids.du == nullptr ? nullptr : ids.du->getQuerySender();
+  if (!handleTimeoutResponseRules(timeoutRespRules, ids, shared_from_this(), sender)) {
+    DOHUnitInterface::handleTimeout(std::move(ids.du));
   }
 
   if (g_rings.shouldRecordResponses()) {
@@ -466,11 +505,11 @@ void DownstreamState::handleUDPTimeout(IDState& ids)
 
     dnsheader fake{};
     memset(&fake, 0, sizeof(fake));
-    fake.id = ids.internal.origID;
+    fake.id = ids.origID;
     uint16_t* flags = getFlagsFromDNSHeader(&fake);
-    *flags = ids.internal.origFlags;
+    *flags = ids.origFlags;
 
-    g_rings.insertResponse(now, ids.internal.origRemote, ids.internal.qname, ids.internal.qtype, std::numeric_limits<unsigned int>::max(), 0, fake, d_config.remote, getProtocol());
+    g_rings.insertResponse(now, ids.origRemote, ids.qname, ids.qtype, std::numeric_limits<unsigned int>::max(), 0, fake, d_config.remote, getProtocol());
   }
 
   reportTimeoutOrError();
@@ -504,7 +543,7 @@ void DownstreamState::handleUDPTimeouts()
     for (auto it = map->begin(); it != map->end(); ) {
       auto& ids = it->second;
       if (isIDSExpired(ids, udpTimeout)) {
-        handleUDPTimeout(ids);
+        handleUDPTimeout(ids.internal);
         it = map->erase(it);
         continue;
       }
@@ -514,23 +553,10 @@ void DownstreamState::handleUDPTimeouts()
   }
   else {
     if (outstanding.load() > 0) {
-      for (IDState& ids : idStates) {
-        if (!ids.isInUse()) {
-          continue;
-        }
-        if (!isIDSExpired(ids, udpTimeout)) {
-          ++ids.age;
-          continue;
-        }
-        auto guard = ids.acquire();
-        if (!guard) {
-          continue;
-        }
-        /* check again, now that we have locked this state */
-        if (ids.isInUse() && isIDSExpired(ids, udpTimeout)) {
-          handleUDPTimeout(ids);
-        }
-      }
+      idStates.expire(udpTimeout, [this](IDStateTable::LockedSlot& slot) {
+        slot.markFree();
+        handleUDPTimeout(slot.getState());
+      });
     }
   }
 }
@@ -574,15 +600,15 @@ uint16_t DownstreamState::saveState(InternalQueryState&& state)
 
   do {
     uint16_t selectedID = (idOffset++) % idStates.size();
-    IDState& ids = idStates[selectedID];
-    auto guard = ids.acquire();
-    if (!guard) {
+    auto slot = idStates.tryAcquire(selectedID);
+    if (!slot) {
       continue;
     }
-    if (ids.isInUse()) {
+    auto& ids = slot->getState();
+    if (slot->isInUse()) {
       /* we are reusing a state, no change in outstanding but if there was an existing DOHUnit we need
          to handle it because it's about to be overwritten. */
-      auto oldDU = std::move(ids.internal.du);
+      auto oldDU = std::move(ids.du);
       ++reuseds;
       ++dnsdist::metrics::g_stats.downstreamTimeouts;
       DOHUnitInterface::handleTimeout(std::move(oldDU));
@@ -590,9 +616,8 @@ uint16_t DownstreamState::saveState(InternalQueryState&& state)
     else {
       ++outstanding;
     }
-    ids.internal = std::move(state);
-    ids.age.store(0);
-    ids.inUse = true;
+    ids = std::move(state);
+    slot->markInUse();
     return selectedID;
   }
   while (true);
@@ -618,24 +643,28 @@ void DownstreamState::restoreState(uint16_t id, InternalQueryState&& state)
     return;
   }
 
-  auto& ids = idStates[id];
-  auto guard = ids.acquire();
-  if (!guard) {
+  if (id >= idStates.size()) {
+    DOHUnitInterface::handleTimeout(std::move(state.du));
+    return;
+  }
+
+  auto slot = idStates.tryAcquire(id);
+  if (!slot) {
     /* already used */
     ++reuseds;
     ++dnsdist::metrics::g_stats.downstreamTimeouts;
     DOHUnitInterface::handleTimeout(std::move(state.du));
     return;
   }
-  if (ids.isInUse()) {
+  if (slot->isInUse()) {
     /* already used */
     ++reuseds;
     ++dnsdist::metrics::g_stats.downstreamTimeouts;
     DOHUnitInterface::handleTimeout(std::move(state.du));
     return;
   }
-  ids.internal = std::move(state);
-  ids.inUse = true;
+  slot->getState() = std::move(state);
+  slot->markInUse();
   ++outstanding;
 }
 
@@ -657,21 +686,20 @@ std::optional<InternalQueryState> DownstreamState::getState(uint16_t id)
     return result;
   }
 
-  if (id > idStates.size()) {
+  if (id >= idStates.size()) {
     return result;
   }
 
-  auto& ids = idStates[id];
-  auto guard = ids.acquire();
-  if (!guard) {
+  auto slot = idStates.tryAcquire(id);
+  if (!slot) {
     return result;
   }
 
-  if (ids.isInUse()) {
-    result = std::move(ids.internal);
+  if (slot->isInUse()) {
+    result = std::move(slot->getState());
     --outstanding;
   }
-  ids.inUse = false;
+  slot->markFree();
   return result;
 }
 
@@ -1056,6 +1084,13 @@ const ServerPolicy::NumberedServerVector& ServerPool::getServers() const
   return d_servers;
 }
 
+const dnsdist::lbpolicies::ConsistentHashRing& ServerPool::getHashRing() const
+{
+  return d_hashRing.get([this]() {
+    return std::make_shared<const dnsdist::lbpolicies::ConsistentHashRing>(d_servers);
+  });
+}
+
 void ServerPool::addServer(std::shared_ptr<DownstreamState>& server)
 {
   auto count = static_cast<unsigned int>(d_servers.size());
@@ -1069,6 +1104,7 @@ void ServerPool::addServer(std::shared_ptr<DownstreamState>& server)
   for (auto& serv : d_servers) {
     serv.first = idx++;
   }
+  d_hashRing.reset();
 
   updateConsistency();
 }
@@ -1093,8 +1129,11 @@ void ServerPool::removeServer(shared_ptr<DownstreamState>& server)
     }
   }
 
-  if (found && !d_isConsistent) {
-    updateConsistency();
+  if (found) {
+    d_hashRing.reset();
+    if (!d_isConsistent) {
+      updateConsistency();
+    }
   }
 }
 
@@ -25,6 +25,7 @@
 #include "dolog.hh"
 #include "dnsparser.hh"
 #include "dnsdist-cache.hh"
+#include "dnsdist-dnsparser.hh"
 #include "dnsdist-ecs.hh"
 #include "ednssubnet.hh"
 #include "packetcache.hh"
@@ -43,11 +44,37 @@ DNSDistPacketCache::DNSDistPacketCache(CacheSettings settings) :
 
   d_shards.resize(d_settings.d_shardCount);
 
-  /* we reserve maxEntries + 1 to avoid rehashing from occurring
-     when we get to maxEntries, as it means a load factor of 1 */
   for (auto& shard : d_shards) {
-    shard.setSize((d_settings.d_maxEntries / d_settings.d_shardCount) + 1);
+    shard.setSize(d_settings.d_maxEntries / d_settings.d_shardCount, d_settings.d_lockFreeLookups, d_settings.d_evictionPolicy);
   }
+
+  d_lastSnapshot = time(nullptr);
+}
+
+DNSDistPacketCache::~DNSDistPacketCache()
+{
+  if (d_settings.d_lockFreeLookups) {
+    /* entries that have been removed from the shards might still be waiting to be
+       reclaimed, and they need the allocators of the shards to be around */
+    dnsdist::rcu::synchronize();
+  }
+}
+
+bool DNSDistPacketCache::CacheValue::qnameMatches(std::string_view qnameWire) const
+{
+  if (qnameWire.size() != qnameLength) {
+    return false;
+  }
+  return dnsdist::QuestionParsing::namesEqualCI(getQNameWire(), qnameWire);
+}
+
+DNSName DNSDistPacketCache::CacheValue::getQName() const
+{
+  if (qnameLength == 0) {
+    return {};
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return {reinterpret_cast<const char*>(data.data()), qnameLength, 0, false};
 }
 
 bool DNSDistPacketCache::getClientSubnet(const PacketBuffer& packet, size_t qnameWireLength, std::optional<Netmask>& subnet)
@@ -78,9 +105,9 @@ bool DNSDistPacketCache::getClientSubnet(const PacketBuffer& packet, size_t qnam
   return false;
 }
 
-bool DNSDistPacketCache::cachedValueMatches(const CacheValue& cachedValue, uint16_t queryFlags, const DNSName& qname, uint16_t qtype, uint16_t qclass, bool receivedOverUDP, bool dnssecOK, const std::optional<Netmask>& subnet) const
+bool DNSDistPacketCache::cachedValueMatches(const CacheValue& cachedValue, uint16_t queryFlags, std::string_view qnameWire, uint16_t qtype, uint16_t qclass, bool receivedOverUDP, bool dnssecOK, const std::optional<Netmask>& subnet) const
 {
-  if (cachedValue.queryFlags != queryFlags || cachedValue.dnssecOK != dnssecOK || cachedValue.receivedOverUDP != receivedOverUDP || cachedValue.qtype != qtype || cachedValue.qclass != qclass || cachedValue.qname != qname) {
+  if (cachedValue.queryFlags != queryFlags || cachedValue.dnssecOK != dnssecOK || cachedValue.receivedOverUDP != receivedOverUDP || cachedValue.qtype != qtype || cachedValue.qclass != qclass || !cachedValue.qnameMatches(qnameWire)) {
     return false;
   }
 
@@ -91,38 +118,198 @@ bool DNSDistPacketCache::cachedValueMatches(const CacheValue& cachedValue, uint1
   return true;
 }
 
-bool DNSDistPacketCache::insertLocked(std::unordered_map<uint32_t, CacheValue>& map, uint32_t key, CacheValue& newValue)
+bool DNSDistPacketCache::insertLocked(CacheShard& shard, std::unordered_map<uint32_t, CacheValue>& map, uint32_t key, CacheValue&& newValue)
 {
+  auto* queue = shard.d_evictionQueue.get();
   /* check again now that we hold the lock to prevent a race */
-  if (map.size() >= (d_settings.d_maxEntries / d_settings.d_shardCount)) {
+  const bool full = map.size() >= (d_settings.d_maxEntries / d_settings.d_shardCount);
+  if (full && queue == nullptr) {
     return false;
   }
 
-  std::unordered_map<uint32_t, CacheValue>::iterator mapIt;
-  bool result{false};
-  std::tie(mapIt, result) = map.insert({key, newValue});
+  auto mapIt = map.find(key);
+  if (mapIt != map.end()) {
+    CacheValue& value = mapIt->second;
+    if (shouldReplaceEntry(value, newValue)) {
+      newValue.evictionSlot = value.evictionSlot;
+      value = std::move(newValue);
+    }
+    return false;
+  }
 
-  if (result) {
-    return true;
+  if (queue != nullptr) {
+    if (full) {
+      map.erase(evictEntry(shard));
+    }
+    newValue.evictionSlot = queue->insert(key);
   }
 
+  map.emplace(key, std::move(newValue));
+  return true;
+}
+
+uint32_t DNSDistPacketCache::evictEntry(CacheShard& shard)
+{
+  auto& queue = *shard.d_evictionQueue;
+  const auto victim = queue.selectVictim();
+  const auto victimKey = queue.getKey(victim);
+  queue.remove(victim);
+  --shard.d_entriesCount;
+  ++d_evictions;
+  return victimKey;
+}
+
+bool DNSDistPacketCache::shouldReplaceEntry(const CacheValue& existing, const CacheValue& newValue)
+{
   /* in case of collision, don't override the existing entry
      except if it has expired */
-  CacheValue& value = mapIt->second;
-  bool wasExpired = value.validity <= newValue.added;
+  bool wasExpired = existing.validity <= newValue.added;
 
-  if (!wasExpired && !cachedValueMatches(value, newValue.queryFlags, newValue.qname, newValue.qtype, newValue.qclass, newValue.receivedOverUDP, newValue.dnssecOK, newValue.subnet)) {
+  if (!wasExpired && !cachedValueMatches(existing, newValue.queryFlags, newValue.getQNameWire(), newValue.qtype, newValue.qclass, newValue.receivedOverUDP, newValue.dnssecOK, newValue.subnet)) {
     ++d_insertCollisions;
     return false;
   }
 
   /* if the existing entry had a longer TTD, keep it */
-  if (newValue.validity <= value.validity) {
-    return false;
+  return newValue.validity > existing.validity;
+}
+
+bool DNSDistPacketCache::insertLockFree(CacheShard& shard, uint32_t key, CacheValue&& newValue, bool mayDefer)
+{
+  std::unique_lock<std::mutex> lock(shard.d_lockFreeWriteLock, std::defer_lock);
+  if (mayDefer) {
+    if (!lock.try_lock()) {
+      ++d_deferredInserts;
+      return false;
+    }
+  }
+  else {
+    lock.lock();
   }
 
-  value = newValue;
-  return false;
+  auto& map = *shard.d_lockFreeMap;
+  auto* queue = shard.d_evictionQueue.get();
+  bool newSlot = false;
+  if (queue != nullptr) {
+    if (const auto* existing = map.find(key); existing != nullptr) {
+      newValue.evictionSlot = existing->evictionSlot;
+    }
+    else {
+      if (queue->full()) {
+        map.remove(evictEntry(shard));
+      }
+      newValue.evictionSlot = queue->insert(key);
+      newSlot = true;
+    }
+  }
+
+  /* newValue is only moved from if it actually gets inserted */
+  const auto slot = newValue.evictionSlot;
+  auto result = map.insert(key, std::move(newValue), [this, &newValue](const CacheValue& existing) {
+    return shouldReplaceEntry(existing, newValue);
+  });
+
+  if (newSlot && result != dnsdist::rcu::HashTable<CacheValue>::InsertResult::Inserted) {
+    queue->remove(slot);
+  }
+  return result == dnsdist::rcu::HashTable<CacheValue>::InsertResult::Inserted;
+}
+
+bool DNSDistPacketCache::insertIntoShard(CacheShard& shard, uint32_t key, CacheValue&& newValue, bool mayDefer)
+{
+  bool inserted = false;
+  if (shard.d_lockFreeMap) {
+    inserted = insertLockFree(shard, key, std::move(newValue), mayDefer);
+  }
+  else if (mayDefer) {
+    auto lock = shard.d_map.try_write_lock();
+
+    if (!lock.owns_lock()) {
+      ++d_deferredInserts;
+      return false;
+    }
+    inserted = insertLocked(shard, *lock, key, std::move(newValue));
+  }
+  else {
+    auto lock = shard.d_map.write_lock();
+
+    inserted = insertLocked(shard, *lock, key, std::move(newValue));
+  }
+  if (inserted) {
+    ++shard.d_entriesCount;
+  }
+  return inserted;
+}
+
+template <typename Visitor>
+void DNSDistPacketCache::visitShard(CacheShard& shard, Visitor&& visitor)
+{
+  if (shard.d_lockFreeMap) {
+    dnsdist::rcu::ReadGuard guard;
+    shard.d_lockFreeMap->visit([&visitor](uint32_t key, const CacheValue& value) {
+      visitor(key, value);
+      return true;
+    });
+    return;
+  }
+
+  auto map = shard.d_map.read_lock();
+  for (const auto& entry : *map) {
+    visitor(entry.first, entry.second);
+  }
+}
+
+/* Remove entries matching the predicate, until the shard
+   has at most maxRemaining entries in it. */
+template <typename Predicate>
+size_t DNSDistPacketCache::removeFromShard(CacheShard& shard, size_t maxRemaining, Predicate&& predicate)
+{
+  size_t removed = 0;
+
+  if (shard.d_lockFreeMap) {
+    std::lock_guard<std::mutex> lock(shard.d_lockFreeWriteLock);
+    auto& map = *shard.d_lockFreeMap;
+    if (map.size() <= maxRemaining) {
+      return 0;
+    }
+
+    auto* queue = shard.d_evictionQueue.get();
+    auto shouldRemove = [&predicate, queue](uint32_t /* key */, const CacheValue& value) {
+      if (!predicate(value)) {
+        return false;
+      }
+      if (queue != nullptr) {
+        queue->remove(value.evictionSlot);
+      }
+      return true;
+    };
+    removed = map.removeIf(shouldRemove, map.size() - maxRemaining);
+  }
+  else {
+    auto map = shard.d_map.write_lock();
+    if (map->size() <= maxRemaining) {
+      return 0;
+    }
+
+    size_t toRemove = map->size() - maxRemaining;
+    auto* queue = shard.d_evictionQueue.get();
+    for (auto it = map->begin(); toRemove > 0 && it != map->end();) {
+      if (predicate(it->second)) {
+        if (queue != nullptr) {
+          queue->remove(it->second.evictionSlot);
+        }
+        it = map->erase(it);
+        --toRemove;
+        ++removed;
+      }
+      else {
+        ++it;
+      }
+    }
+  }
+
+  shard.d_entriesCount -= removed;
+  return removed;
 }
 
 void DNSDistPacketCache::insert(uint32_t key, const std::optional<Netmask>& subnet, uint16_t queryFlags, bool dnssecOK, const DNSName& qname, uint16_t qtype, uint16_t qclass, const PacketBuffer& response, bool receivedOverUDP, uint8_t rcode, std::optional<uint32_t> tempFailureTTL)
@@ -176,15 +363,21 @@ void DNSDistPacketCache::insert(uint32_t key, const std::optional<Netmask>& subn
   }
 
   uint32_t shardIndex = getShardIndex(key);
+  auto& shard = d_shards.at(shardIndex);
 
-  if (d_shards.at(shardIndex).d_entriesCount >= (d_settings.d_maxEntries / d_settings.d_shardCount)) {
+  /* without an eviction policy, there is no point in going further if the shard is full */
+  if (!shard.d_evictionQueue && shard.d_entriesCount >= (d_settings.d_maxEntries / d_settings.d_shardCount)) {
     return;
   }
 
+  const auto& qnameStorage = qname.getStorage();
   const time_t now = time(nullptr);
   time_t newValidity = now + minTTL;
   CacheValue newValue;
-  newValue.qname = qname;
+  newValue.data = shard.d_allocator.allocate(qnameStorage.size() + response.size());
+  memcpy(newValue.data.data(), qnameStorage.data(), qnameStorage.size());
+  memcpy(newValue.data.data() + qnameStorage.size(), response.data(), response.size());
+  newValue.qnameLength = qnameStorage.size();
   newValue.qtype = qtype;
   newValue.qclass = qclass;
   newValue.queryFlags = queryFlags;
@@ -193,29 +386,48 @@ void DNSDistPacketCache::insert(uint32_t key, const std::optional<Netmask>& subn
   newValue.added = now;
   newValue.receivedOverUDP = receivedOverUDP;
   newValue.dnssecOK = dnssecOK;
-  newValue.value = std::string(response.begin(), response.end());
   newValue.subnet = subnet;
 
-  auto& shard = d_shards.at(shardIndex);
+  insertIntoShard(shard, key, std::move(newValue), d_settings.d_deferrableInsertLock);
 
-  bool inserted = false;
-  if (d_settings.d_deferrableInsertLock) {
-    auto lock = shard.d_map.try_write_lock();
+  if (d_settings.d_prefetchPercentage > 0) {
+    /* if this was a prefetch the entry has now been refreshed, and if the insertion
+       was deferred the next query close to the expiration will try again */
+    shard.d_prefetching.lock()->erase(key);
+  }
+}
 
-    if (!lock.owns_lock()) {
-      ++d_deferredInserts;
-      return;
-    }
-    inserted = insertLocked(*lock, key, newValue);
+std::vector<uint32_t> DNSDistPacketCache::releaseInFlightQuery(uint32_t key)
+{
+  std::vector<uint32_t> followers;
+  auto& shard = d_shards.at(getShardIndex(key));
+  auto inFlight = shard.d_inFlight.lock();
+  auto entry = inFlight->find(key);
+  if (entry != inFlight->end()) {
+    followers = std::move(entry->second.d_followers);
+    inFlight->erase(entry);
   }
-  else {
-    auto lock = shard.d_map.write_lock();
+  return followers;
+}
 
-    inserted = insertLocked(*lock, key, newValue);
+bool DNSDistPacketCache::shouldPrefetch(CacheShard& shard, uint32_t key, const CacheValue& value, time_t now)
+{
+  const auto ttl = value.validity - value.added;
+  if (ttl <= 0 || (value.validity - now) * 100 > ttl * static_cast<time_t>(d_settings.d_prefetchPercentage)) {
+    return false;
   }
-  if (inserted) {
-    ++shard.d_entriesCount;
+
+  auto prefetching = shard.d_prefetching.lock();
+  auto [entry, inserted] = prefetching->emplace(key, value.validity);
+  if (!inserted) {
+    if (entry->second > now) {
+      /* already being refreshed */
+      return false;
+    }
+    entry->second = value.validity;
   }
+  ++d_prefetches;
+  return true;
 }
 
 bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_t* keyOut, std::optional<Netmask>& subnet, bool dnssecOK, bool receivedOverUDP, uint32_t allowExpired, bool skipAging, bool truncatedOK, bool recordMiss)
@@ -240,24 +452,12 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
   time_t now = time(nullptr);
   time_t age{0};
   bool stale = false;
+  bool headerOnly = false;
   auto& response = dnsQuestion.getMutableData();
   auto& shard = d_shards.at(shardIndex);
-  {
-    auto map = shard.d_map.try_read_lock();
-    if (!map.owns_lock()) {
-      ++d_deferredLookups;
-      return false;
-    }
-
-    auto mapIt = map->find(key);
-    if (mapIt == map->end()) {
-      if (recordMiss) {
-        ++d_misses;
-      }
-      return false;
-    }
 
-    const CacheValue& value = mapIt->second;
+  /* called with the value protected either by the shard lock or by a read-side critical section */
+  auto useValue = [&](const CacheValue& value) {
     if (value.validity <= now) {
       if ((now - value.validity) >= static_cast<time_t>(allowExpired)) {
         if (recordMiss) {
@@ -273,25 +473,35 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
     }
 
     /* check for collision */
-    if (!cachedValueMatches(value, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnsQuestion.ids.qname, dnsQuestion.ids.qtype, dnsQuestion.ids.qclass, receivedOverUDP, dnssecOK, subnet)) {
+    if (!cachedValueMatches(value, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), std::string_view(dnsQName.data(), dnsQName.size()), dnsQuestion.ids.qtype, dnsQuestion.ids.qclass, receivedOverUDP, dnssecOK, subnet)) {
       ++d_lookupCollisions;
       return false;
     }
 
     if (!truncatedOK) {
-      dnsheader_aligned dh_aligned(value.value.data());
+      dnsheader_aligned dh_aligned(value.getResponse());
       if (dh_aligned->tc != 0) {
         return false;
       }
     }
 
+    /* we cannot prefetch when we are only allowed to serve expired entries,
+       as that means that no backend is available */
+    if (!stale && allowExpired == 0 && d_settings.d_prefetchPercentage > 0 && shouldPrefetch(shard, key, value, now)) {
+      return false;
+    }
+
+    if (shard.d_evictionQueue) {
+      shard.d_evictionQueue->markVisited(value.evictionSlot);
+    }
+
     response.resize(value.len);
     memcpy(&response.at(0), &queryId, sizeof(queryId));
-    memcpy(&response.at(sizeof(queryId)), &value.value.at(sizeof(queryId)), sizeof(dnsheader) - sizeof(queryId));
+    memcpy(&response.at(sizeof(queryId)), value.getResponse() + sizeof(queryId), sizeof(dnsheader) - sizeof(queryId));
 
     if (value.len == sizeof(dnsheader)) {
       /* DNS header only, our work here is done */
-      ++d_hits;
+      headerOnly = true;
       return true;
     }
 
@@ -302,7 +512,7 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
 
     memcpy(&response.at(sizeof(dnsheader)), dnsQName.c_str(), dnsQNameLen);
     if (value.len > (sizeof(dnsheader) + dnsQNameLen)) {
-      memcpy(&response.at(sizeof(dnsheader) + dnsQNameLen), &value.value.at(sizeof(dnsheader) + dnsQNameLen), value.len - (sizeof(dnsheader) + dnsQNameLen));
+      memcpy(&response.at(sizeof(dnsheader) + dnsQNameLen), value.getResponse() + sizeof(dnsheader) + dnsQNameLen, value.len - (sizeof(dnsheader) + dnsQNameLen));
     }
 
     if (!stale) {
@@ -312,6 +522,46 @@ bool DNSDistPacketCache::get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_
       age = (value.validity - value.added) - d_settings.d_staleTTL;
       dnsQuestion.ids.staleCacheHit = true;
     }
+    return true;
+  };
+
+  if (shard.d_lockFreeMap) {
+    dnsdist::rcu::ReadGuard guard;
+    const auto* value = shard.d_lockFreeMap->find(key);
+    if (value == nullptr) {
+      if (recordMiss) {
+        ++d_misses;
+      }
+      return false;
+    }
+
+    if (!useValue(*value)) {
+      return false;
+    }
+  }
+  else {
+    auto map = shard.d_map.try_read_lock();
+    if (!map.owns_lock()) {
+      ++d_deferredLookups;
+      return false;
+    }
+
+    auto mapIt = map->find(key);
+    if (mapIt == map->end()) {
+      if (recordMiss) {
+        ++d_misses;
+      }
+      return false;
+    }
+
+    if (!useValue(mapIt->second)) {
+      return false;
+    }
+  }
+
+  if (headerOnly) {
+    ++d_hits;
+    return true;
   }
 
   if (!d_settings.d_dontAge && !skipAging) {
@@ -351,28 +601,38 @@ size_t DNSDistPacketCache::purgeExpired(size_t upTo, const time_t now)
 
   ++d_cleanupCount;
   for (auto& shard : d_shards) {
-    auto map = shard.d_map.write_lock();
-    if (map->size() <= maxPerShard) {
-      continue;
-    }
-
-    size_t toRemove = map->size() - maxPerShard;
-
-    for (auto it = map->begin(); toRemove > 0 && it != map->end();) {
-      const CacheValue& value = it->second;
-
-      if (value.validity <= now) {
-        it = map->erase(it);
-        --toRemove;
-        --shard.d_entriesCount;
-        ++removed;
+    removed += removeFromShard(shard, maxPerShard, [now](const CacheValue& value) {
+      return value.validity <= now;
+    });
+    if (d_settings.d_prefetchPercentage > 0) {
+      /* forget about the refreshes that did not complete before the entry expired */
+      auto prefetching = shard.d_prefetching.lock();
+      for (auto entry = prefetching->begin(); entry != prefetching->end();) {
+        if (entry->second <= now) {
+          entry = prefetching->erase(entry);
+        }
+        else {
+          ++entry;
+        }
       }
-      else {
-        ++it;
+    }
+    if (d_settings.d_coalescingTimeout > 0) {
+      /* forget about the leaders whose response never came, their followers are resumed when they time out */
+      auto inFlight = shard.d_inFlight.lock();
+      for (auto entry = inFlight->begin(); entry != inFlight->end();) {
+        if (entry->second.d_ttd <= now) {
+          entry = inFlight->erase(entry);
+        }
+        else {
+          ++entry;
+        }
       }
     }
   }
 
+  /* this is a good time to release the memory used by removed entries */
+  dnsdist::rcu::reclaim();
+
   return removed;
 }
 
@@ -388,28 +648,9 @@ size_t DNSDistPacketCache::expunge(size_t upTo)
   size_t removed = 0;
 
   for (auto& shard : d_shards) {
-    auto map = shard.d_map.write_lock();
-
-    if (map->size() <= maxPerShard) {
-      continue;
-    }
-
-    size_t toRemove = map->size() - maxPerShard;
-
-    auto beginIt = map->begin();
-    auto endIt = beginIt;
-
-    if (map->size() >= toRemove) {
-      std::advance(endIt, toRemove);
-      map->erase(beginIt, endIt);
-      shard.d_entriesCount -= toRemove;
-      removed += toRemove;
-    }
-    else {
-      removed += map->size();
-      map->clear();
-      shard.d_entriesCount = 0;
-    }
+    removed += removeFromShard(shard, maxPerShard, [](const CacheValue& /* value */) {
+      return true;
+    });
   }
 
   return removed;
@@ -418,22 +659,15 @@ size_t DNSDistPacketCache::expunge(size_t upTo)
 size_t DNSDistPacketCache::expungeByName(const DNSName& name, uint16_t qtype, bool suffixMatch)
 {
   size_t removed = 0;
+  const std::string_view nameWire(name.getStorage().data(), name.getStorage().size());
 
   for (auto& shard : d_shards) {
-    auto map = shard.d_map.write_lock();
-
-    for (auto it = map->begin(); it != map->end();) {
-      const CacheValue& value = it->second;
-
-      if ((value.qname == name || (suffixMatch && value.qname.isPartOf(name))) && (qtype == QType::ANY || qtype == value.qtype)) {
-        it = map->erase(it);
-        --shard.d_entriesCount;
-        ++removed;
-      }
-      else {
-        ++it;
+    removed += removeFromShard(shard, 0, [&nameWire, &name, qtype, suffixMatch](const CacheValue& value) {
+      if (qtype != QType::ANY && qtype != value.qtype) {
+        return false;
       }
-    }
+      return value.qnameMatches(nameWire) || (suffixMatch && value.getQName().isPartOf(name));
+    });
   }
 
   return removed;
@@ -469,8 +703,15 @@ uint32_t DNSDistPacketCache::getKey(const DNSName::string_t& qname, size_t qname
   }
 
   result = burtle(&packet.at(2), sizeof(dnsheader) - 2, result);
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-  result = burtleCI(reinterpret_cast<const unsigned char*>(qname.c_str()), qname.length(), result);
+  /* hash the qname straight from the packet, right after the header, falling back to the
+     DNSName if the question could not be parsed. Both give the same result */
+  if (auto question = dnsdist::QuestionParsing::parse(packet, result); question && question->d_qnameWireLength == qnameWireLength) {
+    result = question->d_qnameHash;
+  }
+  else {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    result = dnsdist::QuestionParsing::hashNameCI(reinterpret_cast<const uint8_t*>(qname.c_str()), qname.length(), result);
+  }
   if (packet.size() < sizeof(dnsheader) + qnameWireLength) {
     throw std::range_error("Computing packet cache key for an invalid packet (" + std::to_string(packet.size()) + " < " + std::to_string(sizeof(dnsheader) + qnameWireLength) + ")");
   }
@@ -504,6 +745,24 @@ uint64_t DNSDistPacketCache::getEntriesCount()
   return getSize();
 }
 
+uint64_t DNSDistPacketCache::getMemoryAllocated() const
+{
+  uint64_t total = 0;
+  for (const auto& shard : d_shards) {
+    total += shard.d_allocator.getStats().d_allocatedBytes;
+  }
+  return total;
+}
+
+uint64_t DNSDistPacketCache::getMemoryUsed() const
+{
+  uint64_t total = 0;
+  for (const auto& shard : d_shards) {
+    total += shard.d_allocator.getStats().d_usedBytes;
+  }
+  return total;
+}
+
 uint64_t DNSDistPacketCache::dump(int fileDesc, bool rawResponse)
 {
   auto fileDescDuplicated = dup(fileDesc);
@@ -520,59 +779,310 @@ uint64_t DNSDistPacketCache::dump(int fileDesc, bool rawResponse)
   uint64_t count = 0;
   time_t now = time(nullptr);
   for (auto& shard : d_shards) {
-    auto map = shard.d_map.read_lock();
-
-    for (const auto& entry : *map) {
-      const CacheValue& value = entry.second;
+    visitShard(shard, [&](uint32_t key, const CacheValue& value) {
       count++;
 
       try {
         uint8_t rcode = 0;
         if (value.len >= sizeof(dnsheader)) {
           dnsheader dnsHeader{};
-          memcpy(&dnsHeader, value.value.data(), sizeof(dnsheader));
+          memcpy(&dnsHeader, value.getResponse(), sizeof(dnsheader));
           rcode = dnsHeader.rcode;
         }
 
-        fprintf(filePtr.get(), "%s %" PRId64 " %s %s ; ecs %s, rcode %" PRIu8 ", key %" PRIu32 ", length %" PRIu16 ", received over UDP %d, added %" PRId64 ", dnssecOK %d, raw query flags %" PRIu16, value.qname.toString().c_str(), static_cast<int64_t>(value.validity - now), QClass(value.qclass).toString().c_str(), QType(value.qtype).toString().c_str(), value.subnet ? value.subnet.value().toString().c_str() : "empty", rcode, entry.first, value.len, value.receivedOverUDP ? 1 : 0, static_cast<int64_t>(value.added), value.dnssecOK ? 1 : 0, value.queryFlags);
+        fprintf(filePtr.get(), "%s %" PRId64 " %s %s ; ecs %s, rcode %" PRIu8 ", key %" PRIu32 ", length %" PRIu16 ", received over UDP %d, added %" PRId64 ", dnssecOK %d, raw query flags %" PRIu16, value.getQName().toString().c_str(), static_cast<int64_t>(value.validity - now), QClass(value.qclass).toString().c_str(), QType(value.qtype).toString().c_str(), value.subnet ? value.subnet.value().toString().c_str() : "empty", rcode, key, value.len, value.receivedOverUDP ? 1 : 0, static_cast<int64_t>(value.added), value.dnssecOK ? 1 : 0, value.queryFlags);
 
         if (rawResponse) {
-          std::string rawDataResponse = Base64Encode(value.value);
+          std::string rawDataResponse = Base64Encode(std::string(value.getResponseView()));
           fprintf(filePtr.get(), ", base64response %s", rawDataResponse.c_str());
         }
         fprintf(filePtr.get(), "\n");
       }
       catch (...) {
-        fprintf(filePtr.get(), "; error printing '%s'\n", value.qname.empty() ? "EMPTY" : value.qname.toString().c_str());
+        fprintf(filePtr.get(), "; error printing '%s'\n", value.qnameLength == 0 ? "EMPTY" : value.getQName().toString().c_str());
       }
+    });
+  }
+
+  return count;
+}
+
+namespace
+{
+/* snapshot format, all integers in network byte order:
+   - header: magic (4 bytes), version (16 bits), settings fingerprint (32 bits)
+   - then for each entry: key (32 bits), added (64 bits), validity (64 bits), qtype, qclass,
+   query flags, response length and qname length (16 bits each), flags (8 bits),
+   the ECS subnet if any (family and prefix length, 8 bits each, then 4 or 16 bytes of address),
+   and finally the qname in wire format followed by the response */
+constexpr std::array<char, 4> s_snapshotMagic{'D', 'D', 'P', 'C'};
+constexpr uint16_t s_snapshotVersion{1};
+constexpr uint8_t s_snapshotFlagReceivedOverUDP{1 << 0};
+constexpr uint8_t s_snapshotFlagDNSSECOK{1 << 1};
+constexpr uint8_t s_snapshotFlagSubnet{1 << 2};
+
+template <typename T>
+void appendInteger(std::string& out, T value)
+{
+  const auto unsignedValue = static_cast<uint64_t>(value);
+  for (size_t idx = sizeof(T); idx > 0; idx--) {
+    out.push_back(static_cast<char>((unsignedValue >> ((idx - 1) * 8)) & 0xff));
+  }
+}
+
+class SnapshotReader
+{
+public:
+  SnapshotReader(FILE* filePtr) :
+    d_filePtr(filePtr)
+  {
+  }
+
+  /* returns false if the end of the file has been reached before reading anything */
+  bool tryRead(void* dest, size_t size)
+  {
+    auto got = fread(dest, 1, size, d_filePtr);
+    if (got == 0 && size > 0 && feof(d_filePtr) != 0) {
+      return false;
+    }
+    if (got != size) {
+      throw std::runtime_error("Truncated or unreadable packet cache snapshot");
+    }
+    return true;
+  }
+
+  void read(void* dest, size_t size)
+  {
+    if (!tryRead(dest, size)) {
+      throw std::runtime_error("Truncated packet cache snapshot");
+    }
+  }
+
+  template <typename T>
+  T readInteger()
+  {
+    std::array<uint8_t, sizeof(T)> raw{};
+    read(raw.data(), raw.size());
+    return decode<T>(raw);
+  }
+
+  template <typename T>
+  static T decode(const std::array<uint8_t, sizeof(T)>& raw)
+  {
+    uint64_t value = 0;
+    for (const auto byte : raw) {
+      value = (value << 8) | byte;
     }
+    return static_cast<T>(value);
+  }
+
+private:
+  FILE* d_filePtr;
+};
+}
+
+uint32_t DNSDistPacketCache::getSnapshotFingerprint() const
+{
+  std::vector<uint16_t> options(d_settings.d_optionsToSkip.begin(), d_settings.d_optionsToSkip.end());
+  std::sort(options.begin(), options.end());
+  std::string serialized;
+  for (const auto option : options) {
+    appendInteger(serialized, option);
+  }
+  /* separate the two lists so that options and ranks cannot be mistaken for one another */
+  appendInteger(serialized, static_cast<uint32_t>(options.size()));
+  for (const auto rank : d_settings.d_payloadRanks) {
+    appendInteger(serialized, rank);
+  }
+  appendInteger(serialized, static_cast<uint8_t>(d_settings.d_parseECS ? 1 : 0));
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return burtle(reinterpret_cast<const unsigned char*>(serialized.data()), serialized.size(), 0);
+}
+
+bool DNSDistPacketCache::isSnapshotDue(time_t now) const
+{
+  if (d_settings.d_snapshotFile.empty() || d_settings.d_snapshotInterval == 0) {
+    return false;
+  }
+  return now >= d_lastSnapshot.load() + static_cast<time_t>(d_settings.d_snapshotInterval);
+}
+
+uint64_t DNSDistPacketCache::saveSnapshot(const std::string& fileName)
+{
+  const std::string tempFileName = fileName + ".tmp";
+  auto filePtr = pdns::UniqueFilePtr(fopen(tempFileName.c_str(), "w"));
+  if (!filePtr) {
+    throw std::runtime_error("Unable to open '" + tempFileName + "' to save the content of the packet cache: " + stringerror());
   }
 
+  std::string buffer;
+  buffer.append(s_snapshotMagic.data(), s_snapshotMagic.size());
+  appendInteger(buffer, s_snapshotVersion);
+  appendInteger(buffer, getSnapshotFingerprint());
+
+  uint64_t count = 0;
+  bool failed = false;
+  auto flush = [&filePtr, &buffer, &failed]() {
+    if (!failed && !buffer.empty() && fwrite(buffer.data(), 1, buffer.size(), filePtr.get()) != buffer.size()) {
+      failed = true;
+    }
+    buffer.clear();
+  };
+
+  for (auto& shard : d_shards) {
+    /* serialize the shard in memory so that we do not block inserts while doing I/O */
+    visitShard(shard, [&buffer, &count](uint32_t key, const CacheValue& value) {
+      uint8_t flags = 0;
+      if (value.receivedOverUDP) {
+        flags |= s_snapshotFlagReceivedOverUDP;
+      }
+      if (value.dnssecOK) {
+        flags |= s_snapshotFlagDNSSECOK;
+      }
+      if (value.subnet) {
+        flags |= s_snapshotFlagSubnet;
+      }
+
+      appendInteger(buffer, key);
+      appendInteger(buffer, static_cast<int64_t>(value.added));
+      appendInteger(buffer, static_cast<int64_t>(value.validity));
+      appendInteger(buffer, value.qtype);
+      appendInteger(buffer, value.qclass);
+      appendInteger(buffer, value.queryFlags);
+      appendInteger(buffer, value.len);
+      appendInteger(buffer, value.qnameLength);
+      appendInteger(buffer, flags);
+      if (value.subnet) {
+        const auto& network = value.subnet->getNetwork();
+        appendInteger(buffer, static_cast<uint8_t>(network.isIPv4() ? 4 : 6));
+        appendInteger(buffer, value.subnet->getBits());
+        if (network.isIPv4()) {
+          // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+          buffer.append(reinterpret_cast<const char*>(&network.sin4.sin_addr.s_addr), sizeof(network.sin4.sin_addr.s_addr));
+        }
+        else {
+          // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+          buffer.append(reinterpret_cast<const char*>(&network.sin6.sin6_addr.s6_addr), sizeof(network.sin6.sin6_addr.s6_addr));
+        }
+      }
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      buffer.append(reinterpret_cast<const char*>(value.data.data()), value.qnameLength + value.len);
+      ++count;
+    });
+    flush();
+  }
+
+  if (failed || fflush(filePtr.get()) != 0 || fsync(fileno(filePtr.get())) != 0) {
+    auto error = stringerror();
+    filePtr.reset();
+    unlink(tempFileName.c_str());
+    throw std::runtime_error("Error while saving the content of the packet cache to '" + tempFileName + "': " + error);
+  }
+  filePtr.reset();
+
+  if (rename(tempFileName.c_str(), fileName.c_str()) != 0) {
+    auto error = stringerror();
+    unlink(tempFileName.c_str());
+    throw std::runtime_error("Unable to move the packet cache snapshot '" + tempFileName + "' to '" + fileName + "': " + error);
+  }
+
+  d_lastSnapshot = time(nullptr);
   return count;
 }
 
+uint64_t DNSDistPacketCache::loadSnapshot(const std::string& fileName)
+{
+  auto filePtr = pdns::UniqueFilePtr(fopen(fileName.c_str(), "r"));
+  if (!filePtr) {
+    throw std::runtime_error("Unable to open the packet cache snapshot '" + fileName + "': " + stringerror());
+  }
+
+  SnapshotReader reader(filePtr.get());
+  std::array<char, s_snapshotMagic.size()> magic{};
+  reader.read(magic.data(), magic.size());
+  if (magic != s_snapshotMagic) {
+    throw std::runtime_error("'" + fileName + "' is not a packet cache snapshot");
+  }
+  const auto version = reader.readInteger<uint16_t>();
+  if (version != s_snapshotVersion) {
+    throw std::runtime_error("Unsupported version " + std::to_string(version) + " for the packet cache snapshot '" + fileName + "'");
+  }
+  if (reader.readInteger<uint32_t>() != getSnapshotFingerprint()) {
+    throw std::runtime_error("The packet cache snapshot '" + fileName + "' has been created with different hashing settings (skipped options, payload ranks or ECS parsing)");
+  }
+
+  const time_t now = time(nullptr);
+  uint64_t inserted = 0;
+  std::vector<uint8_t> skipped;
+  std::array<uint8_t, sizeof(uint32_t)> rawKey{};
+  while (reader.tryRead(rawKey.data(), rawKey.size())) {
+    const auto key = SnapshotReader::decode<uint32_t>(rawKey);
+    CacheValue value;
+    value.added = static_cast<time_t>(reader.readInteger<int64_t>());
+    value.validity = static_cast<time_t>(reader.readInteger<int64_t>());
+    value.qtype = reader.readInteger<uint16_t>();
+    value.qclass = reader.readInteger<uint16_t>();
+    value.queryFlags = reader.readInteger<uint16_t>();
+    value.len = reader.readInteger<uint16_t>();
+    value.qnameLength = reader.readInteger<uint16_t>();
+    const auto flags = reader.readInteger<uint8_t>();
+    value.receivedOverUDP = (flags & s_snapshotFlagReceivedOverUDP) != 0;
+    value.dnssecOK = (flags & s_snapshotFlagDNSSECOK) != 0;
+    if ((flags & s_snapshotFlagSubnet) != 0) {
+      const auto family = reader.readInteger<uint8_t>();
+      const auto bits = reader.readInteger<uint8_t>();
+      ComboAddress network;
+      if (family == 4) {
+        network.sin4.sin_family = AF_INET;
+        reader.read(&network.sin4.sin_addr.s_addr, sizeof(network.sin4.sin_addr.s_addr));
+      }
+      else if (family == 6) {
+        network.sin6.sin6_family = AF_INET6;
+        reader.read(&network.sin6.sin6_addr.s6_addr, sizeof(network.sin6.sin6_addr.s6_addr));
+      }
+      else {
+        throw std::runtime_error("Invalid address family in the packet cache snapshot '" + fileName + "'");
+      }
+      value.subnet = Netmask(network, bits);
+    }
+
+    const size_t dataSize = static_cast<size_t>(value.qnameLength) + value.len;
+    /* the downtime is accounted for since the validity is an absolute time */
+    if (value.validity <= now || value.len < sizeof(dnsheader) || value.len > d_settings.d_maximumEntrySize || value.qnameLength > 255) {
+      skipped.resize(dataSize);
+      reader.read(skipped.data(), skipped.size());
+      continue;
+    }
+
+    auto& shard = d_shards.at(getShardIndex(key));
+    value.data = shard.d_allocator.allocate(dataSize);
+    reader.read(value.data.data(), dataSize);
+    if (insertIntoShard(shard, key, std::move(value), false)) {
+      ++inserted;
+    }
+  }
+
+  return inserted;
+}
+
 std::set<DNSName> DNSDistPacketCache::getDomainsContainingRecords(const ComboAddress& addr)
 {
   std::set<DNSName> domains;
 
   for (auto& shard : d_shards) {
-    auto map = shard.d_map.read_lock();
-
-    for (const auto& entry : *map) {
-      const CacheValue& value = entry.second;
-
+    visitShard(shard, [&](uint32_t /* key */, const CacheValue& value) {
       try {
         if (value.len < sizeof(dnsheader)) {
-          continue;
+          return;
         }
 
-        dnsheader_aligned dnsHeader(value.value.data());
+        dnsheader_aligned dnsHeader(value.getResponse());
         if (dnsHeader->rcode != RCode::NoError || (dnsHeader->ancount == 0 && dnsHeader->nscount == 0 && dnsHeader->arcount == 0)) {
-          continue;
+          return;
         }
 
         bool found = false;
-        bool valid = visitDNSPacket(value.value, [addr, &found](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
+        bool valid = visitDNSPacket(value.getResponseView(), [addr, &found](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
           if (qtype == QType::A && qclass == QClass::IN && addr.isIPv4() && rdatalength == 4 && rdata != nullptr) {
             ComboAddress parsed;
             parsed.sin4.sin_family = AF_INET;
@@ -596,13 +1106,13 @@ std::set<DNSName> DNSDistPacketCache::getDomainsContainingRecords(const ComboAdd
         });
 
         if (valid && found) {
-          domains.insert(value.qname);
+          domains.insert(value.getQName());
         }
       }
       catch (...) {
-        continue;
+        /* skip this entry */
       }
-    }
+    });
   }
 
   return domains;
@@ -611,28 +1121,25 @@ std::set<DNSName> DNSDistPacketCache::getDomainsContainingRecords(const ComboAdd
 std::set<ComboAddress> DNSDistPacketCache::getRecordsForDomain(const DNSName& domain)
 {
   std::set<ComboAddress> addresses;
+  const std::string_view domainWire(domain.getStorage().data(), domain.getStorage().size());
 
   for (auto& shard : d_shards) {
-    auto map = shard.d_map.read_lock();
-
-    for (const auto& entry : *map) {
-      const CacheValue& value = entry.second;
-
+    visitShard(shard, [&](uint32_t /* key */, const CacheValue& value) {
       try {
-        if (value.qname != domain) {
-          continue;
+        if (!value.qnameMatches(domainWire)) {
+          return;
         }
 
         if (value.len < sizeof(dnsheader)) {
-          continue;
+          return;
         }
 
-        dnsheader_aligned dnsHeader(value.value.data());
+        dnsheader_aligned dnsHeader(value.getResponse());
         if (dnsHeader->rcode != RCode::NoError || (dnsHeader->ancount == 0 && dnsHeader->nscount == 0 && dnsHeader->arcount == 0)) {
-          continue;
+          return;
         }
 
-        visitDNSPacket(value.value, [&addresses](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
+        visitDNSPacket(value.getResponseView(), [&addresses](uint8_t /* section */, uint16_t qclass, uint16_t qtype, uint32_t /* ttl */, uint16_t rdatalength, const char* rdata) {
           if (qtype == QType::A && qclass == QClass::IN && rdatalength == 4 && rdata != nullptr) {
             ComboAddress parsed;
             parsed.sin4.sin_family = AF_INET;
@@ -650,9 +1157,9 @@ std::set<ComboAddress> DNSDistPacketCache::getRecordsForDomain(const DNSName& do
         });
       }
       catch (...) {
-        continue;
+        /* skip this entry */
       }
-    }
+    });
   }
 
   return addresses;
@@ -24,6 +24,9 @@
 #include <atomic>
 #include <unordered_map>
 
+#include "dnsdist-eviction.hh"
+#include "dnsdist-rcu.hh"
+#include "dnsdist-slab.hh"
 #include "iputils.hh"
 #include "lock.hh"
 #include "noinitvector.hh"
@@ -47,15 +50,41 @@ public:
     uint32_t d_maxNegativeTTL{3600};
     uint32_t d_truncatedTTL{0};
     uint32_t d_staleTTL{60};
+    /* when non-zero, a hit on an entry whose remaining TTL is at most this percentage
+       of its original TTL is turned into a miss for that query only, so that it
+       refreshes the entry before it expires */
+    uint32_t d_prefetchPercentage{0};
+    /* when non-zero, a query missing the cache while an identical one has already been forwarded
+       waits for the response to that one, for at most this number of milliseconds, instead of
+       being forwarded as well */
+    uint32_t d_coalescingTimeout{0};
     uint32_t d_shardCount{1};
     bool d_dontAge{false};
     bool d_deferrableInsertLock{true};
     bool d_parseECS{false};
     bool d_keepStaleData{false};
     bool d_shuffle{false};
+    bool d_lockFreeLookups{false};
+    dnsdist::EvictionPolicy d_evictionPolicy{dnsdist::EvictionPolicy::None};
+    /* file the content of the cache is saved to, and restored from at startup */
+    std::string d_snapshotFile{};
+    /* how often, in seconds, the content of the cache should be saved, 0 meaning only on exit */
+    uint32_t d_snapshotInterval{0};
+  };
+
+  enum class CoalescingResult : uint8_t
+  {
+    Leader,
+    Follower,
+    NotCoalesced
   };
 
   DNSDistPacketCache(CacheSettings settings);
+  DNSDistPacketCache(const DNSDistPacketCache&) = delete;
+  DNSDistPacketCache(DNSDistPacketCache&&) = delete;
+  DNSDistPacketCache& operator=(const DNSDistPacketCache&) = delete;
+  DNSDistPacketCache& operator=(DNSDistPacketCache&&) = delete;
+  ~DNSDistPacketCache();
 
   void insert(uint32_t key, const std::optional<Netmask>& subnet, uint16_t queryFlags, bool dnssecOK, const DNSName& qname, uint16_t qtype, uint16_t qclass, const PacketBuffer& response, bool receivedOverUDP, uint8_t rcode, std::optional<uint32_t> tempFailureTTL);
   bool get(DNSQuestion& dnsQuestion, uint16_t queryId, uint32_t* keyOut, std::optional<Netmask>& subnet, bool dnssecOK, bool receivedOverUDP, uint32_t allowExpired = 0, bool skipAging = false, bool truncatedOK = true, bool recordMiss = true);
@@ -74,14 +103,43 @@ public:
   [[nodiscard]] uint64_t getMaxEntries() const { return d_settings.d_maxEntries; }
   [[nodiscard]] uint64_t getTTLTooShorts() const { return d_ttlTooShorts.load(); }
   [[nodiscard]] uint64_t getCleanupCount() const { return d_cleanupCount.load(); }
+  [[nodiscard]] uint64_t getEvictions() const { return d_evictions.load(); }
+  [[nodiscard]] uint64_t getPrefetches() const { return d_prefetches.load(); }
+  [[nodiscard]] uint64_t getCoalescedQueries() const { return d_coalescedQueries.load(); }
+  [[nodiscard]] uint32_t getCoalescingTimeout() const { return d_settings.d_coalescingTimeout; }
+  [[nodiscard]] dnsdist::EvictionPolicy getEvictionPolicy() const { return d_settings.d_evictionPolicy; }
   [[nodiscard]] uint64_t getEntriesCount();
+  /* memory obtained from the system to store the entries, and memory actually used by them */
+  [[nodiscard]] uint64_t getMemoryAllocated() const;
+  [[nodiscard]] uint64_t getMemoryUsed() const;
   uint64_t dump(int fileDesc, bool rawResponse = false);
+  /* write the entries of the cache to a binary snapshot file, replacing it atomically.
+     Returns the number of entries written */
+  uint64_t saveSnapshot(const std::string& fileName);
+  /* insert the entries of a snapshot file that have not expired yet.
+     Returns the number of entries inserted */
+  uint64_t loadSnapshot(const std::string& fileName);
+  [[nodiscard]] const std::string& getSnapshotFile() const
+  {
+    return d_settings.d_snapshotFile;
+  }
+  /* whether a snapshot file has been set and the snapshot interval has elapsed since the last one */
+  [[nodiscard]] bool isSnapshotDue(time_t now) const;
 
   /* get the list of domains (qnames) that contains the given address in an A or AAAA record */
   [[nodiscard]] std::set<DNSName> getDomainsContainingRecords(const ComboAddress& addr);
   /* get the list of IP addresses contained in A or AAAA for a given domains (qname) */
   [[nodiscard]] std::set<ComboAddress> getRecordsForDomain(const DNSName& domain);
 
+  /* in-flight query coalescing: if no query is in flight for that key the caller becomes the leader,
+     which is forwarded and has to call releaseInFlightQuery() once its response has been received.
+     Otherwise 'park(followerID)' is called with the lock of the shard held, so that the release cannot
+     miss it, and the caller becomes a follower if it returned true */
+  template <typename ParkFunction>
+  CoalescingResult joinInFlightQuery(uint32_t key, time_t now, uint32_t followerID, ParkFunction&& park);
+  /* returns the IDs of the followers waiting for the response to the leader for that key */
+  [[nodiscard]] std::vector<uint32_t> releaseInFlightQuery(uint32_t key);
+
   [[nodiscard]] bool isECSParsingEnabled() const { return d_settings.d_parseECS; }
 
   [[nodiscard]] bool keepStaleData() const
@@ -100,19 +158,47 @@ private:
   struct CacheValue
   {
     [[nodiscard]] time_t getTTD() const { return validity; }
-    std::string value;
-    DNSName qname;
+    [[nodiscard]] const uint8_t* getResponse() const
+    {
+      return data.data() + qnameLength;
+    }
+    [[nodiscard]] std::string_view getResponseView() const
+    {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      return {reinterpret_cast<const char*>(getResponse()), len};
+    }
+    [[nodiscard]] std::string_view getQNameWire() const
+    {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      return {reinterpret_cast<const char*>(data.data()), qnameLength};
+    }
+    /* case-insensitive */
+    [[nodiscard]] bool qnameMatches(std::string_view qnameWire) const;
+    [[nodiscard]] DNSName getQName() const;
+
+    /* the qname in wire format, immediately followed by the response */
+    dnsdist::SlabAllocator::Buffer data;
     std::optional<Netmask> subnet;
+    time_t added{0};
+    time_t validity{0};
     uint16_t qtype{0};
     uint16_t qclass{0};
     uint16_t queryFlags{0};
-    time_t added{0};
-    time_t validity{0};
     uint16_t len{0};
+    uint16_t qnameLength{0};
+    /* position in the eviction queue of the shard, if any */
+    uint32_t evictionSlot{dnsdist::EvictionQueue::s_invalidSlot};
     bool receivedOverUDP{false};
     bool dnssecOK{false};
   };
 
+  struct InFlightQuery
+  {
+    std::vector<uint32_t> d_followers;
+    /* after that point we no longer expect a response from the leader */
+    time_t d_ttd{0};
+  };
+
   class CacheShard
   {
   public:
@@ -133,18 +219,60 @@ private:
     }
     ~CacheShard() = default;
 
-    void setSize(size_t maxSize)
+    void setSize(size_t maxSize, bool lockFree, dnsdist::EvictionPolicy evictionPolicy)
     {
-      d_map.write_lock()->reserve(maxSize);
+      if (evictionPolicy != dnsdist::EvictionPolicy::None) {
+        d_evictionQueue = std::make_unique<dnsdist::EvictionQueue>(evictionPolicy, maxSize);
+      }
+      if (lockFree) {
+        d_lockFreeMap = std::make_unique<dnsdist::rcu::HashTable<CacheValue>>(maxSize);
+      }
+      else {
+        /* we reserve maxEntries + 1 to avoid rehashing from occurring
+           when we get to maxEntries, as it means a load factor of 1 */
+        d_map.write_lock()->reserve(maxSize + 1);
+      }
     }
 
+    /* backs the data of the entries of this shard, declared
+       before the maps so that it is destroyed after them */
+    dnsdist::SlabAllocator d_allocator;
     SharedLockGuarded<std::unordered_map<uint32_t, CacheValue>> d_map{};
+    /* only used when lock-free lookups are enabled, in which case d_map is not */
+    std::unique_ptr<dnsdist::rcu::HashTable<CacheValue>> d_lockFreeMap{nullptr};
+    /* serializes the writers of d_lockFreeMap */
+    std::mutex d_lockFreeWriteLock;
+    /* only present if an eviction policy has been set, protected by the same
+       lock as the writes to the map except for markVisited() */
+    std::unique_ptr<dnsdist::EvictionQueue> d_evictionQueue{nullptr};
+    /* keys of the entries being refreshed by a prefetch, and until when, so that
+       only one query is sent to the backend for a given entry */
+    LockGuarded<std::unordered_map<uint32_t, time_t>> d_prefetching{};
+    /* queries forwarded to a backend, and the ones waiting for their response,
+       only used when in-flight coalescing is enabled */
+    LockGuarded<std::unordered_map<uint32_t, InFlightQuery>> d_inFlight{};
     std::atomic<uint64_t> d_entriesCount{0};
   };
 
-  [[nodiscard]] bool cachedValueMatches(const CacheValue& cachedValue, uint16_t queryFlags, const DNSName& qname, uint16_t qtype, uint16_t qclass, bool receivedOverUDP, bool dnssecOK, const std::optional<Netmask>& subnet) const;
+  [[nodiscard]] bool cachedValueMatches(const CacheValue& cachedValue, uint16_t queryFlags, std::string_view qnameWire, uint16_t qtype, uint16_t qclass, bool receivedOverUDP, bool dnssecOK, const std::optional<Netmask>& subnet) const;
   [[nodiscard]] uint32_t getShardIndex(uint32_t key) const;
-  bool insertLocked(std::unordered_map<uint32_t, CacheValue>& map, uint32_t key, CacheValue& newValue);
+  /* whether this still valid entry should be refreshed by the current query,
+     which is the case for the first query close enough to the expiration */
+  [[nodiscard]] bool shouldPrefetch(CacheShard& shard, uint32_t key, const CacheValue& value, time_t now);
+  [[nodiscard]] bool shouldReplaceEntry(const CacheValue& existing, const CacheValue& newValue);
+  bool insertLocked(CacheShard& shard, std::unordered_map<uint32_t, CacheValue>& map, uint32_t key, CacheValue&& newValue);
+  bool insertLockFree(CacheShard& shard, uint32_t key, CacheValue&& newValue, bool mayDefer);
+  bool insertIntoShard(CacheShard& shard, uint32_t key, CacheValue&& newValue, bool mayDefer);
+  /* removes the entry selected by the eviction policy from the eviction queue,
+     returning its key so that the caller can remove it from the map */
+  uint32_t evictEntry(CacheShard& shard);
+  template <typename Visitor>
+  void visitShard(CacheShard& shard, Visitor&& visitor);
+  template <typename Predicate>
+  size_t removeFromShard(CacheShard& shard, size_t maxRemaining, Predicate&& predicate);
+  /* identifies the settings that have an influence on the key of an entry,
+     so that we do not load a snapshot made with different ones */
+  [[nodiscard]] uint32_t getSnapshotFingerprint() const;
 
   std::vector<CacheShard> d_shards{};
 
@@ -156,6 +284,31 @@ private:
   pdns::stat_t d_lookupCollisions{0};
   pdns::stat_t d_ttlTooShorts{0};
   pdns::stat_t d_cleanupCount{0};
+  pdns::stat_t d_evictions{0};
+  pdns::stat_t d_prefetches{0};
+  pdns::stat_t d_coalescedQueries{0};
+  std::atomic<time_t> d_lastSnapshot{0};
 
   CacheSettings d_settings;
 };
+
+template <typename ParkFunction>
+DNSDistPacketCache::CoalescingResult DNSDistPacketCache::joinInFlightQuery(uint32_t key, time_t now, uint32_t followerID, ParkFunction&& park)
+{
+  auto& shard = d_shards.at(getShardIndex(key));
+  auto inFlight = shard.d_inFlight.lock();
+  auto [entry, inserted] = inFlight->try_emplace(key);
+  if (inserted || entry->second.d_ttd <= now) {
+    /* the followers of an expired leader, if any, are resumed when they time out */
+    entry->second.d_followers.clear();
+    entry->second.d_ttd = now + static_cast<time_t>((d_settings.d_coalescingTimeout + 999) / 1000);
+    return CoalescingResult::Leader;
+  }
+
+  if (!park(followerID)) {
+    return CoalescingResult::NotCoalesced;
+  }
+  entry->second.d_followers.push_back(followerID);
+  ++d_coalescedQueries;
+  return CoalescingResult::Follower;
+}
@@ -104,6 +104,8 @@ static bool doOneCarbonExport(const Carbon::Endpoint& endpoint)
       str << base << "tcpmaxconcurrentconnections" << ' ' << state->tcpMaxConcurrentConnections.load() << " " << now << "\r\n";
       str << base << "tcpnewconnections" << ' ' << state->tcpNewConnections.load() << " " << now << "\r\n";
       str << base << "tcpreusedconnections" << ' ' << state->tcpReusedConnections.load() << " " << now << "\r\n";
+      str << base << "tcpsharedparkedconnections" << ' ' << state->tcpSharedParkedConnections.load() << " " << now << "\r\n";
+      str << base << "tcpsharedreusedconnections" << ' ' << state->tcpSharedReusedConnections.load() << " " << now << "\r\n";
       str << base << "tlsresumptions" << ' ' << state->tlsResumptions.load() << " " << now << "\r\n";
       str << base << "tcpavgqueriesperconnection" << ' ' << state->tcpAvgQueriesPerConnection.load() << " " << now << "\r\n";
       str << base << "tcpavgconnectionduration" << ' ' << state->tcpAvgConnectionDuration.load() << " " << now << "\r\n";
@@ -221,6 +223,16 @@ static bool doOneCarbonExport(const Carbon::Endpoint& endpoint)
             << " " << cache->getTTLTooShorts() << " " << now << "\r\n";
         str << base << "cache-cleanup-count"
             << " " << cache->getCleanupCount() << " " << now << "\r\n";
+        str << base << "cache-memory-allocated"
+            << " " << cache->getMemoryAllocated() << " " << now << "\r\n";
+        str << base << "cache-memory-used"
+            << " " << cache->getMemoryUsed() << " " << now << "\r\n";
+        str << base << "cache-evictions"
+            << " " << cache->getEvictions() << " " << now << "\r\n";
+        str << base << "cache-prefetches"
+            << " " << cache->getPrefetches() << " " << now << "\r\n";
+        str << base << "cache-coalesced-queries"
+            << " " << cache->getCoalescedQueries() << " " << now << "\r\n";
       }
     }
 
@@ -827,6 +827,7 @@ static void loadBinds(const ::rust::Vec<dnsdist::rust::settings::BindConfigurati
         if (protocol == "do53" || protocol == "dnscrypt") {
           /* also create the UDP listener */
           state = std::make_shared<ClientState>(ComboAddress(std::string(bind.listen_address), defaultPort), false, bind.reuseport, bind.tcp.fast_open_queue_size, std::string(bind.interface), cpus, bind.enable_proxy_protocol);
+          state->d_udpSegmentation = bind.udp_segmentation;
 #if defined(HAVE_DNSCRYPT)
           state->dnscryptCtx = std::move(dnsCryptContext);
 #endif /* defined(HAVE_DNSCRYPT) */
@@ -1019,12 +1020,17 @@ static void handlePacketCacheConfiguration(const ::rust::Vec<dnsdist::rust::sett
       .d_tempFailureTTL = cache.temporary_failure_ttl,
       .d_maxNegativeTTL = cache.max_negative_ttl,
       .d_staleTTL = cache.stale_ttl,
+      .d_prefetchPercentage = cache.prefetch_percentage,
+      .d_coalescingTimeout = cache.coalescing_timeout,
       .d_shardCount = cache.shards,
       .d_dontAge = cache.dont_age,
       .d_deferrableInsertLock = cache.deferrable_insert_lock,
       .d_parseECS = cache.parse_ecs,
       .d_keepStaleData = cache.keep_stale_data,
       .d_shuffle = cache.shuffle,
+      .d_lockFreeLookups = cache.lock_free_lookups,
+      .d_snapshotFile = std::string(cache.snapshot_file),
+      .d_snapshotInterval = cache.snapshot_interval,
     };
     std::unordered_set<uint16_t> ranks;
     if (!cache.options_to_skip.empty()) {
@@ -1040,6 +1046,12 @@ static void handlePacketCacheConfiguration(const ::rust::Vec<dnsdist::rust::sett
     if (cache.maximum_entry_size >= sizeof(dnsheader)) {
       settings.d_maximumEntrySize = cache.maximum_entry_size;
     }
+    if (auto policy = dnsdist::getEvictionPolicyFromString(std::string(cache.eviction_policy))) {
+      settings.d_evictionPolicy = *policy;
+    }
+    else {
+      throw std::runtime_error("Unsupported eviction policy '" + std::string(cache.eviction_policy) + "' for packet cache '" + std::string(cache.name) + "'");
+    }
     for (const auto& rank : cache.payload_ranks) {
       if (rank < 512 || rank > settings.d_maximumEntrySize) {
         continue;
@@ -1593,9 +1605,8 @@ std::shared_ptr<DNSSelector> getNetmaskGroupSelector(const NetmaskGroupSelectorC
   return newDNSSelector(std::move(selector), config.name);
 }
 
-std::shared_ptr<DNSActionWrapper> getKeyValueStoreLookupAction([[maybe_unused]] const KeyValueStoreLookupActionConfiguration& config)
+std::shared_ptr<DNSActionWrapper> getKeyValueStoreLookupAction(const KeyValueStoreLookupActionConfiguration& config)
 {
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
   auto kvs = dnsdist::configuration::yaml::getRegisteredTypeByName<KeyValueStore>(std::string(config.kvs_name));
   if (!kvs && !(dnsdist::configuration::yaml::s_inClientMode || dnsdist::configuration::yaml::s_inConfigCheckMode)) {
     throw std::runtime_error("Unable to find the key-value store named '" + std::string(config.kvs_name) + "'");
@@ -1606,14 +1617,10 @@ std::shared_ptr<DNSActionWrapper> getKeyValueStoreLookupAction([[maybe_unused]]
   }
   auto action = dnsdist::actions::getKeyValueStoreLookupAction(kvs, lookupKey, std::string(config.destination_tag));
   return newDNSActionWrapper(std::move(action), config.name);
-#else
-  throw std::runtime_error("Unable to create KVS action: neither CDB nor LMDB support are enabled");
-#endif
 }
 
-std::shared_ptr<DNSActionWrapper> getKeyValueStoreRangeLookupAction([[maybe_unused]] const KeyValueStoreRangeLookupActionConfiguration& config)
+std::shared_ptr<DNSActionWrapper> getKeyValueStoreRangeLookupAction(const KeyValueStoreRangeLookupActionConfiguration& config)
 {
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
   auto kvs = dnsdist::configuration::yaml::getRegisteredTypeByName<KeyValueStore>(std::string(config.kvs_name));
   if (!kvs && !(dnsdist::configuration::yaml::s_inClientMode || dnsdist::configuration::yaml::s_inConfigCheckMode)) {
     throw std::runtime_error("Unable to find the key-value store named '" + std::string(config.kvs_name) + "'");
@@ -1624,14 +1631,10 @@ std::shared_ptr<DNSActionWrapper> getKeyValueStoreRangeLookupAction([[maybe_unus
   }
   auto action = dnsdist::actions::getKeyValueStoreRangeLookupAction(kvs, lookupKey, std::string(config.destination_tag));
   return newDNSActionWrapper(std::move(action), config.name);
-#else
-  throw std::runtime_error("Unable to create KVS action: neither CDB nor LMDB support are enabled");
-#endif
 }
 
-std::shared_ptr<DNSSelector> getKeyValueStoreLookupSelector([[maybe_unused]] const KeyValueStoreLookupSelectorConfiguration& config)
+std::shared_ptr<DNSSelector> getKeyValueStoreLookupSelector(const KeyValueStoreLookupSelectorConfiguration& config)
 {
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
   auto kvs = dnsdist::configuration::yaml::getRegisteredTypeByName<KeyValueStore>(std::string(config.kvs_name));
   if (!kvs && !(dnsdist::configuration::yaml::s_inClientMode || dnsdist::configuration::yaml::s_inConfigCheckMode)) {
     throw std::runtime_error("Unable to find the key-value store named '" + std::string(config.kvs_name) + "'");
@@ -1642,14 +1645,10 @@ std::shared_ptr<DNSSelector> getKeyValueStoreLookupSelector([[maybe_unused]] con
   }
   auto selector = dnsdist::selectors::getKeyValueStoreLookupSelector(kvs, lookupKey);
   return newDNSSelector(std::move(selector), config.name);
-#else
-  throw std::runtime_error("Unable to create KVS action: neither CDB nor LMDB support are enabled");
-#endif
 }
 
-std::shared_ptr<DNSSelector> getKeyValueStoreRangeLookupSelector([[maybe_unused]] const KeyValueStoreRangeLookupSelectorConfiguration& config)
+std::shared_ptr<DNSSelector> getKeyValueStoreRangeLookupSelector(const KeyValueStoreRangeLookupSelectorConfiguration& config)
 {
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
   auto kvs = dnsdist::configuration::yaml::getRegisteredTypeByName<KeyValueStore>(std::string(config.kvs_name));
   if (!kvs && !(dnsdist::configuration::yaml::s_inClientMode || dnsdist::configuration::yaml::s_inConfigCheckMode)) {
     throw std::runtime_error("Unable to find the key-value store named '" + std::string(config.kvs_name) + "'");
@@ -1660,9 +1659,6 @@ std::shared_ptr<DNSSelector> getKeyValueStoreRangeLookupSelector([[maybe_unused]
   }
   auto selector = dnsdist::selectors::getKeyValueStoreRangeLookupSelector(kvs, lookupKey);
   return newDNSSelector(std::move(selector), config.name);
-#else
-  throw std::runtime_error("Unable to create KVS action: neither CDB nor LMDB support are enabled");
-#endif
 }
 
 std::shared_ptr<DNSSelector> getTimedIPSetSelector(const TimedIPSetSelectorConfiguration& config)
@@ -1821,16 +1817,17 @@ void registerProtobufLogger(const ProtobufLoggerConfiguration& config)
     return;
   }
   std::shared_ptr<RemoteLoggerInterface> object;
+  const size_t perThreadQueueSize = config.per_thread_queues ? config.max_queued_entries : 0;
   if (config.connection_count > 1) {
     std::vector<std::shared_ptr<RemoteLoggerInterface>> loggers;
     loggers.reserve(config.connection_count);
     for (uint64_t i = 0; i < config.connection_count; i++) {
-      loggers.push_back(std::make_shared<RemoteLogger>(ComboAddress(std::string(config.address)), config.timeout, config.max_queued_entries * 100, config.reconnect_wait_time, dnsdist::configuration::yaml::s_inClientMode));
+      loggers.push_back(std::make_shared<RemoteLogger>(ComboAddress(std::string(config.address)), config.timeout, config.max_queued_entries * 100, config.reconnect_wait_time, dnsdist::configuration::yaml::s_inClientMode, perThreadQueueSize));
     }
     object = std::shared_ptr<RemoteLoggerInterface>(std::make_shared<RemoteLoggerPool>(std::move(loggers)));
   }
   else {
-    object = std::shared_ptr<RemoteLoggerInterface>(std::make_shared<RemoteLogger>(ComboAddress(std::string(config.address)), config.timeout, config.max_queued_entries * 100, config.reconnect_wait_time, dnsdist::configuration::yaml::s_inClientMode));
+    object = std::shared_ptr<RemoteLoggerInterface>(std::make_shared<RemoteLogger>(ComboAddress(std::string(config.address)), config.timeout, config.max_queued_entries * 100, config.reconnect_wait_time, dnsdist::configuration::yaml::s_inClientMode, perThreadQueueSize));
   }
   dnsdist::configuration::yaml::registerType<RemoteLoggerInterface>(object, config.name);
 #endif
@@ -1883,9 +1880,8 @@ void registerDnstapLogger([[maybe_unused]] const DnstapLoggerConfiguration& conf
 #endif
 }
 
-void registerKVSObjects([[maybe_unused]] const KeyValueStoresConfiguration& config)
+void registerKVSObjects(const KeyValueStoresConfiguration& config)
 {
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
   bool createObjects = !dnsdist::configuration::yaml::s_inClientMode && !dnsdist::configuration::yaml::s_inConfigCheckMode;
 #if defined(HAVE_LMDB)
   for (const auto& lmdb : config.lmdb) {
@@ -1899,6 +1895,10 @@ void registerKVSObjects([[maybe_unused]] const KeyValueStoresConfiguration& conf
     dnsdist::configuration::yaml::registerType<KeyValueStore>(store, cdb.name);
   }
 #endif /* defined(HAVE_CDB) */
+  for (const auto& mmapStore : config.mmap) {
+    auto store = createObjects ? std::shared_ptr<KeyValueStore>(std::make_shared<MMapKVStore>(std::string(mmapStore.file_name), mmapStore.refresh_delay)) : std::shared_ptr<KeyValueStore>();
+    dnsdist::configuration::yaml::registerType<KeyValueStore>(store, mmapStore.name);
+  }
   for (const auto& key : config.lookup_keys.source_ip_keys) {
     auto lookup = createObjects ? std::shared_ptr<KeyValueLookupKey>(std::make_shared<KeyValueLookupKeySourceIP>(key.v4_mask, key.v6_mask, key.include_port)) : std::shared_ptr<KeyValueLookupKey>();
     dnsdist::configuration::yaml::registerType<KeyValueLookupKey>(lookup, key.name);
@@ -1915,7 +1915,6 @@ void registerKVSObjects([[maybe_unused]] const KeyValueStoresConfiguration& conf
     auto lookup = createObjects ? std::shared_ptr<KeyValueLookupKey>(std::make_shared<KeyValueLookupKeyTag>(std::string(key.tag))) : std::shared_ptr<KeyValueLookupKey>();
     dnsdist::configuration::yaml::registerType<KeyValueLookupKey>(lookup, key.name);
   }
-#endif /* defined(HAVE_LMDB) || defined(HAVE_CDB) */
 }
 
 void registerNMGObjects(const ::rust::Vec<NetmaskGroupConfiguration>& nmgs)
@@ -80,6 +80,7 @@ struct ImmutableConfiguration
   uint64_t d_outgoingTCPCleanupInterval{60};
   uint64_t d_outgoingDoHMaxIdlePerBackend{10};
   uint64_t d_outgoingTCPMaxIdlePerBackend{10};
+  uint64_t d_outgoingTCPMaxSharedIdlePerBackend{0};
   uint64_t d_maxTCPClientThreads{10};
   uint64_t d_maxTCPConnectionsRatePerClient{0};
   uint64_t d_maxTLSResumedSessionsRatePerClient{0};
@@ -90,6 +91,8 @@ struct ImmutableConfiguration
   size_t d_ringsCapacity{10000};
   size_t d_ringsNumberOfShards{10};
   size_t d_ringsNbLockTries{5};
+  size_t d_ringsSlidingWindow{0};
+  size_t d_ringsSlidingWindowMaxEntries{4096};
   uint32_t d_socketUDPSendBuffer{0};
   uint32_t d_socketUDPRecvBuffer{0};
   uint32_t d_hashPerturbation{0};
@@ -104,8 +107,10 @@ struct ImmutableConfiguration
   uint8_t d_tcpConnectionsMaskV4Port{0};
   bool d_randomizeUDPSocketsToBackend{false};
   bool d_randomizeIDsToBackend{false};
+  bool d_tcpDispatchToLeastLoadedWorker{false};
   bool d_ringsRecordQueries{true};
   bool d_ringsRecordResponses{true};
+  bool d_ringsPerThread{false};
   bool d_snmpEnabled{false};
   bool d_snmpTrapsEnabled{false};
 };
@@ -171,6 +176,7 @@ struct RuntimeConfiguration
   bool d_logConsoleConnections{true};
   bool d_addEDNSToSelfGeneratedResponses{true};
   bool d_applyACLToProxiedClients{false};
+  bool d_compileQueryRules{false};
   bool d_openTelemetryTracing{false}; // XXX: It would be nice to #ifndef DISABLE_PROTOBUF, but as this is defined in dnsdist-settings-definitions.yml, we can't
 };
 
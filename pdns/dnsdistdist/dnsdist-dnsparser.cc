@@ -19,8 +19,15 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "dnsdist-dnsparser.hh"
 #include "dnsparser.hh"
+#include "burtle.hh"
 #include "iputils.hh"
 
 namespace dnsdist
@@ -287,6 +294,153 @@ namespace RecordParsers
   }
 }
 
+namespace QuestionParsing
+{
+#if defined(__AVX2__)
+  using Vector = __m256i;
+  static constexpr size_t s_vectorSize = sizeof(Vector);
+
+  static Vector load(const uint8_t* data)
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): this is how the intrinsics work
+    return _mm256_loadu_si256(reinterpret_cast<const Vector*>(data));
+  }
+
+  static void store(uint8_t* data, Vector value)
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): this is how the intrinsics work
+    _mm256_storeu_si256(reinterpret_cast<Vector*>(data), value);
+  }
+
+  static Vector toLower(Vector value)
+  {
+    /* shift 'A'..'Z' to the lowest signed values, so that a single signed comparison selects them */
+    const auto shifted = _mm256_add_epi8(value, _mm256_set1_epi8(static_cast<char>(0x80 - 'A')));
+    const auto isUpper = _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+    return _mm256_or_si256(value, _mm256_and_si256(isUpper, _mm256_set1_epi8(0x20)));
+  }
+
+  static bool equal(Vector first, Vector second)
+  {
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(first, second))) == 0xffffffffU;
+  }
+#elif defined(__SSE2__)
+  using Vector = __m128i;
+  static constexpr size_t s_vectorSize = sizeof(Vector);
+
+  static Vector load(const uint8_t* data)
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): this is how the intrinsics work
+    return _mm_loadu_si128(reinterpret_cast<const Vector*>(data));
+  }
+
+  static void store(uint8_t* data, Vector value)
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast): this is how the intrinsics work
+    _mm_storeu_si128(reinterpret_cast<Vector*>(data), value);
+  }
+
+  static Vector toLower(Vector value)
+  {
+    /* shift 'A'..'Z' to the lowest signed values, so that a single signed comparison selects them */
+    const auto shifted = _mm_add_epi8(value, _mm_set1_epi8(static_cast<char>(0x80 - 'A')));
+    const auto isUpper = _mm_cmpgt_epi8(_mm_set1_epi8(static_cast<char>(-128 + 26)), shifted);
+    return _mm_or_si128(value, _mm_and_si128(isUpper, _mm_set1_epi8(0x20)));
+  }
+
+  static bool equal(Vector first, Vector second)
+  {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(first, second)) == 0xffff;
+  }
+#endif
+
+  uint32_t hashNameCI(const uint8_t* name, size_t length, uint32_t hashInit)
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-member-init): only the bytes written below are read
+    std::array<uint8_t, DNSName::s_maxDNSNameLength + 1> lowered;
+    if (length > lowered.size()) {
+      return burtleCI(name, length, hashInit);
+    }
+
+    size_t pos = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; pos + s_vectorSize <= length; pos += s_vectorSize) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      store(&lowered.at(pos), toLower(load(name + pos)));
+    }
+#endif
+    for (; pos < length; pos++) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      lowered.at(pos) = dns_tolower(name[pos]);
+    }
+    return burtle(lowered.data(), length, hashInit);
+  }
+
+  bool namesEqualCI(std::string_view first, std::string_view second)
+  {
+    if (first.size() != second.size()) {
+      return false;
+    }
+
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* firstData = reinterpret_cast<const uint8_t*>(first.data());
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto* secondData = reinterpret_cast<const uint8_t*>(second.data());
+    size_t pos = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; pos + s_vectorSize <= first.size(); pos += s_vectorSize) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      if (!equal(toLower(load(firstData + pos)), toLower(load(secondData + pos)))) {
+        return false;
+      }
+    }
+#endif
+    for (; pos < first.size(); pos++) {
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      if (dns_tolower(firstData[pos]) != dns_tolower(secondData[pos])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  std::optional<Question> parse(const PacketBuffer& packet, uint32_t hashInit)
+  {
+    /* only the label lengths are read here, the content of the labels is only touched when hashing */
+    size_t pos = sizeof(dnsheader);
+    while (true) {
+      if (pos >= packet.size()) {
+        return std::nullopt;
+      }
+      const auto labelLength = packet[pos];
+      if (labelLength == 0) {
+        break;
+      }
+      /* this also rejects compression pointers */
+      if (labelLength > 63) {
+        return std::nullopt;
+      }
+      pos += 1 + labelLength;
+      /* the same limit as DNSName, not counting the root label */
+      if (pos - sizeof(dnsheader) > DNSName::s_maxDNSNameLength) {
+        return std::nullopt;
+      }
+    }
+
+    const auto wireLength = pos + 1 - sizeof(dnsheader);
+    if (pos + 1 + 4 > packet.size()) {
+      return std::nullopt;
+    }
+
+    Question question;
+    question.d_qnameWireLength = static_cast<uint16_t>(wireLength);
+    question.d_qtype = packet[pos + 1] * 256 + packet[pos + 2];
+    question.d_qclass = packet[pos + 3] * 256 + packet[pos + 4];
+    question.d_qnameHash = hashNameCI(&packet.at(sizeof(dnsheader)), wireLength, hashInit);
+    return question;
+  }
+}
+
 void setResponseHeadersFromConfig(dnsheader& dnsheader, const ResponseConfig& config)
 {
   if (config.setAA) {
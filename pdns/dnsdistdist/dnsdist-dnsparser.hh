@@ -71,6 +71,27 @@ namespace RecordParsers
   std::optional<DNSName> parseCNAMERecord(const std::string_view& packet, const DNSPacketOverlay::Record& record);
 }
 
+namespace QuestionParsing
+{
+  struct Question
+  {
+    uint32_t d_qnameHash{0};
+    uint16_t d_qnameWireLength{0};
+    uint16_t d_qtype{0};
+    uint16_t d_qclass{0};
+  };
+
+  /* Validates the qname of the first question, which has to be made of uncompressed labels like in any query,
+     and returns its wire length and case-insensitive hash, which is the same as DNSName::hash() would return
+     for the same name and initial value, along with the qtype and qclass, without creating a DNSName.
+     The name is lowercased 32 or 16 bytes at a time if AVX2 or SSE2 are available */
+  std::optional<Question> parse(const PacketBuffer& packet, uint32_t hashInit = 0);
+  /* the same as burtleCI() */
+  uint32_t hashNameCI(const uint8_t* name, size_t length, uint32_t hashInit);
+  /* case-insensitive comparison of two names in wire format */
+  bool namesEqualCI(std::string_view first, std::string_view second);
+}
+
 struct ResponseConfig
 {
   std::optional<bool> setAA{std::nullopt};
@@ -5,6 +5,7 @@
 #include <boost/multi_index/sequenced_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
 
+#include "lock.hh"
 #include "tcpiohandler-mplexer.hh"
 #include "dnsdist-tcp.hh"
 
@@ -31,6 +32,8 @@ class DownstreamConnectionsManager
     list_t d_actives;
     list_t d_idles;
   };
+  /* idle connections handed over by their thread, more recent first */
+  using shared_idles_t = std::map<boost::uuids::uuid, std::deque<std::shared_ptr<T>>>;
 
 public:
   static void setMaxIdleConnectionsPerDownstream(size_t max)
@@ -48,6 +51,22 @@ public:
     s_maxIdleTime = max;
   }
 
+  /* 0 means that idle connections are never shared between threads */
+  static void setMaxSharedIdleConnectionsPerDownstream(size_t max)
+  {
+    s_maxSharedIdleConnectionsPerDownstream = max;
+  }
+
+  static size_t getSharedIdleCount()
+  {
+    size_t count = 0;
+    auto shared = s_sharedIdles.lock();
+    for (const auto& downstream : *shared) {
+      count += downstream.second.size();
+    }
+    return count;
+  }
+
   std::shared_ptr<T> getConnectionToDownstream(std::unique_ptr<FDMultiplexer>& mplexer, const std::shared_ptr<DownstreamState>& ds, const struct timeval& now, std::string&& proxyProtocolPayload)
   {
     struct timeval freshCutOff = now;
@@ -76,6 +95,15 @@ public:
           return entry;
         }
       }
+
+      /* and finally the ones another thread did not need */
+      auto entry = borrowSharedIdleConnection(backendId, mplexer, freshCutOff);
+      if (entry) {
+        ++ds->tcpReusedConnections;
+        ++ds->tcpSharedReusedConnections;
+        d_downstreamConnections[backendId].d_actives.insert(entry);
+        return entry;
+      }
     }
 
     if (ds->d_config.d_tcpConcurrentConnectionsLimit > 0 && ds->tcpCurrentConnections.load() >= ds->d_config.d_tcpConcurrentConnectionsLimit) {
@@ -117,6 +145,53 @@ public:
         ++dsIt;
       }
     }
+
+    if (s_maxSharedIdleConnectionsPerDownstream > 0) {
+      cleanUpSharedIdleConnections(idleCutOff);
+    }
+  }
+
+  /* hand the connections that have not been used in the last second over to the
+     other threads, so that they do not have to open new ones. Should be called
+     outside of any connection processing, since the connections are not owned
+     by this thread anymore once this function returns */
+  void shareIdleConnections(const struct timeval& now)
+  {
+    if (s_maxSharedIdleConnectionsPerDownstream == 0 || d_nextSharing > now.tv_sec) {
+      return;
+    }
+
+    d_nextSharing = now.tv_sec + 1;
+
+    struct timeval freshCutOff = now;
+    freshCutOff.tv_sec -= 1;
+
+    std::vector<std::shared_ptr<T>> candidates;
+    for (auto& [backendId, lists] : d_downstreamConnections) {
+      candidates.clear();
+      for (const auto& entry : lists.d_idles.template get<SequencedTag>()) {
+        if (entry && entry->getLastDataReceivedTime() < freshCutOff && entry->canBeShared()) {
+          candidates.push_back(entry);
+        }
+      }
+      if (candidates.empty()) {
+        continue;
+      }
+
+      auto shared = s_sharedIdles.lock();
+      auto& idles = (*shared)[backendId];
+      /* least recently used first */
+      for (auto connIt = candidates.rbegin(); connIt != candidates.rend() && idles.size() < s_maxSharedIdleConnectionsPerDownstream; ++connIt) {
+        auto& entry = *connIt;
+        lists.d_idles.erase(lists.d_idles.find(entry));
+        entry->detachFromMultiplexer();
+        ++entry->getDS()->tcpSharedParkedConnections;
+        idles.push_front(std::move(entry));
+      }
+      if (idles.empty()) {
+        shared->erase(backendId);
+      }
+    }
   }
 
   size_t clear()
@@ -134,6 +209,7 @@ public:
     }
 
     d_downstreamConnections.clear();
+    s_sharedIdles.lock()->clear();
     return count;
   }
 
@@ -280,6 +356,67 @@ protected:
     return nullptr;
   }
 
+  std::shared_ptr<T> borrowSharedIdleConnection(const boost::uuids::uuid& backendId, std::unique_ptr<FDMultiplexer>& mplexer, const struct timeval& freshCutOff)
+  {
+    if (s_maxSharedIdleConnectionsPerDownstream == 0) {
+      return nullptr;
+    }
+
+    while (true) {
+      std::shared_ptr<T> entry;
+      {
+        auto shared = s_sharedIdles.lock();
+        auto sharedIt = shared->find(backendId);
+        if (sharedIt == shared->end()) {
+          return nullptr;
+        }
+        entry = std::move(sharedIt->second.front());
+        sharedIt->second.pop_front();
+        if (sharedIt->second.empty()) {
+          shared->erase(sharedIt);
+        }
+      }
+
+      /* from now on this connection is ours */
+      entry->attachToMultiplexer(mplexer);
+      if (isConnectionUsable(entry, freshCutOff)) {
+        entry->setReused();
+        return entry;
+      }
+      entry->release(false);
+    }
+  }
+
+  static void cleanUpSharedIdleConnections(const struct timeval& idleCutOff)
+  {
+    std::vector<std::shared_ptr<T>> expired;
+    {
+      auto shared = s_sharedIdles.lock();
+      for (auto dsIt = shared->begin(); dsIt != shared->end();) {
+        auto& idles = dsIt->second;
+        for (auto connIt = idles.begin(); connIt != idles.end();) {
+          if ((*connIt)->getLastDataReceivedTime() < idleCutOff) {
+            expired.push_back(std::move(*connIt));
+            connIt = idles.erase(connIt);
+            continue;
+          }
+          ++connIt;
+        }
+        if (idles.empty()) {
+          dsIt = shared->erase(dsIt);
+        }
+        else {
+          ++dsIt;
+        }
+      }
+    }
+
+    /* release them without holding the lock */
+    for (auto& conn : expired) {
+      conn->release(false);
+    }
+  }
+
   bool isConnectionUsable(const std::shared_ptr<T>& conn, const struct timeval& freshCutOff)
   {
     if (!conn->canBeReused()) {
@@ -299,10 +436,13 @@ protected:
   static size_t s_maxIdleConnectionsPerDownstream;
   static uint16_t s_cleanupInterval;
   static uint16_t s_maxIdleTime;
+  static size_t s_maxSharedIdleConnectionsPerDownstream;
+  static LockGuarded<shared_idles_t> s_sharedIdles;
 
   std::map<boost::uuids::uuid, ConnectionLists> d_downstreamConnections;
 
   time_t d_nextCleanup{0};
+  time_t d_nextSharing{0};
 };
 
 template <class T>
@@ -311,6 +451,10 @@ template <class T>
 uint16_t DownstreamConnectionsManager<T>::s_cleanupInterval{60};
 template <class T>
 uint16_t DownstreamConnectionsManager<T>::s_maxIdleTime{300};
+template <class T>
+size_t DownstreamConnectionsManager<T>::s_maxSharedIdleConnectionsPerDownstream{0};
+template <class T>
+LockGuarded<typename DownstreamConnectionsManager<T>::shared_idles_t> DownstreamConnectionsManager<T>::s_sharedIdles;
 
 using DownstreamTCPConnectionsManager = DownstreamConnectionsManager<TCPConnectionToBackend>;
 extern thread_local DownstreamTCPConnectionsManager t_downstreamTCPConnectionsManager;
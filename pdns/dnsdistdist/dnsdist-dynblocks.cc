@@ -12,17 +12,23 @@ void DynBlockRulesGroup::apply(const timespec& now)
   counts_t counts;
   StatNode statNodeRoot;
 
-  size_t entriesCount = 0;
-  if (hasQueryRules()) {
-    entriesCount += g_rings.getNumberOfQueryEntries();
+  const auto* slidingCounters = g_rings.getSlidingCounters();
+  if (canUseSlidingCounters(slidingCounters)) {
+    processRulesFromCounters(*slidingCounters, counts, statNodeRoot, now);
   }
-  if (hasResponseRules()) {
-    entriesCount += g_rings.getNumberOfResponseEntries();
-  }
-  counts.reserve(entriesCount);
+  else {
+    size_t entriesCount = 0;
+    if (hasQueryRules()) {
+      entriesCount += g_rings.getNumberOfQueryEntries();
+    }
+    if (hasResponseRules()) {
+      entriesCount += g_rings.getNumberOfResponseEntries();
+    }
+    counts.reserve(entriesCount);
 
-  processQueryRules(counts, now);
-  processResponseRules(counts, statNodeRoot, now);
+    processQueryRules(counts, now);
+    processResponseRules(counts, statNodeRoot, now);
+  }
 
   if (counts.empty() && statNodeRoot.empty()) {
     return;
@@ -384,27 +390,24 @@ void DynBlockRulesGroup::processQueryRules(counts_t& counts, const struct timesp
     rule.second.d_cutOff.tv_sec -= rule.second.d_seconds;
   }
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto queryRing = shard->queryRing.lock();
-    for (const auto& ringEntry : *queryRing) {
-      if (now < ringEntry.when) {
-        continue;
-      }
+  g_rings.forEachQuery([&](const Rings::Query& ringEntry) {
+    if (now < ringEntry.when) {
+      return;
+    }
 
-      bool qRateMatches = d_queryRateRule.matches(ringEntry.when);
-      bool typeRuleMatches = checkIfQueryTypeMatches(ringEntry);
+    bool qRateMatches = d_queryRateRule.matches(ringEntry.when);
+    bool typeRuleMatches = checkIfQueryTypeMatches(ringEntry);
 
-      if (qRateMatches || typeRuleMatches) {
-        auto& entry = counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
-        if (qRateMatches) {
-          ++entry.queries;
-        }
-        if (typeRuleMatches) {
-          ++entry.d_qtypeCounts[ringEntry.qtype];
-        }
+    if (qRateMatches || typeRuleMatches) {
+      auto& entry = counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
+      if (qRateMatches) {
+        ++entry.queries;
+      }
+      if (typeRuleMatches) {
+        ++entry.d_qtypeCounts[ringEntry.qtype];
       }
     }
-  }
+  });
 }
 
 void DynBlockRulesGroup::processResponseRules(counts_t& counts, StatNode& root, const struct timespec& now)
@@ -449,41 +452,167 @@ void DynBlockRulesGroup::processResponseRules(counts_t& counts, StatNode& root,
     }
   }
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto responseRing = shard->respRing.lock();
-    for (const auto& ringEntry : *responseRing) {
-      if (now < ringEntry.when) {
-        continue;
-      }
+  g_rings.forEachResponse([&](const Rings::Response& ringEntry) {
+    if (now < ringEntry.when) {
+      return;
+    }
 
-      if (ringEntry.when < responseCutOff) {
-        continue;
-      }
+    if (ringEntry.when < responseCutOff) {
+      return;
+    }
 
-      auto& entry = counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
-      ++entry.responses;
+    auto& entry = counts[AddressAndPortRange(ringEntry.requestor, ringEntry.requestor.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
+    ++entry.responses;
 
-      bool respRateMatches = d_respRateRule.matches(ringEntry.when);
-      bool suffixMatchRuleMatches = d_suffixMatchRule.matches(ringEntry.when);
-      bool rcodeRuleMatches = checkIfResponseCodeMatches(ringEntry);
-      bool respCacheMissRatioRuleMatches = d_respCacheMissRatioRule.matches(ringEntry.when);
+    bool respRateMatches = d_respRateRule.matches(ringEntry.when);
+    bool suffixMatchRuleMatches = d_suffixMatchRule.matches(ringEntry.when);
+    bool rcodeRuleMatches = checkIfResponseCodeMatches(ringEntry);
+    bool respCacheMissRatioRuleMatches = d_respCacheMissRatioRule.matches(ringEntry.when);
 
-      if (respRateMatches) {
-        entry.respBytes += ringEntry.size;
-      }
-      if (rcodeRuleMatches) {
-        ++entry.d_rcodeCounts[ringEntry.dh.rcode];
-      }
-      if (respCacheMissRatioRuleMatches && !ringEntry.isACacheHit()) {
-        ++entry.cacheMisses;
-      }
+    if (respRateMatches) {
+      entry.respBytes += ringEntry.size;
+    }
+    if (rcodeRuleMatches) {
+      ++entry.d_rcodeCounts[ringEntry.dh.rcode];
+    }
+    if (respCacheMissRatioRuleMatches && !ringEntry.isACacheHit()) {
+      ++entry.cacheMisses;
+    }
 
-      if (suffixMatchRuleMatches) {
-        const bool hit = ringEntry.isACacheHit();
-        root.submit(ringEntry.name, ((ringEntry.dh.rcode == 0 && ringEntry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : ringEntry.dh.rcode), ringEntry.size, hit, std::nullopt);
-      }
+    if (suffixMatchRuleMatches) {
+      const bool hit = ringEntry.isACacheHit();
+      root.submit(ringEntry.name, ((ringEntry.dh.rcode == 0 && ringEntry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : ringEntry.dh.rcode), ringEntry.size, hit, std::nullopt);
     }
+  });
+}
+
+/* the per-second counters can only be used if they cover the window of every rule,
+   and if we do not need to distinguish clients by their source port */
+bool DynBlockRulesGroup::canUseSlidingCounters(const dnsdist::SlidingCounters* counters) const
+{
+  if (counters == nullptr || d_portMask != 0) {
+    return false;
+  }
+
+  const auto window = counters->getWindowSeconds();
+  const auto fits = [window](const DynBlockRule& rule) {
+    return !rule.isEnabled() || (rule.d_seconds > 0 && rule.d_seconds <= window);
+  };
+
+  if (!fits(d_queryRateRule) || !fits(d_respRateRule) || !fits(d_suffixMatchRule) || !fits(d_respCacheMissRatioRule)) {
+    return false;
   }
+  for (const auto& rule : d_qtypeRules) {
+    if (!fits(rule.second)) {
+      return false;
+    }
+  }
+  for (const auto& rule : d_rcodeRules) {
+    if (!fits(rule.second)) {
+      return false;
+    }
+  }
+  for (const auto& rule : d_rcodeRatioRules) {
+    if (!fits(rule.second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void DynBlockRulesGroup::processRulesFromCounters(const dnsdist::SlidingCounters& counters, counts_t& counts, StatNode& root, const struct timespec& now)
+{
+  if (!hasRules() && !hasSuffixMatchRules()) {
+    return;
+  }
+
+  /* a bucket holds the entries received during a whole second, we only include it if that whole
+     second is inside the window of the rule, which might lead to slightly under-estimating
+     the rate but never to over-estimating it */
+  const auto inWindow = [&now](time_t second, const DynBlockRule& rule) {
+    return rule.isEnabled() && second > (now.tv_sec - static_cast<time_t>(rule.d_seconds)) && second <= now.tv_sec;
+  };
+
+  unsigned int responsesWindow = 0;
+  const auto widenResponsesWindow = [&responsesWindow](const DynBlockRule& rule) {
+    if (rule.isEnabled()) {
+      responsesWindow = std::max(responsesWindow, rule.d_seconds);
+    }
+  };
+  widenResponsesWindow(d_respRateRule);
+  widenResponsesWindow(d_suffixMatchRule);
+  widenResponsesWindow(d_respCacheMissRatioRule);
+  for (const auto& rule : d_rcodeRules) {
+    widenResponsesWindow(rule.second);
+  }
+  for (const auto& rule : d_rcodeRatioRules) {
+    widenResponsesWindow(rule.second);
+  }
+
+  const time_t oldest = now.tv_sec - static_cast<time_t>(counters.getWindowSeconds()) + 1;
+  counters.visit(oldest, now.tv_sec, [&](const dnsdist::SlidingCounters::Bucket& bucket) {
+    const auto second = bucket.d_second;
+    const bool queryRateMatches = inWindow(second, d_queryRateRule);
+    const bool respRateMatches = inWindow(second, d_respRateRule);
+    const bool respCacheMissRatioRuleMatches = inWindow(second, d_respCacheMissRatioRule);
+    const bool responsesMatch = second > (now.tv_sec - static_cast<time_t>(responsesWindow));
+
+    if (hasRules()) {
+      bucket.d_clients.visit([&](const ComboAddress& client, const dnsdist::SlidingCounters::ClientCounters& clientCounters) {
+        Counts* entry = nullptr;
+        const auto getEntry = [&]() -> Counts& {
+          if (entry == nullptr) {
+            entry = &counts[AddressAndPortRange(client, client.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)];
+          }
+          return *entry;
+        };
+
+        if (queryRateMatches && clientCounters.queries > 0) {
+          getEntry().queries += clientCounters.queries;
+        }
+        if (!responsesMatch || clientCounters.responses == 0) {
+          return;
+        }
+
+        auto& clientEntry = getEntry();
+        clientEntry.responses += clientCounters.responses;
+        if (respRateMatches) {
+          clientEntry.respBytes += clientCounters.respBytes;
+        }
+        if (respCacheMissRatioRuleMatches) {
+          clientEntry.cacheMisses += clientCounters.cacheMisses;
+        }
+        for (size_t idx = 0; idx < clientCounters.rcodes.size(); idx++) {
+          const auto count = clientCounters.rcodes.at(idx);
+          const auto rcode = static_cast<uint8_t>(idx);
+          if (count == 0) {
+            continue;
+          }
+          auto rule = d_rcodeRules.find(rcode);
+          auto ratio = d_rcodeRatioRules.find(rcode);
+          if ((rule != d_rcodeRules.end() && inWindow(second, rule->second)) || (ratio != d_rcodeRatioRules.end() && inWindow(second, ratio->second))) {
+            clientEntry.d_rcodeCounts[rcode] += count;
+          }
+        }
+      });
+    }
+
+    if (!d_qtypeRules.empty()) {
+      bucket.d_qtypes.visit([&](const dnsdist::SlidingCounters::ClientAndQType& key, uint32_t count) {
+        auto rule = d_qtypeRules.find(key.qtype);
+        if (rule == d_qtypeRules.end() || !inWindow(second, rule->second)) {
+          return;
+        }
+        counts[AddressAndPortRange(key.client, key.client.isIPv4() ? d_v4Mask : d_v6Mask, d_portMask)].d_qtypeCounts[key.qtype] += count;
+      });
+    }
+
+    if (inWindow(second, d_suffixMatchRule)) {
+      bucket.d_names.visit([&root](const DNSName& name, const StatNode::Stat& stat) {
+        root.submit(name, stat);
+      });
+    }
+  });
 }
 
 void DynBlockMaintenance::purgeExpired(const struct timespec& now)
@@ -397,6 +397,8 @@ private:
 
   void processQueryRules(counts_t& counts, const struct timespec& now);
   void processResponseRules(counts_t& counts, StatNode& root, const struct timespec& now);
+  bool canUseSlidingCounters(const dnsdist::SlidingCounters* counters) const;
+  void processRulesFromCounters(const dnsdist::SlidingCounters& counters, counts_t& counts, StatNode& root, const struct timespec& now);
 
   std::map<uint8_t, DynBlockRule> d_rcodeRules;
   std::map<uint8_t, DynBlockRatioRule> d_rcodeRatioRules;
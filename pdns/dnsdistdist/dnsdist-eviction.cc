@@ -0,0 +1,179 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <stdexcept>
+
+#include <boost/algorithm/string.hpp>
+
+#include "dnsdist-eviction.hh"
+
+namespace dnsdist
+{
+std::optional<EvictionPolicy> getEvictionPolicyFromString(const std::string& policy)
+{
+  if (boost::iequals(policy, "none")) {
+    return EvictionPolicy::None;
+  }
+  if (boost::iequals(policy, "sieve")) {
+    return EvictionPolicy::Sieve;
+  }
+  if (boost::iequals(policy, "clock")) {
+    return EvictionPolicy::Clock;
+  }
+  return std::nullopt;
+}
+
+std::string getEvictionPolicyName(EvictionPolicy policy)
+{
+  switch (policy) {
+  case EvictionPolicy::None:
+    return "none";
+  case EvictionPolicy::Sieve:
+    return "sieve";
+  case EvictionPolicy::Clock:
+    return "clock";
+  }
+  return "unknown";
+}
+
+EvictionQueue::EvictionQueue(EvictionPolicy policy, size_t capacity) :
+  d_keys(capacity), d_prev(capacity, s_invalidSlot), d_next(capacity, s_invalidSlot), d_visited(std::make_unique<std::atomic<uint8_t>[]>(capacity)), d_capacity(capacity), d_policy(policy)
+{
+  if (capacity >= s_invalidSlot) {
+    throw std::runtime_error("Invalid capacity for an eviction queue: " + std::to_string(capacity));
+  }
+
+  d_freeSlots.reserve(capacity);
+  /* hand out the lower slots first */
+  for (size_t slot = capacity; slot > 0; slot--) {
+    d_freeSlots.push_back(slot - 1);
+  }
+  for (size_t slot = 0; slot < capacity; slot++) {
+    d_visited[slot].store(0, std::memory_order_relaxed);
+  }
+}
+
+void EvictionQueue::linkAfter(uint32_t slot, uint32_t previous)
+{
+  d_prev.at(slot) = previous;
+  if (previous == s_invalidSlot) {
+    /* new head */
+    d_next.at(slot) = d_head;
+    if (d_head != s_invalidSlot) {
+      d_prev.at(d_head) = slot;
+    }
+    d_head = slot;
+  }
+  else {
+    d_next.at(slot) = d_next.at(previous);
+    if (d_next.at(previous) != s_invalidSlot) {
+      d_prev.at(d_next.at(previous)) = slot;
+    }
+    d_next.at(previous) = slot;
+  }
+
+  if (d_next.at(slot) == s_invalidSlot) {
+    d_tail = slot;
+  }
+}
+
+void EvictionQueue::unlink(uint32_t slot)
+{
+  const auto previous = d_prev.at(slot);
+  const auto next = d_next.at(slot);
+  if (previous != s_invalidSlot) {
+    d_next.at(previous) = next;
+  }
+  else {
+    d_head = next;
+  }
+  if (next != s_invalidSlot) {
+    d_prev.at(next) = previous;
+  }
+  else {
+    d_tail = previous;
+  }
+  d_prev.at(slot) = s_invalidSlot;
+  d_next.at(slot) = s_invalidSlot;
+}
+
+uint32_t EvictionQueue::insert(uint32_t key)
+{
+  if (d_freeSlots.empty()) {
+    return s_invalidSlot;
+  }
+
+  const auto slot = d_freeSlots.back();
+  d_freeSlots.pop_back();
+  d_keys.at(slot) = key;
+  d_visited[slot].store(0, std::memory_order_relaxed);
+
+  if (d_policy == EvictionPolicy::Clock) {
+    /* right behind the hand, so it will be the last one to be considered */
+    linkAfter(slot, d_hand);
+  }
+  else {
+    linkAfter(slot, s_invalidSlot);
+  }
+
+  ++d_size;
+  return slot;
+}
+
+void EvictionQueue::remove(uint32_t slot)
+{
+  if (slot >= d_capacity) {
+    return;
+  }
+
+  if (d_hand == slot) {
+    d_hand = d_prev.at(slot);
+  }
+  unlink(slot);
+  d_freeSlots.push_back(slot);
+  --d_size;
+}
+
+uint32_t EvictionQueue::selectVictim()
+{
+  if (d_size == 0) {
+    return s_invalidSlot;
+  }
+
+  if (d_hand == s_invalidSlot) {
+    d_hand = d_tail;
+  }
+
+  /* every visited entry we go over gets its bit cleared, so this
+     ends after at most one full pass */
+  while (d_visited[d_hand].load(std::memory_order_relaxed) != 0) {
+    d_visited[d_hand].store(0, std::memory_order_relaxed);
+    d_hand = d_prev.at(d_hand);
+    if (d_hand == s_invalidSlot) {
+      d_hand = d_tail;
+    }
+  }
+
+  const auto victim = d_hand;
+  d_hand = d_prev.at(victim);
+  return victim;
+}
+}
@@ -0,0 +1,123 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace dnsdist
+{
+enum class EvictionPolicy : uint8_t
+{
+  /* never evict, refuse new entries when full */
+  None,
+  /* https://junchengyang.com/publication/nsdi24-SIEVE.pdf */
+  Sieve,
+  Clock
+};
+
+std::optional<EvictionPolicy> getEvictionPolicyFromString(const std::string& policy);
+std::string getEvictionPolicyName(EvictionPolicy policy);
+
+/*
+  Keeps track of the order in which entries have been inserted, and of whether they
+  have been accessed since the eviction hand last went over them, to decide which
+  entry to evict when there is no room left.
+  Entries are identified by the slot they are given on insertion, and by an opaque
+  32-bit key that is returned when they are selected for eviction.
+  Slots are arranged in a list going from the most recently inserted entry (head) to
+  the least recently inserted one (tail), and the hand moves from the tail towards the
+  head, wrapping around:
+  - with SIEVE, new entries are inserted at the head, so that entries surviving a
+  pass of the hand keep their position and new entries get evicted quickly if they are
+  not accessed ;
+  - with CLOCK, new entries are inserted right behind the hand, so that they will be
+  the last ones to be considered.
+  Only markVisited() can be called concurrently with the other methods, which need
+  to be serialized by the caller.
+*/
+class EvictionQueue
+{
+public:
+  static constexpr uint32_t s_invalidSlot{std::numeric_limits<uint32_t>::max()};
+
+  EvictionQueue(EvictionPolicy policy, size_t capacity);
+
+  /* returns the slot allocated to that entry, s_invalidSlot if the queue is full */
+  [[nodiscard]] uint32_t insert(uint32_t key);
+  void remove(uint32_t slot);
+  /* moves the hand until an entry that has not been visited since the last
+     pass is found, and returns its slot. The entry is not removed. */
+  [[nodiscard]] uint32_t selectVictim();
+
+  [[nodiscard]] uint32_t getKey(uint32_t slot) const
+  {
+    return d_keys.at(slot);
+  }
+
+  /* can be called without holding the lock protecting the other methods */
+  void markVisited(uint32_t slot) const
+  {
+    if (slot >= d_capacity) {
+      return;
+    }
+    auto& visited = d_visited[slot];
+    /* do not dirty the cache line if the bit is already set */
+    if (visited.load(std::memory_order_relaxed) == 0) {
+      visited.store(1, std::memory_order_relaxed);
+    }
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    return d_size;
+  }
+
+  [[nodiscard]] bool full() const
+  {
+    return d_size >= d_capacity;
+  }
+
+private:
+  void linkAfter(uint32_t slot, uint32_t previous);
+  void unlink(uint32_t slot);
+
+  std::vector<uint32_t> d_keys;
+  /* towards the head (more recent entries) */
+  std::vector<uint32_t> d_prev;
+  /* towards the tail (older entries) */
+  std::vector<uint32_t> d_next;
+  std::unique_ptr<std::atomic<uint8_t>[]> d_visited;
+  std::vector<uint32_t> d_freeSlots;
+  const size_t d_capacity;
+  size_t d_size{0};
+  uint32_t d_head{s_invalidSlot};
+  uint32_t d_tail{s_invalidSlot};
+  uint32_t d_hand{s_invalidSlot};
+  const EvictionPolicy d_policy;
+};
+}
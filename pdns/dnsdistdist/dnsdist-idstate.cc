@@ -81,15 +81,15 @@ InternalQueryState::~InternalQueryState()
     }
 
     if (!delayedResponseMsgs.empty()) {
-      for (auto const& msg_logger : delayedResponseMsgs) {
+      for (auto& msg_logger : delayedResponseMsgs) {
         // TODO: we should probably do something with the return value of queueData
-        if (!tracingEnabled) {
-          msg_logger.second->queueData(msg_logger.first);
-          continue;
+        if (tracingEnabled) {
+          // Protobuf wireformat allows us to simply append the second "message"
+          // that only contains the OTTrace data as a single bytes field
+          msg_logger.first.append(pbBuf);
         }
-        // Protobuf wireformat allows us to simply append the second "message"
-        // that only contains the OTTrace data as a single bytes field
-        msg_logger.second->queueData(msg_logger.first + pbBuf);
+        // we are going away, so the logger can take the message instead of copying it
+        msg_logger.second->queueOwnedData(msg_logger.first);
       }
     }
 
@@ -21,8 +21,10 @@
  */
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <ctime>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <string_view>
@@ -216,6 +218,8 @@ public:
   uint32_t cacheKeyNoECS{0}; // 4
   // DoH-only: if we received a TC=1 answer, we had to retry over TCP and thus we need the TCP cache key */
   uint32_t cacheKeyTCP{0}; // 4
+  // key under which the identical queries received while this one is in flight are waiting for its response
+  uint32_t coalescingKey{0}; // 4
   uint32_t ttlCap{0}; // cap the TTL _after_ inserting into the packet cache // 4
   int backendFD{-1}; // 4
   int delayMsec{0};
@@ -237,6 +241,8 @@ public:
   bool selfGenerated{false};
   bool cacheHit{false};
   bool staleCacheHit{false};
+  bool coalesced{false}; // Whether the query already went through in-flight coalescing, as leader or follower
+  bool coalescingLeader{false}; // Whether other queries are waiting for the response to this one
   bool tracingEnabled{false}; // Whether or not Open Telemetry tracing is enabled for this query
   bool rulesAppliedToQuery{false}; // Whether applyRulesToQuery has been called for the query, used to determine if we need to trace
   struct rulesAppliedToQuerySetter
@@ -256,97 +262,202 @@ public:
   };
 };
 
+/* the state of a query sent to a backend over UDP, when randomized IDs are used */
 struct IDState
 {
-  IDState()
-  {
-  }
-
+  IDState() = default;
   IDState(const IDState& orig) = delete;
   IDState(IDState&& rhs) noexcept :
     internal(std::move(rhs.internal))
   {
-    inUse.store(rhs.inUse.load());
     age.store(rhs.age.load());
   }
 
   IDState& operator=(IDState&& rhs) noexcept
   {
-    inUse.store(rhs.inUse.load());
     age.store(rhs.age.load());
     internal = std::move(rhs.internal);
     return *this;
   }
 
-  bool isInUse() const
-  {
-    return inUse;
-  }
-
-  /* For performance reasons we don't want to use a lock here, but that means
-     we need to be very careful when modifying this value. Modifications happen
-     from:
-     - one of the UDP or DoH 'client' threads receiving a query, selecting a backend
-       then picking one of the states associated to this backend (via the idOffset).
-       Most of the time this state should not be in use and usageIndicator is -1, but we
-       might not yet have received a response for the query previously associated to this
-       state, meaning that we will 'reuse' this state and erase the existing state.
-       If we ever receive a response for this state, it will be discarded. This is
-       mostly fine for UDP except that we still need to be careful in order to miss
-       the 'outstanding' counters, which should only be increased when we are picking
-       an empty state, and not when reusing ;
-       For DoH, though, we have dynamically allocated a DOHUnit object that needs to
-       be freed, as well as internal objects internals to libh2o.
-     - one of the UDP receiver threads receiving a response from a backend, picking
-       the corresponding state and sending the response to the client ;
-     - the 'healthcheck' thread scanning the states to actively discover timeouts,
-       mostly to keep some counters like the 'outstanding' one sane.
-
-     We have two flags:
-     - inUse tells us if there currently is an in-flight query whose state is stored
-       in this state
-     - locked tells us whether someone currently owns the state, so no-one else can touch
-       it
-  */
   InternalQueryState internal;
   std::atomic<uint16_t> age{0};
+};
 
-  class StateGuard
+/* The states of the queries sent to a backend over UDP, indexed by the ID used
+   toward the backend.
+   For performance reasons we don't want to use a lock here. Slots are accessed
+   from:
+   - one of the UDP or DoH 'client' threads receiving a query, selecting a backend
+     then picking one of the slots of this backend (via the idOffset).
+     Most of the time this slot should not be in use, but we might not yet have
+     received a response for the query previously associated to it, meaning that
+     we will 'reuse' this slot and erase the existing state.
+     If we ever receive a response for this state, it will be discarded. This is
+     mostly fine for UDP except that we still need to be careful in order to miss
+     the 'outstanding' counters, which should only be increased when we are picking
+     an empty slot, and not when reusing ;
+     For DoH, though, we have dynamically allocated a DOHUnit object that needs to
+     be freed, as well as internal objects internals to libh2o.
+   - one of the UDP receiver threads receiving a response from a backend, picking
+     the corresponding slot and sending the response to the client ;
+   - the 'healthcheck' thread scanning the slots to actively discover timeouts,
+     mostly to keep some counters like the 'outstanding' one sane.
+
+   Picking a slot and scanning for timeouts only need a small header per slot,
+   so the headers are kept in a dense array of single atomic words holding:
+   - a 'locked' flag telling us whether someone currently owns the slot, so no-one
+     else can touch it ;
+   - an 'in use' flag telling us if there currently is an in-flight query whose state
+     is stored in this slot ;
+   - the age of that query, in seconds ;
+   - a generation counter, increased every time the slot is assigned to a new query,
+     so that the timeout scan never ages or expires a query it has not looked at.
+   The much larger InternalQueryState objects are stored separately, allocated the
+   first time a slot is used and then reused for the next queries.
+*/
+class IDStateTable
+{
+public:
+  class LockedSlot
   {
   public:
-    StateGuard(IDState& ids) :
-      d_ids(ids)
+    LockedSlot(IDStateTable& table, size_t index, uint64_t word) :
+      d_table(table), d_index(index), d_word(word)
+    {
+    }
+    ~LockedSlot()
     {
+      d_table.d_headers[d_index].store(d_word & ~s_lockedBit, std::memory_order_release);
     }
-    ~StateGuard()
+    LockedSlot(const LockedSlot&) = delete;
+    LockedSlot(LockedSlot&&) = delete;
+    LockedSlot& operator=(const LockedSlot&) = delete;
+    LockedSlot& operator=(LockedSlot&&) = delete;
+
+    [[nodiscard]] bool isInUse() const
+    {
+      return (d_word & s_inUseBit) != 0;
+    }
+
+    [[nodiscard]] uint16_t getAge() const
+    {
+      return IDStateTable::getAge(d_word);
+    }
+
+    [[nodiscard]] uint32_t getGeneration() const
+    {
+      return static_cast<uint32_t>(d_word >> s_generationShift);
+    }
+
+    InternalQueryState& getState()
+    {
+      auto& state = d_table.d_states.at(d_index);
+      if (!state) {
+        state = std::make_unique<InternalQueryState>();
+      }
+      return *state;
+    }
+
+    /* assigns the slot to a new query, resetting its age */
+    void markInUse()
     {
-      d_ids.release();
+      d_word = ((d_word & ~s_ageMask) | s_inUseBit) + (uint64_t(1) << s_generationShift);
+    }
+
+    void markFree()
+    {
+      d_word &= ~(s_inUseBit | s_ageMask);
     }
-    StateGuard(const StateGuard&) = delete;
-    StateGuard(StateGuard&&) = delete;
-    StateGuard& operator=(const StateGuard&) = delete;
-    StateGuard& operator=(StateGuard&&) = delete;
 
   private:
-    IDState& d_ids;
+    IDStateTable& d_table;
+    const size_t d_index;
+    uint64_t d_word;
   };
 
-  [[nodiscard]] std::optional<StateGuard> acquire()
+  IDStateTable() = default;
+
+  /* not thread-safe, should only be called before the table is used */
+  void resize(size_t size)
   {
-    bool expected = false;
-    if (locked.compare_exchange_strong(expected, true)) {
-      return std::optional<StateGuard>(*this);
+    if (size == d_size) {
+      return;
     }
-    return std::nullopt;
+    d_headers = size > 0 ? std::make_unique<std::atomic<uint64_t>[]>(size) : nullptr;
+    d_states.clear();
+    d_states.resize(size);
+    d_size = size;
+  }
+
+  void clear()
+  {
+    resize(0);
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    return d_size;
+  }
+
+  [[nodiscard]] bool isInUse(size_t index) const
+  {
+    return (d_headers[index].load(std::memory_order_relaxed) & s_inUseBit) != 0;
   }
 
-  void release()
+  /* locks the slot, unless someone else already holds it */
+  [[nodiscard]] std::optional<LockedSlot> tryAcquire(size_t index)
   {
-    locked.store(false);
+    auto& header = d_headers[index];
+    auto word = header.load(std::memory_order_relaxed);
+    do {
+      if ((word & s_lockedBit) != 0) {
+        return std::nullopt;
+      }
+    } while (!header.compare_exchange_weak(word, word | s_lockedBit, std::memory_order_acquire, std::memory_order_relaxed));
+    return std::optional<LockedSlot>(std::in_place, *this, index, word);
   }
 
-  std::atomic<bool> inUse{false}; // 1
+  /* Ages all the in-use slots by one, and calls the visitor on the locked slots that were already
+     older than maxAge. Slots that are locked, or have been assigned to a new query while we were
+     looking at them, are left alone until the next call. */
+  template <typename Visitor>
+  void expire(uint16_t maxAge, Visitor&& visitor)
+  {
+    for (size_t index = 0; index < d_size; index++) {
+      auto& header = d_headers[index];
+      auto word = header.load(std::memory_order_relaxed);
+      if ((word & s_inUseBit) == 0 || (word & s_lockedBit) != 0) {
+        continue;
+      }
+      const auto age = getAge(word);
+      if (age <= maxAge) {
+        if (age < std::numeric_limits<uint16_t>::max()) {
+          header.compare_exchange_strong(word, word + (uint64_t(1) << s_ageShift), std::memory_order_relaxed);
+        }
+        continue;
+      }
+      if (!header.compare_exchange_strong(word, word | s_lockedBit, std::memory_order_acquire, std::memory_order_relaxed)) {
+        continue;
+      }
+      LockedSlot slot(*this, index, word);
+      visitor(slot);
+    }
+  }
 
 private:
-  std::atomic<bool> locked{false}; // 1
+  static constexpr uint64_t s_lockedBit{1};
+  static constexpr uint64_t s_inUseBit{2};
+  static constexpr unsigned int s_ageShift{16};
+  static constexpr uint64_t s_ageMask{uint64_t(0xffff) << s_ageShift};
+  static constexpr unsigned int s_generationShift{32};
+
+  static uint16_t getAge(uint64_t word)
+  {
+    return static_cast<uint16_t>((word & s_ageMask) >> s_ageShift);
+  }
+
+  std::unique_ptr<std::atomic<uint64_t>[]> d_headers{nullptr};
+  std::vector<std::unique_ptr<InternalQueryState>> d_states;
+  size_t d_size{0};
 };
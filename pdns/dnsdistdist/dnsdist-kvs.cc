@@ -23,6 +23,11 @@
 #include "dnsdist-kvs.hh"
 #include "dolog.hh"
 
+#include <algorithm>
+#include <array>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 std::vector<std::string> KeyValueLookupKeySourceIP::getKeys(const ComboAddress& addr)
@@ -283,3 +288,438 @@ bool CDBKVStore::keyExists(const std::string& key)
 }
 
 #endif /* HAVE_CDB */
+
+namespace
+{
+constexpr std::array<char, 8> s_mmapKVSMagic{'D', 'D', 'K', 'V', 'S', 'v', '0', '1'};
+constexpr size_t s_mmapKVSHeaderSize = 64;
+constexpr size_t s_mmapKVSRecordHeaderSize = 2 * sizeof(uint32_t);
+
+uint64_t readLE(const char* data, size_t size)
+{
+  uint64_t result = 0;
+  for (size_t idx = 0; idx < size; idx++) {
+    result |= static_cast<uint64_t>(static_cast<uint8_t>(data[idx])) << (8 * idx);
+  }
+  return result;
+}
+
+void appendLE(std::string& out, uint64_t value, size_t size)
+{
+  for (size_t idx = 0; idx < size; idx++) {
+    out.push_back(static_cast<char>((value >> (8 * idx)) & 0xff));
+  }
+}
+
+uint64_t mmapKVSHash(std::string_view key)
+{
+  /* 64-bit FNV-1a, trivial to implement in whatever tool is used to generate the database */
+  uint64_t hash = 14695981039346656037ULL;
+  for (const auto chr : key) {
+    hash ^= static_cast<uint8_t>(chr);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+}
+
+class MMapKVStore::MappedDatabase
+{
+public:
+  MappedDatabase(const std::string& fname, struct stat& st)
+  {
+    FDWrapper desc(open(fname.c_str(), O_RDONLY | O_CLOEXEC));
+    if (desc.getHandle() < 0) {
+      throw std::runtime_error("Unable to open '" + fname + "': " + stringerror());
+    }
+    if (fstat(desc.getHandle(), &st) != 0) {
+      throw std::runtime_error("Unable to stat '" + fname + "': " + stringerror());
+    }
+    if (st.st_size < 0 || static_cast<uint64_t>(st.st_size) < s_mmapKVSHeaderSize) {
+      throw std::runtime_error("'" + fname + "' is too small to be a valid database");
+    }
+
+    d_size = static_cast<size_t>(st.st_size);
+    void* addr = mmap(nullptr, d_size, PROT_READ, MAP_SHARED, desc.getHandle(), 0);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("Unable to map '" + fname + "': " + stringerror());
+    }
+    d_data = static_cast<const char*>(addr);
+    /* exact lookups are scattered all over the hash index */
+    madvise(addr, d_size, MADV_RANDOM);
+
+    try {
+      parseHeader(fname);
+    }
+    catch (...) {
+      munmap(addr, d_size);
+      throw;
+    }
+  }
+
+  MappedDatabase(const MappedDatabase&) = delete;
+  MappedDatabase(MappedDatabase&&) = delete;
+  MappedDatabase& operator=(const MappedDatabase&) = delete;
+  MappedDatabase& operator=(MappedDatabase&&) = delete;
+
+  ~MappedDatabase()
+  {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast): munmap() wants a non-const pointer
+    munmap(const_cast<char*>(d_data), d_size);
+  }
+
+  bool find(std::string_view key, std::string_view& value) const
+  {
+    if (d_slotsCount == 0) {
+      return false;
+    }
+
+    const uint64_t mask = d_slotsCount - 1;
+    uint64_t slot = mmapKVSHash(key) & mask;
+    /* the writer never fills more than half of the slots, so we will find an empty one soon enough */
+    for (uint64_t probe = 0; probe < d_slotsCount; probe++) {
+      const auto offset = readLE(d_data + d_hashIndexOffset + slot * sizeof(uint64_t), sizeof(uint64_t));
+      if (offset == 0) {
+        return false;
+      }
+      std::string_view recordKey;
+      if (getRecord(offset, recordKey, value) && recordKey == key) {
+        return true;
+      }
+      slot = (slot + 1) & mask;
+    }
+    return false;
+  }
+
+  /* returns the first entry whose key is greater or equal to the supplied one */
+  bool lowerBound(std::string_view key, std::string_view& foundKey, std::string_view& value) const
+  {
+    uint64_t first = 0;
+    uint64_t count = d_entriesCount;
+    while (count > 0) {
+      const uint64_t step = count / 2;
+      const uint64_t current = first + step;
+      std::string_view currentKey;
+      std::string_view currentValue;
+      if (!getRecord(getSortedOffset(current), currentKey, currentValue)) {
+        return false;
+      }
+      if (currentKey < key) {
+        first = current + 1;
+        count -= step + 1;
+      }
+      else {
+        count = step;
+      }
+    }
+
+    if (first >= d_entriesCount) {
+      return false;
+    }
+    return getRecord(getSortedOffset(first), foundKey, value);
+  }
+
+private:
+  void parseHeader(const std::string& fname)
+  {
+    if (memcmp(d_data, s_mmapKVSMagic.data(), s_mmapKVSMagic.size()) != 0) {
+      throw std::runtime_error("'" + fname + "' is not a valid database (invalid magic)");
+    }
+    size_t pos = s_mmapKVSMagic.size();
+    auto readField = [this, &pos]() {
+      auto value = readLE(d_data + pos, sizeof(uint64_t));
+      pos += sizeof(uint64_t);
+      return value;
+    };
+    d_entriesCount = readField();
+    d_slotsCount = readField();
+    d_hashIndexOffset = readField();
+    d_sortedIndexOffset = readField();
+    d_recordsOffset = readField();
+    const auto totalSize = readField();
+
+    if (totalSize != d_size) {
+      throw std::runtime_error("'" + fname + "' is not a valid database (size mismatch, truncated file?)");
+    }
+    if ((d_slotsCount & (d_slotsCount - 1)) != 0 || d_slotsCount < d_entriesCount) {
+      throw std::runtime_error("'" + fname + "' is not a valid database (invalid number of slots)");
+    }
+    auto checkArea = [this, &fname](uint64_t offset, uint64_t count) {
+      if (offset < s_mmapKVSHeaderSize || offset > d_size || count > (d_size - offset) / sizeof(uint64_t)) {
+        throw std::runtime_error("'" + fname + "' is not a valid database (invalid index)");
+      }
+    };
+    checkArea(d_hashIndexOffset, d_slotsCount);
+    checkArea(d_sortedIndexOffset, d_entriesCount);
+    if (d_recordsOffset < s_mmapKVSHeaderSize || d_recordsOffset > d_size) {
+      throw std::runtime_error("'" + fname + "' is not a valid database (invalid records offset)");
+    }
+  }
+
+  uint64_t getSortedOffset(uint64_t idx) const
+  {
+    return readLE(d_data + d_sortedIndexOffset + idx * sizeof(uint64_t), sizeof(uint64_t));
+  }
+
+  bool getRecord(uint64_t offset, std::string_view& key, std::string_view& value) const
+  {
+    /* the file has been validated when it was mapped but the records have not, so we check
+       the bounds now rather than reading past the end of the mapping on a corrupted file */
+    if (offset < d_recordsOffset || offset > d_size || (d_size - offset) < s_mmapKVSRecordHeaderSize) {
+      return false;
+    }
+    const auto keySize = readLE(d_data + offset, sizeof(uint32_t));
+    const auto valueSize = readLE(d_data + offset + sizeof(uint32_t), sizeof(uint32_t));
+    if ((d_size - offset - s_mmapKVSRecordHeaderSize) < keySize + valueSize) {
+      return false;
+    }
+    const char* data = d_data + offset + s_mmapKVSRecordHeaderSize;
+    key = std::string_view(data, keySize);
+    value = std::string_view(data + keySize, valueSize);
+    return true;
+  }
+
+  const char* d_data{nullptr};
+  size_t d_size{0};
+  uint64_t d_entriesCount{0};
+  uint64_t d_slotsCount{0};
+  uint64_t d_hashIndexOffset{0};
+  uint64_t d_sortedIndexOffset{0};
+  uint64_t d_recordsOffset{0};
+};
+
+MMapKVStore::MMapKVStore(const std::string& fname, time_t refreshDelay) :
+  d_fname(fname), d_refreshDelay(refreshDelay)
+{
+  reload(*(d_fileState.lock()));
+  if (d_refreshDelay > 0) {
+    d_nextCheck = time(nullptr) + d_refreshDelay;
+  }
+}
+
+MMapKVStore::~MMapKVStore() = default;
+
+void MMapKVStore::reload(FileState& state)
+{
+  /* keep the identity of the file we actually mapped, it might have been replaced since we last checked */
+  struct stat mapped{};
+  std::shared_ptr<const MappedDatabase> newDB = std::make_shared<const MappedDatabase>(d_fname, mapped);
+  std::atomic_store_explicit(&d_db, std::move(newDB), std::memory_order_release);
+  state.d_mtime = mapped.st_mtime;
+  state.d_inode = mapped.st_ino;
+  state.d_size = mapped.st_size;
+}
+
+bool MMapKVStore::reload()
+{
+  try {
+    reload(*(d_fileState.lock()));
+    return true;
+  }
+  catch (const std::exception& e) {
+    warnlog("Error while reloading the memory-mapped KVS database '%s': %s", d_fname, e.what());
+  }
+  return false;
+}
+
+void MMapKVStore::refreshDBIfNeeded(time_t now)
+{
+  auto state = d_fileState.try_lock();
+  if (!state.owns_lock()) {
+    /* someone else is already refreshing */
+    return;
+  }
+
+  d_nextCheck = now + d_refreshDelay;
+  struct stat st{};
+  if (stat(d_fname.c_str(), &st) != 0) {
+    warnlog("Error while retrieving the last modification time of memory-mapped KVS database '%s': %s", d_fname, stringerror());
+    return;
+  }
+
+  /* the database is usually replaced by renaming a new file over the existing one,
+     which might happen more than once per second, so the modification time is not enough */
+  if (st.st_mtime != state->d_mtime || st.st_ino != state->d_inode || st.st_size != state->d_size) {
+    try {
+      reload(*state);
+    }
+    catch (const std::exception& e) {
+      warnlog("Error while reloading the memory-mapped KVS database '%s': %s", d_fname, e.what());
+    }
+  }
+}
+
+bool MMapKVStore::getValue(const std::string& key, std::string& value)
+{
+  try {
+    if (d_refreshDelay > 0) {
+      time_t now = time(nullptr);
+      if (now >= d_nextCheck.load()) {
+        refreshDBIfNeeded(now);
+      }
+    }
+
+    auto db = std::atomic_load_explicit(&d_db, std::memory_order_acquire);
+    std::string_view result;
+    if (db && db->find(key, result)) {
+      value = std::string(result);
+      return true;
+    }
+  }
+  catch (const std::exception& e) {
+    vinfolog("Error while looking up key '%s' from memory-mapped KVS database '%s': %s", key, d_fname, e.what());
+  }
+  return false;
+}
+
+bool MMapKVStore::keyExists(const std::string& key)
+{
+  try {
+    if (d_refreshDelay > 0) {
+      time_t now = time(nullptr);
+      if (now >= d_nextCheck.load()) {
+        refreshDBIfNeeded(now);
+      }
+    }
+
+    auto db = std::atomic_load_explicit(&d_db, std::memory_order_acquire);
+    std::string_view result;
+    return db && db->find(key, result);
+  }
+  catch (const std::exception& e) {
+    vinfolog("Error while looking up key '%s' from memory-mapped KVS database '%s': %s", key, d_fname, e.what());
+  }
+  return false;
+}
+
+bool MMapKVStore::getRangeValue(const std::string& key, std::string& value)
+{
+  try {
+    if (d_refreshDelay > 0) {
+      time_t now = time(nullptr);
+      if (now >= d_nextCheck.load()) {
+        refreshDBIfNeeded(now);
+      }
+    }
+
+    auto db = std::atomic_load_explicit(&d_db, std::memory_order_acquire);
+    if (!db) {
+      return false;
+    }
+
+    // same semantics as the LMDB store: the key is the last element of the range,
+    // and the value starts with the first element of the range
+    std::string_view last;
+    std::string_view result;
+    if (!db->lowerBound(key, last, result)) {
+      return false;
+    }
+    if (last.size() != key.size() || result.size() < key.size()) {
+      return false;
+    }
+    auto first = result.substr(0, key.size());
+    if (std::string_view(key) < first) {
+      return false;
+    }
+
+    value = std::string(result);
+    return true;
+  }
+  catch (const std::exception& e) {
+    vinfolog("Error while looking up a range from memory-mapped KVS database '%s': %s", d_fname, e.what());
+  }
+  return false;
+}
+
+bool MMapKVStoreWriter::addEntry(std::string key, std::string value)
+{
+  if (key.size() > std::numeric_limits<uint32_t>::max() || value.size() > std::numeric_limits<uint32_t>::max()) {
+    return false;
+  }
+  d_entries.emplace_back(std::move(key), std::move(value));
+  return true;
+}
+
+void MMapKVStoreWriter::write(int fd)
+{
+  std::sort(d_entries.begin(), d_entries.end(), [](const auto& lhs, const auto& rhs) {
+    return lhs.first < rhs.first;
+  });
+  for (size_t idx = 1; idx < d_entries.size(); idx++) {
+    if (d_entries.at(idx - 1).first == d_entries.at(idx).first) {
+      throw std::runtime_error("Duplicate key in the memory-mapped KVS database");
+    }
+  }
+
+  /* keep at least half of the slots empty so that probing stays short */
+  uint64_t slotsCount = d_entries.empty() ? 0 : 1;
+  while (slotsCount < d_entries.size() * 2) {
+    slotsCount <<= 1;
+  }
+  const uint64_t hashIndexOffset = s_mmapKVSHeaderSize;
+  const uint64_t sortedIndexOffset = hashIndexOffset + slotsCount * sizeof(uint64_t);
+  const uint64_t recordsOffset = sortedIndexOffset + d_entries.size() * sizeof(uint64_t);
+
+  std::vector<uint64_t> hashIndex(slotsCount, 0);
+  std::vector<uint64_t> sortedIndex;
+  sortedIndex.reserve(d_entries.size());
+  uint64_t offset = recordsOffset;
+  for (const auto& entry : d_entries) {
+    sortedIndex.push_back(offset);
+    uint64_t slot = mmapKVSHash(entry.first) & (slotsCount - 1);
+    while (hashIndex.at(slot) != 0) {
+      slot = (slot + 1) & (slotsCount - 1);
+    }
+    hashIndex.at(slot) = offset;
+    offset += s_mmapKVSRecordHeaderSize + entry.first.size() + entry.second.size();
+  }
+  const uint64_t totalSize = offset;
+
+  auto writeAll = [fd](const std::string& buffer) {
+    size_t pos = 0;
+    while (pos < buffer.size()) {
+      auto res = ::write(fd, buffer.data() + pos, buffer.size() - pos);
+      if (res < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error("Error while writing the memory-mapped KVS database: " + stringerror());
+      }
+      pos += static_cast<size_t>(res);
+    }
+  };
+
+  std::string buffer;
+  buffer.reserve(s_mmapKVSHeaderSize);
+  buffer.append(s_mmapKVSMagic.data(), s_mmapKVSMagic.size());
+  for (const auto value : {static_cast<uint64_t>(d_entries.size()), slotsCount, hashIndexOffset, sortedIndexOffset, recordsOffset, totalSize, static_cast<uint64_t>(0)}) {
+    appendLE(buffer, value, sizeof(uint64_t));
+  }
+  writeAll(buffer);
+
+  /* flush the indexes and records in reasonably-sized chunks */
+  static constexpr size_t chunkSize = 65536;
+  buffer.clear();
+  auto flushIfNeeded = [&buffer, &writeAll](bool force) {
+    if (buffer.size() >= chunkSize || (force && !buffer.empty())) {
+      writeAll(buffer);
+      buffer.clear();
+    }
+  };
+  for (const auto slot : hashIndex) {
+    appendLE(buffer, slot, sizeof(uint64_t));
+    flushIfNeeded(false);
+  }
+  for (const auto record : sortedIndex) {
+    appendLE(buffer, record, sizeof(uint64_t));
+    flushIfNeeded(false);
+  }
+  for (const auto& entry : d_entries) {
+    appendLE(buffer, entry.first.size(), sizeof(uint32_t));
+    appendLE(buffer, entry.second.size(), sizeof(uint32_t));
+    buffer.append(entry.first);
+    buffer.append(entry.second);
+    flushIfNeeded(false);
+  }
+  flushIfNeeded(true);
+}
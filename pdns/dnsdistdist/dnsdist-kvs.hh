@@ -21,6 +21,8 @@
  */
 #pragma once
 
+#include <sys/stat.h>
+
 #include "dnsdist.hh"
 
 class KeyValueLookupKey
@@ -157,7 +159,7 @@ public:
   // there is a key for the last element of the range (2001:0db8:ffff:ffff:ffff:ffff:ffff:ffff, in network byte order, for 2001:db8::/32)
   // which contains the first element of the range (2001:0db8:0000:0000:0000:0000:0000:0000, in network bytes order) followed by any data in the value
   // AND there is no overlapping ranges in the database !!
-  // This requires that the underlying store supports ordered keys, which is true for LMDB but not for CDB, for example.
+  // This requires that the underlying store supports ordered keys, which is true for LMDB and MMapKVStore but not for CDB, for example.
   virtual bool getRangeValue(const std::string& key, std::string& value)
   {
     (void)key;
@@ -220,4 +222,67 @@ private:
   std::atomic_flag d_refreshing;
 };
 
-#endif /* HAVE_LMDB */
+#endif /* HAVE_CDB */
+
+/* A read-only store backed by an immutable, memory-mapped file built by MMapKVStoreWriter.
+   The file contains a pre-computed hash index for exact lookups and a sorted index for range-based ones,
+   so lookups do not need any lock: a new version of the file is mapped on reload then atomically swapped
+   with the current one, which is unmapped once the last lookup using it is done.
+   The format, all integers being stored in little-endian:
+   - a 64-byte header: the "DDKVSv01" magic, then the number of entries, the number of slots in the hash index
+     (a power of two), the offset of the hash index, the offset of the sorted index, the offset of the records,
+     the total size of the file, all of them as 64-bit integers, then 8 reserved bytes ;
+   - the hash index, one 64-bit record offset per slot, 0 meaning an empty slot. The slot of a key is the
+     64-bit FNV-1a hash of the key modulo the number of slots, with linear probing on collisions ;
+   - the sorted index, one 64-bit record offset per entry, ordered by the binary value of the keys ;
+   - the records: a 32-bit key length, a 32-bit value length, then the key and the value.
+*/
+class MMapKVStore : public KeyValueStore
+{
+public:
+  MMapKVStore(const std::string& fname, time_t refreshDelay);
+  ~MMapKVStore() override;
+  MMapKVStore(const MMapKVStore&) = delete;
+  MMapKVStore(MMapKVStore&&) = delete;
+  MMapKVStore& operator=(const MMapKVStore&) = delete;
+  MMapKVStore& operator=(MMapKVStore&&) = delete;
+
+  bool keyExists(const std::string& key) override;
+  bool getValue(const std::string& key, std::string& value) override;
+  bool getRangeValue(const std::string& key, std::string& value) override;
+  bool reload() override;
+
+  class MappedDatabase;
+
+private:
+  struct FileState
+  {
+    time_t d_mtime{0};
+    ino_t d_inode{0};
+    off_t d_size{0};
+  };
+
+  void refreshDBIfNeeded(time_t now);
+  void reload(FileState& state);
+
+  std::shared_ptr<const MappedDatabase> d_db{nullptr};
+  std::string d_fname;
+  /* only used when reloading, never on the lookup path */
+  LockGuarded<FileState> d_fileState;
+  std::atomic<time_t> d_nextCheck{0};
+  time_t d_refreshDelay{0};
+};
+
+/* Builds a database that can be used with MMapKVStore. The entries are kept in memory until write() is called */
+class MMapKVStoreWriter
+{
+public:
+  /* returns false if the key or the value is too large */
+  bool addEntry(std::string key, std::string value);
+  /* writes the whole database to the file descriptor, which is not closed.
+     Throws if the same key has been added more than once, or on I/O error */
+  void write(int fd);
+
+private:
+  std::vector<std::pair<std::string, std::string>> d_entries;
+};
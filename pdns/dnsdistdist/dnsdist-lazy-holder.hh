@@ -0,0 +1,93 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "lock.hh"
+
+namespace dnsdist
+{
+/*
+  Keeps an immutable object that is built the first time it is needed, by whichever
+  thread needs it first, and that can then be accessed without taking any lock.
+  Copying or moving the holder does not carry the object over: holders are meant to
+  be members of the runtime configuration, which is only copied to be modified.
+  reset() must not be called while another thread might still be using the object.
+*/
+template <typename T>
+class LazyHolder
+{
+public:
+  LazyHolder() = default;
+  LazyHolder(const LazyHolder& /* rhs */)
+  {
+  }
+  LazyHolder(LazyHolder&& /* rhs */) noexcept
+  {
+  }
+  LazyHolder& operator=(const LazyHolder& rhs)
+  {
+    if (this != &rhs) {
+      reset();
+    }
+    return *this;
+  }
+  LazyHolder& operator=(LazyHolder&& rhs) noexcept
+  {
+    if (this != &rhs) {
+      reset();
+    }
+    return *this;
+  }
+  ~LazyHolder() = default;
+
+  /* factory() should return a std::shared_ptr<const T> */
+  template <typename Factory>
+  const T& get(Factory&& factory) const
+  {
+    const auto* object = d_object.load(std::memory_order_acquire);
+    if (object != nullptr) {
+      return *object;
+    }
+
+    auto owner = d_owner.lock();
+    if (!*owner) {
+      *owner = factory();
+      d_object.store(owner->get(), std::memory_order_release);
+    }
+    return **owner;
+  }
+
+  void reset() noexcept
+  {
+    auto owner = d_owner.lock();
+    d_object.store(nullptr, std::memory_order_release);
+    owner->reset();
+  }
+
+private:
+  mutable LockGuarded<std::shared_ptr<const T>> d_owner;
+  mutable std::atomic<const T*> d_object{nullptr};
+};
+}
@@ -80,6 +80,61 @@ std::optional<ServerPolicy::SelectedServerPosition> leastOutstanding(const Serve
   return getLeastOutstanding(servers);
 }
 
+static double getPeakEWMACost(const DownstreamState& server, const struct timespec& now)
+{
+  /* the +1 make sure that a server without any latency sample or outstanding query
+     is still compared on the other metric */
+  return (server.getPeakLatencyUsec(now) + 1.0) * static_cast<double>(server.outstanding.load() + 1);
+}
+
+// pick two servers at random and keep the one with the lowest peak latency times outstanding queries,
+// so that only the counters of these two servers are read instead of those of the whole pool
+std::optional<ServerPolicy::SelectedServerPosition> peakEWMA(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion)
+{
+  if (servers.size() <= 1) {
+    return leastOutstanding(servers, dnsQuestion);
+  }
+
+  const auto firstIdx = dns_random(servers.size());
+  auto secondIdx = dns_random(servers.size() - 1);
+  if (secondIdx >= firstIdx) {
+    ++secondIdx;
+  }
+
+  const auto& first = servers.at(firstIdx);
+  const auto& second = servers.at(secondIdx);
+  const bool firstUp = first.second->isUp();
+  const bool secondUp = second.second->isUp();
+  if (!firstUp && !secondUp) {
+    /* we need to look at the whole pool to find a server that is up, if any */
+    return getLeastOutstanding(servers);
+  }
+  if (!secondUp) {
+    return first.first;
+  }
+  if (!firstUp) {
+    return second.first;
+  }
+
+  struct timespec now{};
+  if (dnsQuestion != nullptr) {
+    now = dnsQuestion->getQueryRealTime();
+  }
+  else {
+    gettime(&now, true);
+  }
+
+  const auto firstCost = getPeakEWMACost(*first.second, now);
+  const auto secondCost = getPeakEWMACost(*second.second, now);
+  if (firstCost != secondCost) {
+    return firstCost < secondCost ? first.first : second.first;
+  }
+  if (first.second->d_config.order != second.second->d_config.order) {
+    return first.second->d_config.order < second.second->d_config.order ? first.first : second.first;
+  }
+  return std::min(first.first, second.first);
+}
+
 std::optional<ServerPolicy::SelectedServerPosition> firstAvailable(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion)
 {
   for (const auto& server : servers) {
@@ -172,15 +227,9 @@ std::optional<ServerPolicy::SelectedServerPosition> whashed(const ServerPolicy::
   return whashedFromHash(servers, dnsQuestion->ids.qname.hash(hashPerturbation));
 }
 
-std::optional<ServerPolicy::SelectedServerPosition> chashedFromHash(const ServerPolicy::NumberedServerVector& servers, size_t qhash)
+static double getConsistentHashTargetLoad(const ServerPolicy::NumberedServerVector& servers, double consistentHashBalancingFactor)
 {
-  unsigned int sel = std::numeric_limits<unsigned int>::max();
-  unsigned int min = std::numeric_limits<unsigned int>::max();
-  std::optional<ServerPolicy::SelectedServerPosition> ret;
-  std::optional<ServerPolicy::SelectedServerPosition> first;
-
   double targetLoad = std::numeric_limits<double>::max();
-  const auto consistentHashBalancingFactor = dnsdist::configuration::getImmutableConfiguration().d_consistentHashBalancingFactor;
   if (consistentHashBalancingFactor > 0) {
     /* we start with one, representing the query we are currently handling */
     double currentLoad = 1;
@@ -196,9 +245,26 @@ std::optional<ServerPolicy::SelectedServerPosition> chashedFromHash(const Server
       targetLoad = (currentLoad / static_cast<double>(totalWeight)) * consistentHashBalancingFactor;
     }
   }
+  return targetLoad;
+}
+
+static bool isConsistentHashCandidate(const DownstreamState& server, double consistentHashBalancingFactor, double targetLoad)
+{
+  return server.isUp() && (consistentHashBalancingFactor == 0 || static_cast<double>(server.outstanding.load()) <= (targetLoad * server.d_config.d_weight));
+}
+
+std::optional<ServerPolicy::SelectedServerPosition> chashedFromHash(const ServerPolicy::NumberedServerVector& servers, size_t qhash)
+{
+  unsigned int sel = std::numeric_limits<unsigned int>::max();
+  unsigned int min = std::numeric_limits<unsigned int>::max();
+  std::optional<ServerPolicy::SelectedServerPosition> ret;
+  std::optional<ServerPolicy::SelectedServerPosition> first;
+
+  const auto consistentHashBalancingFactor = dnsdist::configuration::getImmutableConfiguration().d_consistentHashBalancingFactor;
+  const double targetLoad = getConsistentHashTargetLoad(servers, consistentHashBalancingFactor);
 
   for (const auto& serverPair: servers) {
-    if (serverPair.second->isUp() && (consistentHashBalancingFactor == 0 || static_cast<double>(serverPair.second->outstanding.load()) <= (targetLoad * serverPair.second->d_config.d_weight))) {
+    if (isConsistentHashCandidate(*serverPair.second, consistentHashBalancingFactor, targetLoad)) {
       // make sure hashes have been computed
       if (!serverPair.second->hashesComputed) {
         serverPair.second->hash();
@@ -232,6 +298,85 @@ std::optional<ServerPolicy::SelectedServerPosition> chashedFromHash(const Server
   return std::nullopt;
 }
 
+std::optional<ServerPolicy::SelectedServerPosition> chashedFromPoolHash(const ServerPool& pool, size_t qhash)
+{
+  const auto& servers = pool.getServers();
+  const auto& ring = pool.getHashRing();
+  if (ring.isStale()) {
+    /* the weight of a server has been changed, until the pool is updated */
+    return chashedFromHash(servers, qhash);
+  }
+  return ring.select(servers, qhash);
+}
+
+std::optional<ServerPolicy::SelectedServerPosition> chashedFromPool(const ServerPool& pool, const DNSQuestion* dnsQuestion)
+{
+  const auto hashPerturbation = dnsdist::configuration::getImmutableConfiguration().d_hashPerturbation;
+  return chashedFromPoolHash(pool, dnsQuestion->ids.qname.hash(hashPerturbation));
+}
+
+namespace dnsdist::lbpolicies
+{
+ConsistentHashRing::ConsistentHashRing(const ServerPolicy::NumberedServerVector& servers) :
+  d_generation(DownstreamState::s_hashesGeneration.load())
+{
+  size_t total = 0;
+  for (const auto& serverPair : servers) {
+    // make sure hashes have been computed
+    if (!serverPair.second->hashesComputed) {
+      serverPair.second->hash();
+    }
+    total += serverPair.second->hashes.read_lock()->size();
+  }
+
+  d_points.reserve(total);
+  for (size_t index = 0; index < servers.size(); index++) {
+    auto hashes = servers.at(index).second->hashes.read_lock();
+    for (const auto hash : *hashes) {
+      d_points.push_back({hash, static_cast<uint32_t>(index)});
+    }
+  }
+
+  /* on a tie, the server coming first in the pool wins, as in chashedFromHash() */
+  std::sort(d_points.begin(), d_points.end(), [](const Point& lhs, const Point& rhs) {
+    return std::tie(lhs.d_hash, lhs.d_index) < std::tie(rhs.d_hash, rhs.d_index);
+  });
+}
+
+bool ConsistentHashRing::isStale() const
+{
+  return d_generation != DownstreamState::s_hashesGeneration.load(std::memory_order_relaxed);
+}
+
+std::optional<ServerPolicy::SelectedServerPosition> ConsistentHashRing::select(const ServerPolicy::NumberedServerVector& servers, size_t qhash) const
+{
+  if (d_points.empty()) {
+    return std::nullopt;
+  }
+
+  const auto consistentHashBalancingFactor = dnsdist::configuration::getImmutableConfiguration().d_consistentHashBalancingFactor;
+  const double targetLoad = getConsistentHashTargetLoad(servers, consistentHashBalancingFactor);
+
+  auto start = static_cast<size_t>(std::lower_bound(d_points.begin(), d_points.end(), qhash, [](const Point& point, size_t hash) { return point.d_hash < hash; }) - d_points.begin());
+  /* walk the ring from the first point after the hash of the query, wrapping around, until we find
+     a server that is usable. If we have to skip too many points, most servers are likely not usable
+     so it is faster to look at each server once */
+  const auto maxSkipped = std::min(d_points.size(), std::max(servers.size(), static_cast<size_t>(16)));
+  for (size_t skipped = 0; skipped < maxSkipped; skipped++) {
+    const auto& point = d_points.at((start + skipped) % d_points.size());
+    const auto& serverPair = servers.at(point.d_index);
+    if (isConsistentHashCandidate(*serverPair.second, consistentHashBalancingFactor, targetLoad)) {
+      return serverPair.first;
+    }
+  }
+
+  if (maxSkipped == d_points.size()) {
+    return std::nullopt;
+  }
+  return chashedFromHash(servers, qhash);
+}
+}
+
 std::optional<ServerPolicy::SelectedServerPosition> chashed(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion)
 {
   const auto hashPerturbation = dnsdist::configuration::getImmutableConfiguration().d_hashPerturbation;
@@ -428,6 +573,16 @@ const ServerPolicy::ffipolicyfunc_t& ServerPolicy::getPerThreadPolicy() const
 }
 
 ServerPolicy::SelectedBackend ServerPolicy::getSelectedBackend(const ServerPolicy::NumberedServerVector& servers, DNSQuestion& dnsQuestion) const
+{
+  return getSelectedBackend(servers, nullptr, dnsQuestion);
+}
+
+ServerPolicy::SelectedBackend ServerPolicy::getSelectedBackend(const ServerPool& pool, DNSQuestion& dnsQuestion) const
+{
+  return getSelectedBackend(pool.getServers(), &pool, dnsQuestion);
+}
+
+ServerPolicy::SelectedBackend ServerPolicy::getSelectedBackend(const ServerPolicy::NumberedServerVector& servers, const ServerPool* pool, DNSQuestion& dnsQuestion) const
 {
   ServerPolicy::SelectedBackend result{servers};
 
@@ -445,7 +600,7 @@ ServerPolicy::SelectedBackend ServerPolicy::getSelectedBackend(const ServerPolic
     }
 
     dnsdist_ffi_dnsquestion_t dnsq(&dnsQuestion);
-    dnsdist_ffi_servers_list_t serversList(servers);
+    dnsdist_ffi_servers_list_t serversList(servers, pool);
     ServerPolicy::SelectedServerPosition selected = 0;
 
     if (!d_isPerThread) {
@@ -466,7 +621,7 @@ ServerPolicy::SelectedBackend ServerPolicy::getSelectedBackend(const ServerPolic
     return result;
   }
 
-  auto position = d_policy(servers, &dnsQuestion);
+  auto position = (pool != nullptr && d_poolPolicy) ? d_poolPolicy(*pool, &dnsQuestion) : d_policy(servers, &dnsQuestion);
   if (position && *position > 0 && *position <= servers.size()) {
     result.setSelected(*position - 1);
   }
@@ -483,9 +638,10 @@ const std::vector<std::shared_ptr<ServerPolicy>>& getBuiltInPolicies()
     std::make_shared<ServerPolicy>("roundrobin", roundrobin, false),
     std::make_shared<ServerPolicy>("wrandom", wrandom, false),
     std::make_shared<ServerPolicy>("whashed", whashed, false),
-    std::make_shared<ServerPolicy>("chashed", chashed, false),
+    std::make_shared<ServerPolicy>("chashed", chashed, chashedFromPool),
     std::make_shared<ServerPolicy>("orderedWrandUntag", orderedWrandUntag, false),
-    std::make_shared<ServerPolicy>("leastOutstanding", leastOutstanding, false)};
+    std::make_shared<ServerPolicy>("leastOutstanding", leastOutstanding, false),
+    std::make_shared<ServerPolicy>("peakEWMA", peakEWMA, false)};
   return s_policies;
 }
 }
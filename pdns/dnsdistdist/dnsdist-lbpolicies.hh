@@ -30,6 +30,7 @@ struct dnsdist_ffi_dnsquestion_t;
 
 struct DNSQuestion;
 struct DownstreamState;
+struct ServerPool;
 
 struct PerThreadPoliciesState;
 
@@ -45,12 +46,19 @@ public:
   using NumberedServerVector = NumberedVector<std::shared_ptr<DownstreamState>>;
   using policyfunc_t = std::function<std::optional<SelectedServerPosition>(const NumberedServerVector& servers, const DNSQuestion*)>;
   using ffipolicyfunc_t = std::function<SelectedServerPosition(dnsdist_ffi_servers_list_t* servers, dnsdist_ffi_dnsquestion_t* dq)>;
+  using poolpolicyfunc_t = std::function<std::optional<SelectedServerPosition>(const ServerPool& pool, const DNSQuestion*)>;
 
   ServerPolicy(const std::string& name_, policyfunc_t policy_, bool isLua_) :
     d_name(name_), d_policy(std::move(policy_)), d_isLua(isLua_)
   {
   }
 
+  /* a policy that can also use the state kept by the pool, when selecting a server from a pool */
+  ServerPolicy(const std::string& name_, policyfunc_t policy_, poolpolicyfunc_t poolPolicy_) :
+    d_name(name_), d_policy(std::move(policy_)), d_poolPolicy(std::move(poolPolicy_))
+  {
+  }
+
   ServerPolicy(const std::string& name_, ffipolicyfunc_t policy_) :
     d_name(name_), d_ffipolicy(std::move(policy_)), d_isLua(true), d_isFFI(true)
   {
@@ -100,6 +108,7 @@ public:
   };
 
   SelectedBackend getSelectedBackend(const ServerPolicy::NumberedServerVector& servers, DNSQuestion& dnsQuestion) const;
+  SelectedBackend getSelectedBackend(const ServerPool& pool, DNSQuestion& dnsQuestion) const;
 
   const std::string& getName() const
   {
@@ -114,6 +123,7 @@ public:
 private:
   struct PerThreadState;
 
+  SelectedBackend getSelectedBackend(const ServerPolicy::NumberedServerVector& servers, const ServerPool* pool, DNSQuestion& dnsQuestion) const;
   const ffipolicyfunc_t& getPerThreadPolicy() const;
   static thread_local std::unique_ptr<PerThreadState> t_perThreadState;
 
@@ -123,14 +133,13 @@ public:
 
   policyfunc_t d_policy;
   ffipolicyfunc_t d_ffipolicy;
+  poolpolicyfunc_t d_poolPolicy;
 
   bool d_isLua{false};
   bool d_isFFI{false};
   bool d_isPerThread{false};
 };
 
-struct ServerPool;
-
 using pools_t = std::map<std::string, std::shared_ptr<ServerPool>>;
 const ServerPool& getPool(const std::string& poolName);
 const ServerPool& createPoolIfNotExists(const std::string& poolName);
@@ -142,11 +151,14 @@ const ServerPolicy::NumberedServerVector& getDownstreamCandidates(const std::str
 
 std::optional<ServerPolicy::SelectedServerPosition> firstAvailable(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
 std::optional<ServerPolicy::SelectedServerPosition> leastOutstanding(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
+std::optional<ServerPolicy::SelectedServerPosition> peakEWMA(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
 std::optional<ServerPolicy::SelectedServerPosition> wrandom(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
 std::optional<ServerPolicy::SelectedServerPosition> whashed(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
 std::optional<ServerPolicy::SelectedServerPosition> whashedFromHash(const ServerPolicy::NumberedServerVector& servers, size_t hash);
 std::optional<ServerPolicy::SelectedServerPosition> chashed(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
 std::optional<ServerPolicy::SelectedServerPosition> chashedFromHash(const ServerPolicy::NumberedServerVector& servers, size_t hash);
+std::optional<ServerPolicy::SelectedServerPosition> chashedFromPool(const ServerPool& pool, const DNSQuestion* dnsQuestion);
+std::optional<ServerPolicy::SelectedServerPosition> chashedFromPoolHash(const ServerPool& pool, size_t hash);
 std::optional<ServerPolicy::SelectedServerPosition> roundrobin(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
 std::optional<ServerPolicy::SelectedServerPosition> orderedWrandUntag(const ServerPolicy::NumberedServerVector& servers, const DNSQuestion* dnsQuestion);
 
@@ -155,4 +167,37 @@ std::optional<ServerPolicy::SelectedServerPosition> orderedWrandUntag(const Serv
 namespace dnsdist::lbpolicies
 {
 const std::vector<std::shared_ptr<ServerPolicy>>& getBuiltInPolicies();
+
+/*
+  The points of all the servers of a pool on the consistent hashing ring, merged
+  and sorted, so that the chashed policy only needs a single lookup instead of one
+  per server, and no lock. It is immutable: a new one has to be built when the pool
+  membership changes, and it becomes stale when the hashes of a server are updated.
+*/
+class ConsistentHashRing
+{
+public:
+  ConsistentHashRing(const ServerPolicy::NumberedServerVector& servers);
+
+  /* returns the same server than chashedFromHash() would, 'servers' has to be the
+     vector the ring has been built from */
+  [[nodiscard]] std::optional<ServerPolicy::SelectedServerPosition> select(const ServerPolicy::NumberedServerVector& servers, size_t qhash) const;
+  /* whether the hashes of any server have been updated since the ring was built */
+  [[nodiscard]] bool isStale() const;
+
+  [[nodiscard]] size_t size() const
+  {
+    return d_points.size();
+  }
+
+private:
+  struct Point
+  {
+    unsigned int d_hash;
+    uint32_t d_index;
+  };
+
+  std::vector<Point> d_points;
+  uint64_t d_generation{0};
+};
 }
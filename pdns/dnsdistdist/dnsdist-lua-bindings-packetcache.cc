@@ -31,7 +31,7 @@
 void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
 {
   /* PacketCache */
-  luaCtx.writeFunction("newPacketCache", [client](size_t maxEntries, std::optional<LuaAssociativeTable<boost::variant<bool, size_t, LuaArray<uint16_t>>>> vars) {
+  luaCtx.writeFunction("newPacketCache", [client](size_t maxEntries, std::optional<LuaAssociativeTable<boost::variant<bool, size_t, std::string, LuaArray<uint16_t>>>> vars) {
 
     DNSDistPacketCache::CacheSettings settings {
       .d_maxEntries = maxEntries,
@@ -42,26 +42,42 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
     LuaArray<uint16_t> payloadRanks;
     std::unordered_set<uint16_t> ranks;
     size_t maximumEntrySize{4096};
+    std::string evictionPolicy;
 
+    getOptionalValue<size_t>(vars, "coalescingTimeout", settings.d_coalescingTimeout);
     getOptionalValue<bool>(vars, "deferrableInsertLock", settings.d_deferrableInsertLock);
     getOptionalValue<bool>(vars, "dontAge", settings.d_dontAge);
     getOptionalValue<bool>(vars, "keepStaleData", settings.d_keepStaleData);
+    getOptionalValue<bool>(vars, "lockFreeLookups", settings.d_lockFreeLookups);
     getOptionalValue<bool>(vars, "shuffle", settings.d_shuffle);
     getOptionalValue<size_t>(vars, "maxNegativeTTL", settings.d_maxNegativeTTL);
     getOptionalValue<size_t>(vars, "maxTTL", settings.d_maxTTL);
     getOptionalValue<size_t>(vars, "minTTL", settings.d_minTTL);
     getOptionalValue<size_t>(vars, "numberOfShards", settings.d_shardCount);
     getOptionalValue<bool>(vars, "parseECS", settings.d_parseECS);
+    getOptionalValue<size_t>(vars, "prefetchPercentage", settings.d_prefetchPercentage);
     getOptionalValue<size_t>(vars, "staleTTL", settings.d_staleTTL);
     getOptionalValue<size_t>(vars, "temporaryFailureTTL", settings.d_tempFailureTTL);
     getOptionalValue<size_t>(vars, "truncatedTTL", settings.d_truncatedTTL);
     getOptionalValue<bool>(vars, "cookieHashing", cookieHashing);
     getOptionalValue<size_t>(vars, "maximumEntrySize", maximumEntrySize);
+    getOptionalValue<std::string>(vars, "evictionPolicy", evictionPolicy);
+    getOptionalValue<std::string>(vars, "snapshotFile", settings.d_snapshotFile);
+    getOptionalValue<size_t>(vars, "snapshotInterval", settings.d_snapshotInterval);
 
     if (maximumEntrySize >= sizeof(dnsheader)) {
       settings.d_maximumEntrySize = maximumEntrySize;
     }
 
+    if (!evictionPolicy.empty()) {
+      if (auto policy = dnsdist::getEvictionPolicyFromString(evictionPolicy)) {
+        settings.d_evictionPolicy = *policy;
+      }
+      else {
+        warnlog("Ignoring unknown value '%s' for 'evictionPolicy' on 'newPacketCache'", evictionPolicy);
+      }
+    }
+
     if (getOptionalValue<decltype(skipOptions)>(vars, "skipOptions", skipOptions) > 0) {
       settings.d_optionsToSkip.clear();
       settings.d_optionsToSkip.insert(EDNSOptionCode::COOKIE);
@@ -157,6 +173,12 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
         g_outputBuffer+="Insert Collisions: " + std::to_string(cache->getInsertCollisions()) + "\n";
         g_outputBuffer+="TTL Too Shorts: " + std::to_string(cache->getTTLTooShorts()) + "\n";
         g_outputBuffer+="Cleanup Count: " + std::to_string(cache->getCleanupCount()) + "\n";
+        g_outputBuffer+="Memory Allocated: " + std::to_string(cache->getMemoryAllocated()) + "\n";
+        g_outputBuffer+="Memory Used: " + std::to_string(cache->getMemoryUsed()) + "\n";
+        g_outputBuffer+="Eviction Policy: " + dnsdist::getEvictionPolicyName(cache->getEvictionPolicy()) + "\n";
+        g_outputBuffer+="Evictions: " + std::to_string(cache->getEvictions()) + "\n";
+        g_outputBuffer+="Prefetches: " + std::to_string(cache->getPrefetches()) + "\n";
+        g_outputBuffer+="Coalesced Queries: " + std::to_string(cache->getCoalescedQueries()) + "\n";
       }
     });
   luaCtx.registerFunction<LuaAssociativeTable<uint64_t>(std::shared_ptr<DNSDistPacketCache>::*)()const>("getStats", [](const std::shared_ptr<DNSDistPacketCache>& cache) {
@@ -172,6 +194,11 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
         stats["insertCollisions"] = cache->getInsertCollisions();
         stats["ttlTooShorts"] = cache->getTTLTooShorts();
         stats["cleanupCount"] = cache->getCleanupCount();
+        stats["memoryAllocated"] = cache->getMemoryAllocated();
+        stats["memoryUsed"] = cache->getMemoryUsed();
+        stats["evictions"] = cache->getEvictions();
+        stats["prefetches"] = cache->getPrefetches();
+        stats["coalescedQueries"] = cache->getCoalescedQueries();
       }
       return stats;
     });
@@ -231,5 +258,38 @@ void setupLuaBindingsPacketCache(LuaContext& luaCtx, bool client)
         g_outputBuffer += "Dumped " + std::to_string(records) + " records\n";
       }
     });
+
+  luaCtx.registerFunction<void(std::shared_ptr<DNSDistPacketCache>::*)(std::optional<std::string> fname)>("saveSnapshot", [](std::shared_ptr<DNSDistPacketCache>& cache, std::optional<std::string> fname) {
+      if (!cache) {
+        return;
+      }
+      const auto& fileName = fname ? *fname : cache->getSnapshotFile();
+      if (fileName.empty()) {
+        g_outputBuffer = "No snapshot file set for this cache\n";
+        return;
+      }
+      try {
+        g_outputBuffer += "Saved " + std::to_string(cache->saveSnapshot(fileName)) + " entries\n";
+      }
+      catch (const std::exception& e) {
+        g_outputBuffer = "Error saving the packet cache snapshot: " + std::string(e.what()) + "\n";
+      }
+    });
+  luaCtx.registerFunction<void(std::shared_ptr<DNSDistPacketCache>::*)(std::optional<std::string> fname)>("loadSnapshot", [](std::shared_ptr<DNSDistPacketCache>& cache, std::optional<std::string> fname) {
+      if (!cache) {
+        return;
+      }
+      const auto& fileName = fname ? *fname : cache->getSnapshotFile();
+      if (fileName.empty()) {
+        g_outputBuffer = "No snapshot file set for this cache\n";
+        return;
+      }
+      try {
+        g_outputBuffer += "Loaded " + std::to_string(cache->loadSnapshot(fileName)) + " entries\n";
+      }
+      catch (const std::exception& e) {
+        g_outputBuffer = "Error loading the packet cache snapshot: " + std::string(e.what()) + "\n";
+      }
+    });
 #endif /* DISABLE_PACKETCACHE_BINDINGS */
 }
@@ -67,20 +67,12 @@ void setupLuaBindingsRings(LuaContext& luaCtx, bool client)
       return results;
     }
 
-    for (const auto& shard : g_rings.d_shards) {
-      {
-        auto ql = shard->queryRing.lock();
-        for (const auto& entry : *ql) {
-          addRingEntryToList(results, entry);
-        }
-      }
-      {
-        auto rl = shard->respRing.lock();
-        for (const auto& entry : *rl) {
-          addRingEntryToList(results, entry);
-        }
-      }
-    }
+    g_rings.forEachQuery([&results](const Rings::Query& entry) {
+      addRingEntryToList(results, entry);
+    });
+    g_rings.forEachResponse([&results](const Rings::Response& entry) {
+      addRingEntryToList(results, entry);
+    });
 
     return results;
   });
@@ -342,6 +342,10 @@ void setupLuaBindings(LuaContext& luaCtx, bool client, bool configCheck)
     [](std::shared_ptr<DownstreamState>& state, int newWeight) {
       if (state) {
         state->setWeight(newWeight);
+        if (state->hashesComputed) {
+          /* the pools get a new consistent hashing ring when they are copied */
+          dnsdist::configuration::updateRuntimeConfiguration([](dnsdist::configuration::RuntimeConfiguration&) {});
+        }
       }
     });
   luaCtx.registerMember<int(std::shared_ptr<DownstreamState>::*)>(
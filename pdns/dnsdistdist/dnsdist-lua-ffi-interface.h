@@ -49,6 +49,11 @@ typedef struct dnsdist_ffi_raw_value {
   uint16_t size;
 } dnsdist_ffi_raw_value_t;
 
+typedef struct dnsdist_ffi_async_query_id {
+  uint16_t asyncID;
+  uint16_t queryID;
+} dnsdist_ffi_async_query_id_t;
+
 typedef enum {
  dnsdist_ffi_protocol_type_doudp = 0,
  dnsdist_ffi_protocol_type_dotcp = 1,
@@ -172,6 +177,8 @@ bool dnsdist_ffi_dnsquestion_set_async(dnsdist_ffi_dnsquestion_t* dq, uint16_t a
 bool dnsdist_ffi_dnsresponse_set_async(dnsdist_ffi_dnsquestion_t* dq, uint16_t asyncID, uint16_t queryID, uint32_t timeoutMs) __attribute__ ((visibility ("default")));
 
 bool dnsdist_ffi_resume_from_async(uint16_t asyncID, uint16_t queryID, const char* tag, size_t tagSize, const char* tagValue, size_t tagValueSize, bool useCache) __attribute__ ((visibility ("default")));
+/* resume several queries at once, returns the number of queries that were found and resumed */
+size_t dnsdist_ffi_resume_many_from_async(const dnsdist_ffi_async_query_id_t* ids, size_t idsCount, bool useCache) __attribute__ ((visibility ("default")));
 bool dnsdist_ffi_drop_from_async(uint16_t asyncID, uint16_t queryID) __attribute__ ((visibility ("default")));
 bool dnsdist_ffi_set_answer_from_async(uint16_t asyncID, uint16_t queryID, const char* raw, size_t rawSize) __attribute__ ((visibility ("default")));
 bool dnsdist_ffi_set_rcode_from_async(uint16_t asyncID, uint16_t queryID, uint8_t rcode, bool clearAnswers) __attribute__ ((visibility ("default")));
@@ -746,7 +746,7 @@ void dnsdist_ffi_servers_list_get_server(const dnsdist_ffi_servers_list_t* list,
 size_t dnsdist_ffi_servers_list_chashed(const dnsdist_ffi_servers_list_t* list, const dnsdist_ffi_dnsquestion_t* dq, size_t hash)
 {
   (void)dq;
-  auto serverPosition = chashedFromHash(list->servers, hash);
+  auto serverPosition = list->pool != nullptr ? chashedFromPoolHash(*list->pool, hash) : chashedFromHash(list->servers, hash);
   if (!serverPosition) {
     throw std::runtime_error("Unable to find servers in server list");
   }
@@ -927,6 +927,38 @@ bool dnsdist_ffi_resume_from_async(uint16_t asyncID, uint16_t queryID, const cha
   return dnsdist::queueQueryResumptionEvent(std::move(query));
 }
 
+size_t dnsdist_ffi_resume_many_from_async(const dnsdist_ffi_async_query_id_t* ids, size_t idsCount, bool useCache)
+{
+  if (!dnsdist::g_asyncHolder) {
+    vinfolog("Unable to resume, no asynchronous holder");
+    return 0;
+  }
+  if (ids == nullptr || idsCount == 0) {
+    return 0;
+  }
+
+  std::vector<std::pair<uint16_t, uint16_t>> toResume;
+  toResume.reserve(idsCount);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic): this is a C API
+  for (const auto* current = ids; current != ids + idsCount; ++current) {
+    toResume.emplace_back(current->asyncID, current->queryID);
+  }
+
+  auto queries = dnsdist::g_asyncHolder->get(toResume);
+  size_t found = 0;
+  for (auto& query : queries) {
+    if (query) {
+      query->query.d_idstate.skipCache = !useCache;
+      ++found;
+    }
+  }
+
+  if (found > 0) {
+    dnsdist::queueQueryResumptionEvents(std::move(queries));
+  }
+  return found;
+}
+
 bool dnsdist_ffi_set_rcode_from_async(uint16_t asyncID, uint16_t queryID, uint8_t rcode, bool clearAnswers)
 {
   if (!dnsdist::g_asyncHolder) {
@@ -1601,20 +1633,12 @@ size_t dnsdist_ffi_ring_get_entries(dnsdist_ffi_ring_entry_list_t** out)
   };
   gettime(&now);
 
-  for (const auto& shard : g_rings.d_shards) {
-    {
-      auto ql = shard->queryRing.lock();
-      for (const auto& entry : *ql) {
-        addRingEntryToList(list, now, entry);
-      }
-    }
-    {
-      auto rl = shard->respRing.lock();
-      for (const auto& entry : *rl) {
-        addRingEntryToList(list, now, entry);
-      }
-    }
-  }
+  g_rings.forEachQuery([&list, &now](const Rings::Query& entry) {
+    addRingEntryToList(list, now, entry);
+  });
+  g_rings.forEachResponse([&list, &now](const Rings::Response& entry) {
+    addRingEntryToList(list, now, entry);
+  });
 
   auto count = list->d_entries.size();
   if (count > 0) {
@@ -1648,28 +1672,20 @@ size_t dnsdist_ffi_ring_get_entries_by_addr(const char* addr, dnsdist_ffi_ring_e
   gettime(&now);
 
   auto compare = ComboAddress::addressOnlyEqual();
-  for (const auto& shard : g_rings.d_shards) {
-    {
-      auto ql = shard->queryRing.lock();
-      for (const auto& entry : *ql) {
-        if (!compare(entry.requestor, ca)) {
-          continue;
-        }
-
-        addRingEntryToList(list, now, entry);
-      }
+  g_rings.forEachQuery([&](const Rings::Query& entry) {
+    if (!compare(entry.requestor, ca)) {
+      return;
     }
-    {
-      auto rl = shard->respRing.lock();
-      for (const auto& entry : *rl) {
-        if (!compare(entry.requestor, ca)) {
-          continue;
-        }
-
-        addRingEntryToList(list, now, entry);
-      }
+
+    addRingEntryToList(list, now, entry);
+  });
+  g_rings.forEachResponse([&](const Rings::Response& entry) {
+    if (!compare(entry.requestor, ca)) {
+      return;
     }
-  }
+
+    addRingEntryToList(list, now, entry);
+  });
 
   auto count = list->d_entries.size();
   if (count > 0) {
@@ -1693,16 +1709,13 @@ size_t dnsdist_ffi_ring_get_entries_by_mac(const char* addr, dnsdist_ffi_ring_en
   };
   gettime(&now);
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto ql = shard->queryRing.lock();
-    for (const auto& entry : *ql) {
-      if (memcmp(addr, entry.macaddress.data(), entry.macaddress.size()) != 0) {
-        continue;
-      }
-
-      addRingEntryToList(list, now, entry);
+  g_rings.forEachQuery([&](const Rings::Query& entry) {
+    if (memcmp(addr, entry.macaddress.data(), entry.macaddress.size()) != 0) {
+      return;
     }
-  }
+
+    addRingEntryToList(list, now, entry);
+  });
 
   auto count = list->d_entries.size();
   if (count > 0) {
@@ -142,8 +142,8 @@ struct LuaContext::Pusher<dnsdist_ffi_servers_list_t*>
 
 struct dnsdist_ffi_servers_list_t
 {
-  dnsdist_ffi_servers_list_t(const ServerPolicy::NumberedServerVector& servers_) :
-    servers(servers_)
+  dnsdist_ffi_servers_list_t(const ServerPolicy::NumberedServerVector& servers_, const ServerPool* pool_ = nullptr) :
+    servers(servers_), pool(pool_)
   {
     ffiServers.reserve(servers.size());
     for (const auto& server : servers) {
@@ -153,6 +153,8 @@ struct dnsdist_ffi_servers_list_t
 
   std::vector<dnsdist_ffi_server_t> ffiServers;
   const ServerPolicy::NumberedServerVector& servers;
+  /* set when the servers are the ones of this pool */
+  const ServerPool* pool{nullptr};
 };
 
 // dnsdist_ffi_network_message_t is a lightuserdata
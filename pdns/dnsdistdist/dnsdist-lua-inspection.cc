@@ -40,32 +40,27 @@ static LuaArray<std::vector<boost::variant<string, double>>> getGenResponses(uin
   setLuaNoSideEffect();
   map<DNSName, unsigned int> counts;
   unsigned int total = 0;
-  {
-    for (const auto& shard : g_rings.d_shards) {
-      auto respRing = shard->respRing.lock();
-      if (!labels) {
-        for (const auto& entry : *respRing) {
-          if (!pred(entry)) {
-            continue;
-          }
-          counts[entry.name]++;
-          total++;
-        }
+  if (!labels) {
+    g_rings.forEachResponse([&](const Rings::Response& entry) {
+      if (!pred(entry)) {
+        return;
       }
-      else {
-        unsigned int lab = *labels;
-        for (const auto& entry : *respRing) {
-          if (!pred(entry)) {
-            continue;
-          }
-
-          DNSName temp(entry.name);
-          temp.trimToLabels(lab);
-          counts[temp]++;
-          total++;
-        }
+      counts[entry.name]++;
+      total++;
+    });
+  }
+  else {
+    unsigned int lab = *labels;
+    g_rings.forEachResponse([&](const Rings::Response& entry) {
+      if (!pred(entry)) {
+        return;
       }
-    }
+
+      DNSName temp(entry.name);
+      temp.trimToLabels(lab);
+      counts[temp]++;
+      total++;
+    });
   }
   //      cout<<"Looked at "<<total<<" responses, "<<counts.size()<<" different ones"<<endl;
   vector<pair<unsigned int, DNSName>> rcounts;
@@ -132,22 +127,18 @@ static void statNodeRespRing(statvisitor_t visitor, uint64_t seconds)
   cutoff.tv_sec -= static_cast<time_t>(seconds);
 
   StatNode root;
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->respRing.lock();
-
-    for (const auto& entry : *respRing) {
-      if (now < entry.when) {
-        continue;
-      }
-
-      if (seconds != 0 && entry.when < cutoff) {
-        continue;
-      }
+  g_rings.forEachResponse([&](const Rings::Response& entry) {
+    if (now < entry.when) {
+      return;
+    }
 
-      const bool hit = entry.isACacheHit();
-      root.submit(entry.name, ((entry.dh.rcode == 0 && entry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : entry.dh.rcode), entry.size, hit, std::nullopt);
+    if (seconds != 0 && entry.when < cutoff) {
+      return;
     }
-  }
+
+    const bool hit = entry.isACacheHit();
+    root.submit(entry.name, ((entry.dh.rcode == 0 && entry.usec == std::numeric_limits<unsigned int>::max()) ? -1 : entry.dh.rcode), entry.size, hit, std::nullopt);
+  });
 
   StatNode::Stat node;
   root.visit([visitor = std::move(visitor)](const StatNode* node_, const StatNode::Stat& self, const StatNode::Stat& children) { visitor(*node_, self, children); }, node);
@@ -158,21 +149,17 @@ static LuaArray<LuaAssociativeTable<std::string>> getRespRing(std::optional<int>
   using entry_t = LuaAssociativeTable<std::string>;
   LuaArray<entry_t> ret;
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->respRing.lock();
-
-    int count = 1;
-    for (const auto& entry : *respRing) {
-      if (rcode && (rcode.value() != entry.dh.rcode)) {
-        continue;
-      }
-      entry_t newEntry;
-      newEntry["qname"] = entry.name.toString();
-      newEntry["rcode"] = std::to_string(entry.dh.rcode);
-      ret.emplace_back(count, std::move(newEntry));
-      count++;
+  int count = 1;
+  g_rings.forEachResponse([&](const Rings::Response& entry) {
+    if (rcode && (rcode.value() != entry.dh.rcode)) {
+      return;
     }
-  }
+    entry_t newEntry;
+    newEntry["qname"] = entry.name.toString();
+    newEntry["rcode"] = std::to_string(entry.dh.rcode);
+    ret.emplace_back(count, std::move(newEntry));
+    count++;
+  });
 
   return ret;
 }
@@ -188,23 +175,19 @@ static counts_t exceedRespGen(unsigned int rate, int seconds, const std::functio
 
   counts.reserve(g_rings.getNumberOfResponseEntries());
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->respRing.lock();
-    for (const auto& entry : *respRing) {
-
-      if (seconds != 0 && entry.when < cutoff) {
-        continue;
-      }
-      if (now < entry.when) {
-        continue;
-      }
+  g_rings.forEachResponse([&](const Rings::Response& entry) {
+    if (seconds != 0 && entry.when < cutoff) {
+      return;
+    }
+    if (now < entry.when) {
+      return;
+    }
 
-      visitor(counts, entry);
-      if (entry.when < mintime) {
-        mintime = entry.when;
-      }
+    visitor(counts, entry);
+    if (entry.when < mintime) {
+      mintime = entry.when;
     }
-  }
+  });
 
   double delta = seconds != 0 ? seconds : DiffTime(now, mintime);
   return filterScore(counts, delta, rate);
@@ -221,21 +204,18 @@ static counts_t exceedQueryGen(unsigned int rate, int seconds, const std::functi
 
   counts.reserve(g_rings.getNumberOfQueryEntries());
 
-  for (const auto& shard : g_rings.d_shards) {
-    auto respRing = shard->queryRing.lock();
-    for (const auto& entry : *respRing) {
-      if (seconds != 0 && entry.when < cutoff) {
-        continue;
-      }
-      if (now < entry.when) {
-        continue;
-      }
-      visitor(counts, entry);
-      if (entry.when < mintime) {
-        mintime = entry.when;
-      }
+  g_rings.forEachQuery([&](const Rings::Query& entry) {
+    if (seconds != 0 && entry.when < cutoff) {
+      return;
     }
-  }
+    if (now < entry.when) {
+      return;
+    }
+    visitor(counts, entry);
+    if (entry.when < mintime) {
+      mintime = entry.when;
+    }
+  });
 
   double delta = seconds != 0 ? seconds : DiffTime(now, mintime);
   return filterScore(counts, delta, rate);
@@ -395,15 +375,10 @@ void setupLuaInspection(LuaContext& luaCtx)
     uint64_t top = top_ ? *top_ : 10U;
     map<ComboAddress, unsigned int, ComboAddress::addressOnlyLessThan> counts;
     unsigned int total = 0;
-    {
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          counts[entry.requestor]++;
-          total++;
-        }
-      }
-    }
+    g_rings.forEachQuery([&counts, &total](const Rings::Query& entry) {
+      counts[entry.requestor]++;
+      total++;
+    });
     vector<pair<unsigned int, ComboAddress>> rcounts;
     rcounts.reserve(counts.size());
     for (const auto& entry : counts) {
@@ -432,25 +407,19 @@ void setupLuaInspection(LuaContext& luaCtx)
     map<DNSName, unsigned int> counts;
     unsigned int total = 0;
     if (!labels) {
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          counts[entry.name]++;
-          total++;
-        }
-      }
+      g_rings.forEachQuery([&counts, &total](const Rings::Query& entry) {
+        counts[entry.name]++;
+        total++;
+      });
     }
     else {
       unsigned int lab = *labels;
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          auto name = entry.name;
-          name.trimToLabels(lab);
-          counts[name]++;
-          total++;
-        }
-      }
+      g_rings.forEachQuery([&counts, &total, lab](const Rings::Query& entry) {
+        auto name = entry.name;
+        name.trimToLabels(lab);
+        counts[name]++;
+        total++;
+      });
     }
 
     vector<pair<unsigned int, DNSName>> rcounts;
@@ -489,27 +458,20 @@ void setupLuaInspection(LuaContext& luaCtx)
 
   luaCtx.writeFunction("getResponseRing", []() {
     setLuaNoSideEffect();
-    size_t totalEntries = 0;
-    std::vector<boost::circular_buffer<Rings::Response>> rings;
-    rings.reserve(g_rings.getNumberOfShards());
-    for (const auto& shard : g_rings.d_shards) {
-      {
-        auto respRing = shard->respRing.lock();
-        rings.push_back(*respRing);
-      }
-      totalEntries += rings.back().size();
-    }
+    std::vector<Rings::Response> responses;
+    responses.reserve(g_rings.getNumberOfResponseEntries());
+    g_rings.forEachResponse([&responses](const Rings::Response& entry) {
+      responses.push_back(entry);
+    });
     vector<std::unordered_map<string, boost::variant<unsigned int, string>>> ret;
-    ret.reserve(totalEntries);
-    for (const auto& ring : rings) {
-      for (const auto& entry : ring) {
-        decltype(ret)::value_type item;
-        item["name"] = entry.name.toString();
-        item["qtype"] = entry.qtype;
-        item["rcode"] = entry.dh.rcode;
-        item["usec"] = entry.usec;
-        ret.push_back(std::move(item));
-      }
+    ret.reserve(responses.size());
+    for (const auto& entry : responses) {
+      decltype(ret)::value_type item;
+      item["name"] = entry.name.toString();
+      item["qtype"] = entry.qtype;
+      item["rcode"] = entry.dh.rcode;
+      item["usec"] = entry.usec;
+      ret.push_back(std::move(item));
     }
     return ret;
   });
@@ -567,20 +529,12 @@ void setupLuaInspection(LuaContext& luaCtx)
     std::vector<Rings::Response> responses;
     queries.reserve(g_rings.getNumberOfQueryEntries());
     responses.reserve(g_rings.getNumberOfResponseEntries());
-    for (const auto& shard : g_rings.d_shards) {
-      {
-        auto respRing = shard->queryRing.lock();
-        for (const auto& entry : *respRing) {
-          queries.push_back(entry);
-        }
-      }
-      {
-        auto respRing = shard->respRing.lock();
-        for (const auto& entry : *respRing) {
-          responses.push_back(entry);
-        }
-      }
-    }
+    g_rings.forEachQuery([&queries](const Rings::Query& entry) {
+      queries.push_back(entry);
+    });
+    g_rings.forEachResponse([&responses](const Rings::Response& entry) {
+      responses.push_back(entry);
+    });
 
     sort(queries.begin(), queries.end(), [](const decltype(queries)::value_type& lhs, const decltype(queries)::value_type& rhs) {
       return rhs.when < lhs.when;
@@ -676,27 +630,22 @@ void setupLuaInspection(LuaContext& luaCtx)
 
     double totlat = 0;
     unsigned int size = 0;
-    {
-      for (const auto& shard : g_rings.d_shards) {
-        auto respRing = shard->respRing.lock();
-        for (const auto& entry : *respRing) {
-          /* skip actively discovered timeouts */
-          if (entry.usec == std::numeric_limits<unsigned int>::max()) {
-            continue;
-          }
-
-          ++size;
-          auto iter = histo.lower_bound(entry.usec);
-          if (iter != histo.end()) {
-            iter->second++;
-          }
-          else {
-            histo.rbegin()++;
-          }
-          totlat += entry.usec;
-        }
+    g_rings.forEachResponse([&](const Rings::Response& entry) {
+      /* skip actively discovered timeouts */
+      if (entry.usec == std::numeric_limits<unsigned int>::max()) {
+        return;
       }
-    }
+
+      ++size;
+      auto iter = histo.lower_bound(entry.usec);
+      if (iter != histo.end()) {
+        iter->second++;
+      }
+      else {
+        histo.rbegin()++;
+      }
+      totlat += entry.usec;
+    });
 
     if (size == 0) {
       g_outputBuffer = "No traffic yet.\n";
@@ -737,6 +686,15 @@ void setupLuaInspection(LuaContext& luaCtx)
     ret << (fmt % g_tcpclientthreads->getThreadsCount() % immutableConfig.d_maxTCPClientThreads % g_tcpclientthreads->getQueuedCount() % immutableConfig.d_maxTCPQueuedConnections) << endl;
     ret << endl;
 
+    ret << "Workers:" << endl;
+    fmt = boost::format("%-3d %-20d %-20d %-20d");
+    ret << (fmt % "#" % "Pending conn" % "Active conn" % "Queued bytes") << endl;
+    for (size_t idx = 0; idx < g_tcpclientthreads->getThreadsCount(); idx++) {
+      const auto& load = g_tcpclientthreads->getWorkerLoad(idx);
+      ret << (fmt % idx % load.d_pendingConnections % load.d_activeConnections % load.d_queuedResponseBytes) << endl;
+    }
+    ret << endl;
+
     ret << "Frontends:" << endl;
     fmt = boost::format("%-3d %-20.20s %-20d %-20d %-20d %-25d %-20d %-20d %-20d %-20f %-20f %-20d %-20d %-25d %-25d %-15d %-15d %-15d %-15d %-15d %-15d");
     ret << (fmt % "#" % "Address" % "Connections" % "Max concurrent conn" % "Died reading query" % "Died sending response" % "Gave up" % "Client timeouts" % "Downstream timeouts" % "Avg queries/conn" % "Avg duration" % "Avg read IOs/conn" % "TLS new sessions" % "TLS Resumptions" % "TLS unknown ticket keys" % "TLS inactive ticket keys" % "TLS 1.0" % "TLS 1.1" % "TLS 1.2" % "TLS 1.3" % "TLS other") << endl;
@@ -678,7 +678,6 @@ void setupLuaSelectors(LuaContext& luaCtx)
     return std::shared_ptr<DNSRule>(dnsdist::selectors::getTagSelector(tag, value, !value));
   });
 
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
   luaCtx.writeFunction("KeyValueStoreLookupRule", [](std::shared_ptr<KeyValueStore>& kvs, std::shared_ptr<KeyValueLookupKey>& lookupKey) {
     return std::shared_ptr<DNSRule>(new KeyValueStoreLookupRule(kvs, lookupKey));
   });
@@ -686,7 +685,6 @@ void setupLuaSelectors(LuaContext& luaCtx)
   luaCtx.writeFunction("KeyValueStoreRangeLookupRule", [](std::shared_ptr<KeyValueStore>& kvs, std::shared_ptr<KeyValueLookupKey>& lookupKey) {
     return std::shared_ptr<DNSRule>(new KeyValueStoreRangeLookupRule(kvs, lookupKey));
   });
-#endif /* defined(HAVE_LMDB) || defined(HAVE_CDB) */
 
 #include "dnsdist-lua-selectors-generated-body.hh"
 }
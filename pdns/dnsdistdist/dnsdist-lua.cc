@@ -785,6 +785,7 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
       if (tcpMaxConcurrentConnections > 0) {
         tcpCS->d_tcpConcurrentConnectionsLimit = tcpMaxConcurrentConnections;
       }
+      getOptionalValue<bool>(vars, "udpSegmentation", udpCS->d_udpSegmentation);
 
 #ifdef HAVE_XSK
       std::shared_ptr<XskSocket> socket;
@@ -845,6 +846,7 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
       if (tcpMaxConcurrentConnections > 0) {
         tcpCS->d_tcpConcurrentConnectionsLimit = tcpMaxConcurrentConnections;
       }
+      getOptionalValue<bool>(vars, "udpSegmentation", udpCS->d_udpSegmentation);
 #ifdef HAVE_XSK
       std::shared_ptr<XskSocket> socket;
       parseXskVars(vars, socket);
@@ -1974,6 +1976,15 @@ static void setupLuaConfig(LuaContext& luaCtx, bool client, bool configCheck)
         if (options.count("recordResponses") > 0) {
           config.d_ringsRecordResponses = boost::get<bool>(options.at("recordResponses"));
         }
+        if (options.count("perThread") > 0) {
+          config.d_ringsPerThread = boost::get<bool>(options.at("perThread"));
+        }
+        if (options.count("slidingWindow") > 0) {
+          config.d_ringsSlidingWindow = boost::get<uint64_t>(options.at("slidingWindow"));
+        }
+        if (options.count("slidingWindowMaxEntries") > 0) {
+          config.d_ringsSlidingWindowMaxEntries = boost::get<uint64_t>(options.at("slidingWindowMaxEntries"));
+        }
       });
     }
     catch (const std::exception& exp) {
@@ -164,6 +164,12 @@ Stats::Stats() :
     {"tcp-query-pipe-full", "", &tcpQueryPipeFull},
     {"tcp-cross-protocol-query-pipe-full", "", &tcpCrossProtocolQueryPipeFull},
     {"tcp-cross-protocol-response-pipe-full", "", &tcpCrossProtocolResponsePipeFull},
+    {"udp-responder-recv-batches", "", &udpResponderRecvBatches},
+    {"udp-responder-recv-batched", "", &udpResponderRecvBatched},
+    {"udp-responder-send-batches", "", &udpResponderSendBatches},
+    {"udp-responder-send-batched", "", &udpResponderSendBatched},
+    {"udp-gro-segments", "", &udpGROSegments},
+    {"udp-gso-segments", "", &udpGSOSegments},
     // Latency histogram
     {"latency-sum", "", &latencySum},
     {"latency-count", "", &latencyCount},
@@ -140,7 +140,7 @@ void DoHConnectionToBackend::handleResponse(PendingRequest&& request)
   try {
     if (!d_healthCheckQuery) {
       const double udiff = request.d_query.d_idstate.queryRealTime.udiff();
-      d_ds->updateTCPLatency(udiff);
+      d_ds->updateTCPLatency(udiff, request.d_query.d_idstate.queryRealTime.d_start);
       if (request.d_buffer.size() >= sizeof(dnsheader)) {
         dnsheader dh;
         memcpy(&dh, request.d_buffer.data(), sizeof(dh));
@@ -790,7 +790,7 @@ DoHConnectionToBackend::DoHConnectionToBackend(const std::shared_ptr<DownstreamS
   ConnectionToBackend(ds, mplexer, now), d_proxyProtocolPayload(std::move(proxyProtocolPayload))
 {
   // inherit most of the stuff from the ConnectionToBackend()
-  d_ioState = make_unique<IOStateHandler>(*d_mplexer, d_handler->getDescriptor());
+  d_ioState = make_unique<IOStateHandler>(*d_mplexer.get(), d_handler->getDescriptor());
 
   nghttp2_session_callbacks* cbs = nullptr;
   if (nghttp2_session_callbacks_new(&cbs) != 0) {
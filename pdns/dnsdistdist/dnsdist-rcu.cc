@@ -0,0 +1,209 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "dnsdist-rcu.hh"
+#include "lock.hh"
+#include "stat_t.hh"
+
+namespace dnsdist::rcu
+{
+struct ThreadRecord
+{
+  /* the epoch the thread was in when it entered its current read-side
+     critical section, 0 meaning that it is not inside one */
+  alignas(CPU_LEVEL1_DCACHE_LINESIZE) std::atomic<uint64_t> d_epoch{0};
+  std::atomic<bool> d_inUse{true};
+  ThreadRecord* d_next{nullptr};
+  /* only accessed by the owning thread, to support nested guards */
+  size_t d_depth{0};
+};
+
+struct RetiredObject
+{
+  void* d_object;
+  void (*d_deleter)(void*);
+  uint64_t d_epoch;
+};
+
+/* records are never freed, only released when their thread exits
+   so that they can be reused by a new thread */
+static std::atomic<ThreadRecord*> s_records{nullptr};
+static std::atomic<uint64_t> s_epoch{1};
+static LockGuarded<std::vector<RetiredObject>> s_retired;
+static constexpr size_t s_reclaimThreshold{1024};
+
+static ThreadRecord* acquireRecord()
+{
+  for (auto* record = s_records.load(); record != nullptr; record = record->d_next) {
+    bool inUse = false;
+    if (!record->d_inUse.load(std::memory_order_relaxed) && record->d_inUse.compare_exchange_strong(inUse, true)) {
+      return record;
+    }
+  }
+
+  // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+  auto* record = new ThreadRecord();
+  auto* head = s_records.load();
+  do {
+    record->d_next = head;
+  } while (!s_records.compare_exchange_weak(head, record));
+  return record;
+}
+
+class ThreadRecordHolder
+{
+public:
+  ThreadRecordHolder() = default;
+  ThreadRecordHolder(const ThreadRecordHolder&) = delete;
+  ThreadRecordHolder(ThreadRecordHolder&&) = delete;
+  ThreadRecordHolder& operator=(const ThreadRecordHolder&) = delete;
+  ThreadRecordHolder& operator=(ThreadRecordHolder&&) = delete;
+  ~ThreadRecordHolder()
+  {
+    if (d_record != nullptr) {
+      d_record->d_inUse.store(false, std::memory_order_release);
+    }
+  }
+
+  ThreadRecord* get()
+  {
+    if (d_record == nullptr) {
+      d_record = acquireRecord();
+    }
+    return d_record;
+  }
+
+private:
+  ThreadRecord* d_record{nullptr};
+};
+
+static thread_local ThreadRecordHolder t_record;
+
+ReadGuard::ReadGuard() :
+  d_record(t_record.get())
+{
+  if (d_record->d_depth++ == 0) {
+    /* our announcement has to be visible to writers before we load any shared pointer,
+       pairs with the scan of the records in reclaim() */
+    d_record->d_epoch.store(s_epoch.load());
+  }
+}
+
+ReadGuard::~ReadGuard()
+{
+  if (--d_record->d_depth == 0) {
+    d_record->d_epoch.store(0, std::memory_order_release);
+  }
+}
+
+void retire(void* object, void (*deleter)(void*))
+{
+  bool needReclaim = false;
+  {
+    auto retired = s_retired.lock();
+    /* the object has been unlinked before we read the epoch */
+    retired->push_back({object, deleter, s_epoch.load()});
+    needReclaim = retired->size() >= s_reclaimThreshold;
+  }
+
+  if (needReclaim) {
+    reclaim();
+  }
+}
+
+/* remove the retired objects tagged with an epoch older than the supplied one from the list,
+   so that they can be destroyed once the lock has been released */
+static std::vector<RetiredObject> extractRetiredObjects(std::vector<RetiredObject>& retired, uint64_t before)
+{
+  auto firstToKeep = std::partition(retired.begin(), retired.end(), [before](const RetiredObject& object) {
+    return object.d_epoch < before;
+  });
+  std::vector<RetiredObject> extracted(retired.begin(), firstToKeep);
+  retired.erase(retired.begin(), firstToKeep);
+  return extracted;
+}
+
+static size_t destroyRetiredObjects(const std::vector<RetiredObject>& toDestroy)
+{
+  for (const auto& object : toDestroy) {
+    object.d_deleter(object.d_object);
+  }
+  return toDestroy.size();
+}
+
+size_t reclaim()
+{
+  std::vector<RetiredObject> toDestroy;
+  {
+    auto retired = s_retired.lock();
+    if (retired->empty()) {
+      return 0;
+    }
+
+    /* readers entering from now on cannot see any of the objects retired so far */
+    s_epoch.fetch_add(1);
+
+    auto oldestActiveEpoch = std::numeric_limits<uint64_t>::max();
+    for (auto* record = s_records.load(); record != nullptr; record = record->d_next) {
+      auto epoch = record->d_epoch.load();
+      if (epoch != 0 && epoch < oldestActiveEpoch) {
+        oldestActiveEpoch = epoch;
+      }
+    }
+
+    toDestroy = extractRetiredObjects(*retired, oldestActiveEpoch);
+  }
+
+  return destroyRetiredObjects(toDestroy);
+}
+
+void synchronize()
+{
+  std::vector<RetiredObject> toDestroy;
+  {
+    auto retired = s_retired.lock();
+    /* readers entering from now on cannot see any of the objects retired so far */
+    const auto newEpoch = s_epoch.fetch_add(1) + 1;
+
+    for (auto* record = s_records.load(); record != nullptr; record = record->d_next) {
+      auto epoch = record->d_epoch.load();
+      while (epoch != 0 && epoch < newEpoch) {
+        std::this_thread::yield();
+        epoch = record->d_epoch.load();
+      }
+    }
+
+    toDestroy = extractRetiredObjects(*retired, newEpoch);
+  }
+
+  destroyRetiredObjects(toDestroy);
+}
+
+size_t getPendingReclamationsCount()
+{
+  return s_retired.lock()->size();
+}
+}
@@ -0,0 +1,349 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+/*
+  This file provides a minimal epoch-based reclamation scheme, allowing readers to
+  access shared data structures without taking any lock, and without writing to any
+  memory location shared with other threads.
+
+  - A reader enters a read-side critical section by creating a ReadGuard object, which
+  publishes the current global epoch in a per-thread record, and leaves it when the guard
+  is destroyed. Pointers loaded from the shared structure are only valid while the guard
+  is alive.
+
+  - A writer, which has to be serialized with other writers by some other mean (usually
+  a mutex), unlinks objects from the shared structure then passes them to retire().
+  They are destroyed by reclaim() once every reader that was inside a critical section
+  when they were unlinked has left it.
+
+  HashTable is an open-addressing hash table built on top of this scheme, storing
+  immutable values indexed by a 32-bit hash.
+
+  Note that the loads done by readers and the stores done by writers to shared pointers
+  have to be sequentially consistent, pairing with the announcement of the reader's epoch
+  and the scan of the readers' epochs done by reclaim(), which is why the default memory
+  order is used everywhere except for writer-only accesses.
+*/
+namespace dnsdist::rcu
+{
+struct ThreadRecord;
+
+class ReadGuard
+{
+public:
+  ReadGuard();
+  ~ReadGuard();
+  ReadGuard(const ReadGuard&) = delete;
+  ReadGuard(ReadGuard&&) = delete;
+  ReadGuard& operator=(const ReadGuard&) = delete;
+  ReadGuard& operator=(ReadGuard&&) = delete;
+
+private:
+  ThreadRecord* d_record{nullptr};
+};
+
+/* Defer the destruction of an object, that has already been made unreachable
+   to new readers, until no existing reader can hold a reference to it. */
+void retire(void* object, void (*deleter)(void*));
+
+template <typename T>
+void retire(T* object)
+{
+  retire(object, [](void* ptr) {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    delete static_cast<T*>(ptr);
+  });
+}
+
+/* Destroy the retired objects that can no longer be referenced by any reader,
+   returning the number of destroyed objects. */
+size_t reclaim();
+/* Wait until every reader currently inside a read-side critical section has left it,
+   then destroy all the objects retired so far. Must not be called from inside a
+   critical section. */
+void synchronize();
+/* Number of retired objects waiting to be destroyed */
+size_t getPendingReclamationsCount();
+
+template <typename T>
+class HashTable
+{
+public:
+  enum class InsertResult : uint8_t
+  {
+    Inserted,
+    Replaced,
+    Kept,
+    Full
+  };
+
+  /* maxEntries is a hard limit on the number of entries, needed because
+     the table is never resized, only rebuilt to get rid of tombstones */
+  HashTable(size_t maxEntries) :
+    d_maxEntries(maxEntries)
+  {
+    size_t capacity = 16;
+    /* keep the load factor at or below 0.5 when the table is full */
+    while (capacity < (maxEntries * 2)) {
+      capacity *= 2;
+    }
+    d_slots.store(new Slots(capacity));
+  }
+
+  ~HashTable()
+  {
+    /* no reader can be present at this point */
+    auto* slots = d_slots.load();
+    for (size_t idx = 0; idx < slots->d_capacity; idx++) {
+      auto* node = slots->d_slots[idx].load();
+      if (node != nullptr && node != tombstone()) {
+        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+        delete node;
+      }
+    }
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    delete slots;
+  }
+
+  HashTable(const HashTable&) = delete;
+  HashTable(HashTable&&) = delete;
+  HashTable& operator=(const HashTable&) = delete;
+  HashTable& operator=(HashTable&&) = delete;
+
+  /* Reader side, the returned pointer is only valid as long as the
+     ReadGuard that needs to be held by the caller is alive */
+  [[nodiscard]] const T* find(uint32_t key) const
+  {
+    const auto* slots = d_slots.load();
+    for (size_t probe = 0, idx = slots->getHomeIndex(key); probe < slots->d_capacity; probe++, idx = (idx + 1) & slots->d_mask) {
+      const auto* node = slots->d_slots[idx].load();
+      if (node == nullptr) {
+        return nullptr;
+      }
+      if (node != tombstone() && node->d_key == key) {
+        return &node->d_value;
+      }
+    }
+    return nullptr;
+  }
+
+  /* Reader side as well, the visitor is called for every entry until
+     it returns false */
+  template <typename Visitor>
+  void visit(Visitor&& visitor) const
+  {
+    const auto* slots = d_slots.load();
+    for (size_t idx = 0; idx < slots->d_capacity; idx++) {
+      const auto* node = slots->d_slots[idx].load();
+      if (node == nullptr || node == tombstone()) {
+        continue;
+      }
+      if (!visitor(node->d_key, node->d_value)) {
+        return;
+      }
+    }
+  }
+
+  /* Writer side, calls to insert() and removeIf() need to be serialized by the caller.
+     If an entry already exists for this key, shouldReplace is called with the existing value
+     to decide whether it should be replaced. */
+  template <typename ShouldReplace>
+  InsertResult insert(uint32_t key, T&& value, ShouldReplace&& shouldReplace)
+  {
+    auto* slots = d_slots.load(std::memory_order_relaxed);
+    std::optional<size_t> freeSlot;
+    size_t idx = slots->getHomeIndex(key);
+    for (size_t probe = 0; probe < slots->d_capacity; probe++, idx = (idx + 1) & slots->d_mask) {
+      auto* node = slots->d_slots[idx].load(std::memory_order_relaxed);
+      if (node == nullptr) {
+        if (!freeSlot) {
+          freeSlot = idx;
+        }
+        break;
+      }
+      if (node == tombstone()) {
+        if (!freeSlot) {
+          freeSlot = idx;
+        }
+        continue;
+      }
+      if (node->d_key == key) {
+        if (!shouldReplace(node->d_value)) {
+          return InsertResult::Kept;
+        }
+        // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+        slots->d_slots[idx].store(new Node(key, std::move(value)));
+        retire(node);
+        return InsertResult::Replaced;
+      }
+    }
+
+    if (d_size >= d_maxEntries || !freeSlot) {
+      return InsertResult::Full;
+    }
+
+    auto& slot = slots->d_slots[*freeSlot];
+    if (slot.load(std::memory_order_relaxed) == nullptr) {
+      ++d_used;
+    }
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    slot.store(new Node(key, std::move(value)));
+    ++d_size;
+
+    if (d_used >= (slots->d_capacity / 4) * 3) {
+      rebuild();
+    }
+    return InsertResult::Inserted;
+  }
+
+  /* Writer side, returns true if an entry was removed */
+  bool remove(uint32_t key)
+  {
+    auto* slots = d_slots.load(std::memory_order_relaxed);
+    for (size_t probe = 0, idx = slots->getHomeIndex(key); probe < slots->d_capacity; probe++, idx = (idx + 1) & slots->d_mask) {
+      auto* node = slots->d_slots[idx].load(std::memory_order_relaxed);
+      if (node == nullptr) {
+        return false;
+      }
+      if (node != tombstone() && node->d_key == key) {
+        slots->d_slots[idx].store(tombstone());
+        retire(node);
+        --d_size;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* Writer side, remove at most upTo entries (0 means no limit) for which
+     the predicate returns true, returning the number of removed entries */
+  template <typename Predicate>
+  size_t removeIf(Predicate&& predicate, size_t upTo = 0)
+  {
+    size_t removed = 0;
+    auto* slots = d_slots.load(std::memory_order_relaxed);
+    for (size_t idx = 0; idx < slots->d_capacity && (upTo == 0 || removed < upTo); idx++) {
+      auto* node = slots->d_slots[idx].load(std::memory_order_relaxed);
+      if (node == nullptr || node == tombstone()) {
+        continue;
+      }
+      if (predicate(node->d_key, node->d_value)) {
+        slots->d_slots[idx].store(tombstone());
+        retire(node);
+        --d_size;
+        ++removed;
+      }
+    }
+    return removed;
+  }
+
+  /* Writer side */
+  [[nodiscard]] size_t size() const
+  {
+    return d_size;
+  }
+
+  [[nodiscard]] size_t getCapacity() const
+  {
+    return d_slots.load(std::memory_order_relaxed)->d_capacity;
+  }
+
+private:
+  struct Node
+  {
+    Node(uint32_t key, T&& value) :
+      d_value(std::move(value)), d_key(key)
+    {
+    }
+    T d_value;
+    const uint32_t d_key;
+  };
+
+  struct Slots
+  {
+    Slots(size_t capacity) :
+      d_slots(std::make_unique<std::atomic<Node*>[]>(capacity)), d_capacity(capacity), d_mask(capacity - 1)
+    {
+      for (size_t idx = 0; idx < d_capacity; idx++) {
+        d_slots[idx].store(nullptr, std::memory_order_relaxed);
+      }
+      while ((static_cast<size_t>(1) << d_bits) < capacity) {
+        ++d_bits;
+      }
+    }
+
+    [[nodiscard]] size_t getHomeIndex(uint32_t key) const
+    {
+      /* the keys of a given packet cache shard share the same value modulo the number
+         of shards, so we cannot use the lower bits directly. Fibonacci hashing it is. */
+      return (static_cast<uint32_t>(key * 2654435769U) >> (32 - d_bits)) & d_mask;
+    }
+
+    std::unique_ptr<std::atomic<Node*>[]> d_slots;
+    const size_t d_capacity;
+    const size_t d_mask;
+    uint8_t d_bits{0};
+  };
+
+  static Node* tombstone()
+  {
+    static Node* const marker = reinterpret_cast<Node*>(&s_tombstoneMarker); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    return marker;
+  }
+
+  /* get rid of the tombstones by building a fresh copy of the slots,
+     the nodes themselves are shared between the old and new copies */
+  void rebuild()
+  {
+    auto* oldSlots = d_slots.load(std::memory_order_relaxed);
+    auto newSlots = std::make_unique<Slots>(oldSlots->d_capacity);
+    for (size_t idx = 0; idx < oldSlots->d_capacity; idx++) {
+      auto* node = oldSlots->d_slots[idx].load(std::memory_order_relaxed);
+      if (node == nullptr || node == tombstone()) {
+        continue;
+      }
+      size_t newIdx = newSlots->getHomeIndex(node->d_key);
+      while (newSlots->d_slots[newIdx].load(std::memory_order_relaxed) != nullptr) {
+        newIdx = (newIdx + 1) & newSlots->d_mask;
+      }
+      newSlots->d_slots[newIdx].store(node, std::memory_order_relaxed);
+    }
+    d_slots.store(newSlots.release());
+    d_used = d_size;
+    retire(oldSlots);
+  }
+
+  static inline char s_tombstoneMarker{0};
+  std::atomic<Slots*> d_slots{nullptr};
+  const size_t d_maxEntries;
+  /* only accessed by writers */
+  size_t d_size{0};
+  /* live entries and tombstones */
+  size_t d_used{0};
+};
+}
@@ -24,12 +24,15 @@
 
 #include "dnsdist-rings.hh"
 
-void Rings::init(size_t capacity, size_t numberOfShards, size_t nbLockRetries, bool recordQueries, bool recordResponses)
+void Rings::init(size_t capacity, size_t numberOfShards, size_t nbLockRetries, bool recordQueries, bool recordResponses, bool perThread)
 {
   if (d_initialized.exchange(true)) {
     throw std::runtime_error("Rings::init() should only be called once");
   }
 
+  d_perThread = perThread;
+  d_threadShards.clear();
+
   d_capacity = capacity;
   d_numberOfShards = numberOfShards;
   d_nbLockTries = nbLockRetries;
@@ -41,9 +44,13 @@ void Rings::init(size_t capacity, size_t numberOfShards, size_t nbLockRetries, b
 
   d_shards.resize(d_numberOfShards);
 
-  /* resize all the rings */
+  /* resize all the rings. In per-thread mode the shards are kept empty,
+     and the rings are created on the first insertion from a given thread */
   for (auto& shard : d_shards) {
     shard = std::make_unique<Shard>();
+    if (d_perThread) {
+      continue;
+    }
     if (shouldRecordQueries()) {
       shard->queryRing.lock()->set_capacity(d_capacity / d_numberOfShards);
     }
@@ -57,15 +64,62 @@ void Rings::init(size_t capacity, size_t numberOfShards, size_t nbLockRetries, b
   d_nbResponseEntries = 0;
 }
 
-size_t Rings::numDistinctRequestors()
+void Rings::enableSlidingCounters(const dnsdist::SlidingCounters::Settings& settings)
 {
-  std::set<ComboAddress, ComboAddress::addressOnlyLessThan> requestors;
-  for (const auto& shard : d_shards) {
-    auto queries = shard->queryRing.lock();
-    for (const auto& query : *queries) {
-      requestors.insert(query.requestor);
+  d_slidingCounters = std::make_unique<dnsdist::SlidingCounters>(settings);
+}
+
+Rings::ThreadShard& Rings::getThreadShard()
+{
+  return d_threadShards.get([this]() {
+    ThreadShard shard;
+    const auto perThreadCapacity = std::max(d_capacity / std::max(d_numberOfShards, static_cast<size_t>(1)), static_cast<size_t>(1));
+    if (shouldRecordQueries()) {
+      shard.queryRing = std::make_unique<dnsdist::SnapshotRing<PackedQuery>>(perThreadCapacity);
     }
+    if (shouldRecordResponses()) {
+      shard.respRing = std::make_unique<dnsdist::SnapshotRing<PackedResponse>>(perThreadCapacity);
+    }
+    return shard;
+  });
+}
+
+void Rings::PackedName::pack(const DNSName& name)
+{
+  const auto& storage = name.getStorage();
+  d_length = static_cast<uint8_t>(std::min(storage.size(), d_data.size()));
+  memcpy(d_data.data(), storage.data(), d_length);
+}
+
+DNSName Rings::PackedName::unpack() const
+{
+  if (d_length == 0) {
+    return DNSName();
   }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+  return DNSName(reinterpret_cast<const char*>(d_data.data()), d_length, 0, false);
+}
+
+Rings::Query Rings::PackedQuery::unpack() const
+{
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+  return Query{requestor, name.unpack(), when, dh, size, qtype, protocol, macaddress, hasmac};
+#else
+  return Query{requestor, name.unpack(), when, dh, size, qtype, protocol};
+#endif
+}
+
+Rings::Response Rings::PackedResponse::unpack() const
+{
+  return Response{requestor, ds, name.unpack(), when, dh, usec, size, qtype, protocol};
+}
+
+size_t Rings::numDistinctRequestors()
+{
+  std::set<ComboAddress, ComboAddress::addressOnlyLessThan> requestors;
+  forEachQuery([&requestors](const Query& query) {
+    requestors.insert(query.requestor);
+  });
   return requestors.size();
 }
 
@@ -73,22 +127,14 @@ std::unordered_map<int, vector<boost::variant<string, double>>> Rings::getTopBan
 {
   map<ComboAddress, unsigned int, ComboAddress::addressOnlyLessThan> counts;
   uint64_t total = 0;
-  for (const auto& shard : d_shards) {
-    {
-      auto queries = shard->queryRing.lock();
-      for (const auto& query : *queries) {
-        counts[query.requestor] += query.size;
-        total += query.size;
-      }
-    }
-    {
-      auto responses = shard->respRing.lock();
-      for (const auto& response : *responses) {
-        counts[response.requestor] += response.size;
-        total += response.size;
-      }
-    }
-  }
+  forEachQuery([&counts, &total](const Query& query) {
+    counts[query.requestor] += query.size;
+    total += query.size;
+  });
+  forEachResponse([&counts, &total](const Response& response) {
+    counts[response.requestor] += response.size;
+    total += response.size;
+  });
 
   using ret_t = vector<pair<unsigned int, ComboAddress>>;
   ret_t rcounts;
@@ -194,8 +240,13 @@ size_t Rings::loadFromFile(const std::string& filepath, const struct timespec& n
 
 bool Rings::Response::isACacheHit() const
 {
-  bool hit = ds.sin4.sin_family == 0;
-  if (!hit && ds.isIPv4() && ds.sin4.sin_addr.s_addr == 0 && ds.sin4.sin_port == 0) {
+  return isACacheHit(ds);
+}
+
+bool Rings::Response::isACacheHit(const ComboAddress& backend)
+{
+  bool hit = backend.sin4.sin_family == 0;
+  if (!hit && backend.isIPv4() && backend.sin4.sin_addr.s_addr == 0 && backend.sin4.sin_port == 0) {
     hit = true;
   }
   return hit;
@@ -21,6 +21,7 @@
  */
 #pragma once
 
+#include <limits>
 #include <time.h>
 #include <unordered_map>
 
@@ -33,6 +34,9 @@
 #include "stat_t.hh"
 #include "dnsdist-protocols.hh"
 #include "dnsdist-mac-address.hh"
+#include "dnsdist-sliding-counters.hh"
+#include "dnsdist-snapshot-ring.hh"
+#include "dnsdist-thread-registry.hh"
 
 struct Rings
 {
@@ -65,6 +69,7 @@ struct Rings
     dnsdist::Protocol protocol;
 
     bool isACacheHit() const;
+    static bool isACacheHit(const ComboAddress& backend);
   };
 
   struct Shard
@@ -73,11 +78,61 @@ struct Rings
     LockGuarded<boost::circular_buffer<Response>> respRing;
   };
 
+  /* trivially copyable versions of Query and Response, used by the per-thread rings,
+     with the name stored in wire format */
+  struct PackedName
+  {
+    void pack(const DNSName& name);
+    [[nodiscard]] DNSName unpack() const;
+
+    std::array<uint8_t, 255> d_data;
+    uint8_t d_length;
+  };
+
+  struct PackedQuery
+  {
+    [[nodiscard]] Query unpack() const;
+
+    ComboAddress requestor;
+    PackedName name;
+    struct timespec when;
+    struct dnsheader dh;
+    uint16_t size;
+    uint16_t qtype;
+    dnsdist::Protocol protocol;
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+    dnsdist::MacAddress macaddress;
+    bool hasmac;
+#endif
+  };
+
+  struct PackedResponse
+  {
+    [[nodiscard]] Response unpack() const;
+
+    ComboAddress requestor;
+    ComboAddress ds;
+    PackedName name;
+    struct timespec when;
+    struct dnsheader dh;
+    unsigned int usec;
+    uint16_t size;
+    uint16_t qtype;
+    dnsdist::Protocol protocol;
+  };
+
+  /* the rings owned by a given thread, only written to by that thread */
+  struct ThreadShard
+  {
+    std::unique_ptr<dnsdist::SnapshotRing<PackedQuery>> queryRing;
+    std::unique_ptr<dnsdist::SnapshotRing<PackedResponse>> respRing;
+  };
+
   std::unordered_map<int, vector<boost::variant<string, double>>> getTopBandwidth(unsigned int numentries);
   size_t numDistinctRequestors();
 
   /* This function should only be called at configuration time before any query or response has been inserted */
-  void init(size_t capacity, size_t numberOfShards, size_t nbLockRetries = 5, bool recordQueries = true, bool recordResponses = true);
+  void init(size_t capacity, size_t numberOfShards, size_t nbLockRetries = 5, bool recordQueries = true, bool recordResponses = true, bool perThread = false);
 
   size_t getNumberOfShards() const
   {
@@ -94,9 +149,23 @@ struct Rings
     return d_nbResponseEntries;
   }
 
+  bool isPerThread() const
+  {
+    return d_perThread;
+  }
+
+  /* This function should only be called at configuration time, after init(), to keep
+     per-second counters of the inserted entries over a sliding window */
+  void enableSlidingCounters(const dnsdist::SlidingCounters::Settings& settings);
+
+  /* returns nullptr if the sliding counters have not been enabled */
+  const dnsdist::SlidingCounters* getSlidingCounters() const
+  {
+    return d_slidingCounters.get();
+  }
+
   void insertQuery(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, uint16_t qtype, uint16_t size, const struct dnsheader& dh, dnsdist::Protocol protocol)
   {
-    auto ourName = DNSName(name);
 #if defined(DNSDIST_RINGS_WITH_MACADDRESS)
     dnsdist::MacAddress macaddress;
     bool hasmac{false};
@@ -104,6 +173,29 @@ struct Rings
       hasmac = true;
     }
 #endif
+    if (d_slidingCounters) {
+      d_slidingCounters->addQuery(when, requestor, qtype);
+    }
+
+    if (d_perThread) {
+      auto& ring = getThreadShard().queryRing;
+      if (!ring) {
+        return;
+      }
+      PackedQuery query{requestor, {}, when, dh, size, qtype, protocol
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+                        ,
+                        macaddress, hasmac
+#endif
+      };
+      query.name.pack(name);
+      if (!ring->push(query)) {
+        d_nbQueryEntries++;
+      }
+      return;
+    }
+
+    auto ourName = DNSName(name);
     for (size_t idx = 0; idx < d_nbLockTries; idx++) {
       auto& shard = getOneShard();
       bool wasFull = false;
@@ -149,6 +241,24 @@ struct Rings
 
   void insertResponse(const struct timespec& when, const ComboAddress& requestor, const DNSName& name, uint16_t qtype, unsigned int usec, unsigned int size, const struct dnsheader& dh, const ComboAddress& backend, dnsdist::Protocol protocol)
   {
+    if (d_slidingCounters) {
+      const int rcode = (dh.rcode == 0 && usec == std::numeric_limits<unsigned int>::max()) ? -1 : dh.rcode;
+      d_slidingCounters->addResponse(when, requestor, name, rcode, size, Response::isACacheHit(backend));
+    }
+
+    if (d_perThread) {
+      auto& ring = getThreadShard().respRing;
+      if (!ring) {
+        return;
+      }
+      PackedResponse response{requestor, backend, {}, when, dh, usec, static_cast<uint16_t>(size), qtype, protocol};
+      response.name.pack(name);
+      if (!ring->push(response)) {
+        d_nbResponseEntries++;
+      }
+      return;
+    }
+
     auto ourName = DNSName(name);
     for (size_t idx = 0; idx < d_nbLockTries; idx++) {
       auto& shard = getOneShard();
@@ -184,12 +294,88 @@ struct Rings
     }
   }
 
+  /* calls the visitor with every query present in the rings. The visitor can
+     return false to stop the iteration early. In per-thread mode no lock is
+     taken, the per-thread rings are merged and the visitor gets a copy of
+     each entry, entries being overwritten while we read them are skipped */
+  template <typename Visitor>
+  void forEachQuery(Visitor&& visitor) const
+  {
+    if (d_perThread) {
+      for (const auto& shard : getThreadShards()) {
+        if (!shard->queryRing) {
+          continue;
+        }
+        bool stopped = false;
+        shard->queryRing->visit([&visitor, &stopped](const PackedQuery& entry) {
+          stopped = !callVisitor(visitor, entry.unpack());
+          return !stopped;
+        });
+        if (stopped) {
+          return;
+        }
+      }
+      return;
+    }
+
+    for (const auto& shard : d_shards) {
+      auto ring = shard->queryRing.lock();
+      for (const auto& entry : *ring) {
+        if (!callVisitor(visitor, entry)) {
+          return;
+        }
+      }
+    }
+  }
+
+  /* same as forEachQuery() but for responses */
+  template <typename Visitor>
+  void forEachResponse(Visitor&& visitor) const
+  {
+    if (d_perThread) {
+      for (const auto& shard : getThreadShards()) {
+        if (!shard->respRing) {
+          continue;
+        }
+        bool stopped = false;
+        shard->respRing->visit([&visitor, &stopped](const PackedResponse& entry) {
+          stopped = !callVisitor(visitor, entry.unpack());
+          return !stopped;
+        });
+        if (stopped) {
+          return;
+        }
+      }
+      return;
+    }
+
+    for (const auto& shard : d_shards) {
+      auto ring = shard->respRing.lock();
+      for (const auto& entry : *ring) {
+        if (!callVisitor(visitor, entry)) {
+          return;
+        }
+      }
+    }
+  }
+
   void clear()
   {
     for (auto& shard : d_shards) {
       shard->queryRing.lock()->clear();
       shard->respRing.lock()->clear();
     }
+    for (const auto& shard : getThreadShards()) {
+      if (shard->queryRing) {
+        shard->queryRing->clear();
+      }
+      if (shard->respRing) {
+        shard->respRing->clear();
+      }
+    }
+    if (d_slidingCounters) {
+      d_slidingCounters->clear();
+    }
 
     d_nbQueryEntries.store(0);
     d_nbResponseEntries.store(0);
@@ -204,6 +390,7 @@ struct Rings
   void reset()
   {
     clear();
+    d_slidingCounters.reset();
     d_initialized = false;
   }
 
@@ -238,6 +425,25 @@ private:
     return d_shards[getShardId()];
   }
 
+  /* returns the rings owned by the current thread, creating them if needed */
+  ThreadShard& getThreadShard();
+  std::vector<std::shared_ptr<ThreadShard>> getThreadShards() const
+  {
+    return d_threadShards.getAll();
+  }
+
+  template <typename Visitor, typename Entry>
+  static bool callVisitor(Visitor& visitor, const Entry& entry)
+  {
+    if constexpr (std::is_void_v<std::invoke_result_t<Visitor&, const Entry&>>) {
+      visitor(entry);
+      return true;
+    }
+    else {
+      return visitor(entry);
+    }
+  }
+
 #if defined(DNSDIST_RINGS_WITH_MACADDRESS)
   bool insertQueryLocked(boost::circular_buffer<Query>& ring, const struct timespec& when, const ComboAddress& requestor, DNSName&& name, uint16_t qtype, uint16_t size, const struct dnsheader& dh, dnsdist::Protocol protocol, const dnsdist::MacAddress& macaddress, const bool hasmac)
 #else
@@ -266,6 +472,9 @@ private:
 
   static constexpr bool s_keepLockingStats{false};
 
+  dnsdist::ThreadLocalRegistry<ThreadShard> d_threadShards;
+  std::unique_ptr<dnsdist::SlidingCounters> d_slidingCounters;
+
   std::atomic<size_t> d_nbQueryEntries{0};
   std::atomic<size_t> d_nbResponseEntries{0};
   std::atomic<size_t> d_currentShardId{0};
@@ -276,6 +485,7 @@ private:
   size_t d_nbLockTries{5};
   bool d_recordQueries{true};
   bool d_recordResponses{true};
+  bool d_perThread{false};
 };
 
 extern Rings g_rings;
@@ -0,0 +1,237 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <map>
+#include <typeinfo>
+
+#include "dnsdist-rule-chains-compiled.hh"
+#include "dnsdist-rules-factory.hh"
+
+namespace dnsdist::rules
+{
+static std::vector<size_t> mergePositions(const std::vector<size_t>& first, const std::vector<size_t>& second)
+{
+  std::vector<size_t> result;
+  result.reserve(first.size() + second.size());
+  std::set_union(first.begin(), first.end(), second.begin(), second.end(), std::back_inserter(result));
+  return result;
+}
+
+static std::optional<size_t> getFirstPosition(const std::vector<size_t>* positions, size_t from)
+{
+  if (positions == nullptr) {
+    return std::nullopt;
+  }
+  auto position = std::lower_bound(positions->begin(), positions->end(), from);
+  if (position == positions->end()) {
+    return std::nullopt;
+  }
+  return *position;
+}
+
+CompiledRuleChain::Kind CompiledRuleChain::getKind(const RuleAction& rule)
+{
+  const auto& selector = *rule.d_rule;
+  /* we want these exact types, not something deriving from them that might override matches() */
+  if (typeid(selector) == typeid(SuffixMatchNodeRule)) {
+    return Kind::QNameSuffix;
+  }
+  if (typeid(selector) == typeid(QTypeRule)) {
+    return Kind::QType;
+  }
+  if (typeid(selector) == typeid(NetmaskGroupRule)) {
+    const auto& nmgRule = dynamic_cast<const NetmaskGroupRule&>(selector);
+    /* a negated entry would hide the less specific ones of the same rule, but not the ones of
+       the other rules, which we cannot express with a single best-match lookup */
+    bool negated = false;
+    nmgRule.getNetmaskGroup().visit([&negated](const Netmask& /* netmask */, bool positive) {
+      if (!positive) {
+        negated = true;
+      }
+    });
+    if (negated) {
+      return Kind::Generic;
+    }
+    return nmgRule.isSourceAddress() ? Kind::SourceAddress : Kind::DestinationAddress;
+  }
+  return Kind::Generic;
+}
+
+CompiledRuleChain::Segment CompiledRuleChain::compile(const std::vector<RuleAction>& rules, size_t start, size_t end, Kind kind)
+{
+  Segment segment;
+  segment.d_start = start;
+  segment.d_end = end;
+  segment.d_kind = kind;
+
+  if (kind == Kind::QNameSuffix) {
+    std::map<DNSName, std::vector<size_t>> names;
+    for (size_t position = start; position < end; position++) {
+      const auto& selector = dynamic_cast<const SuffixMatchNodeRule&>(*rules.at(position).d_rule);
+      for (const auto& name : selector.getSuffixes().d_tree.getNodes()) {
+        auto& positions = names[name];
+        if (positions.empty() || positions.back() != position) {
+          positions.push_back(position);
+        }
+      }
+    }
+    for (const auto& [name, positions] : names) {
+      auto merged = positions;
+      auto parent = name;
+      while (parent.chopOff()) {
+        auto entry = names.find(parent);
+        if (entry != names.end()) {
+          merged = mergePositions(merged, entry->second);
+        }
+      }
+      segment.d_suffixes.add(name, std::move(merged));
+    }
+  }
+  else if (kind == Kind::QType) {
+    for (size_t position = start; position < end; position++) {
+      const auto& selector = dynamic_cast<const QTypeRule&>(*rules.at(position).d_rule);
+      auto& positions = segment.d_qtypes[selector.getQType()];
+      if (positions.empty() || positions.back() != position) {
+        positions.push_back(position);
+      }
+    }
+  }
+  else if (kind == Kind::SourceAddress || kind == Kind::DestinationAddress) {
+    std::map<Netmask, std::vector<size_t>> netmasks;
+    for (size_t position = start; position < end; position++) {
+      const auto& selector = dynamic_cast<const NetmaskGroupRule&>(*rules.at(position).d_rule);
+      selector.getNetmaskGroup().visit([&netmasks, position](const Netmask& netmask, bool /* positive */) {
+        auto& positions = netmasks[netmask];
+        if (positions.empty() || positions.back() != position) {
+          positions.push_back(position);
+        }
+      });
+    }
+    /* insert the least specific netmasks first, so that the best match for a netmask
+       we are about to insert is the closest one containing it */
+    std::vector<std::map<Netmask, std::vector<size_t>>::const_iterator> ordered;
+    ordered.reserve(netmasks.size());
+    for (auto entry = netmasks.cbegin(); entry != netmasks.cend(); ++entry) {
+      ordered.push_back(entry);
+    }
+    std::stable_sort(ordered.begin(), ordered.end(), [](const auto& lhs, const auto& rhs) {
+      return lhs->first.getBits() < rhs->first.getBits();
+    });
+    for (const auto& entry : ordered) {
+      auto merged = entry->second;
+      const auto* parent = segment.d_netmasks.lookup(entry->first);
+      if (parent != nullptr) {
+        merged = mergePositions(merged, parent->second);
+      }
+      segment.d_netmasks.insert(entry->first).second = std::move(merged);
+    }
+  }
+
+  return segment;
+}
+
+CompiledRuleChain::CompiledRuleChain(const std::vector<RuleAction>& rules)
+{
+  d_segmentByRule.reserve(rules.size());
+
+  size_t position = 0;
+  while (position < rules.size()) {
+    auto kind = getKind(rules.at(position));
+    auto end = position + 1;
+    while (end < rules.size() && getKind(rules.at(end)) == kind) {
+      end++;
+    }
+
+    if (kind == Kind::Generic || (end - position) < s_minimumRunLength) {
+      /* not worth an index, append these rules to the previous generic segment if any */
+      if (d_segments.empty() || d_segments.back().d_kind != Kind::Generic) {
+        Segment segment;
+        segment.d_start = position;
+        d_segments.push_back(std::move(segment));
+      }
+      d_segments.back().d_end = end;
+    }
+    else {
+      d_segments.push_back(compile(rules, position, end, kind));
+      d_mergedRules += end - position;
+    }
+
+    for (; position < end; position++) {
+      d_segmentByRule.push_back(d_segments.size() - 1);
+    }
+  }
+}
+
+std::optional<size_t> CompiledRuleChain::Segment::getFirstMatch(const std::vector<RuleAction>& rules, const DNSQuestion& dnsQuestion, size_t from) const
+{
+  switch (d_kind) {
+  case Kind::Generic:
+    for (auto position = from; position < d_end; position++) {
+      if (rules.at(position).d_rule->matches(&dnsQuestion)) {
+        return position;
+      }
+    }
+    return std::nullopt;
+  case Kind::QNameSuffix:
+    return getFirstPosition(d_suffixes.lookup(dnsQuestion.ids.qname), from);
+  case Kind::QType: {
+    auto entry = d_qtypes.find(dnsQuestion.ids.qtype);
+    if (entry == d_qtypes.end()) {
+      return std::nullopt;
+    }
+    return getFirstPosition(&entry->second, from);
+  }
+  case Kind::SourceAddress:
+  case Kind::DestinationAddress: {
+    const auto& address = d_kind == Kind::SourceAddress ? dnsQuestion.ids.origRemote : dnsQuestion.ids.origDest;
+    const auto* entry = d_netmasks.lookup(address);
+    if (entry == nullptr) {
+      return std::nullopt;
+    }
+    return getFirstPosition(&entry->second, from);
+  }
+  }
+  return std::nullopt;
+}
+
+size_t CompiledRuleChain::getNextMatch(const std::vector<RuleAction>& rules, const DNSQuestion& dnsQuestion, size_t from) const
+{
+  if (rules.size() != d_segmentByRule.size()) {
+    throw std::runtime_error("Trying to evaluate a compiled rule chain against a different chain");
+  }
+
+  if (from >= rules.size()) {
+    return rules.size();
+  }
+
+  for (auto segmentIdx = d_segmentByRule.at(from); segmentIdx < d_segments.size(); segmentIdx++) {
+    const auto& segment = d_segments.at(segmentIdx);
+    auto match = segment.getFirstMatch(rules, dnsQuestion, std::max(from, segment.d_start));
+    if (match) {
+      return *match;
+    }
+  }
+
+  return rules.size();
+}
+}
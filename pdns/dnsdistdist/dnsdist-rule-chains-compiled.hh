@@ -0,0 +1,102 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+#pragma once
+
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "dnsname.hh"
+#include "iputils.hh"
+#include "dnsdist-rule-chains.hh"
+
+struct DNSQuestion;
+
+namespace dnsdist::rules
+{
+/*
+  A query rule chain where consecutive rules of the same simple kind (qname suffix,
+  qtype, source or destination netmask group) are merged into a single index, so
+  that one lookup tells us which of these rules is the first to match, instead of
+  calling every rule in turn. The other rules are still evaluated one by one.
+  The rules are evaluated lazily, from a given position, so that the effects of an
+  action executed before the next lookup are taken into account exactly as they
+  would have been by a linear evaluation.
+*/
+class CompiledRuleChain
+{
+public:
+  /* consecutive rules of the same kind are only merged if there are at least that many */
+  static constexpr size_t s_minimumRunLength{2};
+
+  CompiledRuleChain(const std::vector<RuleAction>& rules);
+
+  /* returns the position of the first rule at or after 'from' that matches this query,
+     or the size of the chain if there is none. 'rules' has to be the chain we have been
+     compiled from */
+  [[nodiscard]] size_t getNextMatch(const std::vector<RuleAction>& rules, const DNSQuestion& dnsQuestion, size_t from) const;
+
+  [[nodiscard]] size_t getSegmentsCount() const
+  {
+    return d_segments.size();
+  }
+
+  [[nodiscard]] size_t getMergedRulesCount() const
+  {
+    return d_mergedRules;
+  }
+
+private:
+  enum class Kind : uint8_t
+  {
+    Generic,
+    QNameSuffix,
+    QType,
+    SourceAddress,
+    DestinationAddress,
+  };
+
+  /* a run of consecutive rules, [d_start, d_end[, either merged into an index or not */
+  struct Segment
+  {
+    [[nodiscard]] std::optional<size_t> getFirstMatch(const std::vector<RuleAction>& rules, const DNSQuestion& dnsQuestion, size_t from) const;
+
+    /* for each entry, the sorted positions of every rule matching it, including the ones
+       matching a less specific entry, so that the best match is enough */
+    SuffixMatchTree<std::vector<size_t>> d_suffixes;
+    NetmaskTree<std::vector<size_t>> d_netmasks;
+    std::unordered_map<uint16_t, std::vector<size_t>> d_qtypes;
+    size_t d_start{0};
+    size_t d_end{0};
+    Kind d_kind{Kind::Generic};
+  };
+
+  static Kind getKind(const RuleAction& rule);
+  static Segment compile(const std::vector<RuleAction>& rules, size_t start, size_t end, Kind kind);
+
+  std::vector<Segment> d_segments;
+  /* the segment each rule belongs to */
+  std::vector<size_t> d_segmentByRule;
+  size_t d_mergedRules{0};
+};
+}
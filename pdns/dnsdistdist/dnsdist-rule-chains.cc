@@ -21,6 +21,7 @@
  */
 
 #include "dnsdist-rule-chains.hh"
+#include "dnsdist-rule-chains-compiled.hh"
 
 namespace dnsdist::rules
 {
@@ -50,10 +51,13 @@ const std::vector<RuleChainDescription>& getRuleChainDescriptions()
 
 std::vector<RuleAction>& getRuleChain(RuleChains& chains, RuleChain chain)
 {
+  /* the caller might modify the chain, so the compiled version cannot be trusted anymore */
   switch (chain) {
   case RuleChain::Rules:
+    chains.d_compiledRuleActions.reset();
     return chains.d_ruleActions;
   case RuleChain::CacheMissRules:
+    chains.d_compiledCacheMissRuleActions.reset();
     return chains.d_cacheMissRuleActions;
   }
 
@@ -72,6 +76,23 @@ const std::vector<RuleAction>& getRuleChain(const RuleChains& chains, RuleChain
   throw std::runtime_error("Trying to accept an invalid rule chain");
 }
 
+const CompiledRuleChain& getCompiledRuleChain(const RuleChains& chains, RuleChain chain)
+{
+  const auto& rules = getRuleChain(chains, chain);
+  auto compiler = [&rules]() {
+    return std::make_shared<const CompiledRuleChain>(rules);
+  };
+
+  switch (chain) {
+  case RuleChain::Rules:
+    return chains.d_compiledRuleActions.get(compiler);
+  case RuleChain::CacheMissRules:
+    return chains.d_compiledCacheMissRuleActions.get(compiler);
+  }
+
+  throw std::runtime_error("Trying to compile an invalid rule chain");
+}
+
 std::vector<ResponseRuleAction>& getRuleChain(RuleChains& chains, ResponseRuleChain chain)
 {
   return getResponseRuleChain(chains, chain);
@@ -25,6 +25,7 @@
 #include <string>
 #include <vector>
 
+#include "dnsdist-lazy-holder.hh"
 #include "uuid-utils.hh"
 
 class DNSRule;
@@ -83,6 +84,11 @@ struct ResponseRuleChainDescription
   const ResponseRuleChain identifier;
 };
 
+class CompiledRuleChain;
+
+/* the compiled version of a query rule chain, built the first time it is needed */
+using CompiledRuleChainHolder = LazyHolder<CompiledRuleChain>;
+
 struct RuleChains
 {
   std::vector<RuleAction> d_ruleActions;
@@ -93,11 +99,15 @@ struct RuleChains
   std::vector<ResponseRuleAction> d_cacheInsertedRespRuleActions;
   std::vector<ResponseRuleAction> d_XFRRespRuleActions;
   std::vector<ResponseRuleAction> d_TimeoutRespRuleActions;
+  CompiledRuleChainHolder d_compiledRuleActions;
+  CompiledRuleChainHolder d_compiledCacheMissRuleActions;
 };
 
 const std::vector<RuleChainDescription>& getRuleChainDescriptions();
 std::vector<RuleAction>& getRuleChain(RuleChains& chains, RuleChain chain);
 const std::vector<RuleAction>& getRuleChain(const RuleChains& chains, RuleChain chain);
+/* compiles the query rule chain the first time it is requested */
+const CompiledRuleChain& getCompiledRuleChain(const RuleChains& chains, RuleChain chain);
 const std::vector<ResponseRuleChainDescription>& getResponseRuleChainDescriptions();
 std::vector<ResponseRuleAction>& getRuleChain(RuleChains& chains, ResponseRuleChain chain);
 const std::vector<ResponseRuleAction>& getRuleChain(const RuleChains& chains, ResponseRuleChain chain);
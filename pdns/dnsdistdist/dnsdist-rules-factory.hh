@@ -27,6 +27,7 @@
 #include <boost/multi_index/key_extractors.hpp>
 
 #include "cachecleaner.hh"
+#include "dnsdist-dnsparser.hh"
 #include "dnsdist-ecs.hh"
 #include "dnsdist-kvs.hh"
 #include "dnsdist-lua.hh"
@@ -250,6 +251,16 @@ public:
     return ret + d_nmg.toString();
   }
 
+  const NetmaskGroup& getNetmaskGroup() const
+  {
+    return d_nmg;
+  }
+
+  bool isSourceAddress() const
+  {
+    return d_src;
+  }
+
 private:
   NetmaskGroup d_nmg;
   bool d_src;
@@ -643,6 +654,11 @@ public:
       return "qname in " + d_smn.toString();
   }
 
+  const SuffixMatchNode& getSuffixes() const
+  {
+    return d_smn;
+  }
+
 private:
   SuffixMatchNode d_smn;
   bool d_quiet;
@@ -658,7 +674,9 @@ public:
 
   bool matches(const DNSQuestion* dq) const override
   {
-    return d_qname == dq->ids.qname;
+    const auto& ours = d_qname.getStorage();
+    const auto& theirs = dq->ids.qname.getStorage();
+    return dnsdist::QuestionParsing::namesEqualCI(std::string_view(ours.data(), ours.size()), std::string_view(theirs.data(), theirs.size()));
   }
   string toString() const override
   {
@@ -708,6 +726,11 @@ public:
     return "qtype==" + qt.toString();
   }
 
+  uint16_t getQType() const
+  {
+    return d_qtype;
+  }
+
 private:
   uint16_t d_qtype;
 };
@@ -22,6 +22,7 @@
 #pragma once
 #include <memory>
 
+#include "dnsdist-lazy-holder.hh"
 #include "dnsdist-lbpolicies.hh"
 
 class DNSDistPacketCache;
@@ -67,6 +68,8 @@ struct ServerPool
   const ServerPolicy::NumberedServerVector& getServers() const;
   void addServer(std::shared_ptr<DownstreamState>& server);
   void removeServer(std::shared_ptr<DownstreamState>& server);
+  /* built the first time it is needed */
+  const dnsdist::lbpolicies::ConsistentHashRing& getHashRing() const;
   bool isTCPOnly() const
   {
     // coverity[missing_lock]
@@ -80,6 +83,7 @@ private:
   void updateConsistency();
 
   ServerPolicy::NumberedServerVector d_servers;
+  dnsdist::LazyHolder<dnsdist::lbpolicies::ConsistentHashRing> d_hashRing;
   bool d_useECS{false};
   bool d_zeroScope{true};
   bool d_tcpOnly{false};
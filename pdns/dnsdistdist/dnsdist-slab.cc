@@ -0,0 +1,154 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "dnsdist-slab.hh"
+
+namespace dnsdist
+{
+uint8_t SlabAllocator::getSizeClass(size_t size)
+{
+  if (size <= s_minSlotSize) {
+    return 0;
+  }
+  if (size > s_maxSlotSize) {
+    return s_oversizedClass;
+  }
+
+  /* find the power of two such that 2^power < size <= 2^(power+1),
+     then split that range into four classes */
+  size_t power = 6;
+  while ((static_cast<size_t>(1) << (power + 1)) < size) {
+    ++power;
+  }
+  const size_t base = static_cast<size_t>(1) << power;
+  const size_t step = base / 4;
+  const size_t sub = (size - base + step - 1) / step;
+  return static_cast<uint8_t>(((power - 6) * 4) + sub);
+}
+
+size_t SlabAllocator::getClassSlotSize(uint8_t sizeClass)
+{
+  if (sizeClass == 0) {
+    return s_minSlotSize;
+  }
+  const size_t power = 6 + ((sizeClass - 1) / 4);
+  const size_t sub = ((sizeClass - 1) % 4) + 1;
+  const size_t base = static_cast<size_t>(1) << power;
+  return base + (sub * (base / 4));
+}
+
+size_t SlabAllocator::getSlotSize(size_t size)
+{
+  auto sizeClass = getSizeClass(size);
+  if (sizeClass == s_oversizedClass) {
+    return size;
+  }
+  return getClassSlotSize(sizeClass);
+}
+
+SlabAllocator::Buffer SlabAllocator::allocate(size_t size)
+{
+  if (size > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("Trying to allocate a slab buffer of " + std::to_string(size) + " bytes");
+  }
+
+  const auto sizeClass = getSizeClass(size);
+  if (sizeClass == s_oversizedClass) {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    auto* data = new uint8_t[size];
+    {
+      auto state = d_state.lock();
+      state->d_stats.d_allocatedBytes += size;
+      state->d_stats.d_usedBytes += size;
+    }
+    return {this, data, static_cast<uint32_t>(size), sizeClass};
+  }
+
+  const size_t slotSize = getClassSlotSize(sizeClass);
+  auto state = d_state.lock();
+  auto& slabClass = state->d_classes.at(sizeClass);
+  uint8_t* data = nullptr;
+  if (slabClass.d_freeList != nullptr) {
+    data = slabClass.d_freeList;
+    memcpy(&slabClass.d_freeList, data, sizeof(slabClass.d_freeList));
+  }
+  else {
+    const size_t slotsPerChunk = s_chunkSize / slotSize;
+    if (slabClass.d_chunks.empty() || slabClass.d_nextSlotInChunk >= slotsPerChunk) {
+      slabClass.d_chunks.push_back(std::make_unique<uint8_t[]>(s_chunkSize));
+      slabClass.d_nextSlotInChunk = 0;
+      state->d_stats.d_allocatedBytes += s_chunkSize;
+    }
+    data = slabClass.d_chunks.back().get() + (slabClass.d_nextSlotInChunk * slotSize);
+    ++slabClass.d_nextSlotInChunk;
+  }
+
+  ++slabClass.d_usedSlots;
+  state->d_stats.d_usedBytes += slotSize;
+  return {this, data, static_cast<uint32_t>(size), sizeClass};
+}
+
+void SlabAllocator::release(uint8_t* data, uint32_t size, uint8_t sizeClass)
+{
+  if (sizeClass == s_oversizedClass) {
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory)
+    delete[] data;
+    auto state = d_state.lock();
+    state->d_stats.d_allocatedBytes -= size;
+    state->d_stats.d_usedBytes -= size;
+    return;
+  }
+
+  auto state = d_state.lock();
+  auto& slabClass = state->d_classes.at(sizeClass);
+  state->d_stats.d_usedBytes -= getClassSlotSize(sizeClass);
+  if (--slabClass.d_usedSlots == 0) {
+    /* nothing left in this class, give the memory back */
+    state->d_stats.d_allocatedBytes -= slabClass.d_chunks.size() * s_chunkSize;
+    slabClass.d_chunks.clear();
+    slabClass.d_freeList = nullptr;
+    slabClass.d_nextSlotInChunk = 0;
+    return;
+  }
+
+  memcpy(data, &slabClass.d_freeList, sizeof(slabClass.d_freeList));
+  slabClass.d_freeList = data;
+}
+
+SlabAllocator::Stats SlabAllocator::getStats() const
+{
+  return d_state.lock()->d_stats;
+}
+
+void SlabAllocator::Buffer::release()
+{
+  if (d_allocator != nullptr && d_data != nullptr) {
+    d_allocator->release(d_data, d_size, d_sizeClass);
+  }
+  d_allocator = nullptr;
+  d_data = nullptr;
+  d_size = 0;
+}
+}
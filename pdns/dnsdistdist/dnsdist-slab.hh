@@ -0,0 +1,156 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "lock.hh"
+
+namespace dnsdist
+{
+/*
+  Hands out fixed-size slots, grouped into size classes (four per power of two,
+  between 64 bytes and 16 kB), carved out of 64 kB chunks. Freed slots are kept
+  in a per-class free list and reused for the next allocation of the same class,
+  and the chunks of a class are given back to the system once none of its slots
+  is in use anymore. Larger allocations are served from the regular heap.
+  Allocating and releasing are thread-safe.
+*/
+class SlabAllocator
+{
+public:
+  struct Stats
+  {
+    /* memory obtained from the system, including unused slots */
+    uint64_t d_allocatedBytes{0};
+    /* memory held by the slots currently in use */
+    uint64_t d_usedBytes{0};
+  };
+
+  /* A move-only handle to an allocated slot, released on destruction. The
+     allocator needs to outlive it. */
+  class Buffer
+  {
+  public:
+    Buffer() = default;
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+    Buffer(Buffer&& rhs) noexcept :
+      d_allocator(rhs.d_allocator), d_data(rhs.d_data), d_size(rhs.d_size), d_sizeClass(rhs.d_sizeClass)
+    {
+      rhs.d_allocator = nullptr;
+      rhs.d_data = nullptr;
+      rhs.d_size = 0;
+    }
+    Buffer& operator=(Buffer&& rhs) noexcept
+    {
+      if (this != &rhs) {
+        release();
+        d_allocator = rhs.d_allocator;
+        d_data = rhs.d_data;
+        d_size = rhs.d_size;
+        d_sizeClass = rhs.d_sizeClass;
+        rhs.d_allocator = nullptr;
+        rhs.d_data = nullptr;
+        rhs.d_size = 0;
+      }
+      return *this;
+    }
+    ~Buffer()
+    {
+      release();
+    }
+
+    [[nodiscard]] uint8_t* data()
+    {
+      return d_data;
+    }
+    [[nodiscard]] const uint8_t* data() const
+    {
+      return d_data;
+    }
+    /* the requested size, not the size of the slot */
+    [[nodiscard]] size_t size() const
+    {
+      return d_size;
+    }
+
+  private:
+    friend class SlabAllocator;
+    Buffer(SlabAllocator* allocator, uint8_t* data, uint32_t size, uint8_t sizeClass) :
+      d_allocator(allocator), d_data(data), d_size(size), d_sizeClass(sizeClass)
+    {
+    }
+    void release();
+
+    SlabAllocator* d_allocator{nullptr};
+    uint8_t* d_data{nullptr};
+    uint32_t d_size{0};
+    uint8_t d_sizeClass{0};
+  };
+
+  SlabAllocator() = default;
+  SlabAllocator(const SlabAllocator&) = delete;
+  SlabAllocator(SlabAllocator&&) = delete;
+  SlabAllocator& operator=(const SlabAllocator&) = delete;
+  SlabAllocator& operator=(SlabAllocator&&) = delete;
+  ~SlabAllocator() = default;
+
+  [[nodiscard]] Buffer allocate(size_t size);
+  [[nodiscard]] Stats getStats() const;
+
+  [[nodiscard]] static size_t getSlotSize(size_t size);
+
+private:
+  static constexpr size_t s_minSlotSize{64};
+  static constexpr size_t s_maxSlotSize{16384};
+  static constexpr size_t s_chunkSize{65536};
+  /* 64 bytes, then four classes for every power of two up to 16384 bytes */
+  static constexpr uint8_t s_numberOfClasses{33};
+  static constexpr uint8_t s_oversizedClass{s_numberOfClasses};
+
+  struct SizeClass
+  {
+    std::vector<std::unique_ptr<uint8_t[]>> d_chunks;
+    /* singly-linked list of released slots, the pointer to the next one being stored in the slot itself */
+    uint8_t* d_freeList{nullptr};
+    /* next never-used slot in the last chunk */
+    size_t d_nextSlotInChunk{0};
+    size_t d_usedSlots{0};
+  };
+
+  struct State
+  {
+    std::array<SizeClass, s_numberOfClasses> d_classes;
+    Stats d_stats;
+  };
+
+  static uint8_t getSizeClass(size_t size);
+  static size_t getClassSlotSize(uint8_t sizeClass);
+  void release(uint8_t* data, uint32_t size, uint8_t sizeClass);
+
+  mutable LockGuarded<State> d_state;
+};
+}
@@ -0,0 +1,112 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "dnsdist-sliding-counters.hh"
+
+namespace dnsdist
+{
+SlidingCounters::SlidingCounters(const Settings& settings) :
+  d_settings(settings)
+{
+  if (d_settings.d_windowSeconds == 0) {
+    throw std::runtime_error("The sliding window of the ring counters should be at least one second long");
+  }
+  if (d_settings.d_maxEntries == 0) {
+    throw std::runtime_error("The ring counters should be allowed to track at least one entry per second");
+  }
+}
+
+SlidingCounters::Window& SlidingCounters::getThreadWindow()
+{
+  return d_windows.get([this]() {
+    std::vector<Bucket> buckets;
+    /* one extra bucket so that the current second, which is still being filled,
+       does not prevent us from looking at the full window */
+    buckets.reserve(d_settings.d_windowSeconds + 1);
+    for (size_t idx = 0; idx <= d_settings.d_windowSeconds; idx++) {
+      buckets.emplace_back(d_settings.d_maxEntries);
+    }
+    return std::make_unique<LockGuarded<std::vector<Bucket>>>(std::move(buckets));
+  });
+}
+
+SlidingCounters::Bucket& SlidingCounters::getBucket(std::vector<Bucket>& buckets, time_t second)
+{
+  auto& bucket = buckets.at(static_cast<size_t>(second) % buckets.size());
+  if (bucket.d_second != second) {
+    bucket.clear(second);
+  }
+  return bucket;
+}
+
+void SlidingCounters::addQuery(const timespec& when, const ComboAddress& requestor, uint16_t qtype)
+{
+  auto buckets = getThreadWindow()->lock();
+  auto& bucket = getBucket(*buckets, when.tv_sec);
+  bucket.d_clients.get(requestor).queries++;
+  bucket.d_qtypes.get({requestor, qtype})++;
+}
+
+void SlidingCounters::addResponse(const timespec& when, const ComboAddress& requestor, const DNSName& name, int rcode, unsigned int size, bool cacheHit)
+{
+  auto buckets = getThreadWindow()->lock();
+  auto& bucket = getBucket(*buckets, when.tv_sec);
+  auto& client = bucket.d_clients.get(requestor);
+  client.responses++;
+  client.respBytes += size;
+  if (!cacheHit) {
+    client.cacheMisses++;
+  }
+  if (rcode >= 0 && static_cast<size_t>(rcode) < client.rcodes.size()) {
+    client.rcodes.at(rcode)++;
+  }
+
+  auto& stat = bucket.d_names.get(name);
+  if (rcode < 0) {
+    stat.drops++;
+  }
+  else if (rcode == RCode::NoError) {
+    stat.noerrors++;
+  }
+  else if (rcode == RCode::ServFail) {
+    stat.servfails++;
+  }
+  else if (rcode == RCode::NXDomain) {
+    stat.nxdomains++;
+  }
+  stat.queries++;
+  stat.bytes += size;
+  if (cacheHit) {
+    stat.hits++;
+  }
+}
+
+void SlidingCounters::clear()
+{
+  for (const auto& window : d_windows.getAll()) {
+    auto buckets = (*window)->lock();
+    for (auto& bucket : *buckets) {
+      bucket.clear(0);
+    }
+  }
+}
+}
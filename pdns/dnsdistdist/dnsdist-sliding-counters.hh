@@ -0,0 +1,254 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <array>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+#include "dnsname.hh"
+#include "iputils.hh"
+#include "lock.hh"
+#include "statnode.hh"
+#include "dnsdist-thread-registry.hh"
+
+namespace dnsdist
+{
+/*
+  A fixed-size table keeping track of the heaviest keys. Each key can only be
+  stored in a few slots, and when all of them are taken the lightest one is
+  evicted, so keys seen often are kept while rarely seen ones might be lost.
+  It never allocates once the table has been created, on the first insertion.
+*/
+template <typename Key, typename Value, typename Hash, typename KeyEqual>
+class HeavyHitterTable
+{
+public:
+  explicit HeavyHitterTable(size_t capacity)
+  {
+    d_capacity = 1;
+    while (d_capacity < capacity) {
+      d_capacity <<= 1;
+    }
+  }
+
+  /* returns the value associated to this key, inserting it if needed */
+  Value& get(const Key& key)
+  {
+    if (d_slots.empty()) {
+      d_slots.resize(d_capacity);
+    }
+
+    const auto mask = d_slots.size() - 1;
+    const auto hash = Hash()(key);
+    Slot* lightest = nullptr;
+    for (size_t probe = 0; probe < s_maxProbes; probe++) {
+      auto& slot = d_slots.at((hash + probe) & mask);
+      if (!slot.d_used) {
+        slot.d_key = key;
+        slot.d_value = Value();
+        slot.d_weight = 1;
+        slot.d_used = true;
+        d_size++;
+        return slot.d_value;
+      }
+      if (KeyEqual()(slot.d_key, key)) {
+        slot.d_weight++;
+        return slot.d_value;
+      }
+      if (lightest == nullptr || slot.d_weight < lightest->d_weight) {
+        lightest = &slot;
+      }
+    }
+
+    d_evictions++;
+    lightest->d_key = key;
+    lightest->d_value = Value();
+    lightest->d_weight = 1;
+    return lightest->d_value;
+  }
+
+  template <typename Visitor>
+  void visit(Visitor&& visitor) const
+  {
+    if (d_size == 0) {
+      return;
+    }
+    for (const auto& slot : d_slots) {
+      if (slot.d_used) {
+        visitor(slot.d_key, slot.d_value);
+      }
+    }
+  }
+
+  /* keeps the memory around */
+  void clear()
+  {
+    if (d_size == 0) {
+      return;
+    }
+    for (auto& slot : d_slots) {
+      slot.d_used = false;
+    }
+    d_size = 0;
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    return d_size;
+  }
+
+  [[nodiscard]] uint64_t getEvictions() const
+  {
+    return d_evictions;
+  }
+
+private:
+  static constexpr size_t s_maxProbes{8};
+
+  struct Slot
+  {
+    Key d_key{};
+    Value d_value{};
+    uint64_t d_weight{0};
+    bool d_used{false};
+  };
+
+  std::vector<Slot> d_slots;
+  size_t d_capacity;
+  size_t d_size{0};
+  uint64_t d_evictions{0};
+};
+
+/*
+  Per-second counters of the queries and responses, per client and per name,
+  over a sliding window of a few seconds. They are updated as the entries are
+  inserted into the rings, by the inserting thread, so that evaluating the
+  dynamic block rules does not require scanning the whole rings.
+  Only the heaviest clients and names of each thread are tracked every second,
+  so light ones might be under-counted, but counts are never over-estimated.
+*/
+class SlidingCounters
+{
+public:
+  struct Settings
+  {
+    /* the number of seconds the counters are kept for */
+    size_t d_windowSeconds{0};
+    /* the maximum number of clients, client and qtype pairs, and names
+       tracked by each thread for a given second */
+    size_t d_maxEntries{4096};
+  };
+
+  struct ClientCounters
+  {
+    uint64_t respBytes{0};
+    uint32_t queries{0};
+    uint32_t responses{0};
+    uint32_t cacheMisses{0};
+    std::array<uint32_t, 16> rcodes{};
+  };
+
+  struct ClientAndQType
+  {
+    ComboAddress client;
+    uint16_t qtype{0};
+  };
+
+  struct ClientAndQTypeHash
+  {
+    size_t operator()(const ClientAndQType& key) const
+    {
+      return ComboAddress::addressOnlyHash()(key.client) ^ (static_cast<size_t>(key.qtype) * 0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  struct ClientAndQTypeEqual
+  {
+    bool operator()(const ClientAndQType& lhs, const ClientAndQType& rhs) const
+    {
+      return lhs.qtype == rhs.qtype && ComboAddress::addressOnlyEqual()(lhs.client, rhs.client);
+    }
+  };
+
+  struct Bucket
+  {
+    explicit Bucket(size_t maxEntries) :
+      d_clients(maxEntries), d_qtypes(maxEntries), d_names(maxEntries)
+    {
+    }
+
+    void clear(time_t second)
+    {
+      d_second = second;
+      d_clients.clear();
+      d_qtypes.clear();
+      d_names.clear();
+    }
+
+    /* clients are tracked per address only, ignoring the source port */
+    HeavyHitterTable<ComboAddress, ClientCounters, ComboAddress::addressOnlyHash, ComboAddress::addressOnlyEqual> d_clients;
+    HeavyHitterTable<ClientAndQType, uint32_t, ClientAndQTypeHash, ClientAndQTypeEqual> d_qtypes;
+    HeavyHitterTable<DNSName, StatNode::Stat, std::hash<DNSName>, std::equal_to<DNSName>> d_names;
+    time_t d_second{0};
+  };
+
+  SlidingCounters(const Settings& settings);
+
+  void addQuery(const timespec& when, const ComboAddress& requestor, uint16_t qtype);
+  /* a negative rcode indicates a timeout */
+  void addResponse(const timespec& when, const ComboAddress& requestor, const DNSName& name, int rcode, unsigned int size, bool cacheHit);
+
+  /* calls the visitor for every non-empty bucket of every thread holding the counters
+     for a second between oldest and newest, inclusive. Can be called from any thread,
+     but the thread owning the bucket cannot update its counters in the meantime */
+  template <typename Visitor>
+  void visit(time_t oldest, time_t newest, Visitor&& visitor) const
+  {
+    for (const auto& window : d_windows.getAll()) {
+      auto buckets = (*window)->lock();
+      for (const auto& bucket : *buckets) {
+        if (bucket.d_second < oldest || bucket.d_second > newest) {
+          continue;
+        }
+        visitor(bucket);
+      }
+    }
+  }
+
+  void clear();
+
+  [[nodiscard]] size_t getWindowSeconds() const
+  {
+    return d_settings.d_windowSeconds;
+  }
+
+private:
+  using Window = std::unique_ptr<LockGuarded<std::vector<Bucket>>>;
+  Bucket& getBucket(std::vector<Bucket>& buckets, time_t second);
+  Window& getThreadWindow();
+
+  mutable ThreadLocalRegistry<Window> d_windows;
+  const Settings d_settings;
+};
+}
@@ -0,0 +1,146 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+namespace dnsdist
+{
+/*
+  A fixed-size ring of trivially copyable entries, written by a single thread
+  and read by any number of threads without taking any lock.
+  When the ring is full the oldest entry is overwritten. Each slot is protected
+  by a sequence number (a seqlock): readers copy the content of a slot, then
+  check that the sequence number did not change while they were doing so,
+  skipping the entry otherwise. The content is stored in relaxed atomic words
+  so that a concurrent read and write is not a data race.
+*/
+template <typename T>
+class SnapshotRing
+{
+  static_assert(std::is_trivially_copyable_v<T>, "SnapshotRing entries need to be trivially copyable");
+
+public:
+  explicit SnapshotRing(size_t capacity) :
+    d_slots(std::make_unique<Slot[]>(capacity)), d_capacity(capacity)
+  {
+    if (capacity == 0) {
+      throw std::runtime_error("Trying to create a 0-sized ring");
+    }
+  }
+
+  /* can only be called from the thread owning the ring. Returns true if
+     an entry had to be overwritten to make room for this one */
+  bool push(const T& entry)
+  {
+    std::array<uint64_t, s_words> raw{};
+    memcpy(raw.data(), &entry, sizeof(T));
+
+    const auto index = d_head.load(std::memory_order_relaxed);
+    auto& slot = d_slots[index % d_capacity];
+    /* an odd value means that the slot is being written to */
+    slot.d_sequence.store((index * 2) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t idx = 0; idx < s_words; idx++) {
+      slot.d_words.at(idx).store(raw.at(idx), std::memory_order_relaxed);
+    }
+    slot.d_sequence.store((index * 2) + 2, std::memory_order_release);
+    d_head.store(index + 1, std::memory_order_release);
+
+    return index >= d_oldest.load(std::memory_order_relaxed) + d_capacity;
+  }
+
+  /* calls the visitor with a copy of every entry currently in the ring, from the
+     oldest to the most recent one, until it returns false. Entries written to
+     while we are reading them are skipped. Can be called from any thread. */
+  template <typename Visitor>
+  void visit(Visitor&& visitor) const
+  {
+    const auto head = d_head.load(std::memory_order_acquire);
+    auto start = head > d_capacity ? head - d_capacity : 0;
+    start = std::max(start, d_oldest.load(std::memory_order_acquire));
+
+    std::array<uint64_t, s_words> raw{};
+    T entry;
+    for (auto index = start; index < head; index++) {
+      const auto& slot = d_slots[index % d_capacity];
+      const uint64_t expected = (index * 2) + 2;
+      if (slot.d_sequence.load(std::memory_order_acquire) != expected) {
+        /* already overwritten by a newer entry */
+        continue;
+      }
+      for (size_t idx = 0; idx < s_words; idx++) {
+        raw.at(idx) = slot.d_words.at(idx).load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.d_sequence.load(std::memory_order_relaxed) != expected) {
+        continue;
+      }
+      memcpy(&entry, raw.data(), sizeof(T));
+      if (!visitor(entry)) {
+        return;
+      }
+    }
+  }
+
+  /* forget about all existing entries, can be called from any thread */
+  void clear()
+  {
+    d_oldest.store(d_head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    const auto head = d_head.load(std::memory_order_acquire);
+    const auto oldest = d_oldest.load(std::memory_order_acquire);
+    return std::min(head - std::min(head, oldest), static_cast<uint64_t>(d_capacity));
+  }
+
+  [[nodiscard]] size_t capacity() const
+  {
+    return d_capacity;
+  }
+
+private:
+  static constexpr size_t s_words = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+  struct Slot
+  {
+    std::atomic<uint64_t> d_sequence{0};
+    std::array<std::atomic<uint64_t>, s_words> d_words{};
+  };
+
+  std::unique_ptr<Slot[]> d_slots;
+  const size_t d_capacity;
+  /* index of the next entry to be written */
+  std::atomic<uint64_t> d_head{0};
+  /* entries before this index have been cleared */
+  std::atomic<uint64_t> d_oldest{0};
+};
+}
@@ -320,7 +320,7 @@ void TCPConnectionToBackend::handleReconnectionAttempt(std::shared_ptr<TCPConnec
 
     try {
       if (conn->reconnect()) {
-        conn->d_ioState = make_unique<IOStateHandler>(*conn->d_mplexer, conn->d_handler->getDescriptor());
+        conn->d_ioState = make_unique<IOStateHandler>(*conn->d_mplexer.get(), conn->d_handler->getDescriptor());
 
         /* we need to resend the queries that were in flight, if any */
         if (conn->d_state == State::sendingQueryToBackend) {
@@ -549,7 +549,7 @@ void TCPConnectionToBackend::queueQuery(std::shared_ptr<TCPQuerySender>& sender,
 {
   auto closer = query.d_idstate.getCloser(classnamePrefix + __func__);
   if (!d_ioState) {
-    d_ioState = make_unique<IOStateHandler>(*d_mplexer, d_handler->getDescriptor());
+    d_ioState = make_unique<IOStateHandler>(*d_mplexer.get(), d_handler->getDescriptor());
   }
 
   // if we are not already sending a query or in the middle of reading a response (so idle),
@@ -748,7 +748,7 @@ IOState TCPConnectionToBackend::handleResponse(std::shared_ptr<TCPConnectionToBa
   --conn->d_ds->outstanding;
   auto ids = std::move(it->second.d_query.d_idstate);
   const double udiff = ids.queryRealTime.udiff();
-  conn->d_ds->updateTCPLatency(udiff);
+  conn->d_ds->updateTCPLatency(udiff, ids.queryRealTime.d_start);
   if (d_responseBuffer.size() >= sizeof(dnsheader)) {
     dnsheader dh;
     memcpy(&dh, d_responseBuffer.data(), sizeof(dh));
@@ -903,6 +903,11 @@ void setTCPDownstreamMaxIdleConnectionsPerBackend(uint64_t max)
   DownstreamTCPConnectionsManager::setMaxIdleConnectionsPerDownstream(max);
 }
 
+void setTCPDownstreamMaxSharedIdleConnectionsPerBackend(uint64_t max)
+{
+  DownstreamTCPConnectionsManager::setMaxSharedIdleConnectionsPerDownstream(max);
+}
+
 void setTCPDownstreamCleanupInterval(uint64_t interval)
 {
   DownstreamTCPConnectionsManager::setCleanupInterval(interval);
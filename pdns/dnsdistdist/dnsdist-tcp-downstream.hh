@@ -116,6 +116,28 @@ public:
     return true;
   }
 
+  /* whether this connection can be handed over to a different thread:
+     it has to be idle and not waiting for any event from the multiplexer */
+  bool canBeShared() const
+  {
+    if (d_connectionDied || !d_handler || reachedMaxStreamID() || !isIdle()) {
+      return false;
+    }
+    return !d_ioState || (!d_ioState->isWaitingForRead() && !d_ioState->isWaitingForWrite());
+  }
+
+  /* must only be called by the thread owning the connection, when canBeShared() is true */
+  void detachFromMultiplexer()
+  {
+    d_ioState.reset();
+  }
+
+  /* must only be called by the thread that is now owning the connection */
+  void attachToMultiplexer(std::unique_ptr<FDMultiplexer>& mplexer)
+  {
+    d_mplexer = mplexer;
+  }
+
   virtual bool reachedMaxStreamID() const = 0;
   virtual bool reachedMaxConcurrentQueries() const = 0;
   virtual bool isIdle() const = 0;
@@ -211,7 +233,8 @@ protected:
   struct timeval d_lastDataReceivedTime;
   const std::shared_ptr<DownstreamState> d_ds{nullptr};
   std::shared_ptr<TCPQuerySender> d_sender{nullptr};
-  std::unique_ptr<FDMultiplexer>& d_mplexer;
+  /* the multiplexer of the thread currently owning this connection */
+  std::reference_wrapper<std::unique_ptr<FDMultiplexer>> d_mplexer;
   std::unique_ptr<TCPIOHandler> d_handler{nullptr};
   std::unique_ptr<IOStateHandler> d_ioState{nullptr};
   uint64_t d_queries{0};
@@ -308,5 +331,6 @@ private:
 };
 
 void setTCPDownstreamMaxIdleConnectionsPerBackend(uint64_t max);
+void setTCPDownstreamMaxSharedIdleConnectionsPerBackend(uint64_t max);
 void setTCPDownstreamCleanupInterval(uint64_t interval);
 void setTCPDownstreamMaxIdleTime(uint64_t max);
@@ -19,6 +19,8 @@ public:
   pdns::channel::Receiver<CrossProtocolQuery> crossProtocolQueryReceiver;
   pdns::channel::Receiver<TCPCrossProtocolResponse> crossProtocolResponseReceiver;
   pdns::channel::Sender<TCPCrossProtocolResponse> crossProtocolResponseSender;
+  /* replaced by the one shared with the TCPClientCollection for actual TCP workers */
+  std::shared_ptr<TCPClientCollection::WorkerLoad> load{std::make_shared<TCPClientCollection::WorkerLoad>()};
 };
 
 class IncomingTCPConnectionState : public TCPQuerySender, public std::enable_shared_from_this<IncomingTCPConnectionState>
@@ -42,6 +44,7 @@ public:
 
     /* we manage the release of the downstream connection ourselves */
     d_releaseConnection = false;
+    ++d_threadData.load->d_activeConnections;
   }
 
   IncomingTCPConnectionState(const IncomingTCPConnectionState& rhs) = delete;
@@ -152,6 +155,8 @@ public:
   size_t d_proxyProtocolNeed{0};
   size_t d_queriesCount{0};
   size_t d_currentQueriesCount{0};
+  /* total size of d_queuedResponses, in bytes */
+  size_t d_queuedResponsesBytes{0};
   std::thread::id d_creatorThreadID;
   uint16_t d_querySize{0};
   uint16_t d_readIOsCurrentQuery{0};
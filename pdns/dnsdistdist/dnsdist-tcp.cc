@@ -65,6 +65,9 @@ std::atomic<uint64_t> g_tcpStatesDumpRequested{0};
 
 IncomingTCPConnectionState::~IncomingTCPConnectionState()
 {
+  --d_threadData.load->d_activeConnections;
+  d_threadData.load->d_queuedResponseBytes -= d_queuedResponsesBytes;
+
   try {
     dnsdist::IncomingConcurrentTCPConnectionsManager::accountClosedTCPConnection(d_ci.remote);
   }
@@ -172,10 +175,10 @@ std::shared_ptr<TCPConnectionToBackend> IncomingTCPConnectionState::getDownstrea
   return downstream;
 }
 
-static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryReceiver, pdns::channel::Receiver<CrossProtocolQuery>&& crossProtocolQueryReceiver, pdns::channel::Receiver<TCPCrossProtocolResponse>&& crossProtocolResponseReceiver, pdns::channel::Sender<TCPCrossProtocolResponse>&& crossProtocolResponseSender, std::vector<ClientState*> tcpAcceptStates);
+static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryReceiver, pdns::channel::Receiver<CrossProtocolQuery>&& crossProtocolQueryReceiver, pdns::channel::Receiver<TCPCrossProtocolResponse>&& crossProtocolResponseReceiver, pdns::channel::Sender<TCPCrossProtocolResponse>&& crossProtocolResponseSender, std::vector<ClientState*> tcpAcceptStates, std::shared_ptr<TCPClientCollection::WorkerLoad> load);
 
 TCPClientCollection::TCPClientCollection(size_t maxThreads, std::vector<ClientState*> tcpAcceptStates) :
-  d_tcpclientthreads(maxThreads), d_maxthreads(maxThreads)
+  d_tcpclientthreads(maxThreads), d_maxthreads(maxThreads), d_leastLoadedDispatch(dnsdist::configuration::getImmutableConfiguration().d_tcpDispatchToLeastLoadedWorker)
 {
   for (size_t idx = 0; idx < maxThreads; idx++) {
     addTCPClientThread(tcpAcceptStates);
@@ -200,10 +203,11 @@ void TCPClientCollection::addTCPClientThread(std::vector<ClientState*>& tcpAccep
       return;
     }
 
-    TCPWorkerThread worker(std::move(queryChannelSender), std::move(crossProtocolQueryChannelSender));
+    auto load = std::make_shared<WorkerLoad>();
+    TCPWorkerThread worker(std::move(queryChannelSender), std::move(crossProtocolQueryChannelSender), load);
 
     try {
-      std::thread clientThread(tcpClientThread, std::move(queryChannelReceiver), std::move(crossProtocolQueryChannelReceiver), std::move(crossProtocolResponseChannelReceiver), std::move(crossProtocolResponseChannelSender), tcpAcceptStates);
+      std::thread clientThread(tcpClientThread, std::move(queryChannelReceiver), std::move(crossProtocolQueryChannelReceiver), std::move(crossProtocolResponseChannelReceiver), std::move(crossProtocolResponseChannelSender), tcpAcceptStates, std::move(load));
       clientThread.detach();
     }
     catch (const std::runtime_error& e) {
@@ -229,6 +233,8 @@ static IOState sendQueuedResponses(std::shared_ptr<IncomingTCPConnectionState>&
     DEBUGLOG("queue size is " << state->d_queuedResponses.size() << ", sending the next one");
     TCPResponse resp = std::move(state->d_queuedResponses.front());
     state->d_queuedResponses.pop_front();
+    state->d_queuedResponsesBytes -= resp.d_buffer.size();
+    state->d_threadData.load->d_queuedResponseBytes -= resp.d_buffer.size();
     state->d_state = IncomingTCPConnectionState::State::idle;
     result = state->sendResponse(now, std::move(resp));
     if (result != IOState::Done) {
@@ -471,6 +477,8 @@ void IncomingTCPConnectionState::terminateClientConnection()
 {
   DEBUGLOG("terminating client connection");
   d_queuedResponses.clear();
+  d_threadData.load->d_queuedResponseBytes -= d_queuedResponsesBytes;
+  d_queuedResponsesBytes = 0;
   /* we have already released idle connections that could be reused,
      we don't care about the ones still waiting for responses */
   for (auto& backend : d_ownedConnectionsToBackend) {
@@ -509,6 +517,8 @@ void IncomingTCPConnectionState::queueResponse(std::shared_ptr<IncomingTCPConnec
 {
   auto closer = response.d_idstate.getCloser(__func__); // NOLINT(cppcoreguidelines-pro-bounds-array-to-pointer-decay)
   // queue response
+  state->d_queuedResponsesBytes += response.d_buffer.size();
+  state->d_threadData.load->d_queuedResponseBytes += response.d_buffer.size();
   state->d_queuedResponses.emplace_back(std::move(response));
   DEBUGLOG("queueing response, state is " << (int)state->d_state << ", queue size is now " << state->d_queuedResponses.size());
 
@@ -1469,6 +1479,7 @@ static void handleIncomingTCPQuery(int pipefd, FDMultiplexer::funcparam_t& param
   }
 
   g_tcpclientthreads->decrementQueuedCount();
+  --threadData->load->d_pendingConnections;
 
   timeval now{};
   gettimeofday(&now, nullptr);
@@ -1660,12 +1671,12 @@ static void dumpTCPStates(const TCPClientThreadData& data)
         infolog(" - Worker thread pipe");
       }
     });
-    infolog("The TCP/DoT client cache has %d active and %d idle outgoing connections cached", t_downstreamTCPConnectionsManager.getActiveCount(), t_downstreamTCPConnectionsManager.getIdleCount());
+    infolog("The TCP/DoT client cache has %d active and %d idle outgoing connections cached, and %d idle outgoing connections are shared between threads", t_downstreamTCPConnectionsManager.getActiveCount(), t_downstreamTCPConnectionsManager.getIdleCount(), DownstreamTCPConnectionsManager::getSharedIdleCount());
   }
 }
 
 // NOLINTNEXTLINE(performance-unnecessary-value-param): you are wrong, clang-tidy, go home
-static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryReceiver, pdns::channel::Receiver<CrossProtocolQuery>&& crossProtocolQueryReceiver, pdns::channel::Receiver<TCPCrossProtocolResponse>&& crossProtocolResponseReceiver, pdns::channel::Sender<TCPCrossProtocolResponse>&& crossProtocolResponseSender, std::vector<ClientState*> tcpAcceptStates)
+static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryReceiver, pdns::channel::Receiver<CrossProtocolQuery>&& crossProtocolQueryReceiver, pdns::channel::Receiver<TCPCrossProtocolResponse>&& crossProtocolResponseReceiver, pdns::channel::Sender<TCPCrossProtocolResponse>&& crossProtocolResponseSender, std::vector<ClientState*> tcpAcceptStates, std::shared_ptr<TCPClientCollection::WorkerLoad> load)
 {
   /* we get launched with a pipe on which we receive file descriptors from clients that we own
      from that point on */
@@ -1678,6 +1689,7 @@ static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryRecei
     data.queryReceiver = std::move(queryReceiver);
     data.crossProtocolQueryReceiver = std::move(crossProtocolQueryReceiver);
     data.crossProtocolResponseReceiver = std::move(crossProtocolResponseReceiver);
+    data.load = std::move(load);
 
     data.mplexer->addReadFD(data.queryReceiver.getDescriptor(), handleIncomingTCPQuery, &data);
     data.mplexer->addReadFD(data.crossProtocolQueryReceiver.getDescriptor(), handleCrossProtocolQuery, &data);
@@ -1720,6 +1732,7 @@ static void tcpClientThread(pdns::channel::Receiver<ConnectionInfo>&& queryRecei
 
       try {
         t_downstreamTCPConnectionsManager.cleanupClosedConnections(now);
+        t_downstreamTCPConnectionsManager.shareIdleConnections(now);
         dnsdist::IncomingConcurrentTCPConnectionsManager::cleanup(time(nullptr));
 
         if (now.tv_sec > lastTimeoutScan) {
@@ -219,6 +219,25 @@ struct CrossProtocolQuery
 class TCPClientCollection
 {
 public:
+  /* how busy a TCP worker is, updated by the worker itself except for the pending connections */
+  struct WorkerLoad
+  {
+    /* a queued response of the maximum DNS message size weights as much as a connection */
+    static constexpr uint64_t s_bytesPerConnection{65535};
+
+    uint64_t getScore() const
+    {
+      return d_pendingConnections.load() + d_activeConnections.load() + (d_queuedResponseBytes.load() / s_bytesPerConnection);
+    }
+
+    /* connections passed to the worker that it has not picked up yet */
+    stat_t d_pendingConnections{0};
+    /* incoming connections currently handled by the worker */
+    stat_t d_activeConnections{0};
+    /* size of the responses waiting to be sent to the clients, in bytes */
+    stat_t d_queuedResponseBytes{0};
+  };
+
   TCPClientCollection(size_t maxThreads, std::vector<ClientState*> tcpAcceptStates);
 
   bool passConnectionToThread(std::unique_ptr<ConnectionInfo>&& conn)
@@ -227,13 +246,15 @@ public:
       throw std::runtime_error("No TCP worker thread yet");
     }
 
-    uint64_t pos = d_pos++;
-    /* we need to increment this counter _before_ writing to the pipe,
+    auto& worker = d_tcpclientthreads.at(d_leastLoadedDispatch ? getLeastLoadedWorker() : (d_pos++ % d_numthreads));
+    /* we need to increment these counters _before_ writing to the pipe,
        otherwise there is a very real possibility that the other end
        decrement the counter before we can increment it, leading to an underflow */
     ++d_queued;
-    if (!d_tcpclientthreads.at(pos % d_numthreads).d_querySender.send(std::move(conn))) {
+    ++worker.d_load->d_pendingConnections;
+    if (!worker.d_querySender.send(std::move(conn))) {
       --d_queued;
+      --worker.d_load->d_pendingConnections;
       ++dnsdist::metrics::g_stats.tcpQueryPipeFull;
       return false;
     }
@@ -276,17 +297,44 @@ public:
     --d_queued;
   }
 
+  /* idx should be lower than getThreadsCount() */
+  const WorkerLoad& getWorkerLoad(size_t idx) const
+  {
+    return *d_tcpclientthreads.at(idx).d_load;
+  }
+
 private:
   void addTCPClientThread(std::vector<ClientState*>& tcpAcceptStates);
 
+  size_t getLeastLoadedWorker()
+  {
+    const uint64_t numThreads = d_numthreads;
+    /* start from a different worker every time so that ties are spread evenly */
+    const uint64_t start = d_pos++;
+    size_t best = start % numThreads;
+    uint64_t bestScore = std::numeric_limits<uint64_t>::max();
+    for (uint64_t idx = 0; idx < numThreads; idx++) {
+      const size_t pos = (start + idx) % numThreads;
+      const auto score = d_tcpclientthreads.at(pos).d_load->getScore();
+      if (score < bestScore) {
+        best = pos;
+        bestScore = score;
+        if (score == 0) {
+          break;
+        }
+      }
+    }
+    return best;
+  }
+
   struct TCPWorkerThread
   {
     TCPWorkerThread()
     {
     }
 
-    TCPWorkerThread(pdns::channel::Sender<ConnectionInfo>&& querySender, pdns::channel::Sender<CrossProtocolQuery>&& crossProtocolQuerySender) :
-      d_querySender(std::move(querySender)), d_crossProtocolQuerySender(std::move(crossProtocolQuerySender))
+    TCPWorkerThread(pdns::channel::Sender<ConnectionInfo>&& querySender, pdns::channel::Sender<CrossProtocolQuery>&& crossProtocolQuerySender, std::shared_ptr<WorkerLoad> load) :
+      d_querySender(std::move(querySender)), d_crossProtocolQuerySender(std::move(crossProtocolQuerySender)), d_load(std::move(load))
     {
     }
 
@@ -297,6 +345,8 @@ private:
 
     pdns::channel::Sender<ConnectionInfo> d_querySender;
     pdns::channel::Sender<CrossProtocolQuery> d_crossProtocolQuerySender;
+    /* shared with the worker thread */
+    std::shared_ptr<WorkerLoad> d_load;
   };
 
   std::vector<TCPWorkerThread> d_tcpclientthreads;
@@ -304,6 +354,7 @@ private:
   stat_t d_pos{0};
   stat_t d_queued{0};
   const uint64_t d_maxthreads{0};
+  const bool d_leastLoadedDispatch{false};
 };
 
 namespace dnsdist::tcp
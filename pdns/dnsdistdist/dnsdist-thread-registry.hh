@@ -0,0 +1,141 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "lock.hh"
+
+namespace dnsdist
+{
+/*
+  Keeps one object per thread, created the first time a given thread asks for it,
+  while allowing any thread to get all the existing objects. Looking up the object
+  of the current thread does not take any lock once it has been created.
+  When a thread exits its object is orphaned and the next new thread adopts it,
+  so the number of objects is bounded by the maximum number of threads that were
+  alive at the same time.
+*/
+template <typename T>
+class ThreadLocalRegistry
+{
+public:
+  ThreadLocalRegistry() :
+    d_instanceID(++s_instances)
+  {
+  }
+
+  /* returns the object of the current thread, calling factory() to create it if needed */
+  template <typename Factory>
+  T& get(Factory&& factory)
+  {
+    static thread_local CachedEntry t_cached;
+    const auto instanceID = d_instanceID.load(std::memory_order_acquire);
+    if (t_cached.instanceID == instanceID && t_cached.entry) {
+      return t_cached.entry->object;
+    }
+
+    t_cached.release();
+    t_cached.instanceID = instanceID;
+
+    auto entries = d_entries.lock();
+    for (const auto& entry : *entries) {
+      bool orphaned = true;
+      if (entry->orphaned.compare_exchange_strong(orphaned, false, std::memory_order_acquire)) {
+        t_cached.entry = entry;
+        return entry->object;
+      }
+    }
+
+    auto entry = std::make_shared<Entry>(factory());
+    entries->push_back(entry);
+    t_cached.entry = std::move(entry);
+    return t_cached.entry->object;
+  }
+
+  /* returns the objects of all threads, can be called from any thread */
+  [[nodiscard]] std::vector<std::shared_ptr<T>> getAll() const
+  {
+    std::vector<std::shared_ptr<T>> result;
+    auto entries = d_entries.lock();
+    result.reserve(entries->size());
+    for (const auto& entry : *entries) {
+      result.emplace_back(entry, &entry->object);
+    }
+    return result;
+  }
+
+  /* forget about all existing objects. Should not be called while another
+     thread is using its object */
+  void clear()
+  {
+    d_entries.lock()->clear();
+    d_instanceID.store(++s_instances, std::memory_order_release);
+  }
+
+private:
+  struct Entry
+  {
+    explicit Entry(T&& object_) :
+      object(std::move(object_))
+    {
+    }
+
+    T object;
+    std::atomic<bool> orphaned{false};
+  };
+
+  struct CachedEntry
+  {
+    CachedEntry() = default;
+    CachedEntry(const CachedEntry&) = delete;
+    CachedEntry(CachedEntry&&) = delete;
+    CachedEntry& operator=(const CachedEntry&) = delete;
+    CachedEntry& operator=(CachedEntry&&) = delete;
+    ~CachedEntry()
+    {
+      release();
+    }
+
+    void release()
+    {
+      if (entry) {
+        /* release so that the thread adopting it sees everything we did */
+        entry->orphaned.store(true, std::memory_order_release);
+        entry.reset();
+      }
+    }
+
+    uint64_t instanceID{0};
+    std::shared_ptr<Entry> entry;
+  };
+
+  /* instance IDs are never reused, so a cached entry can be used as long as the IDs match */
+  static inline std::atomic<uint64_t> s_instances{0};
+
+  mutable LockGuarded<std::vector<std::shared_ptr<Entry>>> d_entries;
+  std::atomic<uint64_t> d_instanceID;
+};
+}
@@ -44,6 +44,7 @@
 #include "dnsdist-rings.hh"
 #include "dnsdist-rule-chains.hh"
 #include "dnsdist-rules.hh"
+#include "dnsdist-tcp.hh"
 #include "dnsdist-web.hh"
 #include "dolog.hh"
 #include "gettime.hh"
@@ -119,6 +120,12 @@ std::map<std::string, MetricDefinition> MetricDefinitionStorage::metrics{
   {"tcp-query-pipe-full", MetricDefinition(PrometheusMetricType::counter, "Number of TCP queries dropped because the internal pipe used to distribute queries was full")},
   {"tcp-cross-protocol-query-pipe-full", MetricDefinition(PrometheusMetricType::counter, "Number of TCP cross-protocol queries dropped because the internal pipe used to distribute queries was full")},
   {"tcp-cross-protocol-response-pipe-full", MetricDefinition(PrometheusMetricType::counter, "Number of TCP cross-protocol responses dropped because the internal pipe used to distribute queries was full")},
+  {"udp-responder-recv-batches", MetricDefinition(PrometheusMetricType::counter, "Number of recvmmsg() calls that returned at least one response from a backend")},
+  {"udp-responder-recv-batched", MetricDefinition(PrometheusMetricType::counter, "Number of responses from a backend received via recvmmsg()")},
+  {"udp-responder-send-batches", MetricDefinition(PrometheusMetricType::counter, "Number of batches of responses to UDP clients sent via sendmmsg() from the responder threads")},
+  {"udp-responder-send-batched", MetricDefinition(PrometheusMetricType::counter, "Number of responses to UDP clients sent via sendmmsg() from the responder threads")},
+  {"udp-gro-segments", MetricDefinition(PrometheusMetricType::counter, "Number of queries received as part of a datagram coalesced by the kernel (GRO)")},
+  {"udp-gso-segments", MetricDefinition(PrometheusMetricType::counter, "Number of responses to UDP clients sent as part of a segmented message (GSO)")},
   {"udp-in-errors", MetricDefinition(PrometheusMetricType::counter, "From /proc/net/snmp InErrors")},
   {"udp-noport-errors", MetricDefinition(PrometheusMetricType::counter, "From /proc/net/snmp NoPorts")},
   {"udp-recvbuf-errors", MetricDefinition(PrometheusMetricType::counter, "From /proc/net/snmp RcvbufErrors")},
@@ -592,6 +599,10 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
   output << "# TYPE " << statesbase << "tcpnewconnections "               << "counter"                                                                              << "\n";
   output << "# HELP " << statesbase << "tcpreusedconnections "            << "The number of times a TCP connection has been reused"                                 << "\n";
   output << "# TYPE " << statesbase << "tcpreusedconnections "            << "counter"                                                                              << "\n";
+  output << "# HELP " << statesbase << "tcpsharedparkedconnections "      << "The number of idle TCP connections handed over to the other threads"                  << "\n";
+  output << "# TYPE " << statesbase << "tcpsharedparkedconnections "      << "counter"                                                                              << "\n";
+  output << "# HELP " << statesbase << "tcpsharedreusedconnections "      << "The number of times a TCP connection handed over by another thread has been reused"   << "\n";
+  output << "# TYPE " << statesbase << "tcpsharedreusedconnections "      << "counter"                                                                              << "\n";
   output << "# HELP " << statesbase << "tcpavgqueriesperconn "            << "The average number of queries per TCP connection"                                     << "\n";
   output << "# TYPE " << statesbase << "tcpavgqueriesperconn "            << "gauge"                                                                                << "\n";
   output << "# HELP " << statesbase << "tcpavgconnduration "              << "The average duration of a TCP connection (ms)"                                        << "\n";
@@ -654,6 +665,8 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
     output << statesbase << "tcptoomanyconcurrentconnections"  << label << " " << state->tcpTooManyConcurrentConnections << "\n";
     output << statesbase << "tcpnewconnections"                << label << " " << state->tcpNewConnections               << "\n";
     output << statesbase << "tcpreusedconnections"             << label << " " << state->tcpReusedConnections            << "\n";
+    output << statesbase << "tcpsharedparkedconnections"       << label << " " << state->tcpSharedParkedConnections      << "\n";
+    output << statesbase << "tcpsharedreusedconnections"       << label << " " << state->tcpSharedReusedConnections      << "\n";
     output << statesbase << "tcpavgqueriesperconn"             << label << " " << state->tcpAvgQueriesPerConnection      << "\n";
     output << statesbase << "tcpavgconnduration"               << label << " " << state->tcpAvgConnectionDuration        << "\n";
     output << statesbase << "tlsresumptions"                   << label << " " << state->tlsResumptions                  << "\n";
@@ -859,6 +872,16 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
   output << "# TYPE dnsdist_pool_cache_ttl_too_shorts " << "counter" << "\n";
   output << "# HELP dnsdist_pool_cache_cleanup_count_total " << "Number of times the cache has been scanned to remove expired entries, if any" << "\n";
   output << "# TYPE dnsdist_pool_cache_cleanup_count_total " << "counter" << "\n";
+  output << "# HELP dnsdist_pool_cache_memory_allocated_bytes " << "Memory obtained from the system to store the entries of that cache, in bytes" << "\n";
+  output << "# TYPE dnsdist_pool_cache_memory_allocated_bytes " << "gauge" << "\n";
+  output << "# HELP dnsdist_pool_cache_memory_used_bytes " << "Memory actually used by the entries of that cache, in bytes" << "\n";
+  output << "# TYPE dnsdist_pool_cache_memory_used_bytes " << "gauge" << "\n";
+  output << "# HELP dnsdist_pool_cache_evictions " << "Number of entries removed from that cache by the eviction policy to make room for new ones" << "\n";
+  output << "# TYPE dnsdist_pool_cache_evictions " << "counter" << "\n";
+  output << "# HELP dnsdist_pool_cache_prefetches " << "Number of queries forwarded to refresh an entry of that cache before it expires" << "\n";
+  output << "# TYPE dnsdist_pool_cache_prefetches " << "counter" << "\n";
+  output << "# HELP dnsdist_pool_cache_coalesced_queries " << "Number of queries that waited for the response to an identical query instead of being forwarded" << "\n";
+  output << "# TYPE dnsdist_pool_cache_coalesced_queries " << "counter" << "\n";
 
   for (const auto& entry : dnsdist::configuration::getCurrentRuntimeConfiguration().d_pools) {
     string poolName = entry.first;
@@ -884,6 +907,11 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
       output << cachebase << "cache_insert_collisions" <<label << " " << cache->getInsertCollisions() << "\n";
       output << cachebase << "cache_ttl_too_shorts"    <<label << " " << cache->getTTLTooShorts()     << "\n";
       output << cachebase << "cache_cleanup_count_total"     <<label << " " << cache->getCleanupCount()     << "\n";
+      output << cachebase << "cache_memory_allocated_bytes"  <<label << " " << cache->getMemoryAllocated()  << "\n";
+      output << cachebase << "cache_memory_used_bytes"       <<label << " " << cache->getMemoryUsed()       << "\n";
+      output << cachebase << "cache_evictions"         <<label << " " << cache->getEvictions()        << "\n";
+      output << cachebase << "cache_prefetches"        <<label << " " << cache->getPrefetches()       << "\n";
+      output << cachebase << "cache_coalesced_queries" <<label << " " << cache->getCoalescedQueries() << "\n";
     }
   }
 
@@ -919,6 +947,23 @@ static void handlePrometheus(const YaHTTP::Request& req, YaHTTP::Response& resp)
   }
 #endif /* DISABLE_DYNBLOCKS */
 
+  if (g_tcpclientthreads) {
+    output << "# HELP dnsdist_tcp_worker_pending_connections " << "Number of incoming TCP connections passed to that TCP worker and not picked up yet" << "\n";
+    output << "# TYPE dnsdist_tcp_worker_pending_connections " << "gauge" << "\n";
+    output << "# HELP dnsdist_tcp_worker_active_connections " << "Number of incoming TCP connections currently handled by that TCP worker" << "\n";
+    output << "# TYPE dnsdist_tcp_worker_active_connections " << "gauge" << "\n";
+    output << "# HELP dnsdist_tcp_worker_queued_response_bytes " << "Size of the responses waiting to be sent to the clients by that TCP worker, in bytes" << "\n";
+    output << "# TYPE dnsdist_tcp_worker_queued_response_bytes " << "gauge" << "\n";
+    const auto workers = g_tcpclientthreads->getThreadsCount();
+    for (size_t idx = 0; idx < workers; idx++) {
+      const auto& load = g_tcpclientthreads->getWorkerLoad(idx);
+      const string label = "{worker=\"" + std::to_string(idx) + "\"}";
+      output << "dnsdist_tcp_worker_pending_connections" << label << " " << load.d_pendingConnections << "\n";
+      output << "dnsdist_tcp_worker_active_connections" << label << " " << load.d_activeConnections << "\n";
+      output << "dnsdist_tcp_worker_queued_response_bytes" << label << " " << load.d_queuedResponseBytes << "\n";
+    }
+  }
+
   output << "# HELP dnsdist_info " << "Info from dnsdist, value is always 1" << "\n";
   output << "# TYPE dnsdist_info " << "gauge" << "\n";
   output << "dnsdist_info{version=\"" << VERSION << "\"} " << "1" << "\n";
@@ -1117,6 +1162,8 @@ static void addServerToJSON(Json::array& servers, int identifier, const std::sha
     {"tcpTooManyConcurrentConnections", (double)backend->tcpTooManyConcurrentConnections},
     {"tcpNewConnections", (double)backend->tcpNewConnections},
     {"tcpReusedConnections", (double)backend->tcpReusedConnections},
+    {"tcpSharedParkedConnections", (double)backend->tcpSharedParkedConnections},
+    {"tcpSharedReusedConnections", (double)backend->tcpSharedReusedConnections},
     {"tcpAvgQueriesPerConnection", (double)backend->tcpAvgQueriesPerConnection},
     {"tcpAvgConnectionDuration", (double)backend->tcpAvgConnectionDuration},
     {"tlsResumptions", (double)backend->tlsResumptions},
@@ -1265,7 +1312,12 @@ static void handleStats(const YaHTTP::Request& req, YaHTTP::Response& resp)
         {"cacheLookupCollisions", (double)(cache ? cache->getLookupCollisions() : 0)},
         {"cacheInsertCollisions", (double)(cache ? cache->getInsertCollisions() : 0)},
         {"cacheTTLTooShorts", (double)(cache ? cache->getTTLTooShorts() : 0)},
-        {"cacheCleanupCount", (double)(cache ? cache->getCleanupCount() : 0)}};
+        {"cacheCleanupCount", (double)(cache ? cache->getCleanupCount() : 0)},
+        {"cacheMemoryAllocated", (double)(cache ? cache->getMemoryAllocated() : 0)},
+        {"cacheMemoryUsed", (double)(cache ? cache->getMemoryUsed() : 0)},
+        {"cacheEvictions", (double)(cache ? cache->getEvictions() : 0)},
+        {"cachePrefetches", (double)(cache ? cache->getPrefetches() : 0)},
+        {"cacheCoalescedQueries", (double)(cache ? cache->getCoalescedQueries() : 0)}};
       pools.emplace_back(std::move(entry));
     }
   }
@@ -1375,7 +1427,12 @@ static void handlePoolStats(const YaHTTP::Request& req, YaHTTP::Response& resp)
     {"cacheLookupCollisions", (double)(cache ? cache->getLookupCollisions() : 0)},
     {"cacheInsertCollisions", (double)(cache ? cache->getInsertCollisions() : 0)},
     {"cacheTTLTooShorts", (double)(cache ? cache->getTTLTooShorts() : 0)},
-    {"cacheCleanupCount", (double)(cache ? cache->getCleanupCount() : 0)}};
+    {"cacheCleanupCount", (double)(cache ? cache->getCleanupCount() : 0)},
+    {"cacheMemoryAllocated", (double)(cache ? cache->getMemoryAllocated() : 0)},
+    {"cacheMemoryUsed", (double)(cache ? cache->getMemoryUsed() : 0)},
+    {"cacheEvictions", (double)(cache ? cache->getEvictions() : 0)},
+    {"cachePrefetches", (double)(cache ? cache->getPrefetches() : 0)},
+    {"cacheCoalescedQueries", (double)(cache ? cache->getCoalescedQueries() : 0)}};
 
   Json::array servers;
   int num = 0;
@@ -1688,27 +1745,19 @@ static void handleRings(const YaHTTP::Request& req, YaHTTP::Response& resp)
   struct timespec now{};
   gettime(&now);
 
-  for (const auto& shard : g_rings.d_shards) {
-    if (!maxNumberOfQueries || numberOfQueries < *maxNumberOfQueries) {
-      auto queryRing = shard->queryRing.lock();
-      for (const auto& entry : *queryRing) {
-        addRingEntryToList(now, queries, entry);
-        numberOfQueries++;
-        if (maxNumberOfQueries && numberOfQueries >= *maxNumberOfQueries) {
-          break;
-        }
-      }
-    }
-    if (!maxNumberOfResponses || numberOfResponses < *maxNumberOfResponses) {
-      auto responseRing = shard->respRing.lock();
-      for (const auto& entry : *responseRing) {
-        addRingEntryToList(now, responses, entry);
-        numberOfResponses++;
-        if (maxNumberOfResponses && numberOfResponses >= *maxNumberOfResponses) {
-          break;
-        }
-      }
-    }
+  if (!maxNumberOfQueries || *maxNumberOfQueries > 0) {
+    g_rings.forEachQuery([&](const Rings::Query& entry) {
+      addRingEntryToList(now, queries, entry);
+      numberOfQueries++;
+      return !maxNumberOfQueries || numberOfQueries < *maxNumberOfQueries;
+    });
+  }
+  if (!maxNumberOfResponses || *maxNumberOfResponses > 0) {
+    g_rings.forEachResponse([&](const Rings::Response& entry) {
+      addRingEntryToList(now, responses, entry);
+      numberOfResponses++;
+      return !maxNumberOfResponses || numberOfResponses < *maxNumberOfResponses;
+    });
   }
   doc.emplace("queries", std::move(queries));
   doc.emplace("responses", std::move(responses));
@@ -23,12 +23,14 @@
 #include "config.h"
 
 #include <cstdint>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <getopt.h>
 #include <grp.h>
 #include <limits>
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
 #include <optional>
 #include <pwd.h>
 #include <set>
@@ -54,6 +56,7 @@
 #include "dnsdist-console-completion.hh"
 #include "dnsdist-crypto.hh"
 #include "dnsdist-discovery.hh"
+#include "dnsdist-dnsparser.hh"
 #include "dnsdist-dynblocks.hh"
 #include "dnsdist-ecs.hh"
 #include "dnsdist-edns.hh"
@@ -66,6 +69,7 @@
 #include "dnsdist-proxy-protocol.hh"
 #include "dnsdist-random.hh"
 #include "dnsdist-rings.hh"
+#include "dnsdist-rule-chains-compiled.hh"
 #include "dnsdist-rules.hh"
 #include "dnsdist-secpoll.hh"
 #include "dnsdist-self-answers.hh"
@@ -152,6 +156,262 @@ static void sendfromto(int sock, const PacketBuffer& buffer, const ComboAddress&
   }
 }
 
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+#if defined(UDP_SEGMENT)
+/* appends a UDP_SEGMENT control message after the ones already present, if any */
+static void addCMsgUDPSegment(msghdr* msgh, cmsgbuf_aligned* cbuf, uint16_t segmentSize)
+{
+  const size_t used = msgh->msg_control != nullptr ? msgh->msg_controllen : 0;
+  if (used + CMSG_SPACE(sizeof(segmentSize)) > sizeof(*cbuf)) {
+    throw std::runtime_error("Buffer is too small for the UDP segment size");
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
+  auto* cmsg = reinterpret_cast<cmsghdr*>(reinterpret_cast<char*>(cbuf) + used);
+  memset(cmsg, 0, CMSG_SPACE(sizeof(segmentSize)));
+  cmsg->cmsg_level = SOL_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(segmentSize));
+  memcpy(CMSG_DATA(cmsg), &segmentSize, sizeof(segmentSize));
+  msgh->msg_control = cbuf;
+  msgh->msg_controllen = used + CMSG_SPACE(sizeof(segmentSize));
+}
+#endif /* UDP_SEGMENT */
+
+/* returns the size of the segments if the kernel coalesced several datagrams into this one (GRO), 0 otherwise */
+static size_t getGROSegmentSize([[maybe_unused]] const msghdr* msgh)
+{
+#if defined(UDP_GRO)
+  if (msgh->msg_control == nullptr || msgh->msg_controllen == 0) {
+    return 0;
+  }
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast): CMSG_NXTHDR is not const-correct
+  auto* hdr = const_cast<msghdr*>(msgh);
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO && cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+      int segmentSize = 0;
+      memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+      return segmentSize > 0 ? static_cast<size_t>(segmentSize) : 0;
+    }
+  }
+#endif /* UDP_GRO */
+  return 0;
+}
+#elif !defined(HAVE_RECVMMSG)
+struct mmsghdr
+{
+  msghdr msg_hdr;
+  unsigned int msg_len{0};
+};
+#endif
+
+class UDPResponsesBatch;
+
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+/* Responses to UDP clients that are not sent right away but kept until the end of the
+   current batch, then sent with one sendmmsg() call per frontend socket. The response
+   buffers have to stay valid until flush() is called.
+   When the frontend has UDP segmentation enabled, consecutive responses of the same size
+   to the same client are coalesced into a single message, to be split by the kernel or
+   the network card (GSO). */
+class UDPResponsesBatch
+{
+public:
+  UDPResponsesBatch(size_t capacity, pdns::stat_t* sendBatches = nullptr, pdns::stat_t* sendBatched = nullptr) :
+    d_queued(capacity), d_iovs(capacity), d_msgs(capacity), d_messages(capacity), d_sendBatches(sendBatches), d_sendBatched(sendBatched)
+  {
+  }
+
+  /* returns false if the batch is full, in which case the response should be sent right away */
+  bool queue(int socket, const PacketBuffer& response, const ComboAddress& dest, const ComboAddress& remote, bool segmentation = false)
+  {
+    if (d_count >= d_queued.size() || response.empty()) {
+      return false;
+    }
+    auto& entry = d_queued.at(d_count);
+    entry.d_response = &response;
+    entry.d_dest = dest;
+    entry.d_remote = remote;
+    entry.d_socket = socket;
+    entry.d_segmentation = segmentation && response.size() <= s_maxSegmentSize;
+    if (entry.d_segmentation) {
+      d_segmentable++;
+    }
+    d_count++;
+    return true;
+  }
+
+  void flush()
+  {
+    if (d_count == 0) {
+      return;
+    }
+
+    /* group the responses per socket, keeping the order in which they were queued,
+       and if they might be coalesced, per client as well */
+    if (d_segmentable > 1) {
+      std::stable_sort(d_queued.begin(), d_queued.begin() + static_cast<ssize_t>(d_count), [](const Queued& lhs, const Queued& rhs) {
+        return std::tie(lhs.d_socket, lhs.d_remote, lhs.d_dest) < std::tie(rhs.d_socket, rhs.d_remote, rhs.d_dest);
+      });
+    }
+    else {
+      std::stable_sort(d_queued.begin(), d_queued.begin() + static_cast<ssize_t>(d_count), [](const Queued& lhs, const Queued& rhs) {
+        return lhs.d_socket < rhs.d_socket;
+      });
+    }
+
+    size_t start = 0;
+    while (start < d_count) {
+      const int socket = d_queued.at(start).d_socket;
+      size_t end = start + 1;
+      while (end < d_count && d_queued.at(end).d_socket == socket) {
+        end++;
+      }
+
+      size_t msgsCount = prepareMessages(start, end);
+      size_t sent = 0;
+      while (sent < msgsCount) {
+        auto ret = sendmmsg(socket, &d_msgs.at(sent), msgsCount - sent, 0);
+        if (ret <= 0) {
+          const auto& failed = d_messages.at(sent);
+          if (failed.d_segments <= 1) {
+            vinfolog("Error sending responses with sendmmsg() (%d on %u): %s", ret, msgsCount - sent, stringerror());
+            break;
+          }
+          /* the kernel or the network card might not support segmentation offload
+             for this destination, send the responses one by one instead */
+          vinfolog("Error sending %u coalesced responses with sendmmsg(), sending them separately: %s", failed.d_segments, stringerror());
+          for (size_t idx = failed.d_first; idx < failed.d_first + failed.d_segments; idx++) {
+            const auto& entry = d_queued.at(idx);
+            sendUDPResponse(socket, *entry.d_response, 0, entry.d_dest, entry.d_remote);
+          }
+          ret = 1;
+        }
+        sent += static_cast<size_t>(ret);
+      }
+      if (d_sendBatches != nullptr) {
+        ++(*d_sendBatches);
+      }
+      if (d_sendBatched != nullptr) {
+        for (size_t idx = 0; idx < sent; idx++) {
+          (*d_sendBatched) += d_messages.at(idx).d_segments;
+        }
+      }
+      start = end;
+    }
+
+    d_count = 0;
+    d_segmentable = 0;
+  }
+
+private:
+  /* the kernel does not accept more than 64 segments per message, and the total size of
+     the message should still fit in a single UDP datagram */
+  static constexpr size_t s_maxSegments{64};
+  static constexpr size_t s_maxCoalescedSize{65507};
+  /* the segments should not exceed the MTU of the path, so only coalesce responses
+     that are small enough to not require fragmentation on a usual network */
+  static constexpr size_t s_maxSegmentSize{1232};
+
+  struct Queued
+  {
+    ComboAddress d_dest;
+    ComboAddress d_remote;
+    const PacketBuffer* d_response{nullptr};
+    int d_socket{-1};
+    bool d_segmentation{false};
+    /* used by addCMsgSrcAddr and addCMsgUDPSegment, has to be the last member */
+    cmsgbuf_aligned d_cbuf{};
+  };
+
+  struct Message
+  {
+    size_t d_first{0};
+    size_t d_segments{0};
+  };
+
+  /* returns the number of segments, starting at first, that can be sent as a single message */
+  [[nodiscard]] size_t getSegmentsCount([[maybe_unused]] size_t first, [[maybe_unused]] size_t end) const
+  {
+#if defined(UDP_SEGMENT)
+    const auto& head = d_queued.at(first);
+    if (!head.d_segmentation) {
+      return 1;
+    }
+    const size_t segmentSize = head.d_response->size();
+    size_t total = segmentSize;
+    size_t count = 1;
+    while (first + count < end && count < s_maxSegments) {
+      const auto& next = d_queued.at(first + count);
+      const size_t nextSize = next.d_response->size();
+      if (!next.d_segmentation || nextSize > segmentSize || total + nextSize > s_maxCoalescedSize || next.d_remote != head.d_remote || next.d_dest != head.d_dest) {
+        break;
+      }
+      total += nextSize;
+      count++;
+      /* only the last segment is allowed to be smaller */
+      if (nextSize < segmentSize) {
+        break;
+      }
+    }
+    return count;
+#else
+    return 1;
+#endif /* UDP_SEGMENT */
+  }
+
+  size_t prepareMessages(size_t start, size_t end)
+  {
+    size_t msgsCount = 0;
+    size_t idx = start;
+    while (idx < end) {
+      const size_t segments = getSegmentsCount(idx, end);
+      auto& entry = d_queued.at(idx);
+      auto& outMsg = d_msgs.at(msgsCount);
+      outMsg.msg_len = 0;
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast,cppcoreguidelines-pro-type-reinterpret-cast): API
+      fillMSGHdr(&outMsg.msg_hdr, &d_iovs.at(idx), nullptr, 0, const_cast<char*>(reinterpret_cast<const char*>(entry.d_response->data())), entry.d_response->size(), &entry.d_remote);
+      for (size_t segment = 1; segment < segments; segment++) {
+        const auto& response = *d_queued.at(idx + segment).d_response;
+        auto& iov = d_iovs.at(idx + segment);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast): API
+        iov.iov_base = const_cast<uint8_t*>(response.data());
+        iov.iov_len = response.size();
+      }
+      outMsg.msg_hdr.msg_iovlen = segments;
+
+      if (entry.d_dest.sin4.sin_family == 0) {
+        outMsg.msg_hdr.msg_control = nullptr;
+      }
+      else {
+        addCMsgSrcAddr(&outMsg.msg_hdr, &entry.d_cbuf, &entry.d_dest, 0);
+      }
+#if defined(UDP_SEGMENT)
+      if (segments > 1) {
+        addCMsgUDPSegment(&outMsg.msg_hdr, &entry.d_cbuf, static_cast<uint16_t>(entry.d_response->size()));
+        dnsdist::metrics::g_stats.udpGSOSegments += segments;
+      }
+#endif /* UDP_SEGMENT */
+
+      auto& message = d_messages.at(msgsCount);
+      message.d_first = idx;
+      message.d_segments = segments;
+      msgsCount++;
+      idx += segments;
+    }
+    return msgsCount;
+  }
+
+  std::vector<Queued> d_queued;
+  std::vector<iovec> d_iovs;
+  std::vector<mmsghdr> d_msgs;
+  std::vector<Message> d_messages;
+  pdns::stat_t* d_sendBatches{nullptr};
+  pdns::stat_t* d_sendBatched{nullptr};
+  size_t d_count{0};
+  size_t d_segmentable{0};
+};
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+
 static void truncateTC(PacketBuffer& packet, size_t maximumSize, unsigned int qnameWireLength, bool addEDNSToSelfGeneratedResponses)
 {
   try {
@@ -299,7 +559,8 @@ bool responseContentMatches(const PacketBuffer& response, const DNSName& qname,
 
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-bounds-pointer-arithmetic)
     const std::string_view packetView(reinterpret_cast<const char*>(response.data() + sizeof(dnsheader)), response.size() - sizeof(dnsheader));
-    if (qname.matchesUncompressedName(packetView)) {
+    const auto& storage = qname.getStorage();
+    if (dnsdist::QuestionParsing::namesEqualCI(std::string_view(storage.data(), storage.size()), packetView.substr(0, storage.size()))) {
       size_t pos = sizeof(dnsheader) + qname.wirelength();
       rqtype = response.at(pos) * 256 + response.at(pos + 1);
       rqclass = response.at(pos + 2) * 256 + response.at(pos + 3);
@@ -526,6 +787,9 @@ bool processResponseAfterRules(PacketBuffer& response, DNSResponse& dnsResponse,
     if (closer) {
       closer->setAttribute("result", AnyValue{"fixUpResponse->false"});
     }
+    if (dnsResponse.ids.coalescingLeader && dnsResponse.ids.packetCache) {
+      dnsdist::releaseCoalescedQueries(*dnsResponse.ids.packetCache, dnsResponse.ids);
+    }
     return false;
   }
 
@@ -555,12 +819,18 @@ bool processResponseAfterRules(PacketBuffer& response, DNSResponse& dnsResponse,
       auto cacheInsertCloser = dnsResponse.ids.getCloser("packetCacheInsert"); // NOLINT(cppcoreguidelines-pro-bounds-array-to-pointer-decay)
       dnsResponse.ids.packetCache->insert(cacheKey, zeroScope ? std::nullopt : dnsResponse.ids.subnet, dnsResponse.ids.cacheFlags, dnsResponse.ids.dnssecOK ? *dnsResponse.ids.dnssecOK : false, dnsResponse.ids.qname, dnsResponse.ids.qtype, dnsResponse.ids.qclass, response, dnsResponse.ids.forwardedOverUDP, dnsResponse.getHeader()->rcode, dnsResponse.ids.tempFailureTTL);
     }
+    /* the queries waiting for this response can now be answered from the cache */
+    dnsdist::releaseCoalescedQueries(*dnsResponse.ids.packetCache, dnsResponse.ids);
     const auto& chains = dnsdist::configuration::getCurrentRuntimeConfiguration().d_ruleChains;
     const auto& cacheInsertedRespRuleActions = dnsdist::rules::getResponseRuleChain(chains, dnsdist::rules::ResponseRuleChain::CacheInsertedResponseRules);
     if (!applyRulesToResponse(cacheInsertedRespRuleActions, dnsResponse)) {
       return false;
     }
   }
+  else if (dnsResponse.ids.coalescingLeader && dnsResponse.ids.packetCache) {
+    /* not cacheable, the queries waiting for it will be forwarded */
+    dnsdist::releaseCoalescedQueries(*dnsResponse.ids.packetCache, dnsResponse.ids);
+  }
 
   if (dnsResponse.ids.ttlCap > 0) {
     dnsdist::PacketMangling::restrictDNSPacketTTLs(dnsResponse.getMutableData(), 0, dnsResponse.ids.ttlCap);
@@ -688,7 +958,7 @@ static void handleResponseTC4UDPClient(DNSQuestion& dnsQuestion, uint16_t udpPay
   }
 }
 
-static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& response, const std::shared_ptr<DownstreamState>& backend, bool isAsync, bool selfGenerated)
+static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& response, const std::shared_ptr<DownstreamState>& backend, bool isAsync, bool selfGenerated, [[maybe_unused]] UDPResponsesBatch* batch = nullptr)
 {
   DNSResponse dnsResponse(ids, response, backend);
 
@@ -716,7 +986,12 @@ static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& re
 
   bool muted = true;
   if (ids.cs != nullptr && !ids.cs->muted && !ids.isXSK()) {
-    sendUDPResponse(ids.cs->udpFD, response, dnsResponse.ids.delayMsec, ids.hopLocal, ids.hopRemote);
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+    if (batch == nullptr || dnsResponse.ids.delayMsec > 0 || !batch->queue(ids.cs->udpFD, response, ids.hopLocal, ids.hopRemote, ids.cs->d_udpSegmentation))
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+    {
+      sendUDPResponse(ids.cs->udpFD, response, dnsResponse.ids.delayMsec, ids.hopLocal, ids.hopRemote);
+    }
     muted = false;
   }
 
@@ -741,7 +1016,7 @@ static void handleResponseForUDPClient(InternalQueryState& ids, PacketBuffer& re
   }
 }
 
-bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer& response, InternalQueryState&& ids)
+static bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer& response, InternalQueryState&& ids, UDPResponsesBatch* batch)
 {
 
   const dnsheader_aligned dnsHeader(response.data());
@@ -762,6 +1037,7 @@ bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer&
   double udiff = ids.queryRealTime.udiff();
   // do that _before_ the processing, otherwise it's not fair to the backend
   dss->latencyUsec = (127.0 * dss->latencyUsec / 128.0) + udiff / 128.0;
+  dss->updatePeakLatency(udiff, ids.queryRealTime.d_start);
   dss->reportResponse(dnsHeader->rcode);
 
   /* don't call processResponse for DOH */
@@ -773,15 +1049,154 @@ bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer&
     return false;
   }
 
-  handleResponseForUDPClient(ids, response, dss, false, false);
+  handleResponseForUDPClient(ids, response, dss, false, false, batch);
   return true;
 }
 
+bool processResponderPacket(std::shared_ptr<DownstreamState>& dss, PacketBuffer& response, InternalQueryState&& ids)
+{
+  return processResponderPacket(dss, response, std::move(ids), nullptr);
+}
+
+static void handleResponseFromBackend(std::shared_ptr<DownstreamState>& dss, int sockDesc, PacketBuffer& response, uint16_t& queryId, UDPResponsesBatch* batch)
+{
+  const dnsheader_aligned dnsHeader(response.data());
+  queryId = dnsHeader->id;
+
+  auto ids = dss->getState(queryId);
+  if (!ids) {
+    return;
+  }
+
+  if (!ids->isXSK() && sockDesc != ids->backendFD) {
+    dss->restoreState(queryId, std::move(*ids));
+    return;
+  }
+
+  dnsdist::configuration::refreshLocalRuntimeConfiguration();
+  if (processResponderPacket(dss, response, std::move(*ids), batch) && ids->isXSK() && ids->cs->xskInfoResponder) {
+#ifdef HAVE_XSK
+    auto& xskInfo = ids->cs->xskInfoResponder;
+    auto xskPacket = xskInfo->getEmptyFrame();
+    if (!xskPacket) {
+      return;
+    }
+    xskPacket->setHeader(ids->xskPacketHeader);
+    if (!xskPacket->setPayload(response)) {
+    }
+    if (ids->delayMsec > 0) {
+      xskPacket->addDelay(ids->delayMsec);
+    }
+    xskPacket->updatePacket();
+    xskInfo->pushToSendQueue(*xskPacket);
+    xskInfo->notifyXskSocket();
+#endif /* HAVE_XSK */
+  }
+}
+
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+static void MultipleMessagesResponderThread(std::shared_ptr<DownstreamState>& dss, size_t vectSize)
+{
+  struct MMReceiver
+  {
+    PacketBuffer packet;
+    ComboAddress from;
+    iovec iov{};
+  };
+
+  const size_t initialBufferSize = getInitialUDPPacketBufferSize(false);
+  auto recvData = std::vector<MMReceiver>(vectSize);
+  auto msgVec = std::vector<mmsghdr>(vectSize);
+  UDPResponsesBatch batch(vectSize, &dnsdist::metrics::g_stats.udpResponderSendBatches, &dnsdist::metrics::g_stats.udpResponderSendBatched);
+  uint16_t queryId = 0;
+  std::vector<int> sockets;
+  sockets.reserve(dss->sockets.size());
+
+  for (auto& slot : recvData) {
+    slot.from = dss->d_config.remote;
+  }
+
+  for (;;) {
+    try {
+      if (dss->isStopped()) {
+        break;
+      }
+
+      if (!dss->connected) {
+        dss->waitUntilConnected();
+        continue;
+      }
+
+      dss->pickSocketsReadyForReceiving(sockets);
+
+      if (dss->isStopped()) {
+        break;
+      }
+
+      for (const auto& sockDesc : sockets) {
+        /* the buffers might have been resized, or moved away, while processing the previous batch,
+           and we need one more byte than what we accept so we can detect truncation */
+        for (size_t idx = 0; idx < vectSize; idx++) {
+          auto& slot = recvData[idx];
+          // NOLINTNEXTLINE(bugprone-use-after-move): resizing a vector has no preconditions so it is valid to do so after moving it
+          slot.packet.resize(initialBufferSize + 1);
+          // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+          fillMSGHdr(&msgVec[idx].msg_hdr, &slot.iov, nullptr, 0, reinterpret_cast<char*>(slot.packet.data()), slot.packet.size(), &slot.from);
+        }
+
+        /* block until we have at least one response ready, but return
+           as many as possible to save the syscall costs */
+        int msgsGot = recvmmsg(sockDesc, msgVec.data(), vectSize, MSG_WAITFORONE, nullptr);
+        if (msgsGot <= 0) {
+          if (dss->isStopped()) {
+            break;
+          }
+          continue;
+        }
+
+        ++dnsdist::metrics::g_stats.udpResponderRecvBatches;
+        dnsdist::metrics::g_stats.udpResponderRecvBatched += static_cast<uint64_t>(msgsGot);
+
+        for (int msgIdx = 0; msgIdx < msgsGot; msgIdx++) {
+          auto& slot = recvData[msgIdx];
+          const size_t got = msgVec[msgIdx].msg_len;
+          if (got < sizeof(dnsheader) || got == (initialBufferSize + 1) || (msgVec[msgIdx].msg_hdr.msg_flags & MSG_TRUNC) != 0) {
+            continue;
+          }
+
+          try {
+            slot.packet.resize(got);
+            handleResponseFromBackend(dss, sockDesc, slot.packet, queryId, &batch);
+          }
+          catch (const std::exception& e) {
+            vinfolog("Got an error in UDP responder thread while parsing a response from %s, id %d: %s", dss->d_config.remote.toStringWithPort(), queryId, e.what());
+          }
+        }
+
+        /* the responses that are not delayed, going to XSK or DoH can be sent in batch */
+        batch.flush();
+      }
+    }
+    catch (const std::exception& e) {
+      vinfolog("Got an error in UDP responder thread while processing responses from %s, id %d: %s", dss->d_config.remote.toStringWithPort(), queryId, e.what());
+    }
+  }
+}
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+
 // listens on a dedicated socket, lobs answers from downstream servers to original requestors
 void responderThread(std::shared_ptr<DownstreamState> dss)
 {
   try {
     setThreadName("dnsdist/respond");
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
+    const size_t vectSize = dnsdist::configuration::getImmutableConfiguration().d_udpVectorSize;
+    if (vectSize > 1) {
+      MultipleMessagesResponderThread(dss, std::min(vectSize, static_cast<size_t>(std::numeric_limits<uint16_t>::max())));
+      return;
+    }
+#endif /* !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
+
     const size_t initialBufferSize = getInitialUDPPacketBufferSize(false);
     /* allocate one more byte so we can detect truncation */
     PacketBuffer response(initialBufferSize + 1);
@@ -827,38 +1242,7 @@ void responderThread(std::shared_ptr<DownstreamState> dss)
           }
 
           response.resize(static_cast<size_t>(got));
-          const dnsheader_aligned dnsHeader(response.data());
-          queryId = dnsHeader->id;
-
-          auto ids = dss->getState(queryId);
-          if (!ids) {
-            continue;
-          }
-
-          if (!ids->isXSK() && sockDesc != ids->backendFD) {
-            dss->restoreState(queryId, std::move(*ids));
-            continue;
-          }
-
-          dnsdist::configuration::refreshLocalRuntimeConfiguration();
-          if (processResponderPacket(dss, response, std::move(*ids)) && ids->isXSK() && ids->cs->xskInfoResponder) {
-#ifdef HAVE_XSK
-            auto& xskInfo = ids->cs->xskInfoResponder;
-            auto xskPacket = xskInfo->getEmptyFrame();
-            if (!xskPacket) {
-              continue;
-            }
-            xskPacket->setHeader(ids->xskPacketHeader);
-            if (!xskPacket->setPayload(response)) {
-            }
-            if (ids->delayMsec > 0) {
-              xskPacket->addDelay(ids->delayMsec);
-            }
-            xskPacket->updatePacket();
-            xskInfo->pushToSendQueue(*xskPacket);
-            xskInfo->notifyXskSocket();
-#endif /* HAVE_XSK */
-          }
+          handleResponseFromBackend(dss, sockDesc, response, queryId, nullptr);
         }
       }
       catch (const std::exception& e) {
@@ -1014,8 +1398,9 @@ bool processRulesResult(const DNSAction::Action& action, DNSQuestion& dnsQuestio
   return false;
 }
 
-static bool applyRulesChainToQuery(const std::vector<dnsdist::rules::RuleAction>& rules, DNSQuestion& dnsQuestion)
+static bool applyRulesChainToQuery(const dnsdist::configuration::RuntimeConfiguration& config, dnsdist::rules::RuleChain chain, DNSQuestion& dnsQuestion)
 {
+  const auto& rules = dnsdist::rules::getRuleChain(config.d_ruleChains, chain);
   if (rules.empty()) {
     return true;
   }
@@ -1027,6 +1412,20 @@ static bool applyRulesChainToQuery(const std::vector<dnsdist::rules::RuleAction>
   auto closer = dnsQuestion.ids.getCloser(__func__); // NOLINT(cppcoreguidelines-pro-bounds-array-to-pointer-decay)
   static const std::string ruleType; // Empty string
 
+  /* the compiled chain does not evaluate the rules one by one, so it cannot report them to the tracer */
+  if (config.d_compileQueryRules && !config.d_openTelemetryTracing) {
+    const auto& compiled = dnsdist::rules::getCompiledRuleChain(config.d_ruleChains, chain);
+    for (auto position = compiled.getNextMatch(rules, dnsQuestion, 0); position < rules.size(); position = compiled.getNextMatch(rules, dnsQuestion, position + 1)) {
+      const auto& rule = rules.at(position);
+      rule.d_rule->d_matches++;
+      action = (*rule.d_action)(&dnsQuestion, &ruleresult);
+      if (processRulesResult(action, dnsQuestion, ruleresult, drop)) {
+        break;
+      }
+    }
+    return !drop;
+  }
+
   for (const auto& rule : rules) {
     auto ruleCloser = dnsQuestion.ids.getRulesCloser(rule.d_name, ruleType);
 
@@ -1233,9 +1632,7 @@ static bool applyRulesToQuery(DNSQuestion& dnsQuestion, const timespec& now)
   }
 #endif /* DISABLE_DYNBLOCKS */
 
-  const auto& chains = dnsdist::configuration::getCurrentRuntimeConfiguration().d_ruleChains;
-  const auto& queryRules = dnsdist::rules::getRuleChain(chains, dnsdist::rules::RuleChain::Rules);
-  return applyRulesChainToQuery(queryRules, dnsQuestion);
+  return applyRulesChainToQuery(dnsdist::configuration::getCurrentRuntimeConfiguration(), dnsdist::rules::RuleChain::Rules, dnsQuestion);
 }
 
 ssize_t udpClientSendRequestToBackend(const std::shared_ptr<DownstreamState>& backend, const int socketDesc, const PacketBuffer& request, bool healthCheck)
@@ -1364,28 +1761,6 @@ bool checkQueryHeaders(const struct dnsheader& dnsHeader, ClientState& clientSta
   return true;
 }
 
-#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
-static void queueResponse(const PacketBuffer& response, const ComboAddress& dest, const ComboAddress& remote, struct mmsghdr& outMsg, struct iovec* iov, cmsgbuf_aligned* cbuf)
-{
-  outMsg.msg_len = 0;
-  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast,cppcoreguidelines-pro-type-reinterpret-cast): API
-  fillMSGHdr(&outMsg.msg_hdr, iov, nullptr, 0, const_cast<char*>(reinterpret_cast<const char*>(&response.at(0))), response.size(), const_cast<ComboAddress*>(&remote));
-
-  if (dest.sin4.sin_family == 0) {
-    outMsg.msg_hdr.msg_control = nullptr;
-  }
-  else {
-    addCMsgSrcAddr(&outMsg.msg_hdr, cbuf, &dest, 0);
-  }
-}
-#elif !defined(HAVE_RECVMMSG)
-struct mmsghdr
-{
-  msghdr msg_hdr;
-  unsigned int msg_len{0};
-};
-#endif
-
 /* self-generated responses or cache hits */
 static bool prepareOutgoingResponse([[maybe_unused]] const ClientState& clientState, DNSQuestion& dnsQuestion, bool cacheHit)
 {
@@ -1461,8 +1836,7 @@ static ServerPolicy::SelectedBackend selectBackendForOutgoingQuery(DNSQuestion&
   auto closer = dnsQuestion.ids.getCloser(__func__); // NOLINT(cppcoreguidelines-pro-bounds-array-to-pointer-decay)
 
   const auto& policy = serverPool.policy != nullptr ? *serverPool.policy : *dnsdist::configuration::getCurrentRuntimeConfiguration().d_lbPolicy;
-  const auto& servers = serverPool.getServers();
-  auto selectedBackend = policy.getSelectedBackend(servers, dnsQuestion);
+  auto selectedBackend = policy.getSelectedBackend(serverPool, dnsQuestion);
 
   if (closer) {
     closer->setAttribute("backend.name", AnyValue{selectedBackend->getNameWithAddr()});
@@ -1577,22 +1951,32 @@ ProcessQueryResult processQueryAfterRules(DNSQuestion& dnsQuestion, std::shared_
 
       vinfolog("Packet cache miss for query for %s|%s from %s (%s, %d bytes)", dnsQuestion.ids.qname.toLogString(), QType(dnsQuestion.ids.qtype).toString(), dnsQuestion.ids.origRemote.toStringWithPort(), dnsQuestion.ids.protocol.toString(), dnsQuestion.getData().size());
 
+      /* the ECS option has already been added to the query, so it could not be processed again once resumed */
+      if (!useECS && serverPool.packetCache->getCoalescingTimeout() > 0) {
+        const auto coalescingKey = dnsQuestion.ids.protocol == dnsdist::Protocol::DoH && !willBeForwardedOverUDP ? dnsQuestion.ids.cacheKeyTCP : dnsQuestion.ids.cacheKey;
+        if (dnsdist::coalesceQuery(dnsQuestion, *serverPool.packetCache, coalescingKey)) {
+          vinfolog("Query for %s|%s is waiting for the response to an identical query", dnsQuestion.ids.qname.toLogString(), QType(dnsQuestion.ids.qtype).toString());
+          return ProcessQueryResult::Asynchronous;
+        }
+      }
+
       ++dnsdist::metrics::g_stats.cacheMisses;
 
       // coverity[auto_causes_copy]
       const auto existingPool = dnsQuestion.ids.poolName;
-      const auto& chains = dnsdist::configuration::getCurrentRuntimeConfiguration().d_ruleChains;
-      const auto& cacheMissRuleActions = dnsdist::rules::getRuleChain(chains, dnsdist::rules::RuleChain::CacheMissRules);
-
-      if (!applyRulesChainToQuery(cacheMissRuleActions, dnsQuestion)) {
+      if (!applyRulesChainToQuery(dnsdist::configuration::getCurrentRuntimeConfiguration(), dnsdist::rules::RuleChain::CacheMissRules, dnsQuestion)) {
+        dnsdist::releaseCoalescedQueries(*serverPool.packetCache, dnsQuestion.ids);
         return ProcessQueryResult::Drop;
       }
       if (dnsQuestion.getHeader()->qr) { // something turned it into a response
+        dnsdist::releaseCoalescedQueries(*serverPool.packetCache, dnsQuestion.ids);
         return handleQueryTurnedIntoSelfAnsweredResponse(dnsQuestion);
       }
       /* let's be nice and allow the selection of a different pool,
          but no second cache-lookup for you */
       if (dnsQuestion.ids.poolName != existingPool) {
+        /* the response will not be inserted into this cache */
+        dnsdist::releaseCoalescedQueries(*serverPool.packetCache, dnsQuestion.ids);
         const auto& newServerPool = getPool(dnsQuestion.ids.poolName);
         dnsQuestion.ids.packetCache = newServerPool.packetCache;
         selectedBackend = selectBackendForOutgoingQuery(dnsQuestion, newServerPool);
@@ -1610,6 +1994,9 @@ ProcessQueryResult processQueryAfterRules(DNSQuestion& dnsQuestion, std::shared_
     if (!selectedBackend) {
       auto servFailOnNoPolicy = dnsdist::configuration::getCurrentRuntimeConfiguration().d_servFailOnNoPolicy;
       ++dnsdist::metrics::g_stats.noPolicy;
+      if (dnsQuestion.ids.coalescingLeader && dnsQuestion.ids.packetCache) {
+        dnsdist::releaseCoalescedQueries(*dnsQuestion.ids.packetCache, dnsQuestion.ids);
+      }
 
       vinfolog("%s query for %s|%s from %s, no downstream server available", servFailOnNoPolicy ? "ServFailed" : "Dropped", dnsQuestion.ids.qname.toLogString(), QType(dnsQuestion.ids.qtype).toString(), dnsQuestion.ids.origRemote.toStringWithPort());
       if (servFailOnNoPolicy) {
@@ -1886,9 +2273,8 @@ bool assignOutgoingUDPQueryToBackend(std::shared_ptr<DownstreamState>& downstrea
   return true;
 }
 
-static void processUDPQuery(ClientState& clientState, const struct msghdr* msgh, const ComboAddress& remote, ComboAddress& dest, PacketBuffer& query, std::vector<mmsghdr>* responsesVect, unsigned int* queuedResponses, struct iovec* respIOV, cmsgbuf_aligned* respCBuf)
+static void processUDPQuery(ClientState& clientState, const struct msghdr* msgh, const ComboAddress& remote, ComboAddress& dest, PacketBuffer& query, [[maybe_unused]] UDPResponsesBatch* batch)
 {
-  assert(responsesVect == nullptr || (queuedResponses != nullptr && respIOV != nullptr && respCBuf != nullptr));
   uint16_t queryId = 0;
   InternalQueryState ids;
 
@@ -1992,9 +2378,7 @@ static void processUDPQuery(ClientState& clientState, const struct msghdr* msgh,
       handleResponseTC4UDPClient(dnsQuestion, udpPayloadSize, query);
 #ifndef DISABLE_RECVMMSG
 #if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE)
-      if (dnsQuestion.ids.delayMsec == 0 && responsesVect != nullptr) {
-        queueResponse(query, dest, remote, (*responsesVect)[*queuedResponses], respIOV, respCBuf);
-        (*queuedResponses)++;
+      if (dnsQuestion.ids.delayMsec == 0 && batch != nullptr && batch->queue(clientState.udpFD, query, dest, remote, clientState.d_udpSegmentation)) {
         handleResponseSent(dnsQuestion.ids.qname, dnsQuestion.ids.qtype, 0., remote, ComboAddress(), query.size(), *dnsHeader, dnsdist::Protocol::DoUDP, dnsdist::Protocol::DoUDP, false);
         return;
       }
@@ -2173,7 +2557,7 @@ static void MultipleMessagesUDPClientThread(ClientState* clientState)
     ComboAddress remote;
     ComboAddress dest;
     iovec iov{};
-    /* used by HarvestDestinationAddress */
+    /* used by HarvestDestinationAddress and to get the GRO segment size */
     cmsgbuf_aligned cbuf{};
   };
   const size_t vectSize = dnsdist::configuration::getImmutableConfiguration().d_udpVectorSize;
@@ -2182,9 +2566,15 @@ static void MultipleMessagesUDPClientThread(ClientState* clientState)
     throw std::runtime_error("The value of setUDPMultipleMessagesVectorSize is too high, the maximum value is " + std::to_string(std::numeric_limits<uint16_t>::max()));
   }
 
+  /* the kernel coalesces at most 64 datagrams when GRO is enabled */
+  static constexpr size_t maxGROSegments{64};
+  const bool segmentation = clientState->d_udpSegmentation;
   auto recvData = std::vector<MMReceiver>(vectSize);
   auto msgVec = std::vector<mmsghdr>(vectSize);
-  auto outMsgVec = std::vector<mmsghdr>(vectSize);
+  UDPResponsesBatch batch(segmentation ? vectSize * maxGROSegments : vectSize);
+  /* the queries split from a coalesced datagram, which need to stay valid until the responses have been sent.
+     We use a deque so that adding new buffers does not invalidate the existing ones */
+  std::deque<PacketBuffer> groSegments;
 
   /* the actual buffer is larger because:
      - we may have to add EDNS and/or ECS
@@ -2193,33 +2583,38 @@ static void MultipleMessagesUDPClientThread(ClientState* clientState)
   */
   const size_t initialBufferSize = getInitialUDPPacketBufferSize(clientState->d_enableProxyProtocol);
   const size_t maxIncomingPacketSize = getMaximumIncomingPacketSize(*clientState);
+  /* when GRO is enabled, the kernel might coalesce several datagrams into a single one */
+  const size_t receiveBufferSize = segmentation ? std::max(initialBufferSize, static_cast<size_t>(std::numeric_limits<uint16_t>::max())) : initialBufferSize;
+  const size_t maxReceiveSize = segmentation ? receiveBufferSize : maxIncomingPacketSize;
 
   /* initialize the structures needed to receive our messages */
   for (size_t idx = 0; idx < vectSize; idx++) {
     recvData[idx].remote.sin4.sin_family = clientState->local.sin4.sin_family;
-    recvData[idx].packet.resize(initialBufferSize);
+    recvData[idx].packet.resize(receiveBufferSize);
     // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
-    fillMSGHdr(&msgVec[idx].msg_hdr, &recvData[idx].iov, &recvData[idx].cbuf, sizeof(recvData[idx].cbuf), reinterpret_cast<char*>(recvData[idx].packet.data()), maxIncomingPacketSize, &recvData[idx].remote);
+    fillMSGHdr(&msgVec[idx].msg_hdr, &recvData[idx].iov, &recvData[idx].cbuf, sizeof(recvData[idx].cbuf), reinterpret_cast<char*>(recvData[idx].packet.data()), maxReceiveSize, &recvData[idx].remote);
   }
 
   int msgsGot = static_cast<int>(vectSize);
   /* go now */
   for (;;) {
 
-    /* reset the IO vector, since it's also used to send the vector of responses
-       to avoid having to copy the data around.
+    /* reset the IO vector, since the buffers might have been resized while
+       processing the previous messages.
        No need to reset the parts that have not been used, though. */
     for (int idx = 0; idx < msgsGot; idx++) {
       auto& slot = recvData[idx];
       /* only resize if the buffer is actually smaller than expected */
-      if (slot.packet.size() < initialBufferSize) {
-        slot.packet.resize(initialBufferSize);
+      if (slot.packet.size() < receiveBufferSize) {
+        slot.packet.resize(receiveBufferSize);
       }
       /* but we need to set the IOv pointer and size
          anyway, because if we resized it the pointer might
          now be invalid */
       slot.iov.iov_base = &slot.packet.at(0);
-      slot.iov.iov_len = slot.packet.size();
+      slot.iov.iov_len = maxReceiveSize;
+      /* the kernel updates the size of the control buffer to what it actually used */
+      msgVec[idx].msg_hdr.msg_controllen = sizeof(slot.cbuf);
     }
 
     /* block until we have at least one message ready, but return
@@ -2231,7 +2626,7 @@ static void MultipleMessagesUDPClientThread(ClientState* clientState)
       continue;
     }
 
-    unsigned int msgsToSend = 0;
+    size_t groSegmentsUsed = 0;
 
     /* process the received messages */
     for (int msgIdx = 0; msgIdx < msgsGot; msgIdx++) {
@@ -2247,21 +2642,47 @@ static void MultipleMessagesUDPClientThread(ClientState* clientState)
       }
 
       auto& data = recvData[msgIdx];
-      data.packet.resize(got);
       dnsdist::configuration::refreshLocalRuntimeConfiguration();
-      processUDPQuery(*clientState, msgh, remote, data.dest, data.packet, &outMsgVec, &msgsToSend, &data.iov, &data.cbuf);
-    }
 
-    /* immediate (not delayed or sent to a backend) responses (mostly from a rule, dynamic block
-       or the cache) can be sent in batch too */
+      if (!segmentation) {
+        data.packet.resize(got);
+        processUDPQuery(*clientState, msgh, remote, data.dest, data.packet, &batch);
+        continue;
+      }
 
-    if (msgsToSend > 0 && msgsToSend <= static_cast<unsigned int>(msgsGot)) {
-      int sent = sendmmsg(clientState->udpFD, outMsgVec.data(), msgsToSend, 0);
+      /* with GRO the receive buffers are large, so we copy the queries out of them instead of shrinking
+         and growing them back for every datagram. A datagram might contain several queries of the
+         same size, except for the last one which might be smaller */
+      size_t segmentSize = getGROSegmentSize(msgh);
+      const bool coalesced = segmentSize > 0 && segmentSize < got;
+      if (!coalesced) {
+        segmentSize = got;
+      }
 
-      if (sent < 0 || static_cast<unsigned int>(sent) != msgsToSend) {
-        vinfolog("Error sending responses with sendmmsg() (%d on %u): %s", sent, msgsToSend, stringerror());
+      for (size_t offset = 0; offset < got; offset += segmentSize) {
+        const size_t length = std::min(segmentSize, got - offset);
+        if (coalesced) {
+          ++dnsdist::metrics::g_stats.udpGROSegments;
+        }
+        if (length < sizeof(struct dnsheader) || length > maxIncomingPacketSize) {
+          ++dnsdist::metrics::g_stats.nonCompliantQueries;
+          ++clientState->nonCompliantQueries;
+          continue;
+        }
+        if (groSegmentsUsed >= groSegments.size()) {
+          groSegments.emplace_back();
+          groSegments.back().reserve(initialBufferSize);
+        }
+        auto& query = groSegments.at(groSegmentsUsed++);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+        query.assign(data.packet.data() + offset, data.packet.data() + offset + length);
+        processUDPQuery(*clientState, msgh, remote, data.dest, query, &batch);
       }
     }
+
+    /* immediate (not delayed or sent to a backend) responses (mostly from a rule, dynamic block
+       or the cache) can be sent in batch too */
+    batch.flush();
   }
 }
 #endif /* defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) */
@@ -2316,7 +2737,7 @@ static void udpClientThread(std::vector<ClientState*> states)
         packet.resize(static_cast<size_t>(got));
 
         dnsdist::configuration::refreshLocalRuntimeConfiguration();
-        processUDPQuery(*param.cs, &msgh, remote, dest, packet, nullptr, nullptr, nullptr, nullptr);
+        processUDPQuery(*param.cs, &msgh, remote, dest, packet, nullptr);
       };
 
       std::vector<UDPStateParam> params;
@@ -2387,6 +2808,61 @@ static void udpClientThread(std::vector<ClientState*> states)
   }
 }
 
+/* only set once the snapshots have been loaded, so that we do not overwrite them
+   with the empty caches of a configuration check or of a client */
+static std::atomic<bool> s_packetCacheSnapshotsLoaded{false};
+
+static std::set<std::shared_ptr<DNSDistPacketCache>> getPacketCachesWithSnapshot()
+{
+  std::set<std::shared_ptr<DNSDistPacketCache>> caches;
+  for (const auto& entry : dnsdist::configuration::getCurrentRuntimeConfiguration().d_pools) {
+    const auto& packetCache = entry.second.packetCache;
+    if (packetCache && !packetCache->getSnapshotFile().empty()) {
+      caches.insert(packetCache);
+    }
+  }
+  return caches;
+}
+
+static void loadPacketCacheSnapshots()
+{
+  for (const auto& packetCache : getPacketCachesWithSnapshot()) {
+    const auto& fileName = packetCache->getSnapshotFile();
+    if (access(fileName.c_str(), F_OK) != 0) {
+      continue;
+    }
+    try {
+      auto loaded = packetCache->loadSnapshot(fileName);
+      infolog("Loaded %d entries into the packet cache from '%s'", loaded, fileName);
+    }
+    catch (const std::exception& e) {
+      warnlog("Error loading the packet cache snapshot from '%s': %s", fileName, e.what());
+    }
+  }
+  s_packetCacheSnapshotsLoaded = true;
+}
+
+static void savePacketCacheSnapshots(bool exiting)
+{
+  if (!s_packetCacheSnapshotsLoaded) {
+    return;
+  }
+  const time_t now = time(nullptr);
+  for (const auto& packetCache : getPacketCachesWithSnapshot()) {
+    if (!exiting && !packetCache->isSnapshotDue(now)) {
+      continue;
+    }
+    const auto& fileName = packetCache->getSnapshotFile();
+    try {
+      auto saved = packetCache->saveSnapshot(fileName);
+      vinfolog("Saved %d entries from the packet cache to '%s'", saved, fileName);
+    }
+    catch (const std::exception& e) {
+      warnlog("Error saving the packet cache snapshot to '%s': %s", fileName, e.what());
+    }
+  }
+}
+
 static void maintThread()
 {
   setThreadName("dnsdist/main");
@@ -2462,6 +2938,8 @@ static void maintThread()
       }
       counter = 0;
     }
+
+    savePacketCacheSnapshots(false);
   }
 }
 
@@ -2786,6 +3264,32 @@ static void setupLocalSocket(ClientState& clientState, const ComboAddress& addr,
         warnlog(e.what());
       }
     }
+
+    if (clientState.d_udpSegmentation) {
+#if !defined(DISABLE_RECVMMSG) && defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG) && defined(MSG_WAITFORONE) && defined(UDP_GRO) && defined(UDP_SEGMENT)
+      if (immutableConfig.d_udpVectorSize <= 1) {
+        /* the coalesced datagrams are only split, and the responses only coalesced, when receiving and sending in batches */
+        if (warn) {
+          warnlog("UDP segmentation has been enabled on local address '%s' but setUDPMultipleMessagesVectorSize() has not been set to a value greater than 1, disabling it", addr.toStringWithPort());
+        }
+        clientState.d_udpSegmentation = false;
+      }
+      else {
+        int one = 1;
+        if (setsockopt(socket, SOL_UDP, UDP_GRO, &one, sizeof(one)) < 0) {
+          if (warn) {
+            warnlog("Failed to enable UDP GRO on local address '%s', disabling UDP segmentation: %s", addr.toStringWithPort(), stringerror());
+          }
+          clientState.d_udpSegmentation = false;
+        }
+      }
+#else
+      if (warn) {
+        warnlog("UDP segmentation has been enabled on local address '%s' but is not supported", addr.toStringWithPort());
+      }
+      clientState.d_udpSegmentation = false;
+#endif
+    }
   }
 
   const std::string& itf = clientState.interface;
@@ -2967,12 +3471,17 @@ void doExitNicely(int exitCode)
   if (dnsdist::g_asyncHolder) {
     dnsdist::g_asyncHolder->stop();
   }
+  if (dnsdist::g_coalescingHolder) {
+    dnsdist::g_coalescingHolder->stop();
+  }
 
   for (auto& backend : dnsdist::configuration::getCurrentRuntimeConfiguration().d_backends) {
     backend->stop();
   }
 #endif
 
+  savePacketCacheSnapshots(true);
+
   {
     auto lock = g_lua.lock();
     dnsdist::lua::hooks::runExitCallbacks(*lock);
@@ -3619,6 +4128,7 @@ int main(int argc, char** argv)
     infolog("dnsdist %s comes with ABSOLUTELY NO WARRANTY. This is free software, and you are welcome to redistribute it according to the terms of the GPL version 2", VERSION);
 
     dnsdist::g_asyncHolder = std::make_unique<dnsdist::AsynchronousHolder>();
+    dnsdist::g_coalescingHolder = std::make_unique<dnsdist::AsynchronousHolder>();
 
     /* create the default pool no matter what */
     createPoolIfNotExists("");
@@ -3657,6 +4167,7 @@ int main(int argc, char** argv)
     {
       const auto& immutableConfig = dnsdist::configuration::getImmutableConfiguration();
       setTCPDownstreamMaxIdleConnectionsPerBackend(immutableConfig.d_outgoingTCPMaxIdlePerBackend);
+      setTCPDownstreamMaxSharedIdleConnectionsPerBackend(immutableConfig.d_outgoingTCPMaxSharedIdlePerBackend);
       setTCPDownstreamMaxIdleTime(immutableConfig.d_outgoingTCPMaxIdleTime);
       setTCPDownstreamCleanupInterval(immutableConfig.d_outgoingTCPCleanupInterval);
 #if defined(HAVE_DNS_OVER_HTTPS) && defined(HAVE_NGHTTP2)
@@ -3668,7 +4179,10 @@ int main(int argc, char** argv)
 
     {
       const auto& config = dnsdist::configuration::getImmutableConfiguration();
-      g_rings.init(config.d_ringsCapacity, config.d_ringsNumberOfShards, config.d_ringsNbLockTries, config.d_ringsRecordQueries, config.d_ringsRecordResponses);
+      g_rings.init(config.d_ringsCapacity, config.d_ringsNumberOfShards, config.d_ringsNbLockTries, config.d_ringsRecordQueries, config.d_ringsRecordResponses, config.d_ringsPerThread);
+      if (config.d_ringsSlidingWindow > 0) {
+        g_rings.enableSlidingCounters({config.d_ringsSlidingWindow, config.d_ringsSlidingWindowMaxEntries});
+      }
     }
 
     for (const auto& frontend : dnsdist::getFrontends()) {
@@ -3793,6 +4307,9 @@ int main(int argc, char** argv)
       handleQueuedHealthChecks(*mplexer, true);
     }
 
+    /* warm the caches up before we start accepting queries */
+    loadPacketCacheSnapshots();
+
     dnsdist::startFrontends();
 
     dnsdist::ServiceDiscovery::run();
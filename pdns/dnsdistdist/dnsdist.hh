@@ -365,6 +365,8 @@ struct ClientState
   bool reuseport;
   bool d_enableProxyProtocol{true}; // the global proxy protocol ACL still applies
   bool ready{false};
+  /* UDP only: accept datagrams coalesced by the kernel (GRO) and coalesce responses to the same client (GSO) */
+  bool d_udpSegmentation{false};
 
   int getSocket() const
   {
@@ -677,6 +679,10 @@ struct DownstreamState : public std::enable_shared_from_this<DownstreamState>
   stat_t tcpTooManyConcurrentConnections{0};
   stat_t tcpReusedConnections{0};
   stat_t tcpNewConnections{0};
+  /* number of idle connections handed over to the pool shared between threads */
+  stat_t tcpSharedParkedConnections{0};
+  /* number of connections taken from that pool, each one saving a new connection and TLS handshake */
+  stat_t tcpSharedReusedConnections{0};
   stat_t tlsResumptions{0};
   pdns::stat_double_t tcpAvgQueriesPerConnection{0.0};
   /* in ms */
@@ -689,7 +695,7 @@ struct DownstreamState : public std::enable_shared_from_this<DownstreamState>
 
 private:
   LockGuarded<std::map<uint16_t, IDState>> d_idStatesMap;
-  vector<IDState> idStates;
+  IDStateTable idStates;
 
   struct LazyHealthCheckStats
   {
@@ -719,14 +725,23 @@ public:
   size_t socketsOffset{0};
   double latencyUsec{0.0};
   double latencyUsecTCP{0.0};
+  /* a moving average of the latency, over UDP and TCP, that immediately follows increases
+     but otherwise decays over time, used by the peakEWMA policy. The time of the
+     last update is in microseconds since the epoch */
+  std::atomic<double> d_peakLatencyUsec{0.0};
+  std::atomic<int64_t> d_peakLatencyLastUpdate{0};
+  /* the time it takes, in microseconds, for the peak latency to decay to roughly a third of its value */
+  static constexpr double s_peakLatencyDecayUsec{10000000.0};
   unsigned int d_nextCheck{0};
   uint16_t currentCheckFailures{0};
   std::atomic<bool> hashesComputed{false};
+  /* incremented every time the hashes of any server are updated */
+  static inline std::atomic<uint64_t> s_hashesGeneration{0};
   std::atomic<bool> connected{false};
   std::atomic<bool> upStatus{false};
 
 private:
-  void handleUDPTimeout(IDState& ids);
+  void handleUDPTimeout(InternalQueryState& ids);
   void updateNextLazyHealthCheck(LazyHealthCheckStats& stats, bool checkScheduled, std::optional<time_t> currentTime = std::nullopt);
   void connectUDPSockets();
 #ifdef HAVE_XSK
@@ -779,6 +794,7 @@ public:
     if (!newStatus) {
       latencyUsec = 0.0;
       latencyUsecTCP = 0.0;
+      d_peakLatencyUsec.store(0.0, std::memory_order_relaxed);
     }
   }
   void setDown()
@@ -786,6 +802,7 @@ public:
     d_config.d_availability = Availability::Down;
     latencyUsec = 0.0;
     latencyUsecTCP = 0.0;
+    d_peakLatencyUsec.store(0.0, std::memory_order_relaxed);
   }
   void setAuto()
   {
@@ -854,11 +871,17 @@ public:
     tcpAvgConnectionDuration = (99.0 * tcpAvgConnectionDuration / 100.0) + (durationMs / 100.0);
   }
 
-  void updateTCPLatency(double udiff)
+  void updateTCPLatency(double udiff, const struct timespec& queryTime)
   {
     latencyUsecTCP = (127.0 * latencyUsecTCP / 128.0) + udiff / 128.0;
+    updatePeakLatency(udiff, queryTime);
   }
 
+  /* udiff is the latency of a query received at queryTime, in real time */
+  void updatePeakLatency(double udiff, const struct timespec& queryTime);
+  /* the peak latency, decayed up to now, in real time */
+  [[nodiscard]] double getPeakLatencyUsec(const struct timespec& now) const;
+
   void incQueriesCount()
   {
     ++queries;
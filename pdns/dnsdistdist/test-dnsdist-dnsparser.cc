@@ -515,4 +515,87 @@ BOOST_AUTO_TEST_CASE(test_Overlay)
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_QuestionParsing)
+{
+  /* long enough to go over several vectors, mixing cases and characters close to the upper-case ones */
+  const std::vector<DNSName> names{
+    DNSName("."),
+    DNSName("powerdns.com."),
+    DNSName("PowerDNS.COM."),
+    DNSName("a-very-LONG-label-@[`{-to-go-over-several-vectors.sub.Dnsdist.Org."),
+    DNSName(std::string(63, 'Z') + "." + std::string(63, 'a') + "." + std::string(63, 'M') + "." + std::string(61, 'q') + "."),
+  };
+
+  for (const auto& name : names) {
+    for (const uint32_t init : {0U, 42U}) {
+      PacketBuffer query;
+      GenericDNSPacketWriter<PacketBuffer> pwQ(query, name, QType::AAAA, QClass::CHAOS, 0);
+      pwQ.getHeader()->rd = 1;
+
+      auto question = dnsdist::QuestionParsing::parse(query, init);
+      BOOST_REQUIRE(question);
+      BOOST_CHECK_EQUAL(question->d_qnameWireLength, name.wirelength());
+      BOOST_CHECK_EQUAL(question->d_qnameHash, name.hash(init));
+      BOOST_CHECK_EQUAL(question->d_qtype, QType::AAAA);
+      BOOST_CHECK_EQUAL(question->d_qclass, QClass::CHAOS);
+
+      const auto& storage = name.getStorage();
+      // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+      BOOST_CHECK_EQUAL(dnsdist::QuestionParsing::hashNameCI(reinterpret_cast<const uint8_t*>(storage.data()), storage.size(), init), name.hash(init));
+    }
+
+    const auto& storage = name.getStorage();
+    const auto lowered = name.makeLowerCase();
+    const auto& loweredStorage = lowered.getStorage();
+    BOOST_CHECK(dnsdist::QuestionParsing::namesEqualCI(std::string_view(storage.data(), storage.size()), std::string_view(loweredStorage.data(), loweredStorage.size())));
+  }
+
+  /* names that only differ by one byte, at every position */
+  {
+    const auto& storage = names.at(3).getStorage();
+    const std::string_view reference(storage.data(), storage.size());
+    for (size_t idx = 1; idx < reference.size() - 1; idx++) {
+      std::string modified(reference);
+      modified.at(idx) = modified.at(idx) == 'x' ? 'y' : 'x';
+      BOOST_CHECK(!dnsdist::QuestionParsing::namesEqualCI(reference, modified));
+    }
+    BOOST_CHECK(!dnsdist::QuestionParsing::namesEqualCI(reference, reference.substr(0, reference.size() - 1)));
+    /* '@' and '`', '[' and '{' only differ by 0x20 but are not letters */
+    BOOST_CHECK(!dnsdist::QuestionParsing::namesEqualCI(std::string_view("\x01@", 2), std::string_view("\x01`", 2)));
+    BOOST_CHECK(!dnsdist::QuestionParsing::namesEqualCI(std::string_view("\x01[", 2), std::string_view("\x01{", 2)));
+  }
+
+  {
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, names.at(1), QType::A, QClass::IN, 0);
+
+    /* truncated before the end of the qname, then of the qtype and qclass */
+    for (size_t size = 0; size < query.size(); size++) {
+      PacketBuffer truncated(query.begin(), query.begin() + static_cast<ssize_t>(size));
+      BOOST_CHECK(!dnsdist::QuestionParsing::parse(truncated));
+    }
+
+    /* compressed */
+    PacketBuffer compressed(query.begin(), query.begin() + sizeof(dnsheader));
+    compressed.insert(compressed.end(), {0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01});
+    BOOST_CHECK(!dnsdist::QuestionParsing::parse(compressed));
+
+    /* invalid label length */
+    PacketBuffer invalid(query);
+    invalid.at(sizeof(dnsheader)) = 64;
+    BOOST_CHECK(!dnsdist::QuestionParsing::parse(invalid));
+  }
+
+  {
+    /* too long */
+    PacketBuffer query(sizeof(dnsheader));
+    for (size_t idx = 0; idx < 5; idx++) {
+      query.push_back(63);
+      query.insert(query.end(), 63, 'a');
+    }
+    query.insert(query.end(), {0x00, 0x00, 0x01, 0x00, 0x01});
+    BOOST_CHECK(!dnsdist::QuestionParsing::parse(query));
+  }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
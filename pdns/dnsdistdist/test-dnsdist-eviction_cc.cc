@@ -0,0 +1,156 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+#define BOOST_TEST_NO_MAIN
+
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist-eviction.hh"
+
+BOOST_AUTO_TEST_SUITE(test_dnsdisteviction_cc)
+
+using dnsdist::EvictionPolicy;
+using dnsdist::EvictionQueue;
+
+static uint32_t evictOne(EvictionQueue& queue)
+{
+  auto slot = queue.selectVictim();
+  BOOST_REQUIRE(slot != EvictionQueue::s_invalidSlot);
+  auto key = queue.getKey(slot);
+  queue.remove(slot);
+  return key;
+}
+
+BOOST_AUTO_TEST_CASE(test_PolicyNames)
+{
+  BOOST_CHECK(dnsdist::getEvictionPolicyFromString("none") == EvictionPolicy::None);
+  BOOST_CHECK(dnsdist::getEvictionPolicyFromString("SIEVE") == EvictionPolicy::Sieve);
+  BOOST_CHECK(dnsdist::getEvictionPolicyFromString("clock") == EvictionPolicy::Clock);
+  BOOST_CHECK(!dnsdist::getEvictionPolicyFromString("lru"));
+  BOOST_CHECK_EQUAL(dnsdist::getEvictionPolicyName(EvictionPolicy::Sieve), "sieve");
+  BOOST_CHECK_EQUAL(dnsdist::getEvictionPolicyName(EvictionPolicy::Clock), "clock");
+}
+
+BOOST_AUTO_TEST_CASE(test_Sieve)
+{
+  const size_t capacity = 4;
+  EvictionQueue queue(EvictionPolicy::Sieve, capacity);
+  BOOST_CHECK(queue.selectVictim() == EvictionQueue::s_invalidSlot);
+
+  std::vector<uint32_t> slots;
+  for (uint32_t key = 1; key <= capacity; key++) {
+    slots.push_back(queue.insert(key));
+  }
+  BOOST_CHECK(queue.full());
+  BOOST_CHECK(queue.insert(42) == EvictionQueue::s_invalidSlot);
+
+  /* nothing has been visited, the oldest entry goes first */
+  BOOST_CHECK_EQUAL(evictOne(queue), 1U);
+  BOOST_CHECK_EQUAL(queue.size(), capacity - 1);
+
+  /* 2 and 3 are visited, so they survive, 4 is not */
+  queue.markVisited(slots.at(1));
+  queue.markVisited(slots.at(2));
+  auto slot5 = queue.insert(5);
+  BOOST_CHECK_EQUAL(evictOne(queue), 4U);
+
+  /* the hand goes on from where it stopped, towards the head:
+     5 has been visited so it survives, 6 has not */
+  queue.markVisited(slot5);
+  BOOST_CHECK(queue.insert(6) != EvictionQueue::s_invalidSlot);
+  BOOST_CHECK_EQUAL(evictOne(queue), 6U);
+  /* then it wraps around to the tail, and 2, 3 and 5 all lost
+     their visited bit during the previous passes */
+  BOOST_CHECK_EQUAL(evictOne(queue), 2U);
+  BOOST_CHECK_EQUAL(evictOne(queue), 3U);
+  BOOST_CHECK_EQUAL(evictOne(queue), 5U);
+  BOOST_CHECK_EQUAL(queue.size(), 0U);
+  BOOST_CHECK(queue.selectVictim() == EvictionQueue::s_invalidSlot);
+}
+
+BOOST_AUTO_TEST_CASE(test_Clock)
+{
+  const size_t capacity = 4;
+  EvictionQueue queue(EvictionPolicy::Clock, capacity);
+
+  std::vector<uint32_t> slots;
+  for (uint32_t key = 1; key <= capacity; key++) {
+    slots.push_back(queue.insert(key));
+  }
+
+  queue.markVisited(slots.at(0));
+  /* 1 is visited, 2 is the next oldest one */
+  BOOST_CHECK_EQUAL(evictOne(queue), 2U);
+  /* the new entry takes the place of the evicted one, right behind the hand */
+  BOOST_CHECK(queue.insert(5) != EvictionQueue::s_invalidSlot);
+  /* the hand goes on with 3, then 4, then wraps around to 1, which
+     lost its visited bit, then 5 */
+  BOOST_CHECK_EQUAL(evictOne(queue), 3U);
+  BOOST_CHECK(queue.insert(6) != EvictionQueue::s_invalidSlot);
+  BOOST_CHECK_EQUAL(evictOne(queue), 4U);
+  BOOST_CHECK(queue.insert(7) != EvictionQueue::s_invalidSlot);
+  BOOST_CHECK_EQUAL(evictOne(queue), 1U);
+  BOOST_CHECK_EQUAL(evictOne(queue), 5U);
+}
+
+BOOST_AUTO_TEST_CASE(test_RemoveUnderTheHand)
+{
+  for (const auto policy : {EvictionPolicy::Sieve, EvictionPolicy::Clock}) {
+    const size_t capacity = 100;
+    EvictionQueue queue(policy, capacity);
+    std::vector<uint32_t> slots;
+    for (uint32_t key = 0; key < capacity; key++) {
+      slots.push_back(queue.insert(key));
+      queue.markVisited(slots.back());
+    }
+
+    /* every entry is visited, so the hand has to do a full pass first */
+    BOOST_CHECK_EQUAL(evictOne(queue), 0U);
+    /* removing arbitrary entries, including the one the hand is on, must not break the list */
+    for (uint32_t key = 1; key < capacity; key += 2) {
+      queue.remove(slots.at(key));
+    }
+    BOOST_CHECK_EQUAL(queue.size(), (capacity / 2) - 1);
+
+    std::set<uint32_t> evicted;
+    while (queue.size() > 0) {
+      evicted.insert(evictOne(queue));
+    }
+    BOOST_CHECK_EQUAL(evicted.size(), (capacity / 2) - 1);
+    for (const auto key : evicted) {
+      BOOST_CHECK_EQUAL(key % 2, 0U);
+    }
+
+    /* and the slots are reusable */
+    for (uint32_t key = 0; key < capacity; key++) {
+      BOOST_CHECK(queue.insert(key) != EvictionQueue::s_invalidSlot);
+    }
+    BOOST_CHECK(queue.full());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,148 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+#define BOOST_TEST_NO_MAIN
+
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist-idstate.hh"
+#include "dnsdist-doh-common.hh"
+#include "doh3.hh"
+#include "doq.hh"
+
+BOOST_AUTO_TEST_SUITE(test_dnsdist_idstate_hh)
+
+BOOST_AUTO_TEST_CASE(test_IDStateTable_Acquire)
+{
+  IDStateTable table;
+  table.resize(16);
+  BOOST_CHECK_EQUAL(table.size(), 16U);
+  BOOST_CHECK(!table.isInUse(0));
+
+  {
+    auto slot = table.tryAcquire(0);
+    BOOST_REQUIRE(slot);
+    BOOST_CHECK(!slot->isInUse());
+    BOOST_CHECK_EQUAL(slot->getGeneration(), 0U);
+
+    /* already locked */
+    BOOST_CHECK(!table.tryAcquire(0));
+    /* but the other slots are not */
+    BOOST_CHECK(table.tryAcquire(1));
+
+    slot->getState().qname = DNSName("powerdns.com.");
+    slot->markInUse();
+    BOOST_CHECK(slot->isInUse());
+    BOOST_CHECK_EQUAL(slot->getGeneration(), 1U);
+  }
+
+  BOOST_CHECK(table.isInUse(0));
+  {
+    auto slot = table.tryAcquire(0);
+    BOOST_REQUIRE(slot);
+    BOOST_CHECK(slot->isInUse());
+    BOOST_CHECK_EQUAL(slot->getState().qname, DNSName("powerdns.com."));
+    slot->markFree();
+  }
+  BOOST_CHECK(!table.isInUse(0));
+
+  {
+    auto slot = table.tryAcquire(0);
+    BOOST_REQUIRE(slot);
+    BOOST_CHECK(!slot->isInUse());
+    /* the generation is only increased when the slot is assigned to a new query */
+    BOOST_CHECK_EQUAL(slot->getGeneration(), 1U);
+    slot->markInUse();
+    BOOST_CHECK_EQUAL(slot->getGeneration(), 2U);
+  }
+
+  /* same size, nothing changes */
+  table.resize(16);
+  BOOST_CHECK(table.isInUse(0));
+
+  table.clear();
+  BOOST_CHECK_EQUAL(table.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_IDStateTable_Expire)
+{
+  const uint16_t maxAge = 2;
+  IDStateTable table;
+  table.resize(4);
+
+  for (size_t idx = 0; idx < 3; idx++) {
+    auto slot = table.tryAcquire(idx);
+    BOOST_REQUIRE(slot);
+    slot->getState().origID = idx;
+    slot->markInUse();
+  }
+
+  std::vector<uint16_t> expired;
+  auto visitor = [&expired](IDStateTable::LockedSlot& slot) {
+    expired.push_back(slot.getState().origID);
+    slot.markFree();
+  };
+
+  /* ages go from 0 to 3, the slots are only expired once they are older than maxAge */
+  for (size_t round = 0; round <= maxAge; round++) {
+    table.expire(maxAge, visitor);
+    BOOST_CHECK(expired.empty());
+  }
+
+  {
+    /* a slot that is locked is left alone */
+    auto locked = table.tryAcquire(0);
+    BOOST_REQUIRE(locked);
+    BOOST_CHECK_EQUAL(locked->getAge(), maxAge + 1);
+
+    /* a slot that has been assigned to a new query since is not expired */
+    auto reused = table.tryAcquire(1);
+    BOOST_REQUIRE(reused);
+    reused->markInUse();
+    BOOST_CHECK_EQUAL(reused->getAge(), 0U);
+
+    table.expire(maxAge, visitor);
+    BOOST_REQUIRE_EQUAL(expired.size(), 1U);
+    BOOST_CHECK_EQUAL(expired.at(0), 2U);
+  }
+
+  /* now that it has been released, the first slot can be expired */
+  table.expire(maxAge, visitor);
+  BOOST_REQUIRE_EQUAL(expired.size(), 2U);
+  BOOST_CHECK_EQUAL(expired.at(1), 0U);
+  BOOST_CHECK(!table.isInUse(0));
+  BOOST_CHECK(table.isInUse(1));
+  BOOST_CHECK(!table.isInUse(2));
+  BOOST_CHECK(!table.isInUse(3));
+
+  expired.clear();
+  for (size_t round = 0; round <= maxAge; round++) {
+    table.expire(maxAge, visitor);
+  }
+  BOOST_REQUIRE_EQUAL(expired.size(), 1U);
+  BOOST_CHECK_EQUAL(expired.at(0), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,276 @@
+/*
+ * This file is part of PowerDNS or dnsdist.
+ * Copyright -- PowerDNS.COM B.V. and its contributors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * In addition, for the avoidance of any doubt, permission is granted to
+ * link this program with OpenSSL and to (re)distribute the binaries
+ * produced as the result of such linking.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+#define BOOST_TEST_NO_MAIN
+
+#include <string>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist-rcu.hh"
+
+BOOST_AUTO_TEST_SUITE(test_dnsdistrcu_hh)
+
+struct ReclaimCounter
+{
+  ReclaimCounter(std::atomic<size_t>& counter) :
+    d_counter(counter)
+  {
+  }
+  ReclaimCounter(const ReclaimCounter&) = delete;
+  ReclaimCounter(ReclaimCounter&&) = delete;
+  ReclaimCounter& operator=(const ReclaimCounter&) = delete;
+  ReclaimCounter& operator=(ReclaimCounter&&) = delete;
+  ~ReclaimCounter()
+  {
+    ++d_counter;
+  }
+  std::atomic<size_t>& d_counter;
+};
+
+BOOST_AUTO_TEST_CASE(test_Reclamation)
+{
+  std::atomic<size_t> destroyed{0};
+  /* make sure nothing is left from previous tests */
+  dnsdist::rcu::reclaim();
+
+  {
+    dnsdist::rcu::ReadGuard guard;
+    dnsdist::rcu::retire(new ReclaimCounter(destroyed));
+    BOOST_CHECK_EQUAL(dnsdist::rcu::getPendingReclamationsCount(), 1U);
+    /* we are still inside a read-side critical section */
+    BOOST_CHECK_EQUAL(dnsdist::rcu::reclaim(), 0U);
+    BOOST_CHECK_EQUAL(destroyed.load(), 0U);
+
+    {
+      /* nested guards are fine */
+      dnsdist::rcu::ReadGuard nested;
+    }
+    BOOST_CHECK_EQUAL(dnsdist::rcu::reclaim(), 0U);
+    BOOST_CHECK_EQUAL(destroyed.load(), 0U);
+  }
+
+  BOOST_CHECK_EQUAL(dnsdist::rcu::reclaim(), 1U);
+  BOOST_CHECK_EQUAL(destroyed.load(), 1U);
+  BOOST_CHECK_EQUAL(dnsdist::rcu::getPendingReclamationsCount(), 0U);
+
+  /* a reader from another thread should prevent reclamation as well */
+  std::atomic<bool> inside{false};
+  std::atomic<bool> done{false};
+  std::thread reader([&inside, &done]() {
+    dnsdist::rcu::ReadGuard guard;
+    inside = true;
+    while (!done) {
+      std::this_thread::yield();
+    }
+  });
+  while (!inside) {
+    std::this_thread::yield();
+  }
+
+  dnsdist::rcu::retire(new ReclaimCounter(destroyed));
+  BOOST_CHECK_EQUAL(dnsdist::rcu::reclaim(), 0U);
+  BOOST_CHECK_EQUAL(destroyed.load(), 1U);
+  done = true;
+  reader.join();
+  BOOST_CHECK_EQUAL(dnsdist::rcu::reclaim(), 1U);
+  BOOST_CHECK_EQUAL(destroyed.load(), 2U);
+
+  /* but objects retired after a reader entered have to wait for it */
+  {
+    dnsdist::rcu::ReadGuard guard;
+    dnsdist::rcu::retire(new ReclaimCounter(destroyed));
+  }
+  BOOST_CHECK_EQUAL(dnsdist::rcu::reclaim(), 1U);
+  BOOST_CHECK_EQUAL(destroyed.load(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(test_Synchronize)
+{
+  std::atomic<size_t> destroyed{0};
+  std::atomic<bool> inside{false};
+  std::atomic<bool> synchronized{false};
+  bool synchronizedTooEarly = false;
+  std::thread reader([&inside, &synchronized, &synchronizedTooEarly]() {
+    dnsdist::rcu::ReadGuard guard;
+    inside = true;
+    /* give synchronize() a chance to (wrongly) complete while we are still inside */
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    synchronizedTooEarly = synchronized.load();
+  });
+  while (!inside) {
+    std::this_thread::yield();
+  }
+
+  dnsdist::rcu::retire(new ReclaimCounter(destroyed));
+  dnsdist::rcu::synchronize();
+  synchronized = true;
+  BOOST_CHECK_EQUAL(destroyed.load(), 1U);
+  BOOST_CHECK_EQUAL(dnsdist::rcu::getPendingReclamationsCount(), 0U);
+  reader.join();
+  BOOST_CHECK(!synchronizedTooEarly);
+}
+
+BOOST_AUTO_TEST_CASE(test_HashTable)
+{
+  const size_t maxEntries = 100;
+  dnsdist::rcu::HashTable<std::string> table(maxEntries);
+  using InsertResult = dnsdist::rcu::HashTable<std::string>::InsertResult;
+  BOOST_CHECK_EQUAL(table.size(), 0U);
+  BOOST_CHECK_GE(table.getCapacity(), maxEntries * 2);
+
+  auto alwaysReplace = [](const std::string& /* existing */) { return true; };
+  auto neverReplace = [](const std::string& /* existing */) { return false; };
+
+  /* keys sharing the same lower bits, as in a sharded cache */
+  for (uint32_t idx = 0; idx < maxEntries; idx++) {
+    BOOST_CHECK(table.insert(idx * 64, std::to_string(idx), neverReplace) == InsertResult::Inserted);
+  }
+  BOOST_CHECK_EQUAL(table.size(), maxEntries);
+  BOOST_CHECK(table.insert(maxEntries * 64, "too many", alwaysReplace) == InsertResult::Full);
+
+  {
+    dnsdist::rcu::ReadGuard guard;
+    for (uint32_t idx = 0; idx < maxEntries; idx++) {
+      const auto* value = table.find(idx * 64);
+      BOOST_REQUIRE(value != nullptr);
+      BOOST_CHECK_EQUAL(*value, std::to_string(idx));
+    }
+    BOOST_CHECK(table.find(1) == nullptr);
+  }
+
+  /* existing entries */
+  BOOST_CHECK(table.insert(0, "not replaced", neverReplace) == InsertResult::Kept);
+  BOOST_CHECK(table.insert(64, "replaced", alwaysReplace) == InsertResult::Replaced);
+  BOOST_CHECK_EQUAL(table.size(), maxEntries);
+  {
+    dnsdist::rcu::ReadGuard guard;
+    BOOST_CHECK_EQUAL(*table.find(0), "0");
+    BOOST_CHECK_EQUAL(*table.find(64), "replaced");
+  }
+
+  size_t visited = 0;
+  {
+    dnsdist::rcu::ReadGuard guard;
+    table.visit([&visited](uint32_t key, const std::string& /* value */) {
+      BOOST_CHECK_EQUAL(key % 64, 0U);
+      ++visited;
+      return true;
+    });
+  }
+  BOOST_CHECK_EQUAL(visited, maxEntries);
+
+  /* remove at most 10 entries with an even key */
+  BOOST_CHECK_EQUAL(table.removeIf([](uint32_t key, const std::string& /* value */) { return (key / 64) % 2 == 0; }, 10), 10U);
+  BOOST_CHECK_EQUAL(table.size(), maxEntries - 10);
+  /* then all of them */
+  BOOST_CHECK_EQUAL(table.removeIf([](uint32_t key, const std::string& /* value */) { return (key / 64) % 2 == 0; }), (maxEntries / 2) - 10);
+  BOOST_CHECK_EQUAL(table.size(), maxEntries / 2);
+  {
+    dnsdist::rcu::ReadGuard guard;
+    for (uint32_t idx = 0; idx < maxEntries; idx++) {
+      BOOST_CHECK_EQUAL(table.find(idx * 64) != nullptr, idx % 2 == 1);
+    }
+  }
+
+  /* single entry removal */
+  BOOST_CHECK(table.remove(64));
+  BOOST_CHECK(!table.remove(64));
+  BOOST_CHECK(!table.remove(128));
+  BOOST_CHECK_EQUAL(table.size(), (maxEntries / 2) - 1);
+  BOOST_CHECK(table.insert(64, "64", neverReplace) == InsertResult::Inserted);
+
+  /* churn a lot so that the slots have to be rebuilt several times,
+     removing tombstones */
+  for (uint32_t round = 0; round < 100; round++) {
+    for (uint32_t idx = 0; idx < maxEntries / 2; idx++) {
+      auto key = (maxEntries + (round * maxEntries) + idx) * 64;
+      BOOST_CHECK(table.insert(key, std::to_string(key), neverReplace) == InsertResult::Inserted);
+    }
+    BOOST_CHECK_EQUAL(table.size(), maxEntries);
+    BOOST_CHECK_EQUAL(table.removeIf([round](uint32_t key, const std::string& /* value */) { return key >= (maxEntries + (round * maxEntries)) * 64; }), maxEntries / 2);
+  }
+  BOOST_CHECK_EQUAL(table.size(), maxEntries / 2);
+  {
+    dnsdist::rcu::ReadGuard guard;
+    for (uint32_t idx = 0; idx < maxEntries; idx++) {
+      BOOST_CHECK_EQUAL(table.find(idx * 64) != nullptr, idx % 2 == 1);
+    }
+  }
+
+  dnsdist::rcu::reclaim();
+  BOOST_CHECK_EQUAL(dnsdist::rcu::getPendingReclamationsCount(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_HashTableConcurrentReaders)
+{
+  const size_t maxEntries = 1000;
+  dnsdist::rcu::HashTable<std::string> table(maxEntries);
+  for (uint32_t idx = 0; idx < maxEntries / 2; idx++) {
+    table.insert(idx, std::to_string(idx), [](const std::string& /* existing */) { return false; });
+  }
+
+  std::atomic<bool> done{false};
+  std::atomic<size_t> errors{0};
+  std::vector<std::thread> readers;
+  readers.reserve(4);
+  for (size_t idx = 0; idx < 4; idx++) {
+    readers.emplace_back([&table, &done, &errors]() {
+      while (!done) {
+        dnsdist::rcu::ReadGuard guard;
+        for (uint32_t key = 0; key < maxEntries / 2; key++) {
+          const auto* value = table.find(key);
+          /* the first half of the keys is always present */
+          if (value == nullptr || *value != std::to_string(key)) {
+            ++errors;
+          }
+        }
+      }
+    });
+  }
+
+  for (uint32_t round = 0; round < 1000; round++) {
+    for (uint32_t key = maxEntries / 2; key < maxEntries; key++) {
+      table.insert(key, std::to_string(key), [](const std::string& /* existing */) { return true; });
+    }
+    /* replace the permanent entries as well */
+    for (uint32_t key = 0; key < maxEntries / 2; key += 10) {
+      table.insert(key, std::to_string(key), [](const std::string& /* existing */) { return true; });
+    }
+    table.removeIf([](uint32_t key, const std::string& /* value */) { return key >= maxEntries / 2; });
+  }
+
+  done = true;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+
+  BOOST_CHECK_EQUAL(errors.load(), 0U);
+  BOOST_CHECK_EQUAL(table.size(), maxEntries / 2);
+  dnsdist::rcu::reclaim();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
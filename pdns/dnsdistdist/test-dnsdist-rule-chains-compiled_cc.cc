@@ -0,0 +1,168 @@
+
+#ifndef BOOST_TEST_DYN_LINK
+#define BOOST_TEST_DYN_LINK
+#endif
+
+#define BOOST_TEST_NO_MAIN
+
+#include <boost/test/unit_test.hpp>
+
+#include "dnsdist-rule-chains.hh"
+#include "dnsdist-rule-chains-compiled.hh"
+#include "dnsdist-rules-factory.hh"
+
+static void addRule(std::vector<dnsdist::rules::RuleAction>& rules, std::shared_ptr<DNSRule> rule)
+{
+  rules.push_back({std::move(rule), nullptr, "", getUniqueID(), rules.size()});
+}
+
+static std::shared_ptr<DNSRule> getSuffixRule(const std::vector<std::string>& names)
+{
+  SuffixMatchNode smn;
+  for (const auto& name : names) {
+    smn.add(DNSName(name));
+  }
+  return std::make_shared<SuffixMatchNodeRule>(smn);
+}
+
+static std::shared_ptr<DNSRule> getNetmaskRule(const std::vector<std::string>& netmasks, bool src)
+{
+  NetmaskGroup nmg;
+  for (const auto& netmask : netmasks) {
+    nmg.addMask(netmask);
+  }
+  return std::make_shared<NetmaskGroupRule>(nmg, src);
+}
+
+static size_t getNextLinearMatch(const std::vector<dnsdist::rules::RuleAction>& rules, const DNSQuestion& dnsQuestion, size_t from)
+{
+  for (auto position = from; position < rules.size(); position++) {
+    if (rules.at(position).d_rule->matches(&dnsQuestion)) {
+      return position;
+    }
+  }
+  return rules.size();
+}
+
+BOOST_AUTO_TEST_SUITE(dnsdistrulechainscompiled_cc)
+
+BOOST_AUTO_TEST_CASE(test_FirstMatchSemantics)
+{
+  std::vector<dnsdist::rules::RuleAction> rules;
+  /* 0 */ addRule(rules, std::make_shared<QTypeRule>(QType::TXT));
+  /* 1 */ addRule(rules, getSuffixRule({"a.powerdns.com."}));
+  /* 2 */ addRule(rules, getSuffixRule({"powerdns.com.", "example.org."}));
+  /* 3 */ addRule(rules, getSuffixRule({"b.a.powerdns.com."}));
+  /* 4 */ addRule(rules, getSuffixRule({"."}));
+  /* 5 */ addRule(rules, std::make_shared<QTypeRule>(QType::A));
+  /* 6 */ addRule(rules, std::make_shared<QTypeRule>(QType::AAAA));
+  /* 7 */ addRule(rules, std::make_shared<QTypeRule>(QType::A));
+  /* 8 */ addRule(rules, getNetmaskRule({"192.0.2.0/24", "2001:db8::/32"}, true));
+  /* 9 */ addRule(rules, getNetmaskRule({"192.0.2.128/25"}, true));
+  /* 10 */ addRule(rules, getNetmaskRule({"0.0.0.0/0"}, true));
+  /* 11 */ addRule(rules, getNetmaskRule({"192.0.2.0/24", "!192.0.2.1/32"}, true));
+  /* 12 */ addRule(rules, getNetmaskRule({"127.0.0.0/8"}, false));
+  /* 13 */ addRule(rules, getNetmaskRule({"127.0.0.1/32", "::1/128"}, false));
+  /* 14 */ addRule(rules, std::make_shared<AllRule>());
+
+  dnsdist::rules::CompiledRuleChain compiled(rules);
+  /* TXT, the suffixes, the qtypes, the source netmasks, the negated one, the destination ones, all */
+  BOOST_CHECK_EQUAL(compiled.getSegmentsCount(), 7U);
+  BOOST_CHECK_EQUAL(compiled.getMergedRulesCount(), 12U);
+
+  const std::vector<std::string> names{"powerdns.com.", "a.powerdns.com.", "B.A.POWERDNS.COM.", "c.b.a.powerdns.com.", "www.example.org.", "example.net.", "."};
+  const std::vector<uint16_t> qtypes{QType::A, QType::AAAA, QType::TXT, QType::MX};
+  const std::vector<std::string> sources{"192.0.2.1:42", "192.0.2.200:42", "198.51.100.1:42", "[2001:db8::1]:42", "[2001:db9::1]:42"};
+  const std::vector<std::string> destinations{"127.0.0.1:53", "127.0.0.2:53", "[::1]:53", "192.0.2.42:53"};
+
+  PacketBuffer packet(sizeof(dnsheader));
+  size_t checked = 0;
+  for (const auto& name : names) {
+    for (const auto qtype : qtypes) {
+      for (const auto& source : sources) {
+        for (const auto& destination : destinations) {
+          InternalQueryState ids;
+          ids.qname = DNSName(name);
+          ids.qtype = qtype;
+          ids.qclass = QClass::IN;
+          ids.origRemote = ComboAddress(source);
+          ids.origDest = ComboAddress(destination);
+          ids.protocol = dnsdist::Protocol::DoUDP;
+          DNSQuestion dnsQuestion(ids, packet);
+
+          /* go through the whole chain, as non-terminal actions would */
+          size_t linear = getNextLinearMatch(rules, dnsQuestion, 0);
+          size_t position = compiled.getNextMatch(rules, dnsQuestion, 0);
+          while (true) {
+            BOOST_REQUIRE_EQUAL(position, linear);
+            checked++;
+            if (position >= rules.size()) {
+              break;
+            }
+            linear = getNextLinearMatch(rules, dnsQuestion, linear + 1);
+            position = compiled.getNextMatch(rules, dnsQuestion, position + 1);
+          }
+        }
+      }
+    }
+  }
+  BOOST_CHECK_GT(checked, names.size() * qtypes.size() * sources.size() * destinations.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_LazyEvaluation)
+{
+  std::vector<dnsdist::rules::RuleAction> rules;
+  addRule(rules, std::make_shared<QTypeRule>(QType::A));
+  addRule(rules, std::make_shared<QTypeRule>(QType::AAAA));
+  addRule(rules, std::make_shared<QTypeRule>(QType::TXT));
+
+  dnsdist::rules::CompiledRuleChain compiled(rules);
+  BOOST_CHECK_EQUAL(compiled.getSegmentsCount(), 1U);
+
+  PacketBuffer packet(sizeof(dnsheader));
+  InternalQueryState ids;
+  ids.qname = DNSName("powerdns.com.");
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.origRemote = ComboAddress("192.0.2.1:42");
+  ids.origDest = ComboAddress("127.0.0.1:53");
+  DNSQuestion dnsQuestion(ids, packet);
+
+  BOOST_CHECK_EQUAL(compiled.getNextMatch(rules, dnsQuestion, 0), 0U);
+  BOOST_CHECK_EQUAL(compiled.getNextMatch(rules, dnsQuestion, 1), rules.size());
+  /* an action changed the query in the meantime, it has to be taken into account */
+  ids.qtype = QType::TXT;
+  BOOST_CHECK_EQUAL(compiled.getNextMatch(rules, dnsQuestion, 1), 2U);
+  BOOST_CHECK_EQUAL(compiled.getNextMatch(rules, dnsQuestion, 3), rules.size());
+
+  /* a different chain */
+  rules.pop_back();
+  BOOST_CHECK_THROW((void)compiled.getNextMatch(rules, dnsQuestion, 0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_CompiledChainInvalidation)
+{
+  dnsdist::rules::RuleChains chains;
+  auto& rules = dnsdist::rules::getRuleChain(chains, dnsdist::rules::RuleChain::Rules);
+  addRule(rules, std::make_shared<QTypeRule>(QType::A));
+  addRule(rules, std::make_shared<QTypeRule>(QType::AAAA));
+
+  const auto& constChains = chains;
+  const auto* compiled = &dnsdist::rules::getCompiledRuleChain(constChains, dnsdist::rules::RuleChain::Rules);
+  BOOST_CHECK_EQUAL(compiled->getMergedRulesCount(), 2U);
+  /* compiled once */
+  BOOST_CHECK_EQUAL(&dnsdist::rules::getCompiledRuleChain(constChains, dnsdist::rules::RuleChain::Rules), compiled);
+
+  /* a copy does not share the compiled version */
+  auto copy = chains;
+  addRule(dnsdist::rules::getRuleChain(copy, dnsdist::rules::RuleChain::Rules), std::make_shared<QTypeRule>(QType::TXT));
+  const auto& constCopy = copy;
+  BOOST_CHECK_EQUAL(dnsdist::rules::getCompiledRuleChain(constCopy, dnsdist::rules::RuleChain::Rules).getMergedRulesCount(), 3U);
+  BOOST_CHECK_EQUAL(dnsdist::rules::getCompiledRuleChain(constChains, dnsdist::rules::RuleChain::Rules).getMergedRulesCount(), 2U);
+
+  /* getting a mutable reference to the chain invalidates the compiled version */
+  addRule(dnsdist::rules::getRuleChain(chains, dnsdist::rules::RuleChain::Rules), std::make_shared<AllRule>());
+  BOOST_CHECK_EQUAL(dnsdist::rules::getCompiledRuleChain(constChains, dnsdist::rules::RuleChain::Rules).getSegmentsCount(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -214,4 +214,92 @@ BOOST_AUTO_TEST_CASE(test_AddingExpiredEvent)
   holder->stop();
 }
 
+BOOST_AUTO_TEST_CASE(test_BatchGet)
+{
+  auto holder = std::make_unique<dnsdist::AsynchronousHolder>();
+  struct timeval ttd{};
+  gettimeofday(&ttd, nullptr);
+  // timeout in 10 s, we do not want any of them to expire
+  const timeval add{10, 0};
+  ttd = ttd + add;
+
+  const uint16_t asyncID = 1;
+  const size_t count = 1000;
+  for (size_t idx = 0; idx < count; idx++) {
+    holder->push(asyncID, static_cast<uint16_t>(idx), ttd, std::make_unique<DummyCrossProtocolQuery>());
+  }
+  BOOST_CHECK(!holder->empty());
+
+  std::vector<std::pair<uint16_t, uint16_t>> ids;
+  /* every even query, plus one that does not exist */
+  for (size_t idx = 0; idx < count; idx += 2) {
+    ids.emplace_back(asyncID, static_cast<uint16_t>(idx));
+  }
+  ids.emplace_back(asyncID + 1, 0);
+
+  auto queries = holder->get(ids);
+  BOOST_REQUIRE_EQUAL(queries.size(), ids.size());
+  for (size_t idx = 0; idx < queries.size() - 1; idx++) {
+    BOOST_CHECK(queries.at(idx) != nullptr);
+  }
+  BOOST_CHECK(queries.back() == nullptr);
+
+  /* already retrieved */
+  BOOST_CHECK(holder->get(asyncID, 0) == nullptr);
+  BOOST_CHECK(!holder->empty());
+
+  ids.clear();
+  for (size_t idx = 1; idx < count; idx += 2) {
+    ids.emplace_back(asyncID, static_cast<uint16_t>(idx));
+  }
+  queries = holder->get(ids);
+  for (const auto& query : queries) {
+    BOOST_CHECK(query != nullptr);
+  }
+  BOOST_CHECK(holder->empty());
+
+  holder->stop();
+}
+
+BOOST_AUTO_TEST_CASE(test_ManyTimeoutsFailClose)
+{
+  auto holder = std::make_unique<dnsdist::AsynchronousHolder>(false);
+  const uint16_t asyncID = 1;
+  const size_t count = 100;
+  std::vector<std::shared_ptr<DummyQuerySender>> senders;
+  senders.reserve(count);
+
+  struct timeval now{};
+  gettimeofday(&now, nullptr);
+  for (size_t idx = 0; idx < count; idx++) {
+    /* spread the timeouts between 0 and 20 ms, so that they land in different slots of the timer wheel */
+    const timeval add{0, static_cast<suseconds_t>((idx % 20) * 1000)};
+    auto query = std::make_unique<DummyCrossProtocolQuery>();
+    senders.push_back(query->d_sender);
+    holder->push(asyncID, static_cast<uint16_t>(idx), now + add, std::move(query));
+  }
+  /* and one that should not expire during the test */
+  const timeval later{10, 0};
+  holder->push(asyncID + 1, 0, now + later, std::make_unique<DummyCrossProtocolQuery>());
+
+  auto allRaised = [&senders]() {
+    return std::all_of(senders.begin(), senders.end(), [](const auto& sender) { return sender->errorRaised.load(); });
+  };
+
+  // see test_TimeoutFailClose about the generous delay
+  for (size_t counter = 0; counter < 20; counter++) {
+    if (allRaised()) {
+      break;
+    }
+    usleep(10000);
+  }
+
+  BOOST_CHECK(allRaised());
+  BOOST_CHECK(!holder->empty());
+  BOOST_CHECK(holder->get(asyncID + 1, 0) != nullptr);
+  BOOST_CHECK(holder->empty());
+
+  holder->stop();
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -32,6 +32,22 @@ struct TestFixture
   }
 };
 
+struct SlidingCountersFixture
+{
+  SlidingCountersFixture()
+  {
+    g_rings.reset();
+    /* the rings themselves do not record anything, so that only the
+       sliding counters can trigger a block */
+    g_rings.init(10000, 10, 5, false, false);
+    g_rings.enableSlidingCounters({10, 4096});
+  }
+  ~SlidingCountersFixture()
+  {
+    g_rings.reset();
+  }
+};
+
 BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_QueryRate, TestFixture) {
   dnsheader dnsHeader{};
   memset(&dnsHeader, 0, sizeof(dnsHeader));
@@ -1208,6 +1224,203 @@ BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_Ranges, TestFixture) {
 
 }
 
+BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesGroup_SlidingCounters, SlidingCountersFixture) {
+  dnsheader dnsHeader{};
+  memset(&dnsHeader, 0, sizeof(dnsHeader));
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor1("192.0.2.1");
+  ComboAddress requestor2("192.0.2.2");
+  ComboAddress backend("192.0.2.42");
+  uint16_t qtype = QType::AAAA;
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  dnsdist::Protocol outgoingProtocol = dnsdist::Protocol::DoUDP;
+  unsigned int responseTime = 100 * 1000; /* 100ms */
+  struct timespec now;
+  gettime(&now);
+
+  size_t numberOfSeconds = 10;
+  size_t blockDuration = 60;
+  const auto action = DNSAction::Action::Drop;
+  const std::string reason = "Exceeded query rate";
+
+  BOOST_REQUIRE(g_rings.getSlidingCounters() != nullptr);
+  BOOST_CHECK_EQUAL(g_rings.getSlidingCounters()->getWindowSeconds(), numberOfSeconds);
+
+  {
+    DynBlockRulesGroup dbrg;
+    dbrg.setQuiet(true);
+    /* block above 50 qps for numberOfSeconds seconds, no warning */
+    dbrg.setQueryRate(DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 50, 0, numberOfSeconds, action));
+
+    /* insert 45 qps from a given client in the last 10s
+       this should not trigger the rule */
+    g_rings.clear();
+    dnsdist::DynamicBlocks::clearClientAddressDynamicRules();
+    for (size_t timeIdx = 0; timeIdx < numberOfSeconds; timeIdx++) {
+      struct timespec when = now;
+      when.tv_sec -= (9 - timeIdx);
+      for (size_t idx = 0; idx < 45; idx++) {
+        g_rings.insertQuery(when, requestor1, qname, qtype, size, dnsHeader, protocol);
+      }
+    }
+    BOOST_CHECK_EQUAL(g_rings.getNumberOfQueryEntries(), 0U);
+
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(dnsdist::DynamicBlocks::getClientAddressDynamicRules().size(), 0U);
+
+    /* 6 more queries per second, and we are above the rate */
+    for (size_t timeIdx = 0; timeIdx < numberOfSeconds; timeIdx++) {
+      struct timespec when = now;
+      when.tv_sec -= (9 - timeIdx);
+      for (size_t idx = 0; idx < 6; idx++) {
+        g_rings.insertQuery(when, requestor1, qname, qtype, size, dnsHeader, protocol);
+      }
+    }
+
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(dnsdist::DynamicBlocks::getClientAddressDynamicRules().size(), 1U);
+    BOOST_CHECK(dnsdist::DynamicBlocks::getClientAddressDynamicRules().lookup(requestor1) != nullptr);
+    BOOST_CHECK(dnsdist::DynamicBlocks::getClientAddressDynamicRules().lookup(requestor2) == nullptr);
+    const auto& block = dnsdist::DynamicBlocks::getClientAddressDynamicRules().lookup(requestor1)->second;
+    BOOST_CHECK_EQUAL(block.reason, reason);
+    BOOST_CHECK_EQUAL(static_cast<size_t>(block.until.tv_sec), now.tv_sec + blockDuration);
+    BOOST_CHECK(block.action == action);
+
+    /* 20s later these queries are out of the window */
+    dnsdist::DynamicBlocks::clearClientAddressDynamicRules();
+    struct timespec later = now;
+    later.tv_sec += 20;
+    dbrg.apply(later);
+    BOOST_CHECK_EQUAL(dnsdist::DynamicBlocks::getClientAddressDynamicRules().size(), 0U);
+  }
+
+  {
+    /* a rule looking at a longer window than the counters is evaluated
+       from the rings, which are empty */
+    DynBlockRulesGroup dbrg;
+    dbrg.setQuiet(true);
+    dbrg.setQueryRate(DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 50, 0, numberOfSeconds * 2, action));
+
+    g_rings.clear();
+    dnsdist::DynamicBlocks::clearClientAddressDynamicRules();
+    for (size_t idx = 0; idx < 1000; idx++) {
+      g_rings.insertQuery(now, requestor1, qname, qtype, size, dnsHeader, protocol);
+    }
+
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(dnsdist::DynamicBlocks::getClientAddressDynamicRules().size(), 0U);
+
+    /* and so is a group using a port mask */
+    DynBlockRulesGroup withPorts;
+    withPorts.setQuiet(true);
+    withPorts.setQueryRate(DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 50, 0, numberOfSeconds, action));
+    withPorts.setMasks(32, 128, 16);
+    withPorts.apply(now);
+    BOOST_CHECK_EQUAL(dnsdist::DynamicBlocks::getClientAddressDynamicRules().size(), 0U);
+  }
+
+  {
+    DynBlockRulesGroup dbrg;
+    dbrg.setQuiet(true);
+    /* block above 50 ServFail/s, or 50 ANY/s, for numberOfSeconds seconds */
+    dbrg.setRCodeRate(RCode::ServFail, DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 50, 0, numberOfSeconds, action));
+    dbrg.setQTypeRate(QType::ANY, DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 50, 0, numberOfSeconds, action));
+
+    g_rings.clear();
+    dnsdist::DynamicBlocks::clearClientAddressDynamicRules();
+    dnsHeader.rcode = RCode::ServFail;
+    for (size_t idx = 0; idx < (50 * numberOfSeconds) + 1; idx++) {
+      /* lots of AAAA queries and of NXDomain responses from requestor1, which should not matter */
+      g_rings.insertQuery(now, requestor1, qname, qtype, size, dnsHeader, protocol);
+      dnsHeader.rcode = RCode::NXDomain;
+      g_rings.insertResponse(now, requestor1, qname, qtype, responseTime, size, dnsHeader, backend, outgoingProtocol);
+      /* ServFail responses to requestor2 */
+      dnsHeader.rcode = RCode::ServFail;
+      g_rings.insertResponse(now, requestor2, qname, qtype, responseTime, size, dnsHeader, backend, outgoingProtocol);
+    }
+
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(dnsdist::DynamicBlocks::getClientAddressDynamicRules().size(), 1U);
+    BOOST_CHECK(dnsdist::DynamicBlocks::getClientAddressDynamicRules().lookup(requestor1) == nullptr);
+    BOOST_CHECK(dnsdist::DynamicBlocks::getClientAddressDynamicRules().lookup(requestor2) != nullptr);
+
+    for (size_t idx = 0; idx < (50 * numberOfSeconds) + 1; idx++) {
+      g_rings.insertQuery(now, requestor1, qname, QType::ANY, size, dnsHeader, protocol);
+    }
+    dbrg.apply(now);
+    BOOST_CHECK_EQUAL(dnsdist::DynamicBlocks::getClientAddressDynamicRules().size(), 2U);
+    BOOST_CHECK(dnsdist::DynamicBlocks::getClientAddressDynamicRules().lookup(requestor1) != nullptr);
+    dnsHeader.rcode = RCode::NoError;
+  }
+
+  {
+    DynBlockRulesGroup dbrg;
+    dbrg.setQuiet(true);
+    dbrg.setSuffixMatchRule(DynBlockRulesGroup::DynBlockRule(reason, blockDuration, 0, 0, numberOfSeconds, action), [](const StatNode& node, const StatNode::Stat& self, const StatNode::Stat& children) {
+      (void)node;
+      (void)children;
+      return std::tuple<bool, std::optional<std::string>, std::optional<int>>(self.servfails > 100, std::nullopt, std::nullopt);
+    });
+
+    g_rings.clear();
+    dnsdist::DynamicBlocks::clearSuffixDynamicRules();
+    const DNSName bad("bad.powerdns.com.");
+    const DNSName good("good.powerdns.com.");
+    dnsHeader.rcode = RCode::ServFail;
+    for (size_t idx = 0; idx < 101; idx++) {
+      struct timespec when = now;
+      when.tv_sec -= idx % numberOfSeconds;
+      g_rings.insertResponse(when, requestor1, bad, qtype, responseTime, size, dnsHeader, backend, outgoingProtocol);
+    }
+    for (size_t idx = 0; idx < 100; idx++) {
+      g_rings.insertResponse(now, requestor1, good, qtype, responseTime, size, dnsHeader, backend, outgoingProtocol);
+    }
+    dnsHeader.rcode = RCode::NoError;
+
+    dbrg.apply(now);
+    BOOST_CHECK(dnsdist::DynamicBlocks::getSuffixDynamicRules().lookup(bad) != nullptr);
+    BOOST_CHECK(dnsdist::DynamicBlocks::getSuffixDynamicRules().lookup(good) == nullptr);
+    dnsdist::DynamicBlocks::clearSuffixDynamicRules();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_HeavyHitterTable) {
+  using table_t = dnsdist::HeavyHitterTable<ComboAddress, uint64_t, ComboAddress::addressOnlyHash, ComboAddress::addressOnlyEqual>;
+  table_t table(4);
+  const ComboAddress heavy("192.0.2.1");
+
+  for (size_t idx = 0; idx < 100; idx++) {
+    table.get(heavy)++;
+  }
+  BOOST_CHECK_EQUAL(table.size(), 1U);
+
+  /* lots of light clients, the heavy one should be kept */
+  for (size_t idx = 0; idx < 200; idx++) {
+    table.get(ComboAddress("198.51.100." + std::to_string(idx)))++;
+  }
+  BOOST_CHECK_EQUAL(table.size(), 4U);
+  BOOST_CHECK_GT(table.getEvictions(), 0U);
+
+  size_t found = 0;
+  table.visit([&heavy, &found](const ComboAddress& key, uint64_t value) {
+    if (ComboAddress::addressOnlyEqual()(key, heavy)) {
+      BOOST_CHECK_EQUAL(value, 100U);
+    }
+    else {
+      BOOST_CHECK_EQUAL(value, 1U);
+    }
+    found++;
+  });
+  BOOST_CHECK_EQUAL(found, 4U);
+
+  table.clear();
+  BOOST_CHECK_EQUAL(table.size(), 0U);
+  table.visit([](const ComboAddress&, uint64_t) {
+    BOOST_CHECK(false);
+  });
+}
+
 BOOST_FIXTURE_TEST_CASE(test_DynBlockRulesMetricsCache_GetTopN, TestFixture) {
   dnsheader dnsHeader{};
   memset(&dnsHeader, 0, sizeof(dnsHeader));
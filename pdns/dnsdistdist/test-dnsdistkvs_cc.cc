@@ -9,7 +9,6 @@
 
 #include "dnsdist-kvs.hh"
 
-#if defined(HAVE_LMDB) || defined(HAVE_CDB)
 static const ComboAddress v4ToMask("203.0.113.255");
 static const ComboAddress v6ToMask("2001:db8:ff:ff:ff:ff:ff:ff");
 
@@ -239,7 +238,6 @@ static void doKVSChecks(std::unique_ptr<KeyValueStore>& kvs, const ComboAddress&
   }
 }
 
-#if defined(HAVE_LMDB)
 static void doKVSRangeChecks(std::unique_ptr<KeyValueStore>& kvs)
 {
   {
@@ -294,10 +292,6 @@ static void doKVSRangeChecks(std::unique_ptr<KeyValueStore>& kvs)
   }
 
 }
-#endif // defined(HAVE_LMDB)
-
-#endif // defined(HAVE_LMDB) || defined(HAVE_CDB)
-
 BOOST_AUTO_TEST_SUITE(dnsdistkvs_cc)
 
 #ifdef HAVE_LMDB
@@ -450,4 +444,122 @@ BOOST_AUTO_TEST_CASE(test_CDB) {
 }
 #endif /* HAVE_CDB */
 
+BOOST_AUTO_TEST_CASE(test_MMap)
+{
+  InternalQueryState ids;
+  ids.qname = DNSName("powerdns.com.");
+  DNSName plaintextDomain("powerdns.org.");
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.origDest = ComboAddress("192.0.2.1:53");
+  ids.origRemote = ComboAddress("192.0.2.128:42");
+  PacketBuffer packet(sizeof(dnsheader));
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  ids.queryRealTime.start();
+
+  DNSQuestion dq(ids, packet);
+  ComboAddress v4Masked(v4ToMask);
+  ComboAddress v6Masked(v6ToMask);
+  v4Masked.truncate(25);
+  v6Masked.truncate(65);
+
+  const ComboAddress firstRangeAddr6("2001:0db8:0000:0000:0000:0000:0000:0000");
+  const ComboAddress lastRangeAddr6("2001:0db8:ffff:ffff:ffff:ffff:ffff:ffff");
+  const ComboAddress firstRangeAddr4("192.0.2.1:0");
+  const ComboAddress lastRangeAddr4("192.0.2.1:16383");
+
+  auto writeDB = [](MMapKVStoreWriter& writer, const std::string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    BOOST_REQUIRE(fd >= 0);
+    writer.write(fd);
+    close(fd);
+  };
+
+  char db[] = "/tmp/test_mmap_kvs.XXXXXX";
+  {
+    int fd = mkstemp(db);
+    BOOST_REQUIRE(fd >= 0);
+    close(fd);
+    MMapKVStoreWriter writer;
+    BOOST_REQUIRE(writer.addEntry(std::string(reinterpret_cast<const char*>(&ids.origRemote.sin4.sin_addr.s_addr), sizeof(ids.origRemote.sin4.sin_addr.s_addr)), "this is the value for the remote addr"));
+    BOOST_REQUIRE(writer.addEntry(std::string(reinterpret_cast<const char*>(&ids.origRemote.sin4.sin_addr.s_addr), sizeof(ids.origRemote.sin4.sin_addr.s_addr)) + std::string(reinterpret_cast<const char*>(&ids.origRemote.sin4.sin_port), sizeof(ids.origRemote.sin4.sin_port)), "this is the value for the remote addr + port"));
+    BOOST_REQUIRE(writer.addEntry(std::string(reinterpret_cast<const char*>(&v4Masked.sin4.sin_addr.s_addr), sizeof(v4Masked.sin4.sin_addr.s_addr)), "this is the value for the masked v4 addr"));
+    BOOST_REQUIRE(writer.addEntry(std::string(reinterpret_cast<const char*>(&v6Masked.sin6.sin6_addr.s6_addr), sizeof(v6Masked.sin6.sin6_addr.s6_addr)), "this is the value for the masked v6 addr"));
+    BOOST_REQUIRE(writer.addEntry(dq.ids.qname.toDNSStringLC(), "this is the value for the qname"));
+    BOOST_REQUIRE(writer.addEntry(plaintextDomain.toStringRootDot(), "this is the value for the plaintext domain"));
+    writeDB(writer, db);
+  }
+
+  std::unique_ptr<KeyValueStore> kvs = std::make_unique<MMapKVStore>(db, 0);
+  doKVSChecks(kvs, ids.origDest, ids.origRemote, dq, plaintextDomain);
+
+  {
+    /* replace the database by a new file, the existing mapping should be used until we reload */
+    const std::string newDB = std::string(db) + ".new";
+    MMapKVStoreWriter writer;
+    BOOST_REQUIRE(writer.addEntry(dq.ids.qname.toDNSStringLC(), "this is the new value for the qname"));
+    writeDB(writer, newDB);
+    BOOST_REQUIRE_EQUAL(rename(newDB.c_str(), db), 0);
+
+    std::string value;
+    BOOST_CHECK(kvs->getValue(dq.ids.qname.toDNSStringLC(), value));
+    BOOST_CHECK_EQUAL(value, "this is the value for the qname");
+    BOOST_CHECK(kvs->keyExists(plaintextDomain.toStringRootDot()));
+
+    BOOST_CHECK(kvs->reload());
+    value.clear();
+    BOOST_CHECK(kvs->getValue(dq.ids.qname.toDNSStringLC(), value));
+    BOOST_CHECK_EQUAL(value, "this is the new value for the qname");
+    BOOST_CHECK(!kvs->keyExists(plaintextDomain.toStringRootDot()));
+  }
+
+  {
+    /* range-based lookups */
+    MMapKVStoreWriter writer;
+    std::string value = std::string(reinterpret_cast<const char*>(&firstRangeAddr6.sin6.sin6_addr.s6_addr), sizeof(firstRangeAddr6.sin6.sin6_addr.s6_addr)) + std::string("any other data");
+    BOOST_REQUIRE(writer.addEntry(std::string(reinterpret_cast<const char*>(&lastRangeAddr6.sin6.sin6_addr.s6_addr), sizeof(lastRangeAddr6.sin6.sin6_addr.s6_addr)), value));
+
+    value = std::string(reinterpret_cast<const char*>(&firstRangeAddr4.sin4.sin_addr.s_addr), sizeof(firstRangeAddr4.sin4.sin_addr.s_addr)) + std::string(reinterpret_cast<const char*>(&firstRangeAddr4.sin4.sin_port), sizeof(firstRangeAddr4.sin4.sin_port)) + std::string("any other data");
+    BOOST_REQUIRE(writer.addEntry(std::string(reinterpret_cast<const char*>(&lastRangeAddr4.sin4.sin_addr.s_addr), sizeof(lastRangeAddr4.sin4.sin_addr.s_addr)) + std::string(reinterpret_cast<const char*>(&lastRangeAddr4.sin4.sin_port), sizeof(lastRangeAddr4.sin4.sin_port)), value));
+    writeDB(writer, db);
+  }
+
+  kvs = std::make_unique<MMapKVStore>(db, 0);
+  doKVSRangeChecks(kvs);
+  kvs.reset();
+
+  {
+    /* duplicate keys are rejected */
+    MMapKVStoreWriter writer;
+    BOOST_REQUIRE(writer.addEntry("key", "value"));
+    BOOST_REQUIRE(writer.addEntry("key", "other value"));
+    int fd = open(db, O_WRONLY | O_TRUNC);
+    BOOST_REQUIRE(fd >= 0);
+    BOOST_CHECK_THROW(writer.write(fd), std::runtime_error);
+    close(fd);
+  }
+
+  {
+    /* an empty database is valid */
+    MMapKVStoreWriter writer;
+    writeDB(writer, db);
+    kvs = std::make_unique<MMapKVStore>(db, 0);
+    std::string value;
+    BOOST_CHECK(!kvs->getValue("key", value));
+    BOOST_CHECK(!kvs->getRangeValue("key", value));
+    kvs.reset();
+  }
+
+  {
+    /* truncated database */
+    MMapKVStoreWriter writer;
+    BOOST_REQUIRE(writer.addEntry("key", "value"));
+    writeDB(writer, db);
+    BOOST_REQUIRE_EQUAL(truncate(db, 100), 0);
+    BOOST_CHECK_THROW(MMapKVStore(db, 0), std::runtime_error);
+  }
+
+  unlink(db);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -541,6 +541,153 @@ BOOST_AUTO_TEST_CASE(test_chashed)
 }
 #endif
 
+BOOST_AUTO_TEST_CASE(test_chashed_ring)
+{
+  std::vector<DNSName> names;
+  names.reserve(1000);
+  for (size_t idx = 0; idx < 1000; idx++) {
+    names.emplace_back("powerdns-" + std::to_string(idx) + ".com.");
+  }
+
+  ServerPool pool;
+  size_t totalWeight = 0;
+  for (size_t idx = 1; idx <= 10; idx++) {
+    auto server = std::make_shared<DownstreamState>(ComboAddress("192.0.2." + std::to_string(idx) + ":53"));
+    server->setUp();
+    server->setWeight(static_cast<int>(100 * idx));
+    totalWeight += 100 * idx;
+    pool.addServer(server);
+  }
+  const auto& servers = pool.getServers();
+
+  const auto& ring = pool.getHashRing();
+  BOOST_CHECK(!ring.isStale());
+  BOOST_CHECK_EQUAL(ring.size(), totalWeight);
+  /* built only once */
+  BOOST_CHECK_EQUAL(&pool.getHashRing(), &ring);
+
+  ServerPolicy pol{"chashed", chashed, chashedFromPool};
+  const auto hashPerturbation = dnsdist::configuration::getImmutableConfiguration().d_hashPerturbation;
+  auto checkSameSelection = [&]() {
+    for (const auto& name : names) {
+      auto hash = name.hash(hashPerturbation);
+      auto expected = chashedFromHash(servers, hash);
+      BOOST_REQUIRE(chashedFromPoolHash(pool, hash) == expected);
+      auto dnsQuestion = getDQ(&name);
+      auto fromPool = pol.getSelectedBackend(pool, dnsQuestion);
+      BOOST_REQUIRE_EQUAL(static_cast<bool>(fromPool), expected.has_value());
+      if (expected) {
+        BOOST_REQUIRE(fromPool.get() == servers.at(*expected - 1).second);
+      }
+    }
+  };
+
+  checkSameSelection();
+
+  /* the points of the servers that are down are skipped */
+  servers.at(0).second->setDown();
+  servers.at(4).second->setDown();
+  servers.at(9).second->setDown();
+  checkSameSelection();
+
+  for (const auto& server : servers) {
+    server.second->setDown();
+  }
+  BOOST_CHECK(!chashedFromPoolHash(pool, names.at(0).hash(hashPerturbation)));
+  checkSameSelection();
+
+  for (const auto& server : servers) {
+    server.second->setUp();
+  }
+
+  /* changing the weight of a server makes the existing rings stale, but the selection stays the same */
+  servers.at(1).second->setWeight(2000);
+  BOOST_CHECK(ring.isStale());
+  checkSameSelection();
+
+  /* a copy of the pool gets a new ring */
+  auto copy = pool;
+  BOOST_CHECK(!copy.getHashRing().isStale());
+  BOOST_CHECK_EQUAL(copy.getHashRing().size(), totalWeight - 200 + 2000);
+}
+
+BOOST_AUTO_TEST_CASE(test_peakEWMA)
+{
+  auto dnsQuestion = getDQ();
+  const auto& now = dnsQuestion.getQueryRealTime();
+  ServerPolicy pol{"peakEWMA", peakEWMA, false};
+  ServerPolicy::NumberedServerVector servers;
+
+  /* no servers */
+  BOOST_CHECK(!pol.getSelectedBackend(servers, dnsQuestion));
+
+  for (size_t idx = 1; idx <= 2; idx++) {
+    servers.emplace_back(idx, std::make_shared<DownstreamState>(ComboAddress("192.0.2." + std::to_string(idx) + ":53")));
+    servers.at(idx - 1).second->setUp();
+  }
+
+  /* the first server is slow */
+  servers.at(0).second->updatePeakLatency(100000.0, now);
+  servers.at(1).second->updatePeakLatency(1000.0, now);
+  for (size_t idx = 0; idx < 100; idx++) {
+    BOOST_CHECK(pol.getSelectedBackend(servers, dnsQuestion).get() == servers.at(1).second);
+  }
+
+  /* but not as slow as a server with a lot of outstanding queries */
+  servers.at(1).second->outstanding = 1000;
+  for (size_t idx = 0; idx < 100; idx++) {
+    BOOST_CHECK(pol.getSelectedBackend(servers, dnsQuestion).get() == servers.at(0).second);
+  }
+  servers.at(1).second->outstanding = 0;
+
+  /* a faster response does not reduce the peak right away */
+  servers.at(0).second->updatePeakLatency(10.0, now);
+  BOOST_CHECK_GT(servers.at(0).second->getPeakLatencyUsec(now), 90000.0);
+  /* a slower one does */
+  servers.at(1).second->updatePeakLatency(500000.0, now);
+  BOOST_CHECK_EQUAL(servers.at(1).second->getPeakLatencyUsec(now), 500000.0);
+  for (size_t idx = 0; idx < 100; idx++) {
+    BOOST_CHECK(pol.getSelectedBackend(servers, dnsQuestion).get() == servers.at(0).second);
+  }
+
+  /* it decays over time when we do not hear from the server */
+  auto later = now;
+  later.tv_sec += 120;
+  BOOST_CHECK_LT(servers.at(1).second->getPeakLatencyUsec(later), 1000.0);
+
+  /* the server that is down is never selected */
+  servers.at(0).second->setDown();
+  BOOST_CHECK_EQUAL(servers.at(0).second->getPeakLatencyUsec(now), 0.0);
+  for (size_t idx = 0; idx < 100; idx++) {
+    BOOST_CHECK(pol.getSelectedBackend(servers, dnsQuestion).get() == servers.at(1).second);
+  }
+
+  /* only two servers are compared, but all of them are eventually selected */
+  for (size_t idx = 3; idx <= 10; idx++) {
+    servers.emplace_back(idx, std::make_shared<DownstreamState>(ComboAddress("192.0.2." + std::to_string(idx) + ":53")));
+    servers.at(idx - 1).second->setUp();
+  }
+  std::map<std::shared_ptr<DownstreamState>, uint64_t> serversMap;
+  for (size_t idx = 0; idx < 1000; idx++) {
+    auto server = pol.getSelectedBackend(servers, dnsQuestion);
+    BOOST_REQUIRE(server);
+    BOOST_CHECK(server.get() != servers.at(0).second);
+    serversMap[server.get()]++;
+  }
+  BOOST_CHECK_EQUAL(serversMap.size(), servers.size() - 1);
+
+  /* and we still find the only server that is up */
+  for (const auto& server : servers) {
+    server.second->setDown();
+  }
+  servers.at(5).second->setUp();
+  for (size_t idx = 0; idx < 100; idx++) {
+    BOOST_CHECK(pol.getSelectedBackend(servers, dnsQuestion).get() == servers.at(5).second);
+  }
+
+  benchPolicy(pol);
+}
+
 BOOST_AUTO_TEST_CASE(test_lua)
 {
   std::vector<DNSName> names;
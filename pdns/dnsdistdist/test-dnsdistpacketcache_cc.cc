@@ -5,6 +5,8 @@
 
 #define BOOST_TEST_NO_MAIN
 
+#include <filesystem>
+
 #include <boost/test/unit_test.hpp>
 
 #include "ednscookies.hh"
@@ -21,13 +23,14 @@ BOOST_AUTO_TEST_SUITE(test_dnsdistpacketcache_cc)
 
 static bool receivedOverUDP = true;
 
-static void test_packetcache_simple(bool shuffle)
+static void test_packetcache_simple(bool shuffle, bool lockFree)
 {
   const DNSDistPacketCache::CacheSettings settings{
     .d_maxEntries = 150000,
     .d_maxTTL = 86400,
     .d_minTTL = 1,
     .d_shuffle = shuffle,
+    .d_lockFreeLookups = lockFree,
   };
   DNSDistPacketCache localCache(settings);
   BOOST_CHECK_EQUAL(localCache.getSize(), 0U);
@@ -138,8 +141,11 @@ static void test_packetcache_simple(bool shuffle)
 BOOST_AUTO_TEST_CASE(test_PacketCacheSimple)
 {
   /* test both with and without shuffle; should be equivalent */
-  test_packetcache_simple(false);
-  test_packetcache_simple(true);
+  test_packetcache_simple(false, false);
+  test_packetcache_simple(true, false);
+  /* and with lock-free lookups */
+  test_packetcache_simple(false, true);
+  test_packetcache_simple(true, true);
 }
 
 BOOST_AUTO_TEST_CASE(test_PacketCacheSharded)
@@ -378,6 +384,121 @@ BOOST_AUTO_TEST_CASE(test_PacketCacheServFailTTL)
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_PacketCachePrefetch)
+{
+  InternalQueryState ids;
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  ids.qname = DNSName("prefetch.powerdns.com.");
+  bool dnssecOK = false;
+
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+  pwQ.getHeader()->rd = 1;
+
+  PacketBuffer response;
+  GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::A, QClass::IN, 0);
+  pwR.getHeader()->rd = 1;
+  pwR.getHeader()->ra = 1;
+  pwR.getHeader()->qr = 1;
+  pwR.getHeader()->id = pwQ.getHeader()->id;
+  pwR.startRecord(ids.qname, QType::A, 3600, QClass::IN, DNSResourceRecord::ANSWER);
+  pwR.xfr32BitInt(0x01020304);
+  pwR.commit();
+
+  /* the lookup replaces the query with the response, so use a fresh copy every time */
+  auto lookup = [&ids, &query, dnssecOK](DNSDistPacketCache& cache, uint32_t& key, uint32_t allowExpired = 0) {
+    PacketBuffer copy(query);
+    DNSQuestion dnsQuestion(ids, copy);
+    std::optional<Netmask> subnet;
+    return cache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP, allowExpired);
+  };
+
+  {
+    /* the entry is far from expiring */
+    DNSDistPacketCache localCache({.d_maxEntries = 100, .d_prefetchPercentage = 10});
+    uint32_t key = 0;
+    BOOST_CHECK(!lookup(localCache, key));
+    localCache.insert(key, std::nullopt, *getFlagsFromDNSHeader(pwQ.getHeader()), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
+    BOOST_CHECK(lookup(localCache, key));
+    BOOST_CHECK_EQUAL(localCache.getPrefetches(), 0U);
+  }
+
+  {
+    /* every hit is close enough to the expiration */
+    DNSDistPacketCache localCache({.d_maxEntries = 100, .d_prefetchPercentage = 100});
+    uint32_t key = 0;
+    BOOST_CHECK(!lookup(localCache, key));
+    localCache.insert(key, std::nullopt, *getFlagsFromDNSHeader(pwQ.getHeader()), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
+    BOOST_CHECK_EQUAL(localCache.getMisses(), 1U);
+
+    /* we never prefetch when expired entries are allowed, as it means no backend is available */
+    BOOST_CHECK(lookup(localCache, key, 60));
+    BOOST_CHECK_EQUAL(localCache.getPrefetches(), 0U);
+    BOOST_CHECK_EQUAL(localCache.getHits(), 1U);
+
+    /* the first query is sent to the backend, without being counted as a hit nor a miss */
+    BOOST_CHECK(!lookup(localCache, key));
+    BOOST_CHECK_EQUAL(localCache.getPrefetches(), 1U);
+    BOOST_CHECK_EQUAL(localCache.getHits(), 1U);
+    BOOST_CHECK_EQUAL(localCache.getMisses(), 1U);
+
+    /* but not the next ones, until the entry has been refreshed */
+    BOOST_CHECK(lookup(localCache, key));
+    BOOST_CHECK(lookup(localCache, key));
+    BOOST_CHECK_EQUAL(localCache.getPrefetches(), 1U);
+    BOOST_CHECK_EQUAL(localCache.getHits(), 3U);
+
+    localCache.insert(key, std::nullopt, *getFlagsFromDNSHeader(pwQ.getHeader()), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
+    BOOST_CHECK(!lookup(localCache, key));
+    BOOST_CHECK_EQUAL(localCache.getPrefetches(), 2U);
+    BOOST_CHECK(lookup(localCache, key));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheInFlightCoalescing)
+{
+  DNSDistPacketCache localCache({.d_maxEntries = 100, .d_coalescingTimeout = 500});
+  const uint32_t key = 42;
+  const time_t now = time(nullptr);
+  std::vector<uint32_t> parked;
+  auto park = [&parked](uint32_t followerID) {
+    parked.push_back(followerID);
+    return true;
+  };
+
+  /* the first query is forwarded */
+  BOOST_CHECK(localCache.joinInFlightQuery(key, now, 1, park) == DNSDistPacketCache::CoalescingResult::Leader);
+  BOOST_CHECK(parked.empty());
+  /* the next ones wait for it */
+  BOOST_CHECK(localCache.joinInFlightQuery(key, now, 2, park) == DNSDistPacketCache::CoalescingResult::Follower);
+  BOOST_CHECK(localCache.joinInFlightQuery(key, now, 3, park) == DNSDistPacketCache::CoalescingResult::Follower);
+  BOOST_CHECK_EQUAL(localCache.getCoalescedQueries(), 2U);
+  /* unless they could not be suspended */
+  BOOST_CHECK(localCache.joinInFlightQuery(key, now, 4, [](uint32_t) { return false; }) == DNSDistPacketCache::CoalescingResult::NotCoalesced);
+  BOOST_CHECK_EQUAL(localCache.getCoalescedQueries(), 2U);
+  /* a different key is not affected */
+  BOOST_CHECK(localCache.joinInFlightQuery(key + 1, now, 5, park) == DNSDistPacketCache::CoalescingResult::Leader);
+
+  auto followers = localCache.releaseInFlightQuery(key);
+  BOOST_CHECK(followers == parked);
+  BOOST_CHECK(localCache.releaseInFlightQuery(key).empty());
+
+  /* the next query is forwarded again */
+  BOOST_CHECK(localCache.joinInFlightQuery(key, now, 6, park) == DNSDistPacketCache::CoalescingResult::Leader);
+
+  /* a leader whose response never came is replaced once it has expired */
+  parked.clear();
+  BOOST_CHECK(localCache.joinInFlightQuery(key + 1, now + 1, 7, park) == DNSDistPacketCache::CoalescingResult::Leader);
+  BOOST_CHECK(localCache.releaseInFlightQuery(key + 1).empty());
+
+  /* and removed by the cleaning */
+  BOOST_CHECK(localCache.joinInFlightQuery(key, now, 8, park) == DNSDistPacketCache::CoalescingResult::Follower);
+  localCache.purgeExpired(0, now + 1);
+  BOOST_CHECK(localCache.releaseInFlightQuery(key).empty());
+}
+
 BOOST_AUTO_TEST_CASE(test_PacketCacheNoDataTTL)
 {
   const DNSDistPacketCache::CacheSettings settings{
@@ -756,12 +877,301 @@ BOOST_AUTO_TEST_CASE(test_PacketCacheMaximumSize)
   }
 }
 
+static void test_packetcache_memory_accounting(bool lockFree)
+{
+  const DNSDistPacketCache::CacheSettings settings{
+    .d_maxEntries = 1000,
+    .d_shardCount = 4,
+    .d_lockFreeLookups = lockFree,
+  };
+  DNSDistPacketCache packetCache(settings);
+  BOOST_CHECK_EQUAL(packetCache.getMemoryAllocated(), 0U);
+  BOOST_CHECK_EQUAL(packetCache.getMemoryUsed(), 0U);
+
+  InternalQueryState ids;
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  bool dnssecOK = false;
+
+  for (size_t counter = 0; counter < 100; counter++) {
+    ids.qname = DNSName(std::to_string(counter) + ".memory.accounting");
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+
+    PacketBuffer response;
+    GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::A, QClass::IN, 0);
+    pwR.getHeader()->rd = 1;
+    pwR.getHeader()->ra = 1;
+    pwR.getHeader()->qr = 1;
+    pwR.getHeader()->id = pwQ.getHeader()->id;
+    pwR.startRecord(ids.qname, QType::A, 7200, QClass::IN, DNSResourceRecord::ANSWER);
+    pwR.xfr32BitInt(0x01020304);
+    pwR.commit();
+
+    uint32_t key = 0;
+    std::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, query);
+    bool found = packetCache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
+    BOOST_CHECK_EQUAL(found, false);
+
+    packetCache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
+    BOOST_CHECK_GE(packetCache.getMemoryUsed(), (counter + 1) * (ids.qname.wirelength() + response.size()));
+  }
+
+  BOOST_CHECK_EQUAL(packetCache.getSize(), 100U);
+  BOOST_CHECK_GE(packetCache.getMemoryAllocated(), packetCache.getMemoryUsed());
+
+  /* the stored name is compared case-insensitively */
+  ids.qname = DNSName("42.MEMORY.accounting");
+  PacketBuffer query;
+  GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+  pwQ.getHeader()->rd = 1;
+  pwQ.commit();
+  uint32_t key = 0;
+  std::optional<Netmask> subnet;
+  DNSQuestion dnsQuestion(ids, query);
+  BOOST_CHECK(packetCache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP));
+  BOOST_CHECK_EQUAL(packetCache.getRecordsForDomain(ids.qname).size(), 1U);
+
+  BOOST_CHECK_EQUAL(packetCache.expungeByName(DNSName("MEMORY.accounting"), QType::ANY, true), 100U);
+  /* removed entries might not have been reclaimed yet */
+  dnsdist::rcu::reclaim();
+  BOOST_CHECK_EQUAL(packetCache.getMemoryUsed(), 0U);
+  BOOST_CHECK_EQUAL(packetCache.getMemoryAllocated(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheMemoryAccounting)
+{
+  test_packetcache_memory_accounting(false);
+  test_packetcache_memory_accounting(true);
+}
+
+static void test_packetcache_eviction(dnsdist::EvictionPolicy policy, bool lockFree)
+{
+  const size_t maxEntries = 10;
+  const DNSDistPacketCache::CacheSettings settings{
+    .d_maxEntries = maxEntries,
+    .d_shardCount = 1,
+    .d_lockFreeLookups = lockFree,
+    .d_evictionPolicy = policy,
+  };
+  DNSDistPacketCache packetCache(settings);
+
+  InternalQueryState ids;
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  bool dnssecOK = false;
+
+  /* inserts the name if insert is true, returns whether it was found in the cache */
+  auto lookup = [&](size_t counter, bool insert) {
+    ids.qname = DNSName(std::to_string(counter) + ".eviction");
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+
+    uint32_t key = 0;
+    std::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, query);
+    bool found = packetCache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
+    if (!found && insert) {
+      PacketBuffer response;
+      GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::A, QClass::IN, 0);
+      pwR.getHeader()->rd = 1;
+      pwR.getHeader()->ra = 1;
+      pwR.getHeader()->qr = 1;
+      pwR.getHeader()->id = pwQ.getHeader()->id;
+      pwR.startRecord(ids.qname, QType::A, 7200, QClass::IN, DNSResourceRecord::ANSWER);
+      pwR.xfr32BitInt(0x01020304);
+      pwR.commit();
+      packetCache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
+    }
+    return found;
+  };
+
+  for (size_t counter = 0; counter < maxEntries; counter++) {
+    lookup(counter, true);
+  }
+  BOOST_CHECK_EQUAL(packetCache.getSize(), maxEntries);
+
+  /* the first half is popular */
+  for (size_t counter = 0; counter < maxEntries / 2; counter++) {
+    BOOST_CHECK(lookup(counter, false));
+  }
+
+  /* new names keep coming */
+  for (size_t counter = maxEntries; counter < maxEntries + (maxEntries / 2); counter++) {
+    lookup(counter, true);
+  }
+  BOOST_CHECK_EQUAL(packetCache.getSize(), maxEntries);
+
+  if (policy == dnsdist::EvictionPolicy::None) {
+    BOOST_CHECK_EQUAL(packetCache.getEvictions(), 0U);
+    for (size_t counter = maxEntries; counter < maxEntries + (maxEntries / 2); counter++) {
+      BOOST_CHECK(!lookup(counter, false));
+    }
+    return;
+  }
+
+  BOOST_CHECK_EQUAL(packetCache.getEvictions(), maxEntries / 2);
+  /* the popular names, and the new ones, are still there */
+  for (size_t counter = 0; counter < maxEntries / 2; counter++) {
+    BOOST_CHECK(lookup(counter, false));
+  }
+  for (size_t counter = maxEntries; counter < maxEntries + (maxEntries / 2); counter++) {
+    BOOST_CHECK(lookup(counter, false));
+  }
+  /* the others have been evicted */
+  for (size_t counter = maxEntries / 2; counter < maxEntries; counter++) {
+    BOOST_CHECK(!lookup(counter, false));
+  }
+
+  /* removing entries from the cache also removes them from the eviction queue */
+  BOOST_CHECK_EQUAL(packetCache.expunge(0), maxEntries);
+  for (size_t counter = 0; counter < maxEntries * 2; counter++) {
+    lookup(counter, true);
+  }
+  BOOST_CHECK_EQUAL(packetCache.getSize(), maxEntries);
+  BOOST_CHECK_EQUAL(packetCache.getEvictions(), (maxEntries / 2) + maxEntries);
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheEviction)
+{
+  for (const auto lockFree : {false, true}) {
+    test_packetcache_eviction(dnsdist::EvictionPolicy::None, lockFree);
+    test_packetcache_eviction(dnsdist::EvictionPolicy::Sieve, lockFree);
+    test_packetcache_eviction(dnsdist::EvictionPolicy::Clock, lockFree);
+  }
+}
+
+static void test_packetcache_snapshot(bool lockFree)
+{
+  /* large enough for the shards not to fill up */
+  const size_t numberOfEntries = 100;
+  const DNSDistPacketCache::CacheSettings settings{
+    .d_maxEntries = numberOfEntries * 10,
+    .d_shardCount = 10,
+    .d_parseECS = true,
+    .d_lockFreeLookups = lockFree,
+  };
+  DNSDistPacketCache packetCache(settings);
+
+  char snapshotPath[] = "/tmp/test_dnsdistpacketcache_snapshot.XXXXXX";
+  int snapshotFD = mkstemp(snapshotPath);
+  BOOST_REQUIRE(snapshotFD >= 0);
+  close(snapshotFD);
+
+  InternalQueryState ids;
+  ids.qtype = QType::A;
+  ids.qclass = QClass::IN;
+  ids.protocol = dnsdist::Protocol::DoUDP;
+  bool dnssecOK = false;
+  const auto ecsSource = Netmask("192.0.2.0/24");
+
+  /* inserts the name if ttl is set, returns whether it was found in the cache */
+  auto lookup = [&](DNSDistPacketCache& cache, size_t counter, std::optional<uint32_t> ttl) {
+    ids.qname = DNSName(std::to_string(counter) + ".snapshot");
+    PacketBuffer query;
+    GenericDNSPacketWriter<PacketBuffer> pwQ(query, ids.qname, QType::A, QClass::IN, 0);
+    pwQ.getHeader()->rd = 1;
+    /* every other entry has an ECS option */
+    if (counter % 2 == 0) {
+      GenericDNSPacketWriter<PacketBuffer>::optvect_t ednsOptions;
+      EDNSSubnetOpts opt;
+      opt.setSource(ecsSource);
+      ednsOptions.emplace_back(EDNSOptionCode::ECS, opt.makeOptString());
+      pwQ.addOpt(512, 0, 0, ednsOptions);
+    }
+    pwQ.commit();
+
+    uint32_t key = 0;
+    std::optional<Netmask> subnet;
+    DNSQuestion dnsQuestion(ids, query);
+    bool found = cache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
+    if (!found && ttl) {
+      BOOST_CHECK_EQUAL(subnet.has_value(), counter % 2 == 0);
+      PacketBuffer response;
+      GenericDNSPacketWriter<PacketBuffer> pwR(response, ids.qname, QType::A, QClass::IN, 0);
+      pwR.getHeader()->rd = 1;
+      pwR.getHeader()->ra = 1;
+      pwR.getHeader()->qr = 1;
+      pwR.getHeader()->id = pwQ.getHeader()->id;
+      pwR.startRecord(ids.qname, QType::A, *ttl, QClass::IN, DNSResourceRecord::ANSWER);
+      pwR.xfr32BitInt(0x01020304);
+      pwR.commit();
+      cache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
+    }
+    return found;
+  };
+
+  /* the first half expires quickly */
+  for (size_t counter = 0; counter < numberOfEntries / 2; counter++) {
+    lookup(packetCache, counter, 1);
+  }
+  for (size_t counter = numberOfEntries / 2; counter < numberOfEntries; counter++) {
+    lookup(packetCache, counter, 3600);
+  }
+  BOOST_CHECK_EQUAL(packetCache.getSize(), numberOfEntries);
+  BOOST_CHECK_EQUAL(packetCache.saveSnapshot(snapshotPath), numberOfEntries);
+
+  std::this_thread::sleep_for(std::chrono::seconds(2));
+
+  {
+    /* a different number of shards is fine */
+    auto otherSettings = settings;
+    otherSettings.d_shardCount = 3;
+    DNSDistPacketCache restored(otherSettings);
+    BOOST_CHECK_EQUAL(restored.loadSnapshot(snapshotPath), numberOfEntries / 2);
+    BOOST_CHECK_EQUAL(restored.getSize(), numberOfEntries / 2);
+    for (size_t counter = 0; counter < numberOfEntries / 2; counter++) {
+      BOOST_CHECK(!lookup(restored, counter, std::nullopt));
+    }
+    for (size_t counter = numberOfEntries / 2; counter < numberOfEntries; counter++) {
+      BOOST_CHECK(lookup(restored, counter, std::nullopt));
+    }
+  }
+
+  {
+    /* different hashing settings, the snapshot is refused */
+    auto otherSettings = settings;
+    otherSettings.d_optionsToSkip.insert(EDNSOptionCode::ECS);
+    DNSDistPacketCache other(otherSettings);
+    BOOST_CHECK_THROW(other.loadSnapshot(snapshotPath), std::runtime_error);
+    BOOST_CHECK_EQUAL(other.getSize(), 0U);
+  }
+
+  {
+    /* a truncated snapshot is detected, but the complete entries are kept */
+    BOOST_REQUIRE_EQUAL(truncate(snapshotPath, static_cast<off_t>(std::filesystem::file_size(snapshotPath) - 1)), 0);
+    DNSDistPacketCache truncated(settings);
+    BOOST_CHECK_THROW(truncated.loadSnapshot(snapshotPath), std::runtime_error);
+    BOOST_CHECK_LE(truncated.getSize(), numberOfEntries / 2);
+  }
+
+  unlink(snapshotPath);
+  BOOST_CHECK_THROW(packetCache.loadSnapshot(snapshotPath), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheSnapshot)
+{
+  test_packetcache_snapshot(false);
+  test_packetcache_snapshot(true);
+}
+
 const DNSDistPacketCache::CacheSettings s_localCacheSettings{
   .d_maxEntries = 500000,
 };
 static DNSDistPacketCache s_localCache(s_localCacheSettings);
+const DNSDistPacketCache::CacheSettings s_lockFreeCacheSettings{
+  .d_maxEntries = 500000,
+  .d_shardCount = 20,
+  .d_lockFreeLookups = true,
+};
+static DNSDistPacketCache s_lockFreeCache(s_lockFreeCacheSettings);
 
-static void threadMangler(unsigned int offset)
+static void threadMangler(DNSDistPacketCache& cache, unsigned int offset)
 {
   InternalQueryState ids;
   ids.qtype = QType::A;
@@ -790,9 +1200,9 @@ static void threadMangler(unsigned int offset)
       uint32_t key = 0;
       std::optional<Netmask> subnet;
       DNSQuestion dnsQuestion(ids, query);
-      s_localCache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
+      cache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
 
-      s_localCache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
+      cache.insert(key, subnet, *(getFlagsFromDNSHeader(dnsQuestion.getHeader().get())), dnssecOK, ids.qname, QType::A, QClass::IN, response, receivedOverUDP, 0, std::nullopt);
     }
   }
   catch (PDNSException& e) {
@@ -801,9 +1211,7 @@ static void threadMangler(unsigned int offset)
   }
 }
 
-static std::atomic<uint64_t> s_missing{0};
-
-static void threadReader(unsigned int offset)
+static void threadReader(DNSDistPacketCache& cache, std::atomic<uint64_t>& missing, unsigned int offset)
 {
   InternalQueryState ids;
   ids.qtype = QType::A;
@@ -822,9 +1230,9 @@ static void threadReader(unsigned int offset)
       uint32_t key = 0;
       std::optional<Netmask> subnet;
       DNSQuestion dnsQuestion(ids, query);
-      bool found = s_localCache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
+      bool found = cache.get(dnsQuestion, 0, &key, subnet, dnssecOK, receivedOverUDP);
       if (!found) {
-        s_missing++;
+        missing++;
       }
     }
   }
@@ -834,13 +1242,14 @@ static void threadReader(unsigned int offset)
   }
 }
 
-BOOST_AUTO_TEST_CASE(test_PacketCacheThreaded)
+static void test_packetcache_threaded(DNSDistPacketCache& cache)
 {
+  std::atomic<uint64_t> missing{0};
   try {
     std::vector<std::thread> threads;
     threads.reserve(4);
     for (int i = 0; i < 4; ++i) {
-      threads.emplace_back(threadMangler, i * 1000000UL);
+      threads.emplace_back(threadMangler, std::ref(cache), i * 1000000UL);
     }
 
     for (auto& thr : threads) {
@@ -849,18 +1258,18 @@ BOOST_AUTO_TEST_CASE(test_PacketCacheThreaded)
 
     threads.clear();
 
-    BOOST_CHECK_EQUAL(s_localCache.getSize() + s_localCache.getDeferredInserts() + s_localCache.getInsertCollisions(), 400000U);
-    BOOST_CHECK_SMALL(1.0 * s_localCache.getInsertCollisions(), 10000.0);
+    BOOST_CHECK_EQUAL(cache.getSize() + cache.getDeferredInserts() + cache.getInsertCollisions(), 400000U);
+    BOOST_CHECK_SMALL(1.0 * cache.getInsertCollisions(), 10000.0);
 
     for (int i = 0; i < 4; ++i) {
-      threads.emplace_back(threadReader, i * 1000000UL);
+      threads.emplace_back(threadReader, std::ref(cache), std::ref(missing), i * 1000000UL);
     }
 
     for (auto& thr : threads) {
       thr.join();
     }
 
-    BOOST_CHECK((s_localCache.getDeferredInserts() + s_localCache.getDeferredLookups() + s_localCache.getInsertCollisions()) >= s_missing.load());
+    BOOST_CHECK((cache.getDeferredInserts() + cache.getDeferredLookups() + cache.getInsertCollisions()) >= missing.load());
   }
   catch (const PDNSException& e) {
     cerr << "Had error: " << e.reason << endl;
@@ -868,6 +1277,18 @@ BOOST_AUTO_TEST_CASE(test_PacketCacheThreaded)
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_PacketCacheThreaded)
+{
+  test_packetcache_threaded(s_localCache);
+}
+
+BOOST_AUTO_TEST_CASE(test_PacketCacheThreadedLockFree)
+{
+  test_packetcache_threaded(s_lockFreeCache);
+  /* there is no lock to contend on */
+  BOOST_CHECK_EQUAL(s_lockFreeCache.getDeferredLookups(), 0U);
+}
+
 BOOST_AUTO_TEST_CASE(test_PCCollision)
 {
   const DNSDistPacketCache::CacheSettings settings{
@@ -300,4 +300,186 @@ BOOST_AUTO_TEST_CASE(test_Rings_Threaded) {
 #endif
 }
 
+BOOST_AUTO_TEST_CASE(test_Rings_PerThread) {
+  const size_t maxEntries = 500;
+  const size_t numberOfShards = 10;
+  const size_t entriesPerThread = maxEntries / numberOfShards;
+
+  Rings rings;
+  rings.init(maxEntries, numberOfShards, 0, true, true, true);
+  BOOST_CHECK(rings.isPerThread());
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), 0U);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), 0U);
+
+  dnsheader dh;
+  memset(&dh, 0, sizeof(dh));
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor1("192.0.2.1");
+  ComboAddress requestor2("2001:db8::2");
+  ComboAddress server("192.0.2.42");
+  unsigned int latency = 100;
+  uint16_t qtype = QType::AAAA;
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  struct timespec now;
+  gettime(&now);
+
+  /* fill the rings of this thread */
+  for (size_t idx = 0; idx < entriesPerThread; idx++) {
+    rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+    rings.insertResponse(now, requestor1, qname, qtype, latency, size, dh, server, protocol);
+  }
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), entriesPerThread);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), entriesPerThread);
+
+  /* and overwrite all existing entries */
+  for (size_t idx = 0; idx < entriesPerThread; idx++) {
+    rings.insertQuery(now, requestor2, qname, qtype, size, dh, protocol);
+    rings.insertResponse(now, requestor2, qname, qtype, latency, size, dh, server, protocol);
+  }
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), entriesPerThread);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), entriesPerThread);
+
+  size_t numberOfQueries = 0;
+  rings.forEachQuery([&](const Rings::Query& entry) {
+    BOOST_CHECK(checkQuery(entry, qname, qtype, size, now, requestor2));
+    numberOfQueries++;
+  });
+  BOOST_CHECK_EQUAL(numberOfQueries, entriesPerThread);
+
+  size_t numberOfResponses = 0;
+  rings.forEachResponse([&](const Rings::Response& entry) {
+    BOOST_CHECK(checkResponse(entry, qname, qtype, size, now, requestor2, latency, server));
+    numberOfResponses++;
+  });
+  BOOST_CHECK_EQUAL(numberOfResponses, entriesPerThread);
+
+  /* the visitor can stop the iteration */
+  numberOfQueries = 0;
+  rings.forEachQuery([&](const Rings::Query&) {
+    numberOfQueries++;
+    return numberOfQueries < 10;
+  });
+  BOOST_CHECK_EQUAL(numberOfQueries, 10U);
+
+  /* another thread gets its own rings */
+  std::thread otherThread([&]() {
+    rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+  });
+  otherThread.join();
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), entriesPerThread + 1);
+  BOOST_CHECK_EQUAL(rings.numDistinctRequestors(), 2U);
+
+  rings.clear();
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), 0U);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), 0U);
+  numberOfQueries = 0;
+  rings.forEachQuery([&](const Rings::Query&) {
+    numberOfQueries++;
+  });
+  BOOST_CHECK_EQUAL(numberOfQueries, 0U);
+
+  rings.insertQuery(now, requestor1, qname, qtype, size, dh, protocol);
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries(), 1U);
+  rings.forEachQuery([&](const Rings::Query& entry) {
+    BOOST_CHECK(checkQuery(entry, qname, qtype, size, now, requestor1));
+  });
+}
+
+static void perThreadRingReaderThread(Rings& rings, std::atomic<bool>& done, size_t numberOfEntries, const DNSName& qname, uint16_t qtype)
+{
+  size_t iterationsDone = 0;
+  bool valid = true;
+
+  while (done == false && valid) {
+    size_t numberOfQueries = 0;
+    size_t numberOfResponses = 0;
+
+    rings.forEachQuery([&](const Rings::Query& entry) {
+      numberOfQueries++;
+      valid = entry.qtype == qtype && entry.name == qname;
+      return valid;
+    });
+    rings.forEachResponse([&](const Rings::Response& entry) {
+      numberOfResponses++;
+      valid = valid && entry.qtype == qtype && entry.name == qname;
+      return valid;
+    });
+
+    BOOST_CHECK_LE(numberOfQueries, numberOfEntries);
+    BOOST_CHECK_LE(numberOfResponses, numberOfEntries);
+    iterationsDone++;
+    usleep(10000);
+  }
+
+  BOOST_CHECK(valid);
+  BOOST_CHECK_GT(iterationsDone, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(test_Rings_PerThread_Threaded) {
+  size_t numberOfEntries = 100000;
+  size_t numberOfWriterThreads = 4;
+  size_t entriesPerThread = numberOfEntries / numberOfWriterThreads;
+
+  struct timespec now;
+  gettime(&now);
+  dnsheader dh;
+  memset(&dh, 0, sizeof(dh));
+  dh.id = htons(4242);
+  dh.qdcount = htons(1);
+  DNSName qname("rings.powerdns.com.");
+  ComboAddress requestor("192.0.2.1");
+  ComboAddress server("192.0.2.42");
+  unsigned int latency = 100;
+  uint16_t qtype = QType::AAAA;
+  uint16_t size = 42;
+  dnsdist::Protocol protocol = dnsdist::Protocol::DoUDP;
+  dnsdist::Protocol outgoingProtocol = dnsdist::Protocol::DoUDP;
+
+  Rings rings;
+  rings.init(numberOfEntries, numberOfWriterThreads, 0, true, true, true);
+#if defined(DNSDIST_RINGS_WITH_MACADDRESS)
+  Rings::Query query({requestor, qname, now, dh, size, qtype, protocol, dnsdist::MacAddress(), false});
+#else
+  Rings::Query query({requestor, qname, now, dh, size, qtype, protocol});
+#endif
+  Rings::Response response({requestor, server, qname, now, dh, latency, size, qtype, outgoingProtocol});
+
+  std::atomic<bool> done(false);
+  std::vector<std::thread> writerThreads;
+  std::thread readerThread(perThreadRingReaderThread, std::ref(rings), std::ref(done), numberOfEntries, std::cref(qname), qtype);
+
+  /* each writer has its own rings, so there is no need to overcommit */
+  for (size_t idx = 0; idx < numberOfWriterThreads; idx++) {
+    writerThreads.push_back(std::thread(ringWriterThread, std::ref(rings), 2 * entriesPerThread, query, response));
+  }
+
+  for (auto& t : writerThreads) {
+    t.join();
+  }
+
+  done = true;
+  readerThread.join();
+
+  /* a writer starting after another one exited might have adopted its rings,
+     but all the rings that are in use are full */
+  BOOST_CHECK_LE(rings.getNumberOfQueryEntries(), numberOfEntries);
+  BOOST_CHECK_GE(rings.getNumberOfQueryEntries(), entriesPerThread);
+  BOOST_CHECK_EQUAL(rings.getNumberOfQueryEntries() % entriesPerThread, 0U);
+  BOOST_CHECK_EQUAL(rings.getNumberOfResponseEntries(), rings.getNumberOfQueryEntries());
+
+  size_t totalQueries = 0;
+  rings.forEachQuery([&](const Rings::Query& entry) {
+    BOOST_CHECK(checkQuery(entry, qname, qtype, size, now, requestor));
+    totalQueries++;
+  });
+  size_t totalResponses = 0;
+  rings.forEachResponse([&](const Rings::Response& entry) {
+    BOOST_CHECK(checkResponse(entry, qname, qtype, size, now, requestor, latency, server));
+    totalResponses++;
+  });
+  BOOST_CHECK_EQUAL(totalQueries, rings.getNumberOfQueryEntries());
+  BOOST_CHECK_EQUAL(totalResponses, rings.getNumberOfResponseEntries());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -32,6 +32,7 @@
 #include "dnsdist-proxy-protocol.hh"
 #include "dnsdist-rings.hh"
 #include "dnsdist-tcp-downstream.hh"
+#include "dnsdist-downstream-connection.hh"
 #include "dnsdist-tcp-upstream.hh"
 
 const bool TCPIOHandler::s_disableConnectForUnitTests = true;
@@ -1028,6 +1029,77 @@ BOOST_FIXTURE_TEST_CASE(test_IncomingConnection_BackendNoOOOR, TestFixture)
     IncomingTCPConnectionState::clearAllDownstreamConnections();
   }
 
+  {
+    /* pass to backend, backend answers right away, client closes the connection,
+       then the idle connection to the backend is handed over to a different thread */
+    TEST_INIT("=> Query to backend, backend answers right away, idle connection shared");
+    s_readBuffer = query;
+
+    s_backendReadBuffer = query;
+
+    s_steps = {
+      { ExpectedStep::ExpectedRequest::handshakeClient, IOState::Done },
+      { ExpectedStep::ExpectedRequest::readFromClient, IOState::Done, 2 },
+      { ExpectedStep::ExpectedRequest::readFromClient, IOState::Done, query.size() - 2 },
+      /* opening a connection to the backend */
+      { ExpectedStep::ExpectedRequest::connectToBackend, IOState::Done },
+      { ExpectedStep::ExpectedRequest::writeToBackend, IOState::Done, query.size() },
+      { ExpectedStep::ExpectedRequest::readFromBackend, IOState::Done, 2 },
+      { ExpectedStep::ExpectedRequest::readFromBackend, IOState::Done, query.size() - 2 },
+      { ExpectedStep::ExpectedRequest::writeToClient, IOState::Done, query.size() },
+      { ExpectedStep::ExpectedRequest::readFromClient, IOState::Done, 0 },
+      /* closing client connection */
+      { ExpectedStep::ExpectedRequest::closeClient, IOState::Done },
+      /* closing a connection to the backend */
+      { ExpectedStep::ExpectedRequest::closeBackend, IOState::Done },
+    };
+    s_processQuery = [backend](DNSQuestion& dq, std::shared_ptr<DownstreamState>& selectedBackend) -> ProcessQueryResult {
+      (void)dq;
+      selectedBackend = backend;
+      return ProcessQueryResult::PassToBackend;
+    };
+    s_processResponse = [](PacketBuffer& response, DNSResponse& dr, bool muted) -> bool {
+      (void)response;
+      (void)dr;
+      (void)muted;
+      return true;
+    };
+
+    DownstreamTCPConnectionsManager::setMaxSharedIdleConnectionsPerDownstream(10);
+    auto state = std::make_shared<IncomingTCPConnectionState>(ConnectionInfo(&localCS, getBackendAddress("84", 4242)), threadData, now);
+    state->handleIO();
+    BOOST_CHECK(s_writeBuffer == query);
+    BOOST_CHECK(s_backendWriteBuffer == query);
+    BOOST_CHECK_EQUAL(t_downstreamTCPConnectionsManager.getIdleCount(), 1U);
+
+    /* used too recently to be shared */
+    t_downstreamTCPConnectionsManager.shareIdleConnections(now);
+    BOOST_CHECK_EQUAL(t_downstreamTCPConnectionsManager.getIdleCount(), 1U);
+    BOOST_CHECK_EQUAL(DownstreamTCPConnectionsManager::getSharedIdleCount(), 0U);
+
+    auto later = now;
+    later.tv_sec += 2;
+    t_downstreamTCPConnectionsManager.shareIdleConnections(later);
+    BOOST_CHECK_EQUAL(t_downstreamTCPConnectionsManager.getIdleCount(), 0U);
+    BOOST_CHECK_EQUAL(DownstreamTCPConnectionsManager::getSharedIdleCount(), 1U);
+    BOOST_CHECK_EQUAL(backend->tcpSharedParkedConnections.load(), 1U);
+
+    /* another thread picks it up instead of opening a new connection */
+    DownstreamTCPConnectionsManager otherThreadManager;
+    std::unique_ptr<FDMultiplexer> otherThreadMplexer = std::make_unique<MockupFDMultiplexer>();
+    auto conn = otherThreadManager.getConnectionToDownstream(otherThreadMplexer, backend, later, std::string());
+    BOOST_REQUIRE(conn != nullptr);
+    BOOST_CHECK_EQUAL(DownstreamTCPConnectionsManager::getSharedIdleCount(), 0U);
+    BOOST_CHECK_EQUAL(otherThreadManager.getActiveCount(), 1U);
+    BOOST_CHECK_EQUAL(backend->tcpSharedReusedConnections.load(), 1U);
+
+    conn.reset();
+    BOOST_CHECK_EQUAL(otherThreadManager.clear(), 1U);
+    DownstreamTCPConnectionsManager::setMaxSharedIdleConnectionsPerDownstream(0);
+    /* we need to clear them now, otherwise we end up with dangling pointers to the steps via the TLS context, etc */
+    IncomingTCPConnectionState::clearAllDownstreamConnections();
+  }
+
   {
     /* pass to backend, backend answers right away, exception while handling the response */
     TEST_INIT("=> Exception while handling the response sent by the backend");
@@ -1764,6 +1764,15 @@ public:
     }
   }
 
+  //! Calls the visitor with each Netmask of the group, and whether it is a positive match
+  template <typename Visitor>
+  void visit(Visitor&& visitor) const
+  {
+    for (const auto& entry : tree) {
+      visitor(entry.first, entry.second);
+    }
+  }
+
   //! Delete this Netmask from the list of possible matches
   void deleteMask(const Netmask& netmask)
   {
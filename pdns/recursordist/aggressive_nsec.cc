@@ -21,12 +21,16 @@
  */
 #include <cinttypes>
 #include <climits>
+#include <protozero/pbf_builder.hpp>
+#include <protozero/pbf_message.hpp>
 
 #include "aggressive_nsec.hh"
 #include "cachecleaner.hh"
 #include "recursor_cache.hh"
 #include "logger.hh"
+#include "logging.hh"
 #include "validate.hh"
+#include "version.hh"
 
 std::unique_ptr<AggressiveNSECCache> g_aggressiveNSECCache{nullptr};
 uint64_t AggressiveNSECCache::s_nsec3DenialProofMaxCost{0};
@@ -947,3 +951,195 @@ size_t AggressiveNSECCache::dumpToFile(pdns::UniqueFilePtr& filePtr, const struc
 
   return ret;
 }
+
+enum class PBAggressiveNSECDump : protozero::pbf_tag_type
+{
+  required_string_version = 1,
+  required_string_identity = 2,
+  required_uint64_protocolVersion = 3,
+  required_int64_time = 4,
+  required_string_type = 5,
+  repeated_message_nsecEntry = 6,
+};
+
+// zone, nsec3 and owner come before the record, as they are needed to decode it
+enum class PBAggressiveNSECEntry : protozero::pbf_tag_type
+{
+  required_bytes_zone = 1,
+  required_bool_nsec3 = 2,
+  required_bytes_owner = 3,
+  required_bytes_record = 4,
+  repeated_bytes_sig = 5,
+  required_int64_ttd = 6,
+  required_bytes_qname = 7,
+  required_uint32_qtype = 8,
+};
+
+size_t AggressiveNSECCache::getPB(const std::string& serverID, std::string& ret)
+{
+  auto log = g_slog->withName("aggressivensec");
+  log->info(Logr::Info, "Producing aggressive NSEC cache dump");
+
+  protozero::pbf_builder<PBAggressiveNSECDump> full(ret);
+  full.add_string(PBAggressiveNSECDump::required_string_version, getPDNSVersion());
+  full.add_string(PBAggressiveNSECDump::required_string_identity, serverID);
+  full.add_uint64(PBAggressiveNSECDump::required_uint64_protocolVersion, 1);
+  full.add_int64(PBAggressiveNSECDump::required_int64_time, time(nullptr));
+  full.add_string(PBAggressiveNSECDump::required_string_type, "PBAggressiveNSECDump");
+
+  size_t count = 0;
+  auto zones = d_zones.read_lock();
+  zones->visit([&full, &count](const SuffixMatchTree<std::shared_ptr<LockGuarded<ZoneEntry>>>& node) {
+    if (!node.d_value) {
+      return;
+    }
+
+    auto zone = node.d_value->lock();
+    const auto zoneName = zone->d_zone.toString();
+    for (const auto& entry : zone->d_entries) {
+      protozero::pbf_builder<PBAggressiveNSECEntry> message(full, PBAggressiveNSECDump::repeated_message_nsecEntry);
+      message.add_bytes(PBAggressiveNSECEntry::required_bytes_zone, zoneName);
+      message.add_bool(PBAggressiveNSECEntry::required_bool_nsec3, zone->d_nsec3);
+      message.add_bytes(PBAggressiveNSECEntry::required_bytes_owner, entry.d_owner.toString());
+      message.add_bytes(PBAggressiveNSECEntry::required_bytes_record, entry.d_record->serialize(entry.d_owner, true));
+      for (const auto& signature : entry.d_signatures) {
+        message.add_bytes(PBAggressiveNSECEntry::repeated_bytes_sig, signature->serialize(entry.d_owner, true));
+      }
+      message.add_int64(PBAggressiveNSECEntry::required_int64_ttd, entry.d_ttd);
+      message.add_bytes(PBAggressiveNSECEntry::required_bytes_qname, entry.d_qname.toString());
+      message.add_uint32(PBAggressiveNSECEntry::required_uint32_qtype, entry.d_qtype);
+      ++count;
+    }
+  });
+
+  log->info(Logr::Info, "Produced aggressive NSEC cache dump", "size", Logging::Loggable(ret.size()), "count", Logging::Loggable(count));
+  return count;
+}
+
+template <typename T>
+bool AggressiveNSECCache::putPBEntry(T& message, time_t now)
+{
+  DNSName zone;
+  DNSName qname;
+  DNSRecord record;
+  std::vector<std::shared_ptr<const RRSIGRecordContent>> signatures;
+  bool nsec3 = false;
+  int64_t ttd = 0;
+  QType qtype;
+  while (message.next()) {
+    switch (message.tag()) {
+    case PBAggressiveNSECEntry::required_bytes_zone:
+      zone = DNSName(message.get_bytes());
+      break;
+    case PBAggressiveNSECEntry::required_bool_nsec3:
+      nsec3 = message.get_bool();
+      break;
+    case PBAggressiveNSECEntry::required_bytes_owner:
+      record.d_name = DNSName(message.get_bytes());
+      break;
+    case PBAggressiveNSECEntry::required_bytes_record:
+      record.d_type = nsec3 ? QType::NSEC3 : QType::NSEC;
+      record.setContent(DNSRecordContent::deserialize(record.d_name, record.d_type, message.get_bytes()));
+      break;
+    case PBAggressiveNSECEntry::repeated_bytes_sig: {
+      auto signature = std::dynamic_pointer_cast<const RRSIGRecordContent>(DNSRecordContent::deserialize(record.d_name, QType::RRSIG, message.get_bytes()));
+      if (signature) {
+        signatures.push_back(std::move(signature));
+      }
+      break;
+    }
+    case PBAggressiveNSECEntry::required_int64_ttd:
+      ttd = message.get_int64();
+      break;
+    case PBAggressiveNSECEntry::required_bytes_qname:
+      qname = DNSName(message.get_bytes());
+      break;
+    case PBAggressiveNSECEntry::required_uint32_qtype:
+      qtype = message.get_uint32();
+      break;
+    default:
+      break;
+    }
+  }
+  if (ttd <= now || !record.getContent()) {
+    return false;
+  }
+  /* insertNSEC() expects the TTL to already be a TTD, and does the same checks as for a fresh record */
+  record.d_ttl = static_cast<uint32_t>(ttd);
+  const auto before = getEntriesCount();
+  insertNSEC(zone, record.d_name, record, signatures, nsec3, qname, qtype);
+  return getEntriesCount() > before;
+}
+
+size_t AggressiveNSECCache::putPB(const std::string& pbuf, time_t now)
+{
+  auto log = g_slog->withName("aggressivensec")->withValues("size", Logging::Loggable(pbuf.size()));
+  log->info(Logr::Debug, "Processing aggressive NSEC cache dump");
+
+  protozero::pbf_message<PBAggressiveNSECDump> full(pbuf);
+  size_t count = 0;
+  size_t inserted = 0;
+  try {
+    bool protocolVersionSeen = false;
+    bool typeSeen = false;
+    while (full.next()) {
+      switch (full.tag()) {
+      case PBAggressiveNSECDump::required_string_version: {
+        auto version = full.get_string();
+        log = log->withValues("version", Logging::Loggable(version));
+        break;
+      }
+      case PBAggressiveNSECDump::required_string_identity: {
+        auto identity = full.get_string();
+        log = log->withValues("identity", Logging::Loggable(identity));
+        break;
+      }
+      case PBAggressiveNSECDump::required_uint64_protocolVersion: {
+        auto protocolVersion = full.get_uint64();
+        log = log->withValues("protocolVersion", Logging::Loggable(protocolVersion));
+        if (protocolVersion != 1) {
+          throw std::runtime_error("Protocol version mismatch");
+        }
+        protocolVersionSeen = true;
+        break;
+      }
+      case PBAggressiveNSECDump::required_int64_time: {
+        auto time = full.get_int64();
+        log = log->withValues("time", Logging::Loggable(time));
+        break;
+      }
+      case PBAggressiveNSECDump::required_string_type: {
+        auto type = full.get_string();
+        if (type != "PBAggressiveNSECDump") {
+          throw std::runtime_error("Data type mismatch");
+        }
+        typeSeen = true;
+        break;
+      }
+      case PBAggressiveNSECDump::repeated_message_nsecEntry: {
+        if (!protocolVersionSeen || !typeSeen) {
+          throw std::runtime_error("Required field missing");
+        }
+        protozero::pbf_message<PBAggressiveNSECEntry> message = full.get_message();
+        if (putPBEntry(message, now)) {
+          ++inserted;
+        }
+        ++count;
+        break;
+      }
+      }
+    }
+    log->info(Logr::Info, "Processed aggressive NSEC cache dump", "processed", Logging::Loggable(count), "inserted", Logging::Loggable(inserted));
+    return inserted;
+  }
+  catch (const std::runtime_error& e) {
+    log->error(Logr::Error, e.what(), "Runtime exception processing aggressive NSEC cache dump");
+  }
+  catch (const std::exception& e) {
+    log->error(Logr::Error, e.what(), "Exception processing aggressive NSEC cache dump");
+  }
+  catch (...) {
+    log->error(Logr::Error, "Other exception processing aggressive NSEC cache dump");
+  }
+  return 0;
+}
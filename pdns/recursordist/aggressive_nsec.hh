@@ -97,6 +97,8 @@ public:
 
   void prune(time_t now);
   size_t dumpToFile(pdns::UniqueFilePtr& filePtr, const struct timeval& now);
+  size_t getPB(const std::string& serverID, std::string& ret);
+  size_t putPB(const std::string& pbuf, time_t now = time(nullptr));
 
 private:
   struct ZoneEntry
@@ -159,6 +161,9 @@ private:
   bool synthesizeFromNSEC3Wildcard(time_t now, const DNSName& name, const QType& type, std::vector<DNSRecord>& ret, int& res, bool doDNSSEC, ZoneEntry::CacheEntry& nextCloser, const DNSName& wildcardName, const OptLog&);
   bool synthesizeFromNSECWildcard(time_t now, const DNSName& name, const QType& type, std::vector<DNSRecord>& ret, int& res, bool doDNSSEC, ZoneEntry::CacheEntry& nsec, const DNSName& wildcardName, const OptLog&);
 
+  template <typename T>
+  bool putPBEntry(T& message, time_t now);
+
   /* slowly updates d_entriesCount */
   void updateEntriesCount(SuffixMatchTree<std::shared_ptr<LockGuarded<ZoneEntry>>>& zones);
 
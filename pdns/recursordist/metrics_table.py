@@ -1410,6 +1410,38 @@ table = [
         'desc': 'Number of authoritative server cookie probes not resulting in success',
         'snmp': 161,
     },
+    {
+        'name': 'udp-recvmmsg-calls',
+        'lambda': '[] { return g_Counters.sum(rec::Counter::udpRecvmmsgCalls); }',
+        'desc': 'Number of recvmmsg() calls on incoming UDP sockets that returned at least one query',
+        'longdesc': 'Only incremented when :ref:`setting-yaml-incoming.udp_vector_size` is larger than 1. Dividing ``udp-recvmmsg-queries`` by this value gives the average batch fill',
+        'snmp': 162,
+    },
+    {
+        'name': 'udp-recvmmsg-queries',
+        'lambda': '[] { return g_Counters.sum(rec::Counter::udpRecvmmsgQueries); }',
+        'desc': 'Number of UDP queries received via recvmmsg()',
+        'snmp': 163,
+    },
+    {
+        'name': 'udp-recvmmsg-full-batches',
+        'lambda': '[] { return g_Counters.sum(rec::Counter::udpRecvmmsgFullBatches); }',
+        'desc': 'Number of recvmmsg() calls on incoming UDP sockets that filled the whole vector',
+        'longdesc': 'A high value compared to ``udp-recvmmsg-calls`` indicates that :ref:`setting-yaml-incoming.udp_vector_size` could be raised',
+        'snmp': 164,
+    },
+    {
+        'name': 'udp-sendmmsg-calls',
+        'lambda': '[] { return g_Counters.sum(rec::Counter::udpSendmmsgCalls); }',
+        'desc': 'Number of sendmmsg() calls used to send packet cache hits answered from a batch of UDP queries',
+        'snmp': 165,
+    },
+    {
+        'name': 'udp-sendmmsg-answers',
+        'lambda': '[] { return g_Counters.sum(rec::Counter::udpSendmmsgAnswers); }',
+        'desc': 'Number of packet cache hits sent to UDP clients via sendmmsg()',
+        'snmp': 166,
+    },
     {
         'name': 'remote-logger-count',
         'lambda':  '''[]() {
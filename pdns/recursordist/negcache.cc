@@ -20,11 +20,15 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <cinttypes>
+#include <protozero/pbf_builder.hpp>
+#include <protozero/pbf_message.hpp>
 
 #include "negcache.hh"
 #include "misc.hh"
 #include "cachecleaner.hh"
+#include "logging.hh"
 #include "rec-taskqueue.hh"
+#include "version.hh"
 
 // For a description on how ServeStale works, see recursor_cache.cc, the general structure is the same.
 uint16_t NegCache::s_maxServedStaleExtensions;
@@ -326,3 +330,252 @@ size_t NegCache::doDump(int fileDesc, size_t maxCacheEntries, time_t now)
   fprintf(filePtr.get(), "; negcache size: %zu/%zu shards: %zu min/max shard size: %zu/%zu\n", size(), maxCacheEntries, d_maps.size(), min, max);
   return ret;
 }
+
+enum class PBNegCacheDump : protozero::pbf_tag_type
+{
+  required_string_version = 1,
+  required_string_identity = 2,
+  required_uint64_protocolVersion = 3,
+  required_int64_time = 4,
+  required_string_type = 5,
+  repeated_message_negCacheEntry = 6,
+};
+
+enum class PBNegCacheEntry : protozero::pbf_tag_type
+{
+  required_bytes_name = 1,
+  required_uint32_qtype = 2,
+  required_bytes_auth = 3,
+  required_int64_ttd = 4,
+  required_uint32_orig_ttl = 5,
+  required_uint32_servedStale = 6,
+  required_uint32_state = 7,
+  repeated_message_soaRecord = 8,
+  repeated_message_soaSignature = 9,
+  repeated_message_dnssecRecord = 10,
+  repeated_message_dnssecSignature = 11,
+};
+
+// name and type come before rdata, as they are needed to decode it
+enum class PBNegCacheRecord : protozero::pbf_tag_type
+{
+  required_bytes_name = 1,
+  required_uint32_type = 2,
+  required_uint32_class = 3,
+  required_uint32_ttl = 4,
+  required_uint32_place = 5,
+  required_bytes_rdata = 6,
+};
+
+template <typename T>
+static void getPBRecords(T& message, PBNegCacheEntry type, const vector<DNSRecord>& records)
+{
+  for (const auto& record : records) {
+    protozero::pbf_builder<PBNegCacheRecord> pbRecord(message, type);
+    pbRecord.add_bytes(PBNegCacheRecord::required_bytes_name, record.d_name.toString());
+    pbRecord.add_uint32(PBNegCacheRecord::required_uint32_type, record.d_type);
+    pbRecord.add_uint32(PBNegCacheRecord::required_uint32_class, record.d_class);
+    pbRecord.add_uint32(PBNegCacheRecord::required_uint32_ttl, record.d_ttl);
+    pbRecord.add_uint32(PBNegCacheRecord::required_uint32_place, record.d_place);
+    pbRecord.add_bytes(PBNegCacheRecord::required_bytes_rdata, record.getContent()->serialize(record.d_name, true));
+  }
+}
+
+static void putPBRecord(protozero::pbf_message<PBNegCacheEntry>& message, vector<DNSRecord>& records)
+{
+  protozero::pbf_message<PBNegCacheRecord> pbRecord = message.get_message();
+  DNSRecord record;
+  while (pbRecord.next()) {
+    switch (pbRecord.tag()) {
+    case PBNegCacheRecord::required_bytes_name:
+      record.d_name = DNSName(pbRecord.get_bytes());
+      break;
+    case PBNegCacheRecord::required_uint32_type:
+      record.d_type = pbRecord.get_uint32();
+      break;
+    case PBNegCacheRecord::required_uint32_class:
+      record.d_class = pbRecord.get_uint32();
+      break;
+    case PBNegCacheRecord::required_uint32_ttl:
+      record.d_ttl = pbRecord.get_uint32();
+      break;
+    case PBNegCacheRecord::required_uint32_place:
+      record.d_place = static_cast<DNSResourceRecord::Place>(pbRecord.get_uint32());
+      break;
+    case PBNegCacheRecord::required_bytes_rdata:
+      record.setContent(DNSRecordContent::deserialize(record.d_name, record.d_type, pbRecord.get_bytes()));
+      break;
+    default:
+      break;
+    }
+  }
+  if (!record.getContent()) {
+    throw std::runtime_error("Negative cache record without content");
+  }
+  records.emplace_back(std::move(record));
+}
+
+template <typename T>
+void NegCache::getPBEntry(T& message, const NegCacheEntry& negEntry)
+{
+  message.add_bytes(PBNegCacheEntry::required_bytes_name, negEntry.d_name.toString());
+  message.add_uint32(PBNegCacheEntry::required_uint32_qtype, negEntry.d_qtype);
+  message.add_bytes(PBNegCacheEntry::required_bytes_auth, negEntry.d_auth.toString());
+  message.add_int64(PBNegCacheEntry::required_int64_ttd, negEntry.d_ttd);
+  message.add_uint32(PBNegCacheEntry::required_uint32_orig_ttl, negEntry.d_orig_ttl);
+  message.add_uint32(PBNegCacheEntry::required_uint32_servedStale, negEntry.d_servedStale);
+  message.add_uint32(PBNegCacheEntry::required_uint32_state, static_cast<uint32_t>(negEntry.d_validationState));
+  getPBRecords(message, PBNegCacheEntry::repeated_message_soaRecord, negEntry.authoritySOA.records);
+  getPBRecords(message, PBNegCacheEntry::repeated_message_soaSignature, negEntry.authoritySOA.signatures);
+  getPBRecords(message, PBNegCacheEntry::repeated_message_dnssecRecord, negEntry.DNSSECRecords.records);
+  getPBRecords(message, PBNegCacheEntry::repeated_message_dnssecSignature, negEntry.DNSSECRecords.signatures);
+}
+
+size_t NegCache::getPB(const std::string& serverID, std::string& ret)
+{
+  auto log = g_slog->withName("negcache");
+  log->info(Logr::Info, "Producing negcache dump");
+
+  protozero::pbf_builder<PBNegCacheDump> full(ret);
+  full.add_string(PBNegCacheDump::required_string_version, getPDNSVersion());
+  full.add_string(PBNegCacheDump::required_string_identity, serverID);
+  full.add_uint64(PBNegCacheDump::required_uint64_protocolVersion, 1);
+  full.add_int64(PBNegCacheDump::required_int64_time, time(nullptr));
+  full.add_string(PBNegCacheDump::required_string_type, "PBNegCacheDump");
+
+  size_t count = 0;
+  for (auto& map : d_maps) {
+    auto lockedMap = map.lock();
+    const auto& sidx = lockedMap->d_map.get<SequenceTag>();
+    for (const auto& negEntry : sidx) {
+      protozero::pbf_builder<PBNegCacheEntry> message(full, PBNegCacheDump::repeated_message_negCacheEntry);
+      getPBEntry(message, negEntry);
+      ++count;
+    }
+  }
+  log->info(Logr::Info, "Produced negcache dump", "size", Logging::Loggable(ret.size()), "count", Logging::Loggable(count));
+  return count;
+}
+
+template <typename T>
+bool NegCache::putPBEntry(T& message, time_t now)
+{
+  NegCacheEntry negEntry{};
+  while (message.next()) {
+    switch (message.tag()) {
+    case PBNegCacheEntry::required_bytes_name:
+      negEntry.d_name = DNSName(message.get_bytes());
+      break;
+    case PBNegCacheEntry::required_uint32_qtype:
+      negEntry.d_qtype = message.get_uint32();
+      break;
+    case PBNegCacheEntry::required_bytes_auth:
+      negEntry.d_auth = DNSName(message.get_bytes());
+      break;
+    case PBNegCacheEntry::required_int64_ttd:
+      negEntry.d_ttd = message.get_int64();
+      break;
+    case PBNegCacheEntry::required_uint32_orig_ttl:
+      negEntry.d_orig_ttl = message.get_uint32();
+      break;
+    case PBNegCacheEntry::required_uint32_servedStale:
+      negEntry.d_servedStale = message.get_uint32();
+      break;
+    case PBNegCacheEntry::required_uint32_state:
+      negEntry.d_validationState = static_cast<vState>(message.get_uint32());
+      break;
+    case PBNegCacheEntry::repeated_message_soaRecord:
+      putPBRecord(message, negEntry.authoritySOA.records);
+      break;
+    case PBNegCacheEntry::repeated_message_soaSignature:
+      putPBRecord(message, negEntry.authoritySOA.signatures);
+      break;
+    case PBNegCacheEntry::repeated_message_dnssecRecord:
+      putPBRecord(message, negEntry.DNSSECRecords.records);
+      break;
+    case PBNegCacheEntry::repeated_message_dnssecSignature:
+      putPBRecord(message, negEntry.DNSSECRecords.signatures);
+      break;
+    default:
+      break;
+    }
+  }
+  if (negEntry.isStale(now)) {
+    return false;
+  }
+  add(negEntry);
+  return true;
+}
+
+size_t NegCache::putPB(const std::string& pbuf, time_t now)
+{
+  auto log = g_slog->withName("negcache")->withValues("size", Logging::Loggable(pbuf.size()));
+  log->info(Logr::Debug, "Processing negcache dump");
+
+  protozero::pbf_message<PBNegCacheDump> full(pbuf);
+  size_t count = 0;
+  size_t inserted = 0;
+  try {
+    bool protocolVersionSeen = false;
+    bool typeSeen = false;
+    while (full.next()) {
+      switch (full.tag()) {
+      case PBNegCacheDump::required_string_version: {
+        auto version = full.get_string();
+        log = log->withValues("version", Logging::Loggable(version));
+        break;
+      }
+      case PBNegCacheDump::required_string_identity: {
+        auto identity = full.get_string();
+        log = log->withValues("identity", Logging::Loggable(identity));
+        break;
+      }
+      case PBNegCacheDump::required_uint64_protocolVersion: {
+        auto protocolVersion = full.get_uint64();
+        log = log->withValues("protocolVersion", Logging::Loggable(protocolVersion));
+        if (protocolVersion != 1) {
+          throw std::runtime_error("Protocol version mismatch");
+        }
+        protocolVersionSeen = true;
+        break;
+      }
+      case PBNegCacheDump::required_int64_time: {
+        auto time = full.get_int64();
+        log = log->withValues("time", Logging::Loggable(time));
+        break;
+      }
+      case PBNegCacheDump::required_string_type: {
+        auto type = full.get_string();
+        if (type != "PBNegCacheDump") {
+          throw std::runtime_error("Data type mismatch");
+        }
+        typeSeen = true;
+        break;
+      }
+      case PBNegCacheDump::repeated_message_negCacheEntry: {
+        if (!protocolVersionSeen || !typeSeen) {
+          throw std::runtime_error("Required field missing");
+        }
+        protozero::pbf_message<PBNegCacheEntry> message = full.get_message();
+        if (putPBEntry(message, now)) {
+          ++inserted;
+        }
+        ++count;
+        break;
+      }
+      }
+    }
+    log->info(Logr::Info, "Processed negcache dump", "processed", Logging::Loggable(count), "inserted", Logging::Loggable(inserted));
+    return inserted;
+  }
+  catch (const std::runtime_error& e) {
+    log->error(Logr::Error, e.what(), "Runtime exception processing negcache dump");
+  }
+  catch (const std::exception& e) {
+    log->error(Logr::Error, e.what(), "Exception processing negcache dump");
+  }
+  catch (...) {
+    log->error(Logr::Error, "Other exception processing negcache dump");
+  }
+  return 0;
+}
@@ -97,6 +97,8 @@ public:
   void prune(time_t now, size_t maxEntries);
   void clear();
   size_t doDump(int fileDesc, size_t maxCacheEntries, time_t now = time(nullptr));
+  size_t getPB(const std::string& serverID, std::string& ret);
+  size_t putPB(const std::string& pbuf, time_t now = time(nullptr));
   size_t wipe(const DNSName& name, bool subtree = false);
   size_t wipeTyped(const DNSName& name, QType qtype);
   [[nodiscard]] size_t size() const;
@@ -124,6 +126,11 @@ private:
 
   static void updateStaleEntry(time_t now, negcache_t::iterator& entry, QType qtype);
 
+  template <typename T>
+  static void getPBEntry(T& message, const NegCacheEntry& negEntry);
+  template <typename T>
+  bool putPBEntry(T& message, time_t now);
+
   struct MapCombo
   {
     MapCombo() = default;
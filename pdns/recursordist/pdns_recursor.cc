@@ -71,6 +71,7 @@ static set<int> g_fromtosockets; // listen sockets that use 'sendfromto()' mecha
 NetmaskGroup g_paddingFrom;
 size_t g_proxyProtocolMaximumSize;
 size_t g_maxUDPQueriesPerRound;
+size_t g_udpVectorSize;
 unsigned int g_maxMThreads;
 unsigned int g_paddingTag;
 PaddingMode g_paddingMode;
@@ -2188,6 +2189,91 @@ bool matchOTConditions(RecEventTrace& eventTrace, const std::unique_ptr<OpenTele
   return true;
 }
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+// Answers from the packet cache to queries read in a single recvmmsg() batch, sent together via sendmmsg()
+class UDPAnswerBatch
+{
+public:
+  void start(int fileDesc, size_t expected)
+  {
+    d_fileDesc = fileDesc;
+    d_answers.clear();
+    d_answers.reserve(expected);
+  }
+
+  [[nodiscard]] bool isActive(int fileDesc) const
+  {
+    return d_fileDesc != -1 && d_fileDesc == fileDesc;
+  }
+
+  void add(std::string&& packet, const ComboAddress& remote, const ComboAddress& local)
+  {
+    d_answers.push_back({std::move(packet), remote, local});
+  }
+
+  void flush();
+
+private:
+  struct Answer
+  {
+    std::string d_packet;
+    ComboAddress d_remote;
+    ComboAddress d_local;
+  };
+
+  std::vector<Answer> d_answers;
+  std::vector<struct mmsghdr> d_msgs;
+  std::vector<struct iovec> d_iovs;
+  std::vector<cmsgbuf_aligned> d_cbufs;
+  int d_fileDesc{-1};
+};
+
+void UDPAnswerBatch::flush()
+{
+  const int fileDesc = d_fileDesc;
+  d_fileDesc = -1;
+  const size_t count = d_answers.size();
+  if (count == 0) {
+    return;
+  }
+
+  d_msgs.resize(count);
+  d_iovs.resize(count);
+  d_cbufs.resize(count);
+  const bool fromTo = g_fromtosockets.count(fileDesc) != 0;
+  for (size_t idx = 0; idx < count; idx++) {
+    auto& answer = d_answers.at(idx);
+    auto& msgh = d_msgs.at(idx).msg_hdr;
+    fillMSGHdr(&msgh, &d_iovs.at(idx), &d_cbufs.at(idx), 0, answer.d_packet.data(), answer.d_packet.size(), &answer.d_remote);
+    msgh.msg_control = nullptr;
+    if (fromTo) {
+      addCMsgSrcAddr(&msgh, &d_cbufs.at(idx), &answer.d_local, 0);
+    }
+    d_msgs.at(idx).msg_len = 0;
+  }
+
+  size_t sent = 0;
+  while (sent < count) {
+    int ret = sendmmsg(fileDesc, &d_msgs.at(sent), static_cast<unsigned int>(count - sent), 0);
+    if (ret > 0) {
+      ++t_Counters.at(rec::Counter::udpSendmmsgCalls);
+      t_Counters.at(rec::Counter::udpSendmmsgAnswers) += static_cast<uint64_t>(ret);
+      sent += static_cast<size_t>(ret);
+      continue;
+    }
+    // the error is about the first datagram we tried to send, skip it and carry on with the others
+    int sendErr = errno;
+    if (g_logCommonErrors) {
+      g_slogudpin->error(Logr::Error, sendErr, "Sending UDP reply to client failed", "remote", Logging::Loggable(d_answers.at(sent).d_remote));
+    }
+    ++sent;
+  }
+  d_answers.clear();
+}
+
+static thread_local UDPAnswerBatch t_udpAnswerBatch;
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG */
+
 // fromaddr: the address from which the query is coming
 // destaddr: the address on which the query was received
 // source: the address we assume the query is coming from, might be set by proxy protocol
@@ -2354,16 +2440,25 @@ static string* doProcessUDPQuestion(const std::string& question, const ComboAddr
                             "source", Logging::Loggable(source), "remote", Logging::Loggable(fromaddr));
         }
         match = eventTrace.add(RecEventTrace::AnswerSent);
-        struct msghdr msgh{};
-        struct iovec iov{};
-        cmsgbuf_aligned cbuf{};
-        fillMSGHdr(&msgh, &iov, &cbuf, 0, reinterpret_cast<char*>(response.data()), response.length(), const_cast<ComboAddress*>(&fromaddr)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-type-const-cast)
-        msgh.msg_control = nullptr;
-
-        if (g_fromtosockets.count(fileDesc) != 0) {
-          addCMsgSrcAddr(&msgh, &cbuf, &destaddr, 0);
+        int sendErr = 0;
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+        if (t_udpAnswerBatch.isActive(fileDesc)) {
+          t_udpAnswerBatch.add(std::move(response), fromaddr, destaddr);
+        }
+        else
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG */
+        {
+          struct msghdr msgh{};
+          struct iovec iov{};
+          cmsgbuf_aligned cbuf{};
+          fillMSGHdr(&msgh, &iov, &cbuf, 0, reinterpret_cast<char*>(response.data()), response.length(), const_cast<ComboAddress*>(&fromaddr)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast,cppcoreguidelines-pro-type-const-cast)
+          msgh.msg_control = nullptr;
+
+          if (g_fromtosockets.count(fileDesc) != 0) {
+            addCMsgSrcAddr(&msgh, &cbuf, &destaddr, 0);
+          }
+          sendErr = sendOnNBSocket(fileDesc, &msgh);
         }
-        int sendErr = sendOnNBSocket(fileDesc, &msgh);
         eventTrace.add(RecEventTrace::AnswerSent, sendErr, false, match);
         traceScope.close(0);
         if (t_protobufServers.servers && logResponse && (!luaconfsLocal->protobufExportConfig.taggedOnly || (pbData && pbData->d_tagged))) {
@@ -2478,212 +2573,303 @@ static string* doProcessUDPQuestion(const std::string& question, const ComboAddr
   return nullptr;
 }
 
-static void handleNewUDPQuestion(int fileDesc, FDMultiplexer::funcparam_t& /* var */) // NOLINT(readability-function-cognitive-complexity): https://github.com/PowerDNS/pdns/issues/12791
+// Processes a single datagram received on one of our UDP listening sockets. Returns false if we should stop reading
+// from that socket for this round.
+static bool handleNewUDPDatagram(int fileDesc, std::string& data, ssize_t len, struct msghdr& msgh, const ComboAddress& fromaddr, std::vector<ProxyProtocolValue>& proxyProtocolValues, RecEventTrace& eventTrace, pdns::trace::InitialSpanInfo& otTrace) // NOLINT(readability-function-cognitive-complexity): https://github.com/PowerDNS/pdns/issues/12791
 {
-  const bool proxyActive = t_proxyProtocolACL && !t_proxyProtocolACL->empty();
-  static const size_t maxIncomingQuerySize = !proxyActive ? 512 : (512 + g_proxyProtocolMaximumSize);
-  static thread_local std::string data;
-  ComboAddress fromaddr; // the address from which the query is coming
+  bool proxyProto = false;
   ComboAddress source; // the address we assume the query is coming from, might be set by proxy protocol
   ComboAddress destination; // the address we assume the query was sent to, might be set by proxy protocol
-  struct msghdr msgh{};
-  struct iovec iov{};
-  cmsgbuf_aligned cbuf;
-  bool firstQuery = true;
-  std::vector<ProxyProtocolValue> proxyProtocolValues;
-  RecEventTrace eventTrace;
-  pdns::trace::InitialSpanInfo otTrace;
 
-  for (size_t queriesCounter = 0; queriesCounter < g_maxUDPQueriesPerRound; queriesCounter++) {
-    bool proxyProto = false;
-    proxyProtocolValues.clear();
-    data.resize(maxIncomingQuerySize);
-    fromaddr.sin6.sin6_family = AF_INET6; // this makes sure fromaddr is big enough
-    fillMSGHdr(&msgh, &iov, &cbuf, sizeof(cbuf), data.data(), data.size(), &fromaddr);
+  eventTrace.clear();
+  eventTrace.setEnabled(SyncRes::s_event_trace_enabled != 0);
+  // eventTrace uses monotonic time, while OpenTelemetry uses absolute time. setEnabled()
+  // established the reference point, get an absolute TS as close as possible to the
+  // eventTrace start of trace time.
+  auto traceTS = pdns::trace::timestamp();
+  auto match = eventTrace.add(RecEventTrace::ReqRecv);
+  if (SyncRes::eventTraceEnabled(SyncRes::event_trace_to_ot)) {
+    otTrace.clear();
+    otTrace.start_time_unix_nano = traceTS;
+  }
 
-    if (ssize_t len = recvmsg(fileDesc, &msgh, 0); len >= 0) {
-      eventTrace.clear();
-      eventTrace.setEnabled(SyncRes::s_event_trace_enabled != 0);
-      // eventTrace uses monotonic time, while OpenTelemetry uses absolute time. setEnabled()
-      // established the reference point, get an absolute TS as close as possible to the
-      // eventTrace start of trace time.
-      auto traceTS = pdns::trace::timestamp();
-      auto match = eventTrace.add(RecEventTrace::ReqRecv);
-      if (SyncRes::eventTraceEnabled(SyncRes::event_trace_to_ot)) {
-        otTrace.clear();
-        otTrace.start_time_unix_nano = traceTS;
-      }
-      firstQuery = false;
+  if ((msgh.msg_flags & MSG_TRUNC) != 0) {
+    t_Counters.at(rec::Counter::truncatedDrops)++;
+    if (!g_quiet) {
+      g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr));
+    }
+    return false;
+  }
 
-      if ((msgh.msg_flags & MSG_TRUNC) != 0) {
-        t_Counters.at(rec::Counter::truncatedDrops)++;
-        if (!g_quiet) {
-          g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr));
-        }
-        return;
+  data.resize(static_cast<size_t>(len));
+
+  ComboAddress destaddr; // the address where the query was sent
+  destaddr.reset(); // this makes sure we ignore this address if not explictly set below
+  const auto* loc = rplookup(g_listenSocketsAddresses, fileDesc);
+  if (HarvestDestinationAddress(&msgh, &destaddr)) {
+    // but.. need to get port too
+    if (loc != nullptr) {
+      destaddr.sin4.sin_port = loc->sin4.sin_port;
+    }
+  }
+  else {
+    if (loc != nullptr) {
+      destaddr = *loc;
+    }
+    else {
+      destaddr.sin4.sin_family = fromaddr.sin4.sin_family;
+      socklen_t slen = destaddr.getSocklen();
+      getsockname(fileDesc, reinterpret_cast<sockaddr*>(&destaddr), &slen); // if this fails, we're ok with it  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+  }
+  if (expectProxyProtocol(fromaddr, destaddr)) {
+    bool tcp = false;
+    ssize_t used = parseProxyHeader(data, proxyProto, source, destination, tcp, proxyProtocolValues);
+    if (used <= 0) {
+      ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
+      if (!g_quiet) {
+        g_slogudpin->info(Logr::Error, "Ignoring invalid proxy protocol query", "length", Logging::Loggable(len),
+                          "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr));
+      }
+      return false;
+    }
+    if (static_cast<size_t>(used) > g_proxyProtocolMaximumSize) {
+      if (g_quiet) {
+        g_slogudpin->info(Logr::Error, "Proxy protocol header in UDP packet  is larger than proxy-protocol-maximum-size",
+                          "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr));
       }
+      ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
+      return false;
+    }
 
-      data.resize(static_cast<size_t>(len));
+    data.erase(0, used);
+  }
+  else if (len > 512) {
+    /* we only allow UDP packets larger than 512 for those with a proxy protocol header */
+    t_Counters.at(rec::Counter::truncatedDrops)++;
+    if (!g_quiet) {
+      g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr));
+    }
+    return false;
+  }
 
-      ComboAddress destaddr; // the address where the query was sent
-      destaddr.reset(); // this makes sure we ignore this address if not explictly set below
-      const auto* loc = rplookup(g_listenSocketsAddresses, fileDesc);
-      if (HarvestDestinationAddress(&msgh, &destaddr)) {
-        // but.. need to get port too
-        if (loc != nullptr) {
-          destaddr.sin4.sin_port = loc->sin4.sin_port;
-        }
+  if (data.size() < sizeof(dnsheader)) {
+    t_Counters.at(rec::Counter::ignoredCount)++;
+    if (!g_quiet) {
+      g_slogudpin->info(Logr::Error, "Ignoring too-short query", "length", Logging::Loggable(data.size()),
+                        "remote", Logging::Loggable(fromaddr));
+    }
+    return false;
+  }
+
+  if (!proxyProto) {
+    source = fromaddr;
+  }
+  ComboAddress mappedSource = source;
+  if (t_proxyMapping) {
+    if (const auto* iter = t_proxyMapping->lookup(source)) {
+      mappedSource = iter->second.address;
+      ++iter->second.stats.netmaskMatches;
+    }
+  }
+  if (t_remotes) {
+    t_remotes->push_back(source);
+  }
+
+  if (t_allowFrom && !t_allowFrom->match(&mappedSource)) {
+    if (!g_quiet) {
+      g_slogudpin->info(Logr::Error, "Dropping UDP query, address not matched by allow-from", "source", Logging::Loggable(mappedSource));
+    }
+
+    t_Counters.at(rec::Counter::unauthorizedUDP)++;
+    return false;
+  }
+
+  BOOST_STATIC_ASSERT(offsetof(sockaddr_in, sin_port) == offsetof(sockaddr_in6, sin6_port));
+  if (fromaddr.sin4.sin_port == 0) { // also works for IPv6
+    if (!g_quiet) {
+      g_slogudpin->info(Logr::Error, "Dropping UDP query can't deal with port 0", "remote", Logging::Loggable(fromaddr));
+    }
+
+    t_Counters.at(rec::Counter::clientParseError)++; // not quite the best place to put it, but needs to go somewhere
+    return false;
+  }
+
+  try {
+    const dnsheader_aligned headerdata(data.data());
+    const dnsheader* dnsheader = headerdata.get();
+
+    if (dnsheader->qr) {
+      t_Counters.at(rec::Counter::ignoredCount)++;
+      if (g_logCommonErrors) {
+        g_slogudpin->info(Logr::Error, "Ignoring answer on server socket", "remote", Logging::Loggable(fromaddr));
       }
-      else {
-        if (loc != nullptr) {
-          destaddr = *loc;
-        }
-        else {
-          destaddr.sin4.sin_family = fromaddr.sin4.sin_family;
-          socklen_t slen = destaddr.getSocklen();
-          getsockname(fileDesc, reinterpret_cast<sockaddr*>(&destaddr), &slen); // if this fails, we're ok with it  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
-        }
+    }
+    else if (dnsheader->opcode != static_cast<unsigned>(Opcode::Query) && dnsheader->opcode != static_cast<unsigned>(Opcode::Notify)) {
+      t_Counters.at(rec::Counter::ignoredCount)++;
+      if (g_logCommonErrors) {
+        g_slogudpin->info(Logr::Error, "Ignoring unsupported opcode server socket", "remote", Logging::Loggable(fromaddr), "opcode", Logging::Loggable(Opcode::to_s(dnsheader->opcode)));
       }
-      if (expectProxyProtocol(fromaddr, destaddr)) {
-        bool tcp = false;
-        ssize_t used = parseProxyHeader(data, proxyProto, source, destination, tcp, proxyProtocolValues);
-        if (used <= 0) {
-          ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
+    }
+    else if (dnsheader->qdcount == 0U) {
+      t_Counters.at(rec::Counter::emptyQueriesCount)++;
+      if (g_logCommonErrors) {
+        g_slogudpin->info(Logr::Error, "Ignoring empty (qdcount == 0) query on server socket!", "remote", Logging::Loggable(fromaddr));
+      }
+    }
+    else {
+      if (dnsheader->opcode == static_cast<unsigned>(Opcode::Notify)) {
+        if (!t_allowNotifyFrom || !t_allowNotifyFrom->match(&mappedSource)) {
           if (!g_quiet) {
-            g_slogudpin->info(Logr::Error, "Ignoring invalid proxy protocol query", "length", Logging::Loggable(len),
-                              "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr));
-          }
-          return;
-        }
-        if (static_cast<size_t>(used) > g_proxyProtocolMaximumSize) {
-          if (g_quiet) {
-            g_slogudpin->info(Logr::Error, "Proxy protocol header in UDP packet  is larger than proxy-protocol-maximum-size",
-                              "used", Logging::Loggable(used), "remote", Logging::Loggable(fromaddr));
+            g_slogudpin->info(Logr::Error, "Dropping UDP NOTIFY from address not matched by allow-notify-from",
+                              "source", Logging::Loggable(mappedSource));
           }
-          ++t_Counters.at(rec::Counter::proxyProtocolInvalidCount);
-          return;
-        }
 
-        data.erase(0, used);
-      }
-      else if (len > 512) {
-        /* we only allow UDP packets larger than 512 for those with a proxy protocol header */
-        t_Counters.at(rec::Counter::truncatedDrops)++;
-        if (!g_quiet) {
-          g_slogudpin->info(Logr::Error, "Ignoring truncated query", "remote", Logging::Loggable(fromaddr));
+          t_Counters.at(rec::Counter::sourceDisallowedNotify)++;
+          return false;
         }
-        return;
       }
 
-      if (data.size() < sizeof(dnsheader)) {
-        t_Counters.at(rec::Counter::ignoredCount)++;
-        if (!g_quiet) {
-          g_slogudpin->info(Logr::Error, "Ignoring too-short query", "length", Logging::Loggable(data.size()),
-                            "remote", Logging::Loggable(fromaddr));
-        }
-        return;
+      struct timeval tval = {0, 0};
+      HarvestTimestamp(&msgh, &tval);
+      if (!proxyProto) {
+        destination = destaddr;
       }
 
-      if (!proxyProto) {
-        source = fromaddr;
+      if (eventTrace.enabled() && !matchOTConditions(t_OTConditions, mappedSource) && SyncRes::eventTraceEnabledOnly(SyncRes::event_trace_to_ot)) {
+        eventTrace.setEnabled(false);
       }
-      ComboAddress mappedSource = source;
-      if (t_proxyMapping) {
-        if (const auto* iter = t_proxyMapping->lookup(source)) {
-          mappedSource = iter->second.address;
-          ++iter->second.stats.netmaskMatches;
-        }
+      eventTrace.add(RecEventTrace::ReqRecv, 0, false, match);
+      if (RecThreadInfo::weDistributeQueries()) {
+        std::string localdata = data;
+        distributeAsyncFunction(data, [localdata = std::move(localdata), fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace, otTrace]() mutable {
+          return doProcessUDPQuestion(localdata, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace, otTrace);
+        });
       }
-      if (t_remotes) {
-        t_remotes->push_back(source);
+      else {
+        doProcessUDPQuestion(data, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace, otTrace);
       }
+    }
+  }
+  catch (const MOADNSException& mde) {
+    t_Counters.at(rec::Counter::clientParseError)++;
+    if (g_logCommonErrors) {
+      g_slogudpin->error(Logr::Error, mde.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("MOADNSException"));
+    }
+  }
+  catch (const std::runtime_error& e) {
+    t_Counters.at(rec::Counter::clientParseError)++;
+    if (g_logCommonErrors) {
+      g_slogudpin->error(Logr::Error, e.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("std::runtime_error"));
+    }
+  }
 
-      if (t_allowFrom && !t_allowFrom->match(&mappedSource)) {
-        if (!g_quiet) {
-          g_slogudpin->info(Logr::Error, "Dropping UDP query, address not matched by allow-from", "source", Logging::Loggable(mappedSource));
-        }
+  return true;
+}
 
-        t_Counters.at(rec::Counter::unauthorizedUDP)++;
-        return;
-      }
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+// Reads up to g_udpVectorSize queries per recvmmsg() call. Queries answered from the packet cache are collected
+// into t_udpAnswerBatch while the batch is processed, and sent back with sendmmsg() once it is done.
+static void handleNewUDPQuestionsBatch(int fileDesc, size_t maxIncomingQuerySize)
+{
+  struct BatchSlot
+  {
+    std::string d_data;
+    ComboAddress d_fromaddr;
+    struct iovec d_iov{};
+    cmsgbuf_aligned d_cbuf{};
+  };
+  static thread_local std::vector<BatchSlot> slots;
+  static thread_local std::vector<struct mmsghdr> msgVec;
+  const size_t vectSize = std::min(g_udpVectorSize, static_cast<size_t>(std::numeric_limits<unsigned int>::max()));
+  if (slots.size() != vectSize) {
+    slots.resize(vectSize);
+    msgVec.resize(vectSize);
+  }
+  std::vector<ProxyProtocolValue> proxyProtocolValues;
+  RecEventTrace eventTrace;
+  pdns::trace::InitialSpanInfo otTrace;
+  bool firstQuery = true;
+  bool keepGoing = true;
+  size_t queriesCounter = 0;
 
-      BOOST_STATIC_ASSERT(offsetof(sockaddr_in, sin_port) == offsetof(sockaddr_in6, sin6_port));
-      if (fromaddr.sin4.sin_port == 0) { // also works for IPv6
-        if (!g_quiet) {
-          g_slogudpin->info(Logr::Error, "Dropping UDP query can't deal with port 0", "remote", Logging::Loggable(fromaddr));
-        }
+  while (keepGoing && queriesCounter < g_maxUDPQueriesPerRound) {
+    const size_t wanted = std::min(vectSize, g_maxUDPQueriesPerRound - queriesCounter);
+    for (size_t idx = 0; idx < wanted; idx++) {
+      auto& slot = slots.at(idx);
+      slot.d_data.resize(maxIncomingQuerySize);
+      slot.d_fromaddr.sin6.sin6_family = AF_INET6; // this makes sure fromaddr is big enough
+      fillMSGHdr(&msgVec.at(idx).msg_hdr, &slot.d_iov, &slot.d_cbuf, sizeof(slot.d_cbuf), slot.d_data.data(), slot.d_data.size(), &slot.d_fromaddr);
+      msgVec.at(idx).msg_len = 0;
+    }
 
-        t_Counters.at(rec::Counter::clientParseError)++; // not quite the best place to put it, but needs to go somewhere
-        return;
+    int msgsGot = recvmmsg(fileDesc, msgVec.data(), static_cast<unsigned int>(wanted), 0, nullptr);
+    if (msgsGot <= 0) {
+      if (firstQuery && errno == EAGAIN) {
+        t_Counters.at(rec::Counter::noPacketError)++;
       }
+      break;
+    }
+    firstQuery = false;
+    const auto got = static_cast<size_t>(msgsGot);
+    queriesCounter += got;
+    ++t_Counters.at(rec::Counter::udpRecvmmsgCalls);
+    t_Counters.at(rec::Counter::udpRecvmmsgQueries) += got;
+    if (got == vectSize) {
+      ++t_Counters.at(rec::Counter::udpRecvmmsgFullBatches);
+    }
 
-      try {
-        const dnsheader_aligned headerdata(data.data());
-        const dnsheader* dnsheader = headerdata.get();
+    t_udpAnswerBatch.start(fileDesc, got);
+    for (size_t idx = 0; idx < got; idx++) {
+      auto& slot = slots.at(idx);
+      proxyProtocolValues.clear();
+      /* the datagrams have already been read, so we process the whole batch even if one of them
+         tells us to stop reading from this socket */
+      if (!handleNewUDPDatagram(fileDesc, slot.d_data, msgVec.at(idx).msg_len, msgVec.at(idx).msg_hdr, slot.d_fromaddr, proxyProtocolValues, eventTrace, otTrace)) {
+        keepGoing = false;
+      }
+    }
+    t_udpAnswerBatch.flush();
 
-        if (dnsheader->qr) {
-          t_Counters.at(rec::Counter::ignoredCount)++;
-          if (g_logCommonErrors) {
-            g_slogudpin->info(Logr::Error, "Ignoring answer on server socket", "remote", Logging::Loggable(fromaddr));
-          }
-        }
-        else if (dnsheader->opcode != static_cast<unsigned>(Opcode::Query) && dnsheader->opcode != static_cast<unsigned>(Opcode::Notify)) {
-          t_Counters.at(rec::Counter::ignoredCount)++;
-          if (g_logCommonErrors) {
-            g_slogudpin->info(Logr::Error, "Ignoring unsupported opcode server socket", "remote", Logging::Loggable(fromaddr), "opcode", Logging::Loggable(Opcode::to_s(dnsheader->opcode)));
-          }
-        }
-        else if (dnsheader->qdcount == 0U) {
-          t_Counters.at(rec::Counter::emptyQueriesCount)++;
-          if (g_logCommonErrors) {
-            g_slogudpin->info(Logr::Error, "Ignoring empty (qdcount == 0) query on server socket!", "remote", Logging::Loggable(fromaddr));
-          }
-        }
-        else {
-          if (dnsheader->opcode == static_cast<unsigned>(Opcode::Notify)) {
-            if (!t_allowNotifyFrom || !t_allowNotifyFrom->match(&mappedSource)) {
-              if (!g_quiet) {
-                g_slogudpin->info(Logr::Error, "Dropping UDP NOTIFY from address not matched by allow-notify-from",
-                                  "source", Logging::Loggable(mappedSource));
-              }
+    if (got < wanted) {
+      // the socket has been drained
+      break;
+    }
+  }
+  t_Counters.updateSnap(g_regressionTestMode);
+}
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG */
 
-              t_Counters.at(rec::Counter::sourceDisallowedNotify)++;
-              return;
-            }
-          }
+static void handleNewUDPQuestion(int fileDesc, FDMultiplexer::funcparam_t& /* var */)
+{
+  const bool proxyActive = t_proxyProtocolACL && !t_proxyProtocolACL->empty();
+  static const size_t maxIncomingQuerySize = !proxyActive ? 512 : (512 + g_proxyProtocolMaximumSize);
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+  if (g_udpVectorSize > 1) {
+    handleNewUDPQuestionsBatch(fileDesc, maxIncomingQuerySize);
+    return;
+  }
+#endif /* HAVE_RECVMMSG && HAVE_SENDMMSG */
+  static thread_local std::string data;
+  ComboAddress fromaddr; // the address from which the query is coming
+  struct msghdr msgh{};
+  struct iovec iov{};
+  cmsgbuf_aligned cbuf;
+  bool firstQuery = true;
+  std::vector<ProxyProtocolValue> proxyProtocolValues;
+  RecEventTrace eventTrace;
+  pdns::trace::InitialSpanInfo otTrace;
 
-          struct timeval tval = {0, 0};
-          HarvestTimestamp(&msgh, &tval);
-          if (!proxyProto) {
-            destination = destaddr;
-          }
+  for (size_t queriesCounter = 0; queriesCounter < g_maxUDPQueriesPerRound; queriesCounter++) {
+    proxyProtocolValues.clear();
+    data.resize(maxIncomingQuerySize);
+    fromaddr.sin6.sin6_family = AF_INET6; // this makes sure fromaddr is big enough
+    fillMSGHdr(&msgh, &iov, &cbuf, sizeof(cbuf), data.data(), data.size(), &fromaddr);
 
-          if (eventTrace.enabled() && !matchOTConditions(t_OTConditions, mappedSource) && SyncRes::eventTraceEnabledOnly(SyncRes::event_trace_to_ot)) {
-            eventTrace.setEnabled(false);
-          }
-          eventTrace.add(RecEventTrace::ReqRecv, 0, false, match);
-          if (RecThreadInfo::weDistributeQueries()) {
-            std::string localdata = data;
-            distributeAsyncFunction(data, [localdata = std::move(localdata), fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace, otTrace]() mutable {
-              return doProcessUDPQuestion(localdata, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace, otTrace);
-            });
-          }
-          else {
-            doProcessUDPQuestion(data, fromaddr, destaddr, source, destination, mappedSource, tval, fileDesc, proxyProtocolValues, eventTrace, otTrace);
-          }
-        }
-      }
-      catch (const MOADNSException& mde) {
-        t_Counters.at(rec::Counter::clientParseError)++;
-        if (g_logCommonErrors) {
-          g_slogudpin->error(Logr::Error, mde.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("MOADNSException"));
-        }
-      }
-      catch (const std::runtime_error& e) {
-        t_Counters.at(rec::Counter::clientParseError)++;
-        if (g_logCommonErrors) {
-          g_slogudpin->error(Logr::Error, e.what(), "Unable to parse packet from remote UDP client", "remote", Logging::Loggable(fromaddr), "exception", Logging::Loggable("std::runtime_error"));
-        }
+    if (ssize_t len = recvmsg(fileDesc, &msgh, 0); len >= 0) {
+      firstQuery = false;
+      if (!handleNewUDPDatagram(fileDesc, data, len, msgh, fromaddr, proxyProtocolValues, eventTrace, otTrace)) {
+        return;
       }
     }
     else {
@@ -54,6 +54,7 @@
 #include <sodium.h>
 
 #include <cstddef>
+#include <fstream>
 #include <utility>
 #endif
 
@@ -107,6 +108,7 @@ LockGuarded<std::shared_ptr<NetmaskGroup>> g_initialAllowFrom; // new thread nee
 LockGuarded<std::shared_ptr<NetmaskGroup>> g_initialAllowNotifyFrom; // new threads need this to be setup
 LockGuarded<std::shared_ptr<notifyset_t>> g_initialAllowNotifyFor; // new threads need this to be setup
 static time_t s_statisticsInterval;
+static time_t s_cacheSnapshotInterval;
 static std::atomic<uint32_t> s_counter;
 int g_argc;
 char** g_argv;
@@ -1763,6 +1765,7 @@ static int initSyncRes(Logr::log_t log)
   SyncRes::s_refresh_ttlperc = ::arg().asNum("refresh-on-ttl-perc");
   SyncRes::s_locked_ttlperc = ::arg().asNum("record-cache-locked-ttl-perc");
   RecursorPacketCache::s_refresh_ttlperc = SyncRes::s_refresh_ttlperc;
+  RecursorPacketCache::s_sharedLookups = ::arg().mustDo("packetcache-shared-lookups");
   SyncRes::s_tcp_fast_open = ::arg().asNum("tcp-fast-open");
   SyncRes::s_tcp_fast_open_connect = ::arg().mustDo("tcp-fast-open-connect");
 
@@ -1782,6 +1785,7 @@ static int initSyncRes(Logr::log_t log)
   }
   MemRecursorCache::s_maxRRSetSize = ::arg().asNum("max-rrset-size");
   MemRecursorCache::s_limitQTypeAny = ::arg().mustDo("limit-qtype-any");
+  MemRecursorCache::s_storeWireFormat = ::arg().mustDo("record-cache-wire-format");
 
   if (SyncRes::s_tcp_fast_open_connect) {
     checkFastOpenSysctl(true, log);
@@ -2104,6 +2108,114 @@ static int initDNS64(Logr::log_t log)
   return 0;
 }
 
+static const std::string s_recordCacheSnapshotFile{"record-cache.pb"};
+static const std::string s_negCacheSnapshotFile{"negative-cache.pb"};
+static const std::string s_aggressiveNSECCacheSnapshotFile{"aggressive-nsec-cache.pb"};
+
+static bool writeCacheSnapshotFile(const std::string& fileName, const std::string& data, Logr::log_t log)
+{
+  std::string tempFile = fileName + ".XXXXXX";
+  auto fileDesc = FDWrapper(mkstemp(tempFile.data()));
+  if (fileDesc == -1) {
+    log->error(Logr::Error, errno, "Unable to create temporary file for cache snapshot", "file", Logging::Loggable(fileName));
+    return false;
+  }
+  try {
+    writen2(fileDesc, data);
+    if (fsync(fileDesc) != 0 || fileDesc.reset() != 0) {
+      throw std::runtime_error("Error while syncing the content of the file: " + stringerror());
+    }
+  }
+  catch (const std::exception& e) {
+    log->error(Logr::Error, e.what(), "Unable to write cache snapshot", "file", Logging::Loggable(tempFile));
+    unlink(tempFile.c_str());
+    return false;
+  }
+  if (rename(tempFile.c_str(), fileName.c_str()) != 0) {
+    log->error(Logr::Error, errno, "Unable to move cache snapshot into place", "file", Logging::Loggable(fileName));
+    unlink(tempFile.c_str());
+    return false;
+  }
+  return true;
+}
+
+static std::optional<std::string> readCacheSnapshotFile(const std::string& fileName, Logr::log_t log)
+{
+  std::ifstream file(fileName, std::ios::binary);
+  if (!file) {
+    log->info(Logr::Info, "No cache snapshot to load", "file", Logging::Loggable(fileName));
+    return std::nullopt;
+  }
+  std::string data{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+  if (file.bad()) {
+    log->info(Logr::Error, "Unable to read cache snapshot", "file", Logging::Loggable(fileName));
+    return std::nullopt;
+  }
+  return data;
+}
+
+static void saveCacheSnapshot(Logr::log_t log)
+{
+  const auto& directory = ::arg()["record-cache-snapshot-directory"];
+  if (directory.empty()) {
+    return;
+  }
+
+  std::string data;
+  auto count = g_recCache->getRecordSets(0, 0, data);
+  if (writeCacheSnapshotFile(directory + "/" + s_recordCacheSnapshotFile, data, log)) {
+    log->info(Logr::Info, "Saved record cache snapshot", "entries", Logging::Loggable(count), "size", Logging::Loggable(data.size()));
+  }
+
+  data.clear();
+  count = g_negCache->getPB(SyncRes::s_serverID, data);
+  if (writeCacheSnapshotFile(directory + "/" + s_negCacheSnapshotFile, data, log)) {
+    log->info(Logr::Info, "Saved negative cache snapshot", "entries", Logging::Loggable(count), "size", Logging::Loggable(data.size()));
+  }
+
+  if (g_aggressiveNSECCache) {
+    data.clear();
+    count = g_aggressiveNSECCache->getPB(SyncRes::s_serverID, data);
+    if (writeCacheSnapshotFile(directory + "/" + s_aggressiveNSECCacheSnapshotFile, data, log)) {
+      log->info(Logr::Info, "Saved aggressive NSEC cache snapshot", "entries", Logging::Loggable(count), "size", Logging::Loggable(data.size()));
+    }
+  }
+}
+
+// Runs before the recursor threads are started, so no query can be answered from a partially loaded cache
+static void loadCacheSnapshot(Logr::log_t log)
+{
+  const auto& directory = ::arg()["record-cache-snapshot-directory"];
+  if (directory.empty()) {
+    return;
+  }
+
+  const time_t start = time(nullptr);
+  // The three caches are independent, load them in parallel. The record cache, by far the largest, is itself loaded by several threads
+  std::vector<std::thread> loaders;
+  loaders.emplace_back([&directory, log]() {
+    if (auto data = readCacheSnapshotFile(directory + "/" + s_recordCacheSnapshotFile, log)) {
+      g_recCache->putRecordSets(*data, std::max(RecThreadInfo::numUDPWorkers(), 1U));
+    }
+  });
+  loaders.emplace_back([&directory, log]() {
+    if (auto data = readCacheSnapshotFile(directory + "/" + s_negCacheSnapshotFile, log)) {
+      g_negCache->putPB(*data);
+    }
+  });
+  if (g_aggressiveNSECCache) {
+    loaders.emplace_back([&directory, log]() {
+      if (auto data = readCacheSnapshotFile(directory + "/" + s_aggressiveNSECCacheSnapshotFile, log)) {
+        g_aggressiveNSECCache->putPB(*data);
+      }
+    });
+  }
+  for (auto& loader : loaders) {
+    loader.join();
+  }
+  log->info(Logr::Notice, "Loaded cache snapshot", "directory", Logging::Loggable(directory), "seconds", Logging::Loggable(time(nullptr) - start), "recordCacheSize", Logging::Loggable(g_recCache->size()), "negCacheSize", Logging::Loggable(g_negCache->size()));
+}
+
 static int serviceMain(Logr::log_t log)
 {
   g_log.setName(g_programname);
@@ -2254,6 +2366,7 @@ static int serviceMain(Logr::log_t log)
   g_gettagNeedsEDNSOptions = ::arg().mustDo("gettag-needs-edns-options");
 
   s_statisticsInterval = ::arg().asNum("statistics-interval");
+  s_cacheSnapshotInterval = ::arg().asNum("record-cache-snapshot-interval");
 
   SyncRes::s_addExtendedResolutionDNSErrors = ::arg().mustDo("extended-resolution-errors");
 
@@ -2286,6 +2399,7 @@ static int serviceMain(Logr::log_t log)
   g_maxTCPPerClient = ::arg().asNum("max-tcp-per-client");
   g_tcpMaxQueriesPerConn = ::arg().asNum("max-tcp-queries-per-connection");
   g_maxUDPQueriesPerRound = ::arg().asNum("max-udp-queries-per-round");
+  g_udpVectorSize = ::arg().asNum("udp-vector-size");
 
   g_useKernelTimestamp = ::arg().mustDo("protobuf-use-kernel-timestamp");
   g_maxChainLength = ::arg().asNum("max-chain-length");
@@ -2345,9 +2459,13 @@ static int serviceMain(Logr::log_t log)
   setupNODThread(log);
 #endif /* NOD_ENABLED */
 
+  loadCacheSnapshot(log);
+
   runStartStopLua(true, log);
   ret = RecThreadInfo::runThreads(log);
   runStartStopLua(false, log);
+  // The worker threads have stopped, in the quit-nicely case the handler waits for g_doneRunning, so the caches are quiet
+  saveCacheSnapshot(log);
   return ret;
 }
 
@@ -2536,6 +2654,13 @@ static void houseKeepingWork(Logr::log_t log)
       }
     });
 
+    if (s_cacheSnapshotInterval > 0) {
+      static PeriodicTask cacheSnapshotTask{"CacheSnapshotTask", s_cacheSnapshotInterval};
+      cacheSnapshotTask.runIfDue(now, [&log]() {
+        saveCacheSnapshot(log);
+      });
+    }
+
     static PeriodicTask pruneNSpeedTask{"pruneNSSpeedTask", 30};
     pruneNSpeedTask.runIfDue(now, [now]() {
       SyncRes::pruneNSSpeeds(now.tv_sec - 300);
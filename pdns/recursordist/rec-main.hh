@@ -217,6 +217,7 @@ extern int g_tcpTimeout;
 extern uint16_t g_udpTruncationThreshold;
 extern double g_balancingFactor;
 extern size_t g_maxUDPQueriesPerRound;
+extern size_t g_udpVectorSize;
 extern bool g_useKernelTimestamp;
 extern bool g_allowNoRD;
 extern unsigned int g_maxChainLength;
@@ -2149,6 +2149,20 @@ you can try to enlarge this value or run with fewer threads.
  ''',
     'versionadded': '4.9.0'
     },
+    {
+        'name' : 'shared_lookups',
+        'section' : 'packetcache',
+        'oldname' : 'packetcache-shared-lookups',
+        'type' : LType.Bool,
+        'default' : 'false',
+        'help' : 'Only take a read lock on the packet cache shards when looking up an entry',
+        'doc' : '''
+If set, looking up an entry in the packet cache only takes a read lock on its shard, so that threads getting cache hits from the same shard no longer wait for each other.
+The order in which entries are evicted is then only an approximation of least recently used: a hit marks an entry instead of moving it, and marked entries get a second chance when an entry has to be evicted from a full shard.
+Consider this setting if ``packetcache-contended/packetcache-acquired`` stays high while most queries are answered from the packet cache.
+ ''',
+    'versionadded': '5.4.0'
+    },
     {
         'name' : 'pdns_distributes_queries',
         'section' : 'incoming',
@@ -2346,6 +2360,50 @@ enlarge this value or run with fewer threads.
  ''',
     'versionadded': '4.4.0'
     },
+    {
+        'name' : 'wire_format',
+        'section' : 'recordcache',
+        'oldname' : 'record-cache-wire-format',
+        'type' : LType.Bool,
+        'default' : 'false',
+        'help' : 'Store the records of the record cache in wire format',
+        'doc' : '''
+If set, the records of new record cache entries are stored as a single blob of uncompressed wire format data instead of one decoded object per record.
+This considerably reduces the memory used per entry, especially for small records like ``A`` and ``AAAA``, at the cost of decoding the records each time they are retrieved from the cache.
+The ``cache-bytes`` metric can be used to compare the memory usage of the record cache with and without this setting.
+ ''',
+    'versionadded': '5.4.0'
+    },
+    {
+        'name' : 'snapshot_directory',
+        'section' : 'recordcache',
+        'oldname' : 'record-cache-snapshot-directory',
+        'type' : LType.String,
+        'default' : '',
+        'help' : 'Directory to save a snapshot of the caches to on shutdown and to load it from on startup',
+        'doc' : '''
+If set, the record cache, the negative cache and the aggressive NSEC cache are saved to files named ``record-cache.pb``, ``negative-cache.pb`` and ``aggressive-nsec-cache.pb`` in this directory when the Recursor is stopped with ``rec_control quit-nicely``.
+On startup, these files are loaded before the listening sockets are serviced, so a restarted Recursor can answer from a warm cache right away.
+Entries that have expired since the snapshot was written are not loaded, the others keep their remaining TTL.
+The directory must be writable by the user the Recursor runs as and is relative to the chroot, if any.
+If empty (the default), no snapshot is written or loaded.
+See also :ref:`setting-record-cache-snapshot-interval`.
+ ''',
+    'versionadded': '5.4.0'
+    },
+    {
+        'name' : 'snapshot_interval',
+        'section' : 'recordcache',
+        'oldname' : 'record-cache-snapshot-interval',
+        'type' : LType.Uint64,
+        'default' : '0',
+        'help' : 'Interval in seconds between periodic cache snapshots, 0 to only write a snapshot on shutdown',
+        'doc' : '''
+If :ref:`setting-record-cache-snapshot-directory` is set and this setting is not zero, a snapshot of the caches is also written every this many seconds by the handler thread.
+This limits the loss of cache content when the Recursor is not stopped cleanly.
+ ''',
+    'versionadded': '5.4.0'
+    },
     {
         'name' : 'refresh_on_ttl_perc',
         'section' : 'recordcache',
@@ -2972,6 +3030,23 @@ To know why 1232, see the note at :ref:`setting-edns-outgoing-bufsize`.
  ''',
         'versionchanged': ('4.2.0', 'Before 4.2.0, the default was 1680.')
     },
+    {
+        'name' : 'udp_vector_size',
+        'section' : 'incoming',
+        'type' : LType.Uint64,
+        'default' : '1',
+        'help' : 'Maximum number of UDP queries read with a single recvmmsg() call, 1 means recvmsg() is used instead',
+        'doc' : '''
+When larger than 1, incoming UDP queries are read from the listening sockets in batches of up to this many datagrams using ``recvmmsg()``,
+instead of one ``recvmsg()`` call per query. Queries from a batch that are answered from the packet cache are then sent back
+together with a single ``sendmmsg()`` call per batch. This reduces the number of system calls on busy servers where most queries are packet cache hits.
+The total number of queries processed per round is still capped by :ref:`setting-max-udp-queries-per-round`.
+
+The ``udp-recvmmsg-calls``, ``udp-recvmmsg-queries`` and ``udp-recvmmsg-full-batches`` metrics can be used to see how well the batches are filled.
+This setting is ignored on systems lacking ``recvmmsg()`` or ``sendmmsg()``.
+ ''',
+    'versionadded': '5.4.0'
+    },
     {
         'name' : 'unique_response_tracking',
         'section' : 'nod',
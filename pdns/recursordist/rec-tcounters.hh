@@ -107,6 +107,11 @@ enum class Counter : uint8_t
   cookieRetry,
   cookieProbeSupported,
   cookieProbeUnsupported,
+  udpRecvmmsgCalls,
+  udpRecvmmsgQueries,
+  udpRecvmmsgFullBatches,
+  udpSendmmsgCalls,
+  udpSendmmsgAnswers,
 
   numberOfCounters
 };
@@ -11,6 +11,10 @@
 #include "rec-taskqueue.hh"
 
 unsigned int RecursorPacketCache::s_refresh_ttlperc{0};
+bool RecursorPacketCache::s_sharedLookups{false};
+
+// how many hit entries at the front of the LRU index get a second chance before one is evicted
+static constexpr size_t s_maxSecondChances = 8;
 
 void RecursorPacketCache::setShardSizes(size_t shardSize)
 {
@@ -33,7 +37,7 @@ uint64_t RecursorPacketCache::bytes()
 {
   uint64_t sum = 0;
   for (auto& shard : d_maps) {
-    auto lock = shard.lock();
+    auto lock = shard.read_lock();
     for (const auto& entry : lock->d_map) {
       sum += sizeof(entry) + entry.d_packet.length() + 4;
     }
@@ -44,9 +48,8 @@ uint64_t RecursorPacketCache::bytes()
 uint64_t RecursorPacketCache::getHits()
 {
   uint64_t sum = 0;
-  for (auto& shard : d_maps) {
-    auto lock = shard.lock();
-    sum += lock->d_hits;
+  for (const auto& shard : d_maps) {
+    sum += shard.d_hits;
   }
   return sum;
 }
@@ -54,9 +57,8 @@ uint64_t RecursorPacketCache::getHits()
 uint64_t RecursorPacketCache::getMisses()
 {
   uint64_t sum = 0;
-  for (auto& shard : d_maps) {
-    auto lock = shard.lock();
-    sum += lock->d_misses;
+  for (const auto& shard : d_maps) {
+    sum += shard.d_misses;
   }
   return sum;
 }
@@ -65,10 +67,9 @@ pair<uint64_t, uint64_t> RecursorPacketCache::stats()
 {
   uint64_t contended = 0;
   uint64_t acquired = 0;
-  for (auto& shard : d_maps) {
-    auto content = shard.lock();
-    contended += content->d_contended_count;
-    acquired += content->d_acquired_count;
+  for (const auto& shard : d_maps) {
+    contended += shard.d_contended_count;
+    acquired += shard.d_acquired_count;
   }
   return {contended, acquired};
 }
@@ -115,7 +116,7 @@ bool RecursorPacketCache::qrMatch(const packetCache_t::index<HashTag>::type::ite
   return queryMatches(iter->d_query, queryPacket, qname, s_skipOptions);
 }
 
-bool RecursorPacketCache::checkResponseMatches(MapCombo::LockedContent& shard, std::pair<packetCache_t::index<HashTag>::type::iterator, packetCache_t::index<HashTag>::type::iterator> range, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata)
+bool RecursorPacketCache::checkResponseMatches(MapCombo& map, packetCache_t* lruMap, std::pair<packetCache_t::index<HashTag>::type::iterator, packetCache_t::index<HashTag>::type::iterator> range, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata)
 {
   for (auto iter = range.first; iter != range.second; ++iter) {
     // the possibility is VERY real that we get hits that are not right - birthday paradox
@@ -128,14 +129,14 @@ bool RecursorPacketCache::checkResponseMatches(MapCombo::LockedContent& shard, s
       *age = static_cast<uint32_t>(now - iter->d_creation);
       // we know ttl is > 0
       auto ttl = static_cast<uint32_t>(iter->d_ttd - now);
-      if (s_refresh_ttlperc > 0 && !iter->d_submitted && taskQTypeIsSupported(qtype)) {
+      if (s_refresh_ttlperc > 0 && !iter->d_submitted.test() && taskQTypeIsSupported(qtype)) {
         const dnsheader_aligned header(iter->d_packet.data());
         const auto* headerPtr = header.get();
         if (headerPtr->rcode == RCode::NoError) {
           const uint32_t deadline = iter->getOrigTTL() * s_refresh_ttlperc / 100;
           const bool almostExpired = ttl <= deadline;
-          if (almostExpired) {
-            iter->d_submitted = true;
+          // with shared lookups, another thread might be looking at the same entry
+          if (almostExpired && !iter->d_submitted.testAndSet()) {
             pushAlmostExpiredTask(qname, qtype, iter->d_ttd, Netmask());
           }
         }
@@ -149,8 +150,14 @@ bool RecursorPacketCache::checkResponseMatches(MapCombo::LockedContent& shard, s
         responsePacket->replace(sizeof(dnsheader), wirelength, queryPacket, sizeof(dnsheader), wirelength);
       }
 
-      shard.d_hits++;
-      moveCacheItemToBack<SequencedTag>(shard.d_map, iter);
+      ++map.d_hits;
+      if (lruMap != nullptr) {
+        moveCacheItemToBack<SequencedTag>(*lruMap, iter);
+      }
+      else if (!iter->d_accessed.test()) {
+        // we only hold a read lock, leave the entry where it is and let the eviction give it a second chance
+        iter->d_accessed.set();
+      }
 
       if (pbdata != nullptr) {
         if (iter->d_pbdata) {
@@ -165,47 +172,62 @@ bool RecursorPacketCache::checkResponseMatches(MapCombo::LockedContent& shard, s
     }
     // We used to move the item to the front of "the to be deleted" sequence,
     // but we very likely will update the entry very soon, so leave it
-    shard.d_misses++;
+    ++map.d_misses;
     break;
   }
 
   return false;
 }
 
-bool RecursorPacketCache::getResponsePacket(unsigned int tag, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now,
-                                            std::string* responsePacket, uint32_t* age, vState* valState, uint32_t* qhash, OptPBData* pbdata, bool tcp)
+template <typename Matcher>
+bool RecursorPacketCache::lookup(MapCombo& map, unsigned int tag, uint32_t qhash, bool tcp, const Matcher& matcher)
 {
-  *qhash = canHashPacket(queryPacket, s_skipOptions);
-  auto& map = getMap(tag, *qhash, tcp);
+  if (s_sharedLookups) {
+    auto shard = map.read_lock();
+    const auto& idx = shard->d_map.get<HashTag>();
+    auto range = idx.equal_range(std::tie(tag, qhash, tcp));
+
+    if (range.first == range.second) {
+      ++map.d_misses;
+      return false;
+    }
+
+    return matcher(range, nullptr);
+  }
+
   auto shard = map.lock();
   const auto& idx = shard->d_map.get<HashTag>();
-  auto range = idx.equal_range(std::tie(tag, *qhash, tcp));
+  auto range = idx.equal_range(std::tie(tag, qhash, tcp));
 
   if (range.first == range.second) {
-    shard->d_misses++;
+    ++map.d_misses;
     return false;
   }
 
-  return checkResponseMatches(*shard, range, queryPacket, qname, qtype, qclass, now, responsePacket, age, valState, pbdata);
+  return matcher(range, &shard->d_map);
 }
 
-bool RecursorPacketCache::getResponsePacket(unsigned int tag, const std::string& queryPacket, DNSName& qname, uint16_t* qtype, uint16_t* qclass, time_t now,
+bool RecursorPacketCache::getResponsePacket(unsigned int tag, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now,
                                             std::string* responsePacket, uint32_t* age, vState* valState, uint32_t* qhash, OptPBData* pbdata, bool tcp)
 {
   *qhash = canHashPacket(queryPacket, s_skipOptions);
   auto& map = getMap(tag, *qhash, tcp);
-  auto shard = map.lock();
-  const auto& idx = shard->d_map.get<HashTag>();
-  auto range = idx.equal_range(std::tie(tag, *qhash, tcp));
 
-  if (range.first == range.second) {
-    shard->d_misses++;
-    return false;
-  }
+  return lookup(map, tag, *qhash, tcp, [&](const auto& range, packetCache_t* lruMap) {
+    return checkResponseMatches(map, lruMap, range, queryPacket, qname, qtype, qclass, now, responsePacket, age, valState, pbdata);
+  });
+}
 
-  qname = DNSName(queryPacket.c_str(), static_cast<int>(queryPacket.length()), sizeof(dnsheader), false, qtype, qclass);
+bool RecursorPacketCache::getResponsePacket(unsigned int tag, const std::string& queryPacket, DNSName& qname, uint16_t* qtype, uint16_t* qclass, time_t now,
+                                            std::string* responsePacket, uint32_t* age, vState* valState, uint32_t* qhash, OptPBData* pbdata, bool tcp)
+{
+  *qhash = canHashPacket(queryPacket, s_skipOptions);
+  auto& map = getMap(tag, *qhash, tcp);
 
-  return checkResponseMatches(*shard, range, queryPacket, qname, *qtype, *qclass, now, responsePacket, age, valState, pbdata);
+  return lookup(map, tag, *qhash, tcp, [&](const auto& range, packetCache_t* lruMap) {
+    qname = DNSName(queryPacket.c_str(), static_cast<int>(queryPacket.length()), sizeof(dnsheader), false, qtype, qclass);
+    return checkResponseMatches(map, lruMap, range, queryPacket, qname, *qtype, *qclass, now, responsePacket, age, valState, pbdata);
+  });
 }
 
 void RecursorPacketCache::insertResponsePacket(unsigned int tag, uint32_t qhash, std::string&& query, const DNSName& qname, uint16_t qtype, uint16_t qclass, std::string&& responsePacket, time_t now, uint32_t ttl, const vState& valState, OptPBData&& pbdata, bool tcp)
@@ -227,7 +249,7 @@ void RecursorPacketCache::insertResponsePacket(unsigned int tag, uint32_t qhash,
     iter->d_ttd = now + ttl;
     iter->d_creation = now;
     iter->d_vstate = valState;
-    iter->d_submitted = false;
+    iter->d_submitted.clear();
     if (pbdata) {
       iter->d_pbdata = std::move(*pbdata);
     }
@@ -245,6 +267,13 @@ void RecursorPacketCache::insertResponsePacket(unsigned int tag, uint32_t qhash,
 
   if (shard->d_map.size() > shard->d_shardSize) {
     auto& seq_idx = shard->d_map.get<SequencedTag>();
+    if (s_sharedLookups) {
+      // lookups did not reorder the LRU index, so move the entries that have been hit since we last looked at them to the back
+      for (size_t count = 0; count < s_maxSecondChances && seq_idx.begin()->d_accessed.test(); ++count) {
+        seq_idx.begin()->d_accessed.clear();
+        seq_idx.relocate(seq_idx.end(), seq_idx.begin());
+      }
+    }
     seq_idx.erase(seq_idx.begin());
     map.decEntriesCount();
   }
@@ -46,6 +46,9 @@ class RecursorPacketCache : public PacketCache
 {
 public:
   static unsigned int s_refresh_ttlperc;
+  // If set, lookups only take a read lock on their shard and do not reorder the LRU index,
+  // hit entries are marked instead and get a second chance when the shard is full.
+  static bool s_sharedLookups;
 
   struct PBData
   {
@@ -101,6 +104,43 @@ public:
   [[nodiscard]] pair<uint64_t, uint64_t> stats();
 
 private:
+  // A flag that lookups can set while only holding a read lock on the shard
+  struct SharedFlag
+  {
+    SharedFlag() = default;
+    SharedFlag(const SharedFlag& rhs) :
+      d_value(rhs.test())
+    {
+    }
+    SharedFlag& operator=(const SharedFlag& rhs)
+    {
+      d_value.store(rhs.test(), std::memory_order_relaxed);
+      return *this;
+    }
+    ~SharedFlag() = default;
+
+    [[nodiscard]] bool test() const
+    {
+      return d_value.load(std::memory_order_relaxed);
+    }
+    void set() const
+    {
+      d_value.store(true, std::memory_order_relaxed);
+    }
+    // returns the previous value
+    bool testAndSet() const
+    {
+      return d_value.exchange(true, std::memory_order_relaxed);
+    }
+    void clear() const
+    {
+      d_value.store(false, std::memory_order_relaxed);
+    }
+
+  private:
+    mutable std::atomic<bool> d_value{false};
+  };
+
   struct Entry
   {
     Entry(DNSName&& qname, uint16_t qtype, uint16_t qclass, std::string&& packet, std::string&& query, bool tcp,
@@ -131,7 +171,8 @@ private:
     uint16_t d_type;
     uint16_t d_class;
     mutable vState d_vstate;
-    mutable bool d_submitted{false}; // whether this entry has been queued for refetch
+    SharedFlag d_submitted; // whether this entry has been queued for refetch
+    SharedFlag d_accessed; // whether this entry has been hit by a shared lookup since it was last considered for eviction
     bool d_tcp; // whether this entry was created from a TCP query
     inline bool operator<(const struct Entry& rhs) const;
 
@@ -177,22 +218,29 @@ private:
     {
       packetCache_t d_map;
       size_t d_shardSize{0};
-      uint64_t d_hits{0};
-      uint64_t d_misses{0};
-      uint64_t d_contended_count{0};
-      uint64_t d_acquired_count{0};
       void invalidate() {}
       void preRemoval(const Entry& /* entry */) {}
     };
 
-    LockGuardedTryHolder<MapCombo::LockedContent> lock()
+    SharedLockGuardedTryHolder<MapCombo::LockedContent> lock()
     {
-      auto locked = d_content.try_lock();
+      auto locked = d_content.try_write_lock();
       if (!locked.owns_lock()) {
         locked.lock();
-        ++locked->d_contended_count;
+        ++d_contended_count;
       }
-      ++locked->d_acquired_count;
+      ++d_acquired_count;
+      return locked;
+    }
+
+    SharedLockGuardedNonExclusiveTryHolder<MapCombo::LockedContent> read_lock()
+    {
+      auto locked = d_content.try_read_lock();
+      if (!locked.owns_lock()) {
+        locked.lock();
+        ++d_contended_count;
+      }
+      ++d_acquired_count;
       return locked;
     }
 
@@ -211,8 +259,14 @@ private:
       --d_entriesCount;
     }
 
+    // these are updated by lookups holding only a read lock
+    pdns::stat_t d_hits{0};
+    pdns::stat_t d_misses{0};
+    pdns::stat_t d_contended_count{0};
+    pdns::stat_t d_acquired_count{0};
+
   private:
-    LockGuarded<LockedContent> d_content;
+    SharedLockGuarded<LockedContent> d_content;
     pdns::stat_t d_entriesCount{0};
   };
 
@@ -238,7 +292,9 @@ private:
   }
 
   static bool qrMatch(const packetCache_t::index<HashTag>::type::iterator& iter, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass);
-  static bool checkResponseMatches(MapCombo::LockedContent& shard, std::pair<packetCache_t::index<HashTag>::type::iterator, packetCache_t::index<HashTag>::type::iterator> range, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata);
+  template <typename Matcher>
+  static bool lookup(MapCombo& map, unsigned int tag, uint32_t qhash, bool tcp, const Matcher& matcher);
+  static bool checkResponseMatches(MapCombo& map, packetCache_t* lruMap, std::pair<packetCache_t::index<HashTag>::type::iterator, packetCache_t::index<HashTag>::type::iterator> range, const std::string& queryPacket, const DNSName& qname, uint16_t qtype, uint16_t qclass, time_t now, std::string* responsePacket, uint32_t* age, vState* valState, OptPBData* pbdata);
 
   void setShardSizes(size_t shardSize);
 };
@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include <cinttypes>
+#include <thread>
 #include <protozero/pbf_builder.hpp>
 #include <protozero/pbf_message.hpp>
 
@@ -76,6 +77,7 @@
 uint16_t MemRecursorCache::s_maxServedStaleExtensions;
 uint16_t MemRecursorCache::s_maxRRSetSize = 256;
 bool MemRecursorCache::s_limitQTypeAny = true;
+bool MemRecursorCache::s_storeWireFormat = false;
 
 const MemRecursorCache::AuthRecs MemRecursorCache::s_emptyAuthRecs = std::make_shared<MemRecursorCache::AuthRecsVec>();
 const MemRecursorCache::SigRecs MemRecursorCache::s_emptySigRecs = std::make_shared<MemRecursorCache::SigRecsVec>();
@@ -88,6 +90,7 @@ void MemRecursorCache::resetStaticsForTests()
   SyncRes::s_locked_ttlperc = 0;
   SyncRes::s_minimumTTL = 0;
   s_maxRRSetSize = 256;
+  s_storeWireFormat = false;
   s_limitQTypeAny = true;
 }
 
@@ -158,11 +161,63 @@ size_t MemRecursorCache::CacheEntry::sizeEstimate() const
   for (const auto& record : d_records) {
     ret += record->sizeEstimate();
   }
+  ret += d_wireRecords.size();
   ret += authRecsSizeEstimate();
   ret += sigRecsSizeEstimate();
   return ret;
 }
 
+void MemRecursorCache::CacheEntry::addWireRecord(const std::string& rdata)
+{
+  // the rdata of a record cannot be larger than 65535 bytes
+  const auto length = static_cast<uint16_t>(rdata.size());
+  d_wireRecords.push_back(static_cast<char>(length >> 8));
+  d_wireRecords.push_back(static_cast<char>(length & 0xff));
+  d_wireRecords.append(rdata);
+  ++d_wireRecordsCount;
+}
+
+MemRecursorCache::CacheEntry::records_t MemRecursorCache::CacheEntry::getRecords() const
+{
+  if (!isWireFormat()) {
+    return d_records;
+  }
+
+  /* Build a response holding the whole RRSet, the owner of each record being a pointer
+     to the question name, and let MOADNSParser decode it */
+  const auto& qnameStorage = d_qname.getStorage();
+  constexpr size_t recordHeaderSize = 10; // compressed owner, type, class and TTL
+  std::string packet;
+  packet.reserve(sizeof(dnsheader) + qnameStorage.size() + 4 + d_wireRecords.size() + (recordHeaderSize * d_wireRecordsCount));
+
+  dnsheader header{};
+  header.qr = 1;
+  header.qdcount = htons(1);
+  header.ancount = htons(d_wireRecordsCount);
+  packet.append(reinterpret_cast<const char*>(&header), sizeof(header)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+  packet.append(qnameStorage);
+  const uint16_t qtype = d_qtype.getCode();
+  const std::array<char, 4> question{static_cast<char>(qtype >> 8), static_cast<char>(qtype & 0xff), 0, QClass::IN};
+  packet.append(question.data(), question.size());
+  const std::array<char, recordHeaderSize> recordHeader{'\xc0', '\x0c', question.at(0), question.at(1), 0, QClass::IN, 0, 0, 0, 0};
+
+  size_t pos = 0;
+  for (uint16_t idx = 0; idx < d_wireRecordsCount && pos + 2 <= d_wireRecords.size(); idx++) {
+    const size_t length = (static_cast<uint8_t>(d_wireRecords.at(pos)) << 8) + static_cast<uint8_t>(d_wireRecords.at(pos + 1));
+    packet.append(recordHeader.data(), recordHeader.size());
+    packet.append(d_wireRecords, pos, 2 + length);
+    pos += 2 + length;
+  }
+
+  MOADNSParser parser(false, packet);
+  records_t records;
+  records.reserve(parser.d_answers.size());
+  for (const auto& answer : parser.d_answers) {
+    records.push_back(answer.getContent());
+  }
+  return records;
+}
+
 // this function is too slow to poll!
 size_t MemRecursorCache::bytes()
 {
@@ -229,13 +284,15 @@ time_t MemRecursorCache::handleHit(time_t now, MapCombo::LockedContent& content,
   }
 
   if (res != nullptr) {
-    if (s_limitQTypeAny && res->size() + entry->d_records.size() > s_maxRRSetSize) {
+    if (s_limitQTypeAny && res->size() + entry->recordsCount() > s_maxRRSetSize) {
       throw ImmediateServFailException("too many records in result");
     }
 
-    res->reserve(res->size() + entry->d_records.size());
+    res->reserve(res->size() + entry->recordsCount());
 
-    for (const auto& record : entry->d_records) {
+    // wire format entries are only decoded here, when the records are actually needed
+    const auto decoded = entry->isWireFormat() ? entry->getRecords() : CacheEntry::records_t{};
+    for (const auto& record : entry->isWireFormat() ? decoded : entry->d_records) {
       DNSRecord result;
       result.d_name = qname;
       result.d_type = entry->d_qtype;
@@ -724,6 +781,8 @@ void MemRecursorCache::replace(time_t now, const DNSName& qname, const QType qty
     cacheEntry.d_authorityRecs = nullptr;
   }
   cacheEntry.d_records.clear();
+  cacheEntry.d_wireRecords.clear();
+  cacheEntry.d_wireRecordsCount = 0;
   cacheEntry.d_authZone = authZone;
   if (extra) {
     cacheEntry.d_from = extra->d_address;
@@ -742,7 +801,9 @@ void MemRecursorCache::replace(time_t now, const DNSName& qname, const QType qty
     toStore = 1; // record cache does not like empty RRSets
     cacheEntry.d_tooBig = true;
   }
-  cacheEntry.d_records.reserve(toStore);
+  if (!s_storeWireFormat) {
+    cacheEntry.d_records.reserve(toStore);
+  }
   for (const auto& record : content) {
     /* Yes, we have altered the d_ttl value by adding time(nullptr) to it
        prior to calling this function, so the TTL actually holds a TTD. */
@@ -756,7 +817,12 @@ void MemRecursorCache::replace(time_t now, const DNSName& qname, const QType qty
     if (cacheEntry.d_orig_ttl < SyncRes::s_minimumTTL || cacheEntry.d_orig_ttl > SyncRes::s_maxcachettl) {
       cacheEntry.d_orig_ttl = SyncRes::s_minimumTTL;
     }
-    cacheEntry.d_records.push_back(record.getContent());
+    if (s_storeWireFormat) {
+      cacheEntry.addWireRecord(record.getContent()->serialize(qname, true));
+    }
+    else {
+      cacheEntry.d_records.push_back(record.getContent());
+    }
     if (--toStore == 0) {
       break;
     }
@@ -947,7 +1013,14 @@ uint64_t MemRecursorCache::doDump(int fileDesc, size_t maxCacheEntries)
     const auto& sidx = lockedShard->d_map.get<SequencedTag>();
     time_t now = time(nullptr);
     for (const auto& recordSet : sidx) {
-      for (const auto& record : recordSet.d_records) {
+      CacheEntry::records_t decoded;
+      try {
+        decoded = recordSet.getRecords();
+      }
+      catch (...) {
+        fprintf(filePtr.get(), "; error decoding '%s'\n", recordSet.d_qname.empty() ? "EMPTY" : recordSet.d_qname.toString().c_str());
+      }
+      for (const auto& record : decoded) {
         count++;
         try {
           fprintf(filePtr.get(), "%s %" PRIu32 " %" PRId64 " IN %s %s ; (%s) auth=%i zone=%s from=%s nm=%s rtag=%s ss=%hd%s%s\n", recordSet.d_qname.toString().c_str(), recordSet.d_orig_ttl, static_cast<int64_t>(recordSet.d_ttd - now), recordSet.d_qtype.toString().c_str(), record->getZoneRepresentation().c_str(), vStateToString(recordSet.d_state).c_str(), static_cast<int>(recordSet.d_auth), recordSet.d_authZone.toLogString().c_str(), recordSet.d_from.toString().c_str(), recordSet.d_netmask.empty() ? "" : recordSet.d_netmask.toString().c_str(), recordSet.d_rtag.c_str(), recordSet.d_servedStale, recordSet.d_tooBig ? " (too big!)" : "", recordSet.d_tcp ? " tcp" : "");
@@ -1027,6 +1100,16 @@ void MemRecursorCache::getRecordSet(T& message, U recordSet)
   // Two fields below must come before the other fields
   message.add_bytes(PBCacheEntry::required_bytes_name, recordSet->d_qname.toString());
   message.add_uint32(PBCacheEntry::required_uint32_qtype, recordSet->d_qtype);
+  if (recordSet->isWireFormat()) {
+    // the stored rdata is already what serialize() would produce
+    size_t pos = 0;
+    const auto& wire = recordSet->d_wireRecords;
+    while (pos + 2 <= wire.size()) {
+      const size_t length = (static_cast<uint8_t>(wire.at(pos)) << 8) + static_cast<uint8_t>(wire.at(pos + 1));
+      message.add_bytes(PBCacheEntry::repeated_bytes_record, wire.data() + pos + 2, length); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      pos += 2 + length;
+    }
+  }
   for (const auto& record : recordSet->d_records) {
     message.add_bytes(PBCacheEntry::repeated_bytes_record, record->serialize(recordSet->d_qname, true));
   }
@@ -1148,7 +1231,7 @@ static void putAuthRecord(protozero::pbf_message<PBCacheEntry>& message, const D
 }
 
 template <typename T>
-bool MemRecursorCache::putRecordSet(T& message)
+bool MemRecursorCache::putRecordSet(T& message, time_t now)
 {
   AuthRecsVec authRecs;
   SigRecsVec sigRecs;
@@ -1156,8 +1239,13 @@ bool MemRecursorCache::putRecordSet(T& message)
   while (message.next()) {
     switch (message.tag()) {
     case PBCacheEntry::repeated_bytes_record: {
-      auto ptr = DNSRecordContent::deserialize(cacheEntry.d_qname, cacheEntry.d_qtype, message.get_bytes());
-      cacheEntry.d_records.emplace_back(ptr);
+      if (s_storeWireFormat) {
+        cacheEntry.addWireRecord(message.get_bytes());
+      }
+      else {
+        auto ptr = DNSRecordContent::deserialize(cacheEntry.d_qname, cacheEntry.d_qtype, message.get_bytes());
+        cacheEntry.d_records.emplace_back(ptr);
+      }
       break;
     }
     case PBCacheEntry::repeated_bytes_sig: {
@@ -1221,17 +1309,27 @@ bool MemRecursorCache::putRecordSet(T& message)
   if (!sigRecs.empty()) {
     cacheEntry.d_signatures = std::make_shared<const SigRecsVec>(std::move(sigRecs));
   }
+  if (cacheEntry.isStale(now)) {
+    return false;
+  }
+  if (cacheEntry.isWireFormat()) {
+    // decode once, so that a malformed record is rejected now instead of on the first hit
+    (void)cacheEntry.getRecords();
+  }
   return replace(std::move(cacheEntry));
 }
 
-size_t MemRecursorCache::putRecordSets(const std::string& pbuf)
+size_t MemRecursorCache::putRecordSets(const std::string& pbuf, size_t threads)
 {
   auto log = g_slog->withName("recordcache")->withValues("size", Logging::Loggable(pbuf.size()));
   log->info(Logr::Debug, "Processing cache dump");
 
   protozero::pbf_message<PBCacheDump> full(pbuf);
+  const time_t now = time(nullptr);
   size_t count = 0;
   size_t inserted = 0;
+  // only used when inserting in parallel, the entries are collected first
+  std::vector<protozero::data_view> entries;
   try {
     bool protocolVersionSeen = false;
     bool typeSeen = false;
@@ -1273,8 +1371,12 @@ size_t MemRecursorCache::putRecordSets(const std::string& pbuf)
         if (!protocolVersionSeen || !typeSeen) {
           throw std::runtime_error("Required field missing");
         }
+        if (threads > 1) {
+          entries.push_back(full.get_view());
+          break;
+        }
         protozero::pbf_message<PBCacheEntry> message = full.get_message();
-        if (putRecordSet(message)) {
+        if (putRecordSet(message, now)) {
           ++inserted;
         }
         ++count;
@@ -1282,6 +1384,35 @@ size_t MemRecursorCache::putRecordSets(const std::string& pbuf)
       }
       }
     }
+    if (!entries.empty()) {
+      count = entries.size();
+      std::atomic<size_t> parallelInserted{0};
+      std::vector<std::thread> workers;
+      threads = std::min(threads, entries.size());
+      workers.reserve(threads);
+      for (size_t worker = 0; worker < threads; ++worker) {
+        // each thread takes every n-th entry, as the entries of a shard are next to each other in the dump
+        workers.emplace_back([this, &entries, &parallelInserted, worker, threads, now, &log]() {
+          size_t mine = 0;
+          for (size_t idx = worker; idx < entries.size(); idx += threads) {
+            try {
+              protozero::pbf_message<PBCacheEntry> message(entries.at(idx));
+              if (putRecordSet(message, now)) {
+                ++mine;
+              }
+            }
+            catch (const std::exception& e) {
+              log->error(Logr::Error, e.what(), "Exception processing cache dump entry");
+            }
+          }
+          parallelInserted += mine;
+        });
+      }
+      for (auto& worker : workers) {
+        worker.join();
+      }
+      inserted = parallelInserted;
+    }
     log->info(Logr::Info, "Processed cache dump", "processed", Logging::Loggable(count), "inserted", Logging::Loggable(inserted));
     return inserted;
   }
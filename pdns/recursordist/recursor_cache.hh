@@ -56,6 +56,9 @@ public:
   // but mark it as too big. Subsequent gets will cause an ImmediateServFailException to be thrown.
   static uint16_t s_maxRRSetSize;
   static bool s_limitQTypeAny;
+  // Store the records of new entries as a single uncompressed wire format blob instead of a vector
+  // of DNSRecordContent objects. They are only decoded when get() is asked for the records.
+  static bool s_storeWireFormat;
 
   [[nodiscard]] size_t size() const;
   [[nodiscard]] size_t bytes();
@@ -63,7 +66,8 @@ public:
   [[nodiscard]] size_t ecsIndexSize();
 
   size_t getRecordSets(size_t perShard, size_t maxSize, std::string& ret);
-  size_t putRecordSets(const std::string& pbuf);
+  // Entries that are already stale are skipped. With more than one thread, the entries are inserted in parallel
+  size_t putRecordSets(const std::string& pbuf, size_t threads = 1);
 
   using OptTag = std::string;
   const static OptTag NOTAG;
@@ -171,10 +175,22 @@ private:
     [[nodiscard]] size_t authRecsSizeEstimate() const;
     [[nodiscard]] size_t sigRecsSizeEstimate() const;
 
+    [[nodiscard]] bool isWireFormat() const
+    {
+      return d_wireRecordsCount > 0;
+    }
+    [[nodiscard]] size_t recordsCount() const
+    {
+      return isWireFormat() ? d_wireRecordsCount : d_records.size();
+    }
+    void addWireRecord(const std::string& rdata);
+    [[nodiscard]] records_t getRecords() const;
+
     OptTag d_rtag; // 40 (sizes for typical 64 bit system)
     Netmask d_netmask; // 36
     ComboAddress d_from; // 28
     records_t d_records; // 24
+    std::string d_wireRecords; // 32, each record is stored as a 16-bit length followed by the uncompressed rdata
     DNSName d_qname; // 24
     DNSName d_authZone; // 24
     SigRecs d_signatures; // 16
@@ -182,6 +198,7 @@ private:
     mutable time_t d_ttd{0}; // 8
     uint32_t d_orig_ttl{0}; // 4
     mutable uint16_t d_servedStale{0}; // 2
+    uint16_t d_wireRecordsCount{0}; // 2
     QType d_qtype; // 2
     mutable vState d_state{vState::Indeterminate}; // 1
     bool d_auth; // 1
@@ -193,7 +210,7 @@ private:
   bool replace(CacheEntry&& entry);
   // Using templates to avoid exposing protozero types in this header file
   template <typename T>
-  bool putRecordSet(T&);
+  bool putRecordSet(T&, time_t now);
   template <typename T, typename U>
   void getRecordSet(T&, U);
 
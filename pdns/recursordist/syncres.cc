@@ -46,6 +46,46 @@
 rec::GlobalCounters g_Counters;
 thread_local rec::TCounters t_Counters(g_Counters);
 
+// The per-server tables below are consulted and updated by all worker threads, several times per outgoing query.
+// To keep the threads from contending on a single mutex, each table is split into shards with their own lock,
+// the shard being selected by hashing the server address or name.
+template <typename T, typename Key, typename Hash>
+class ShardedLockGuarded
+{
+public:
+  static constexpr size_t s_numberOfShards = 64;
+
+  LockGuardedHolder<T> lock(const Key& key)
+  {
+    return d_shards.at(Hash()(key) % d_shards.size()).lock();
+  }
+
+  // Calls func on each shard in turn, only holding the lock of the shard being visited
+  template <typename F>
+  void forEachShard(F func)
+  {
+    for (auto& shard : d_shards) {
+      auto lock = shard.lock();
+      func(*lock);
+    }
+  }
+
+  [[nodiscard]] size_t size()
+  {
+    size_t count = 0;
+    forEachShard([&count](const T& shard) { count += shard.size(); });
+    return count;
+  }
+
+  void clear()
+  {
+    forEachShard([](T& shard) { shard.clear(); });
+  }
+
+private:
+  std::array<LockGuarded<T>, s_numberOfShards> d_shards;
+};
+
 template <class T>
 class fails_t : public boost::noncopyable
 {
@@ -118,18 +158,35 @@ private:
   cont_t d_cont;
 };
 
-static LockGuarded<nsspeeds_t> s_nsSpeeds;
+static ShardedLockGuarded<nsspeeds_t, DNSName, std::hash<DNSName>> s_nsSpeeds;
+
+// Get a copy of all shards, to avoid holding the locks while doing I/O
+static nsspeeds_t getNSSpeedsCopy()
+{
+  nsspeeds_t copy;
+  s_nsSpeeds.forEachShard([&copy](const nsspeeds_t& shard) {
+    copy.insert(shard.begin(), shard.end());
+  });
+  return copy;
+}
 
 size_t SyncRes::getNSSpeedTable(size_t maxSize, std::string& ret)
 {
-  const auto copy = *s_nsSpeeds.lock();
+  const auto copy = getNSSpeedsCopy();
   return copy.getPB(s_serverID, maxSize, ret);
 }
 
 size_t SyncRes::putIntoNSSpeedTable(const std::string& ret)
 {
-  auto lock = s_nsSpeeds.lock();
-  return lock->putPB(time(nullptr) - 300, ret);
+  nsspeeds_t loaded;
+  loaded.putPB(time(nullptr) - 300, ret);
+  size_t inserted = 0;
+  for (const auto& entry : loaded) {
+    if (s_nsSpeeds.lock(entry.d_name)->insert(entry).second) {
+      ++inserted;
+    }
+  }
+  return inserted;
 }
 
 class Throttle
@@ -244,7 +301,7 @@ private:
   cont_t d_cont;
 };
 
-static LockGuarded<Throttle> s_throttle;
+static ShardedLockGuarded<Throttle, ComboAddress, ComboAddress::addressOnlyHash> s_throttle;
 
 struct SavedParentEntry
 {
@@ -296,8 +353,8 @@ SuffixMatchNode SyncRes::s_ednsdomains;
 EDNSSubnetOpts SyncRes::s_ecsScopeZero;
 string SyncRes::s_serverID;
 SyncRes::LogMode SyncRes::s_lm;
-static LockGuarded<fails_t<ComboAddress>> s_fails;
-static LockGuarded<fails_t<DNSName>> s_nonresolving;
+static ShardedLockGuarded<fails_t<ComboAddress>, ComboAddress, ComboAddress::addressOnlyHash> s_fails;
+static ShardedLockGuarded<fails_t<DNSName>, DNSName, std::hash<DNSName>> s_nonresolving;
 
 struct DoTStatus
 {
@@ -1043,11 +1100,11 @@ struct ednsstatus_t : public multi_index_container<SyncRes::EDNSStatus,
   static const time_t Expire = 7200;
 };
 
-static LockGuarded<ednsstatus_t> s_ednsstatus;
+static ShardedLockGuarded<ednsstatus_t, ComboAddress, ComboAddress::addressOnlyHash> s_ednsstatus;
 
 SyncRes::EDNSStatus::EDNSMode SyncRes::getEDNSStatus(const ComboAddress& server)
 {
-  auto lock = s_ednsstatus.lock();
+  auto lock = s_ednsstatus.lock(server);
   const auto& iter = lock->find(server);
   if (iter == lock->end()) {
     return EDNSStatus::EDNSOK;
@@ -1057,17 +1114,17 @@ SyncRes::EDNSStatus::EDNSMode SyncRes::getEDNSStatus(const ComboAddress& server)
 
 uint64_t SyncRes::getEDNSStatusesSize()
 {
-  return s_ednsstatus.lock()->size();
+  return s_ednsstatus.size();
 }
 
 void SyncRes::clearEDNSStatuses()
 {
-  s_ednsstatus.lock()->clear();
+  s_ednsstatus.clear();
 }
 
 void SyncRes::pruneEDNSStatuses(time_t cutoff)
 {
-  s_ednsstatus.lock()->prune(cutoff);
+  s_ednsstatus.forEachShard([cutoff](ednsstatus_t& shard) { shard.prune(cutoff); });
 }
 
 uint64_t SyncRes::doEDNSDump(int fileDesc)
@@ -1084,7 +1141,8 @@ uint64_t SyncRes::doEDNSDump(int fileDesc)
   uint64_t count = 0;
 
   fprintf(filePtr.get(), "; edns dump follows\n; ip\tstatus\tttd\n");
-  const auto copy = s_ednsstatus.lock()->getMap();
+  ednsstatus_t copy;
+  s_ednsstatus.forEachShard([&copy](const ednsstatus_t& shard) { copy.insert(shard.begin(), shard.end()); });
   for (const auto& eds : copy) {
     count++;
     timebuf_t tmp;
@@ -1095,30 +1153,31 @@ uint64_t SyncRes::doEDNSDump(int fileDesc)
 
 void SyncRes::pruneNSSpeeds(time_t limit)
 {
-  auto lock = s_nsSpeeds.lock();
-  auto& ind = lock->get<timeval>();
-  ind.erase(ind.begin(), ind.upper_bound(timeval{limit, 0}));
+  s_nsSpeeds.forEachShard([limit](nsspeeds_t& shard) {
+    auto& ind = shard.get<timeval>();
+    ind.erase(ind.begin(), ind.upper_bound(timeval{limit, 0}));
+  });
 }
 
 uint64_t SyncRes::getNSSpeedsSize()
 {
-  return s_nsSpeeds.lock()->size();
+  return s_nsSpeeds.size();
 }
 
 void SyncRes::submitNSSpeed(const DNSName& server, const ComboAddress& address, int usec, const struct timeval& now)
 {
-  auto lock = s_nsSpeeds.lock();
+  auto lock = s_nsSpeeds.lock(server);
   lock->find_or_enter(server, now).submit(address, usec, now);
 }
 
 void SyncRes::clearNSSpeeds()
 {
-  s_nsSpeeds.lock()->clear();
+  s_nsSpeeds.clear();
 }
 
 float SyncRes::getNSSpeed(const DNSName& server, const ComboAddress& address)
 {
-  auto lock = s_nsSpeeds.lock();
+  auto lock = s_nsSpeeds.lock(server);
   return lock->find_or_enter(server).d_collection[address].peek();
 }
 
@@ -1137,8 +1196,9 @@ uint64_t SyncRes::doDumpNSSpeeds(int fileDesc)
   fprintf(filePtr.get(), "; nsspeed dump follows\n; nsname\ttimestamp\t[ip/decaying-ms/last-ms...]\n");
   uint64_t count = 0;
 
-  // Create a copy to avoid holding the lock while doing I/O
-  for (const auto& iter : *s_nsSpeeds.lock()) {
+  // Create a copy to avoid holding the locks while doing I/O
+  const auto copy = getNSSpeedsCopy();
+  for (const auto& iter : copy) {
     count++;
 
     // an <empty> can appear hear in case of authoritative (hosted) zones
@@ -1156,27 +1216,27 @@ uint64_t SyncRes::doDumpNSSpeeds(int fileDesc)
 
 uint64_t SyncRes::getThrottledServersSize()
 {
-  return s_throttle.lock()->size();
+  return s_throttle.size();
 }
 
 void SyncRes::pruneThrottledServers(time_t now)
 {
-  s_throttle.lock()->prune(now);
+  s_throttle.forEachShard([now](Throttle& shard) { shard.prune(now); });
 }
 
 void SyncRes::clearThrottle()
 {
-  s_throttle.lock()->clear();
+  s_throttle.clear();
 }
 
 bool SyncRes::isThrottled(time_t now, const ComboAddress& server, const DNSName& target, QType qtype)
 {
-  return s_throttle.lock()->shouldThrottle(now, std::tuple(server, target, qtype));
+  return s_throttle.lock(server)->shouldThrottle(now, std::tuple(server, target, qtype));
 }
 
 bool SyncRes::isThrottled(time_t now, const ComboAddress& server)
 {
-  auto throttled = s_throttle.lock()->shouldThrottle(now, std::tuple(server, g_rootdnsname, 0));
+  auto throttled = s_throttle.lock(server)->shouldThrottle(now, std::tuple(server, g_rootdnsname, 0));
   if (throttled) {
     // Give fully throttled servers a chance to be used, to avoid having one bad zone spoil the NS
     // record for others using the same NS. If the NS answers, it will be unThrottled immediately
@@ -1189,18 +1249,19 @@ bool SyncRes::isThrottled(time_t now, const ComboAddress& server)
 
 void SyncRes::unThrottle(const ComboAddress& server, const DNSName& name, QType qtype)
 {
-  s_throttle.lock()->clear(std::tuple(server, g_rootdnsname, 0));
-  s_throttle.lock()->clear(std::tuple(server, name, qtype));
+  auto lock = s_throttle.lock(server);
+  lock->clear(std::tuple(server, g_rootdnsname, 0));
+  lock->clear(std::tuple(server, name, qtype));
 }
 
 void SyncRes::doThrottle(time_t now, const ComboAddress& server, time_t duration, unsigned int tries, Throttle::Reason reason)
 {
-  s_throttle.lock()->throttle(now, std::tuple(server, g_rootdnsname, 0), duration, tries, reason);
+  s_throttle.lock(server)->throttle(now, std::tuple(server, g_rootdnsname, 0), duration, tries, reason);
 }
 
 void SyncRes::doThrottle(time_t now, const ComboAddress& server, const DNSName& name, QType qtype, time_t duration, unsigned int tries, Throttle::Reason reason)
 {
-  s_throttle.lock()->throttle(now, std::tuple(server, name, qtype), duration, tries, reason);
+  s_throttle.lock(server)->throttle(now, std::tuple(server, name, qtype), duration, tries, reason);
 }
 
 uint64_t SyncRes::doDumpThrottleMap(int fileDesc)
@@ -1218,8 +1279,12 @@ uint64_t SyncRes::doDumpThrottleMap(int fileDesc)
   fprintf(filePtr.get(), "; remote IP\tqname\tqtype\tcount\tttd\treason\n");
   uint64_t count = 0;
 
-  // Get a copy to avoid holding the lock while doing I/O
-  const auto throttleMap = s_throttle.lock()->getThrottleMap();
+  // Get a copy to avoid holding the locks while doing I/O
+  Throttle::cont_t throttleMap;
+  s_throttle.forEachShard([&throttleMap](const Throttle& shard) {
+    const auto copy = shard.getThrottleMap();
+    throttleMap.insert(copy.begin(), copy.end());
+  });
   for (const auto& iter : throttleMap) {
     count++;
     timebuf_t tmp;
@@ -1232,22 +1297,22 @@ uint64_t SyncRes::doDumpThrottleMap(int fileDesc)
 
 uint64_t SyncRes::getFailedServersSize()
 {
-  return s_fails.lock()->size();
+  return s_fails.size();
 }
 
 void SyncRes::clearFailedServers()
 {
-  s_fails.lock()->clear();
+  s_fails.clear();
 }
 
 void SyncRes::pruneFailedServers(time_t cutoff)
 {
-  s_fails.lock()->prune(cutoff);
+  s_fails.forEachShard([cutoff](fails_t<ComboAddress>& shard) { shard.prune(cutoff); });
 }
 
 unsigned long SyncRes::getServerFailsCount(const ComboAddress& server)
 {
-  return s_fails.lock()->value(server);
+  return s_fails.lock(server)->value(server);
 }
 
 uint64_t SyncRes::doDumpFailedServers(int fileDesc)
@@ -1265,8 +1330,13 @@ uint64_t SyncRes::doDumpFailedServers(int fileDesc)
   fprintf(filePtr.get(), "; remote IP\tcount\ttimestamp\n");
   uint64_t count = 0;
 
-  // We get a copy, so the I/O does not need to happen while holding the lock
-  for (const auto& iter : s_fails.lock()->getMapCopy()) {
+  // We get a copy, so the I/O does not need to happen while holding the locks
+  fails_t<ComboAddress>::cont_t copy;
+  s_fails.forEachShard([&copy](const fails_t<ComboAddress>& shard) {
+    const auto part = shard.getMapCopy();
+    copy.insert(part.begin(), part.end());
+  });
+  for (const auto& iter : copy) {
     count++;
     timebuf_t tmp;
     fprintf(filePtr.get(), "%s\t%" PRIu64 "\t%s\n", iter.key.toString().c_str(), iter.value, timestamp(iter.last, tmp));
@@ -1277,17 +1347,17 @@ uint64_t SyncRes::doDumpFailedServers(int fileDesc)
 
 uint64_t SyncRes::getNonResolvingNSSize()
 {
-  return s_nonresolving.lock()->size();
+  return s_nonresolving.size();
 }
 
 void SyncRes::clearNonResolvingNS()
 {
-  s_nonresolving.lock()->clear();
+  s_nonresolving.clear();
 }
 
 void SyncRes::pruneNonResolving(time_t cutoff)
 {
-  s_nonresolving.lock()->prune(cutoff);
+  s_nonresolving.forEachShard([cutoff](fails_t<DNSName>& shard) { shard.prune(cutoff); });
 }
 
 uint64_t SyncRes::doDumpNonResolvingNS(int fileDesc)
@@ -1305,8 +1375,13 @@ uint64_t SyncRes::doDumpNonResolvingNS(int fileDesc)
   fprintf(filePtr.get(), "; name\tcount\ttimestamp\n");
   uint64_t count = 0;
 
-  // We get a copy, so the I/O does not need to happen while holding the lock
-  for (const auto& iter : s_nonresolving.lock()->getMapCopy()) {
+  // We get a copy, so the I/O does not need to happen while holding the locks
+  fails_t<DNSName>::cont_t copy;
+  s_nonresolving.forEachShard([&copy](const fails_t<DNSName>& shard) {
+    const auto part = shard.getMapCopy();
+    copy.insert(part.begin(), part.end());
+  });
+  for (const auto& iter : copy) {
     count++;
     timebuf_t tmp;
     fprintf(filePtr.get(), "%s\t%" PRIu64 "\t%s\n", iter.key.toString().c_str(), iter.value, timestamp(iter.last, tmp));
@@ -1447,7 +1522,7 @@ LWResult::Result SyncRes::asyncresolveWrapper(const OptLog& log, const ComboAddr
   // Read current status, defaulting to OK
   SyncRes::EDNSStatus::EDNSMode mode = EDNSStatus::EDNSOK;
   {
-    auto lock = s_ednsstatus.lock();
+    auto lock = s_ednsstatus.lock(address);
     auto ednsstatus = lock->find(address); // does this include port? YES
     if (ednsstatus != lock->end()) {
       if (ednsstatus->ttd != 0 && ednsstatus->ttd < d_now.tv_sec) {
@@ -1499,7 +1574,7 @@ LWResult::Result SyncRes::asyncresolveWrapper(const OptLog& log, const ComboAddr
       // We sent out with EDNS
       // ret is LWResult::Result::Success
       // ednsstatus in table might be pruned or changed by another request/thread, so do a new lookup/insert if needed
-      auto lock = s_ednsstatus.lock(); // all three branches below need a lock
+      auto lock = s_ednsstatus.lock(address); // all three branches below need a lock
 
       // Determine new mode
       if (ret == LWResult::Result::BindError) {
@@ -2084,7 +2159,7 @@ void SyncRes::selectNSOnSpeed(const DNSName& qname, const string& prefix, vector
   */
   map<ComboAddress, float> speeds;
   {
-    auto lock = s_nsSpeeds.lock();
+    auto lock = s_nsSpeeds.lock(qname);
     const auto& collection = lock->find_or_enter(qname, d_now);
     float factor = collection.getFactor(d_now);
     for (const auto& val : ret) {
@@ -3082,7 +3157,7 @@ std::vector<std::pair<DNSName, float>> SyncRes::shuffleInSpeedOrder(const DNSNam
   std::vector<std::pair<DNSName, float>> rnameservers;
   rnameservers.reserve(tnameservers.size());
   for (const auto& tns : tnameservers) {
-    float speed = s_nsSpeeds.lock()->fastest(tns.first, d_now);
+    float speed = s_nsSpeeds.lock(tns.first)->fastest(tns.first, d_now);
     rnameservers.emplace_back(tns.first, speed);
     if (tns.first.empty()) { // this was an authoritative OOB zone, don't pollute the nsSpeeds with that
       return rnameservers;
@@ -3117,7 +3192,7 @@ vector<ComboAddress> SyncRes::shuffleForwardSpeed(const DNSName& qname, const ve
 
   for (const auto& val : nameservers) {
     DNSName nsName = DNSName(val.toStringWithPort());
-    float speed = s_nsSpeeds.lock()->fastest(nsName, d_now);
+    float speed = s_nsSpeeds.lock(nsName)->fastest(nsName, d_now);
     speeds[val] = speed;
   }
   shuffle(nameservers.begin(), nameservers.end(), pdns::dns_random_engine());
@@ -3441,7 +3516,7 @@ vector<ComboAddress> SyncRes::retrieveAddressesForNS(const std::string& prefix,
   size_t nonresolvingfails = 0;
   if (!tns->first.empty()) {
     if (s_nonresolvingnsmaxfails > 0) {
-      nonresolvingfails = s_nonresolving.lock()->value(tns->first);
+      nonresolvingfails = s_nonresolving.lock(tns->first)->value(tns->first);
       if (nonresolvingfails >= s_nonresolvingnsmaxfails) {
         LOG(prefix << qname << ": NS " << tns->first << " in non-resolving map, skipping" << endl);
         return result;
@@ -3457,7 +3532,7 @@ vector<ComboAddress> SyncRes::retrieveAddressesForNS(const std::string& prefix,
     catch (const ImmediateServFailException& ex) {
       if (s_nonresolvingnsmaxfails > 0 && d_outqueries > oldOutQueries) {
         if (!shouldNotThrottle(&tns->first, nullptr)) {
-          s_nonresolving.lock()->incr(tns->first, d_now);
+          s_nonresolving.lock(tns->first)->incr(tns->first, d_now);
         }
       }
       throw ex;
@@ -3465,12 +3540,12 @@ vector<ComboAddress> SyncRes::retrieveAddressesForNS(const std::string& prefix,
     if (s_nonresolvingnsmaxfails > 0 && d_outqueries > oldOutQueries) {
       if (result.empty()) {
         if (!shouldNotThrottle(&tns->first, nullptr)) {
-          s_nonresolving.lock()->incr(tns->first, d_now);
+          s_nonresolving.lock(tns->first)->incr(tns->first, d_now);
         }
       }
       else if (nonresolvingfails > 0) {
         // Succeeding resolve, clear memory of recent failures
-        s_nonresolving.lock()->clear(tns->first);
+        s_nonresolving.lock(tns->first)->clear(tns->first);
       }
     }
     pierceDontQuery = false;
@@ -5551,10 +5626,10 @@ bool SyncRes::doResolveAtThisIP(const std::string& prefix, const DNSName& qname,
         responseUsec = lwr.d_usec;
       }
 
-      s_nsSpeeds.lock()->find_or_enter(nsName.empty() ? DNSName(remoteIP.toStringWithPort()) : nsName, d_now).submit(remoteIP, static_cast<int>(responseUsec), d_now);
+      submitNSSpeed(nsName.empty() ? DNSName(remoteIP.toStringWithPort()) : nsName, remoteIP, static_cast<int>(responseUsec), d_now);
 
       // make sure we don't throttle the root
-      if (s_serverdownmaxfails > 0 && auth != g_rootdnsname && s_fails.lock()->incr(remoteIP, d_now) >= s_serverdownmaxfails) {
+      if (s_serverdownmaxfails > 0 && auth != g_rootdnsname && s_fails.lock(remoteIP)->incr(remoteIP, d_now) >= s_serverdownmaxfails) {
         LOG(prefix << qname << ": Max fails reached resolving on " << remoteIP.toString() << ". Going full throttle for " << s_serverdownthrottletime << " seconds" << endl);
         // mark server as down
         doThrottle(d_now.tv_sec, remoteIP, s_serverdownthrottletime, 10000, Throttle::Reason::ServerDown);
@@ -5582,7 +5657,7 @@ bool SyncRes::doResolveAtThisIP(const std::string& prefix, const DNSName& qname,
     if (!chained && !dontThrottle) {
 
       // let's make sure we prefer a different server for some time, if there is one available
-      s_nsSpeeds.lock()->find_or_enter(nsName.empty() ? DNSName(remoteIP.toStringWithPort()) : nsName, d_now).submit(remoteIP, 1000000, d_now); // 1 sec
+      submitNSSpeed(nsName.empty() ? DNSName(remoteIP.toStringWithPort()) : nsName, remoteIP, 1000000, d_now); // 1 sec
 
       if (doTCP) {
         // we can be more heavy-handed over TCP
@@ -5602,7 +5677,7 @@ bool SyncRes::doResolveAtThisIP(const std::string& prefix, const DNSName& qname,
         // rather than throttling what could be the only server we have for this destination, let's make sure we try a different one if there is one available
         // on the other hand, we might keep hammering a server under attack if there is no other alternative, or the alternative is overwhelmed as well, but
         // at the very least we will detect that if our packets stop being answered
-        s_nsSpeeds.lock()->find_or_enter(nsName.empty() ? DNSName(remoteIP.toStringWithPort()) : nsName, d_now).submit(remoteIP, 1000000, d_now); // 1 sec
+        submitNSSpeed(nsName.empty() ? DNSName(remoteIP.toStringWithPort()) : nsName, remoteIP, 1000000, d_now); // 1 sec
       }
       else {
         Throttle::Reason reason{};
@@ -5625,7 +5700,7 @@ bool SyncRes::doResolveAtThisIP(const std::string& prefix, const DNSName& qname,
 
   /* this server sent a valid answer, mark it backup up if it was down */
   if (s_serverdownmaxfails > 0) {
-    s_fails.lock()->clear(remoteIP);
+    s_fails.lock(remoteIP)->clear(remoteIP);
   }
   // Clear all throttles for this IP, both general and specific throttles for qname-qtype
   unThrottle(remoteIP, qname, qtype);
@@ -6037,7 +6112,7 @@ int SyncRes::doResolveAt(NsSet& nameservers, DNSName auth, bool flawedNSSet, con
           */
           //        cout<<"ms: "<<lwr.d_usec/1000.0<<", "<<g_avgLatency/1000.0<<'\n';
 
-          s_nsSpeeds.lock()->find_or_enter(tns->first.empty() ? DNSName(remoteIP->toStringWithPort()) : tns->first, d_now).submit(*remoteIP, static_cast<int>(lwr.d_usec), d_now);
+          submitNSSpeed(tns->first.empty() ? DNSName(remoteIP->toStringWithPort()) : tns->first, *remoteIP, static_cast<int>(lwr.d_usec), d_now);
 
           /* we have received an answer, are we done ? */
           bool done = processAnswer(depth, prefix, lwr, qname, qtype, auth, wasForwarded, ednsmask, sendRDQuery, nameservers, ret, luaconfsLocal->dfe, &gotNewServers, &rcode, context.state, *remoteIP, overTCP);
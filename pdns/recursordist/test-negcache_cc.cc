@@ -579,4 +579,50 @@ BOOST_AUTO_TEST_CASE(test_count)
   BOOST_CHECK_EQUAL(count, 0U);
 }
 
+BOOST_AUTO_TEST_CASE(test_PB_roundtrip)
+{
+  DNSName qname("www2.powerdns.com");
+  DNSName qname2("www3.powerdns.com");
+  DNSName auth("powerdns.com");
+
+  struct timeval now;
+  Utility::gettimeofday(&now, 0);
+
+  NegCache cache;
+  cache.add(genNegCacheEntry(qname, auth, now));
+  cache.add(genNegCacheEntry(qname2, auth, now, QType::A));
+  // Expires before the dump is loaded, should not be restored
+  auto expiring = genNegCacheEntry(DNSName("expired.powerdns.com"), auth, now);
+  expiring.d_ttd = now.tv_sec + 10;
+  cache.add(expiring);
+  BOOST_CHECK_EQUAL(cache.size(), 3U);
+
+  std::string pbuf;
+  BOOST_CHECK_EQUAL(cache.getPB("id", pbuf), 3U);
+
+  NegCache restored;
+  BOOST_CHECK_EQUAL(restored.putPB(pbuf, now.tv_sec + 20), 2U);
+  BOOST_CHECK_EQUAL(restored.size(), 2U);
+
+  NegCache::NegCacheEntry negEntry;
+  BOOST_CHECK(restored.get(qname, QType(QType::AAAA), now, negEntry));
+  BOOST_CHECK_EQUAL(negEntry.d_name, qname);
+  BOOST_CHECK_EQUAL(negEntry.d_auth, auth);
+  BOOST_CHECK_EQUAL(negEntry.d_ttd, now.tv_sec + 600);
+  BOOST_CHECK_EQUAL(negEntry.d_orig_ttl, 600U);
+  BOOST_REQUIRE_EQUAL(negEntry.authoritySOA.records.size(), 1U);
+  BOOST_CHECK_EQUAL(negEntry.authoritySOA.records.at(0).getContent()->getZoneRepresentation(), genRecsAndSigs(auth, QType::SOA, "ns1 hostmaster 1 2 3 4 5", false).records.at(0).getContent()->getZoneRepresentation());
+  BOOST_CHECK_EQUAL(negEntry.authoritySOA.signatures.size(), 1U);
+  BOOST_CHECK_EQUAL(negEntry.DNSSECRecords.records.size(), 1U);
+  BOOST_CHECK_EQUAL(negEntry.DNSSECRecords.signatures.size(), 1U);
+
+  BOOST_CHECK(restored.get(qname2, QType(QType::A), now, negEntry, true));
+  BOOST_CHECK_EQUAL(negEntry.d_qtype, QType(QType::A));
+  BOOST_CHECK(!restored.get(DNSName("expired.powerdns.com"), QType(QType::A), now, negEntry));
+
+  // Garbage is rejected without touching the cache
+  BOOST_CHECK_EQUAL(restored.putPB("garbage", now.tv_sec), 0U);
+  BOOST_CHECK_EQUAL(restored.size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
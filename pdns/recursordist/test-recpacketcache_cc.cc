@@ -15,6 +15,8 @@
 #include "recpacketcache.hh"
 #include "taskqueue.hh"
 #include "rec-taskqueue.hh"
+#include <chrono>
+#include <thread>
 #include <utility>
 
 BOOST_AUTO_TEST_SUITE(test_recpacketcache_cc)
@@ -450,4 +452,121 @@ BOOST_AUTO_TEST_CASE(test_recPacketCache_TCP)
   BOOST_CHECK_EQUAL(fpacket, r1packet);
 }
 
+static std::pair<std::string, std::string> makeQueryAndResponse(const DNSName& qname, const std::string& address, uint32_t ttl)
+{
+  vector<uint8_t> packet;
+  DNSPacketWriter writer(packet, qname, QType::A);
+  writer.getHeader()->rd = true;
+  writer.getHeader()->qr = false;
+  writer.getHeader()->id = dns_random_uint16();
+  string query(reinterpret_cast<const char*>(packet.data()), packet.size());
+  writer.startRecord(qname, QType::A, ttl);
+  ARecordContent content(address);
+  content.toPacket(writer);
+  writer.commit();
+  string response(reinterpret_cast<const char*>(packet.data()), packet.size());
+  return {query, response};
+}
+
+BOOST_AUTO_TEST_CASE(test_recPacketCache_SharedLookupsEviction)
+{
+  /* With shared lookups, a hit does not move the entry to the back of the LRU index
+     but the entry should still survive the next eviction */
+  RecursorPacketCache::s_sharedLookups = true;
+  RecursorPacketCache rpc(2, 1);
+  const time_t now = time(nullptr);
+  const uint32_t ttl = 3600;
+  string fpacket;
+  uint32_t age = 0;
+
+  std::vector<DNSName> names{DNSName("a.powerdns.com"), DNSName("b.powerdns.com"), DNSName("c.powerdns.com")};
+  std::vector<std::pair<std::string, std::string>> packets;
+  std::vector<uint32_t> hashes(names.size());
+  for (size_t idx = 0; idx < names.size(); idx++) {
+    packets.push_back(makeQueryAndResponse(names.at(idx), "192.0.2." + std::to_string(idx + 1), ttl));
+    BOOST_CHECK(!rpc.getResponsePacket(0, packets.at(idx).first, names.at(idx), QType::A, QClass::IN, now, &fpacket, &age, &hashes.at(idx)));
+  }
+
+  for (size_t idx = 0; idx < 2; idx++) {
+    rpc.insertResponsePacket(0, hashes.at(idx), string(packets.at(idx).first), names.at(idx), QType::A, QClass::IN, string(packets.at(idx).second), now, ttl, vState::Indeterminate, std::nullopt, false);
+  }
+  BOOST_CHECK_EQUAL(rpc.size(), 2U);
+
+  /* a.powerdns.com is the oldest entry, but it has been hit */
+  BOOST_CHECK(rpc.getResponsePacket(0, packets.at(0).first, names.at(0), QType::A, QClass::IN, now, &fpacket, &age, &hashes.at(0)));
+  BOOST_CHECK_EQUAL(fpacket, packets.at(0).second);
+
+  rpc.insertResponsePacket(0, hashes.at(2), string(packets.at(2).first), names.at(2), QType::A, QClass::IN, string(packets.at(2).second), now, ttl, vState::Indeterminate, std::nullopt, false);
+  BOOST_CHECK_EQUAL(rpc.size(), 2U);
+
+  BOOST_CHECK(rpc.getResponsePacket(0, packets.at(0).first, names.at(0), QType::A, QClass::IN, now, &fpacket, &age, &hashes.at(0)));
+  BOOST_CHECK(!rpc.getResponsePacket(0, packets.at(1).first, names.at(1), QType::A, QClass::IN, now, &fpacket, &age, &hashes.at(1)));
+  BOOST_CHECK(rpc.getResponsePacket(0, packets.at(2).first, names.at(2), QType::A, QClass::IN, now, &fpacket, &age, &hashes.at(2)));
+  BOOST_CHECK_EQUAL(rpc.getHits(), 3U);
+  BOOST_CHECK_EQUAL(rpc.getMisses(), 4U);
+
+  RecursorPacketCache::s_sharedLookups = false;
+}
+
+BOOST_AUTO_TEST_CASE(test_recPacketCache_ConcurrentHits)
+{
+  /* Measures the hit throughput of several threads looking up the same small set of entries,
+     with and without shared lookups. Run with --log_level=message to see the numbers. */
+  const size_t numberOfNames = 64;
+  const size_t numberOfThreads = std::max(2U, std::min(std::thread::hardware_concurrency(), 32U));
+  const size_t lookupsPerThread = 50000;
+  const time_t now = time(nullptr);
+  const uint32_t ttl = 3600;
+
+  std::vector<DNSName> names;
+  std::vector<std::pair<std::string, std::string>> packets;
+  for (size_t idx = 0; idx < numberOfNames; idx++) {
+    names.emplace_back("host" + std::to_string(idx) + ".powerdns.com");
+    packets.push_back(makeQueryAndResponse(names.back(), "192.0.2.1", ttl));
+  }
+
+  for (const bool shared : {false, true}) {
+    RecursorPacketCache::s_sharedLookups = shared;
+    RecursorPacketCache rpc(numberOfNames * 2, 16);
+    for (size_t idx = 0; idx < numberOfNames; idx++) {
+      string fpacket;
+      uint32_t age = 0;
+      uint32_t qhash = 0;
+      BOOST_CHECK(!rpc.getResponsePacket(0, packets.at(idx).first, names.at(idx), QType::A, QClass::IN, now, &fpacket, &age, &qhash));
+      rpc.insertResponsePacket(0, qhash, string(packets.at(idx).first), names.at(idx), QType::A, QClass::IN, string(packets.at(idx).second), now, ttl, vState::Indeterminate, std::nullopt, false);
+    }
+
+    std::atomic<uint64_t> hits{0};
+    std::vector<std::thread> threads;
+    threads.reserve(numberOfThreads);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t threadId = 0; threadId < numberOfThreads; threadId++) {
+      threads.emplace_back([&, threadId] {
+        uint64_t found = 0;
+        string fpacket;
+        uint32_t age = 0;
+        uint32_t qhash = 0;
+        for (size_t counter = 0; counter < lookupsPerThread; counter++) {
+          const size_t idx = (threadId + counter) % numberOfNames;
+          if (rpc.getResponsePacket(0, packets.at(idx).first, names.at(idx), QType::A, QClass::IN, now, &fpacket, &age, &qhash)) {
+            found++;
+          }
+        }
+        hits += found;
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    BOOST_CHECK_EQUAL(hits.load(), numberOfThreads * lookupsPerThread);
+    BOOST_CHECK_EQUAL(rpc.getHits(), numberOfThreads * lookupsPerThread);
+    const auto [contended, acquired] = rpc.stats();
+    BOOST_TEST_MESSAGE((shared ? "shared" : "exclusive") << " lookups, " << numberOfThreads << " threads: " << static_cast<uint64_t>(hits.load() / elapsed) << " hits/s, " << contended << "/" << acquired << " contended/acquired");
+  }
+
+  RecursorPacketCache::s_sharedLookups = false;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1379,6 +1379,17 @@ BOOST_AUTO_TEST_CASE(test_RecursorCacheDumpAndRestore)
     BOOST_CHECK_EQUAL(MRC.size(), 100U);
 
     checker();
+
+    // Same, loaded by several threads
+    dump.clear();
+    MRC.getRecordSets(0, 0, dump);
+    MRC.doWipeCache(DNSName("."), true);
+    BOOST_CHECK_EQUAL(MRC.size(), 0U);
+    inserted = MRC.putRecordSets(dump, 4);
+    BOOST_CHECK_EQUAL(inserted, 100U);
+    BOOST_CHECK_EQUAL(MRC.size(), 100U);
+
+    checker();
   }
   catch (const PDNSException& e) {
     cerr << "Had error: " << e.reason << endl;
@@ -1386,6 +1397,93 @@ BOOST_AUTO_TEST_CASE(test_RecursorCacheDumpAndRestore)
   }
 }
 
+BOOST_AUTO_TEST_CASE(test_RecursorCacheWireFormat)
+{
+  MemRecursorCache::resetStaticsForTests();
+  MemRecursorCache classicCache;
+  MemRecursorCache wireCache;
+
+  const DNSName authZone(".");
+  const time_t now = time(nullptr);
+  const auto ttd = static_cast<uint32_t>(now + 30);
+  const ComboAddress who("192.0.2.1");
+  const size_t expected = 100;
+
+  auto makeRRSet = [ttd](const DNSName& name, QType qtype, const std::vector<std::string>& contents) {
+    std::vector<DNSRecord> rset;
+    for (const auto& content : contents) {
+      DNSRecord record;
+      record.d_name = name;
+      record.d_type = qtype;
+      record.d_class = QClass::IN;
+      record.d_ttl = ttd;
+      record.d_place = DNSResourceRecord::ANSWER;
+      record.setContent(DNSRecordContent::make(qtype, QClass::IN, content));
+      rset.push_back(std::move(record));
+    }
+    return rset;
+  };
+
+  const std::vector<std::pair<QType, std::vector<std::string>>> rrsets{
+    {QType::A, {"192.0.2.1", "192.0.2.2"}},
+    {QType::AAAA, {"2001:db8::1"}},
+    {QType::MX, {"10 mx1.powerdns.com.", "20 mx2.powerdns.com."}},
+    {QType::TXT, {"\"v=spf1 -all\""}},
+  };
+
+  auto fill = [&](MemRecursorCache& cache) {
+    for (size_t counter = 0; counter < expected; ++counter) {
+      DNSName name = DNSName("hello ") + DNSName(std::to_string(counter));
+      for (const auto& [qtype, contents] : rrsets) {
+        cache.replace(now, name, qtype, makeRRSet(name, qtype, contents), {}, {}, true, authZone, std::nullopt);
+      }
+    }
+  };
+
+  auto checker = [&](MemRecursorCache& cache) {
+    BOOST_CHECK_EQUAL(cache.size(), expected * rrsets.size());
+    for (size_t counter = 0; counter < expected; ++counter) {
+      DNSName name = DNSName("hello ") + DNSName(std::to_string(counter));
+      for (const auto& [qtype, contents] : rrsets) {
+        std::vector<DNSRecord> retrieved;
+        BOOST_REQUIRE_GT(cache.get(now, name, qtype, MemRecursorCache::None, &retrieved, who), 0);
+        BOOST_REQUIRE_EQUAL(retrieved.size(), contents.size());
+        for (size_t idx = 0; idx < contents.size(); ++idx) {
+          BOOST_CHECK_EQUAL(retrieved.at(idx).d_name, name);
+          BOOST_CHECK_EQUAL(retrieved.at(idx).d_type, qtype.getCode());
+          BOOST_CHECK_EQUAL(retrieved.at(idx).getContent()->getZoneRepresentation(), contents.at(idx));
+        }
+      }
+    }
+  };
+
+  fill(classicCache);
+  checker(classicCache);
+
+  MemRecursorCache::s_storeWireFormat = true;
+  fill(wireCache);
+  checker(wireCache);
+
+  /* the records in wire format do not carry the overhead of one shared pointer and DNSRecordContent object each */
+  BOOST_CHECK_LT(wireCache.bytes(), classicCache.bytes());
+
+  /* a dump of one format can be restored into the other one */
+  std::string dump;
+  classicCache.getRecordSets(0, 0, dump);
+  wireCache.doWipeCache(DNSName("."), true);
+  BOOST_CHECK_EQUAL(wireCache.size(), 0U);
+  BOOST_CHECK_EQUAL(wireCache.putRecordSets(dump), expected * rrsets.size());
+  checker(wireCache);
+
+  dump.clear();
+  wireCache.getRecordSets(0, 0, dump);
+  MemRecursorCache::s_storeWireFormat = false;
+  classicCache.doWipeCache(DNSName("."), true);
+  BOOST_CHECK_EQUAL(classicCache.putRecordSets(dump), expected * rrsets.size());
+  checker(classicCache);
+  MemRecursorCache::resetStaticsForTests();
+}
+
 BOOST_AUTO_TEST_CASE(test_RecursorAuthRecords)
 {
   MemRecursorCache::resetStaticsForTests();
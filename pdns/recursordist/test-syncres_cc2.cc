@@ -462,6 +462,38 @@ BOOST_AUTO_TEST_CASE(test_throttled_server_time)
   BOOST_CHECK(!SyncRes::isThrottled(now + 2, ns));
 }
 
+BOOST_AUTO_TEST_CASE(test_throttled_servers_many)
+{
+  std::unique_ptr<SyncRes> sr;
+  initSR(sr);
+
+  /* the throttle table is split into shards, make sure that size, dump and prune
+     still see the entries of all of them */
+  const size_t count = 300;
+  time_t now = sr->getNow().tv_sec;
+  for (size_t idx = 0; idx < count; idx++) {
+    const ComboAddress server("192.0.2." + std::to_string(idx % 256) + ":" + std::to_string(53 + (idx / 256)));
+    SyncRes::doThrottle(now, server, 10, 10000, SyncRes::ThrottleReason::Timeout);
+  }
+  BOOST_CHECK_EQUAL(SyncRes::getThrottledServersSize(), count);
+
+  for (size_t idx = 0; idx < count; idx++) {
+    const ComboAddress server("192.0.2." + std::to_string(idx % 256) + ":" + std::to_string(53 + (idx / 256)));
+    BOOST_CHECK(SyncRes::isThrottled(now, server));
+  }
+
+  std::string temp{"/tmp/throttleDumpXXXXXX"};
+  auto fileDesc = FDWrapper(mkstemp(temp.data()));
+  BOOST_CHECK_EQUAL(SyncRes::doDumpThrottleMap(fileDesc), count);
+  fileDesc.reset();
+  unlink(temp.c_str());
+
+  SyncRes::pruneThrottledServers(now + 5);
+  BOOST_CHECK_EQUAL(SyncRes::getThrottledServersSize(), count);
+  SyncRes::pruneThrottledServers(now + 11);
+  BOOST_CHECK_EQUAL(SyncRes::getThrottledServersSize(), 0U);
+}
+
 BOOST_AUTO_TEST_CASE(test_dont_query_server)
 {
   std::unique_ptr<SyncRes> sr;
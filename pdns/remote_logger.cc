@@ -1,6 +1,8 @@
 #include <unistd.h>
 #include "threadname.hh"
 #include "remote_logger.hh"
+#include <algorithm>
+#include <climits>
 #include <sys/uio.h>
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -107,13 +109,100 @@ const std::string& RemoteLoggerInterface::toErrorString(Result r)
   return str[std::min(i, 4U)];
 }
 
-RemoteLogger::RemoteLogger(const ComboAddress& remote, uint16_t timeout, uint64_t maxQueuedBytes, uint8_t reconnectWaitTime, bool asyncConnect): d_remote(remote), d_timeout(timeout), d_reconnectWaitTime(reconnectWaitTime), d_asyncConnect(asyncConnect), d_runtime({CircularWriteBuffer(maxQueuedBytes), nullptr})
+/* A single-producer single-consumer ring of messages. The producer swaps the message
+   into a slot that was emptied by the consumer, so that neither the content nor,
+   once the slots have grown large enough, the memory has to be allocated again. */
+struct RemoteLogger::ThreadQueue
+{
+  explicit ThreadQueue(size_t capacity) :
+    d_slots(capacity), d_mask(capacity - 1)
+  {
+  }
+
+  /* producer side */
+  bool push(const std::string* data, std::string* ownedData)
+  {
+    const auto head = d_head.load(std::memory_order_relaxed);
+    if (head - d_cachedTail >= d_slots.size()) {
+      d_cachedTail = d_tail.load(std::memory_order_acquire);
+      if (head - d_cachedTail >= d_slots.size()) {
+        return false;
+      }
+    }
+    auto& slot = d_slots.at(head & d_mask);
+    if (ownedData != nullptr) {
+      slot.swap(*ownedData);
+    }
+    else {
+      slot.assign(*data);
+    }
+    d_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  std::vector<std::string> d_slots;
+  const size_t d_mask;
+  /* only touched by the producer */
+  size_t d_cachedTail{0};
+  /* the consumer never takes a lock, so these two are on their own cache lines
+     to prevent the producer and consumer from invalidating each other's line */
+  alignas(64) std::atomic<size_t> d_head{0};
+  alignas(64) std::atomic<size_t> d_tail{0};
+  /* updated by the producer only */
+  alignas(64) std::atomic<uint64_t> d_queued{0};
+  std::atomic<uint64_t> d_pipeFull{0};
+  std::atomic<uint64_t> d_tooLarge{0};
+  /* set when the logger is destroyed, so that the producer thread can forget about this queue */
+  std::atomic<bool> d_loggerGone{false};
+  /* set when the producer thread exits, so that the writer can forget about this queue once it is empty */
+  std::atomic<bool> d_producerGone{false};
+};
+
+/* the queues of the current thread, one per logger */
+struct RemoteLogger::ThreadQueues
+{
+  ThreadQueues() = default;
+  ThreadQueues(const ThreadQueues&) = delete;
+  ThreadQueues(ThreadQueues&&) = delete;
+  ThreadQueues& operator=(const ThreadQueues&) = delete;
+  ThreadQueues& operator=(ThreadQueues&&) = delete;
+  ~ThreadQueues()
+  {
+    for (const auto& entry : d_queues) {
+      /* release so that the writer sees the last messages we pushed */
+      entry.second->d_producerGone.store(true, std::memory_order_release);
+    }
+  }
+
+  std::vector<std::pair<uint64_t, std::shared_ptr<ThreadQueue>>> d_queues;
+};
+
+static std::atomic<uint64_t> s_remoteLoggerInstances{0};
+
+static size_t getQueueCapacity(size_t requested)
+{
+  if (requested == 0) {
+    return 0;
+  }
+  size_t capacity = 1;
+  while (capacity < requested) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+RemoteLogger::RemoteLogger(const ComboAddress& remote, uint16_t timeout, uint64_t maxQueuedBytes, uint8_t reconnectWaitTime, bool asyncConnect, size_t perThreadQueueSize): d_remote(remote), d_timeout(timeout), d_reconnectWaitTime(reconnectWaitTime), d_asyncConnect(asyncConnect), d_runtime({CircularWriteBuffer(perThreadQueueSize == 0 ? maxQueuedBytes : 0), nullptr}), d_instanceID(++s_remoteLoggerInstances), d_perThreadQueueSize(getQueueCapacity(perThreadQueueSize))
 {
   if (!d_asyncConnect) {
     reconnect();
   }
 
-  d_thread = std::thread(&RemoteLogger::maintenanceThread, this);
+  if (d_perThreadQueueSize > 0) {
+    d_thread = std::thread(&RemoteLogger::queuesWriterThread, this);
+  }
+  else {
+    d_thread = std::thread(&RemoteLogger::maintenanceThread, this);
+  }
 }
 
 bool RemoteLogger::reconnect()
@@ -143,8 +232,61 @@ bool RemoteLogger::reconnect()
   return true;
 }
 
+RemoteLogger::ThreadQueue& RemoteLogger::getThreadQueue()
+{
+  /* a thread rarely submits to more than a handful of loggers, a linear scan is fine */
+  static thread_local ThreadQueues t_threadQueues;
+  auto& t_queues = t_threadQueues.d_queues;
+  for (const auto& [instanceID, queue] : t_queues) {
+    if (instanceID == d_instanceID) {
+      return *queue;
+    }
+  }
+
+  t_queues.erase(std::remove_if(t_queues.begin(), t_queues.end(), [](const auto& entry) { return entry.second->d_loggerGone.load(std::memory_order_relaxed); }), t_queues.end());
+
+  auto queue = std::make_shared<ThreadQueue>(d_perThreadQueueSize);
+  {
+    auto queues = d_threadQueues.lock();
+    queues->push_back(queue);
+    d_threadQueuesCount.store(queues->size(), std::memory_order_release);
+  }
+  t_queues.emplace_back(d_instanceID, queue);
+  return *t_queues.back().second;
+}
+
+RemoteLoggerInterface::Result RemoteLogger::pushToThreadQueue(const std::string* data, std::string* ownedData)
+{
+  auto& queue = getThreadQueue();
+  const auto size = ownedData != nullptr ? ownedData->size() : data->size();
+  if (size > std::numeric_limits<uint16_t>::max()) {
+    queue.d_tooLarge.store(queue.d_tooLarge.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return Result::TooLarge;
+  }
+
+  if (!queue.push(data, ownedData)) {
+    queue.d_pipeFull.store(queue.d_pipeFull.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return Result::PipeFull;
+  }
+
+  queue.d_queued.store(queue.d_queued.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  return Result::Queued;
+}
+
+RemoteLoggerInterface::Result RemoteLogger::queueOwnedData(std::string& data)
+{
+  if (d_perThreadQueueSize == 0) {
+    return queueData(data);
+  }
+  return pushToThreadQueue(nullptr, &data);
+}
+
 RemoteLoggerInterface::Result RemoteLogger::queueData(const std::string& data)
 {
+  if (d_perThreadQueueSize > 0) {
+    return pushToThreadQueue(&data, nullptr);
+  }
+
   auto runtime = d_runtime.lock();
 
   if (data.size() > std::numeric_limits<uint16_t>::max()) {
@@ -253,10 +395,236 @@ void RemoteLogger::maintenanceThread()
   }
 }
 
+/* returns the number of bytes written, 0 if the socket buffer is full, and throws on errors or EOF */
+static size_t writeVectors(int fileDesc, const struct iovec* iov, int count)
+{
+  for (;;) {
+    auto res = writev(fileDesc, iov, count);
+    if (res > 0) {
+      return static_cast<size_t>(res);
+    }
+    if (res == 0) {
+      throw std::runtime_error("EOF");
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+    throw std::runtime_error("Couldn't flush a thing: " + stringerror());
+  }
+}
+
+void RemoteLogger::queuesWriterThread()
+{
+  /* how long we sleep when there was nothing to send, doubling every time
+     we wake up to find the queues still empty */
+  static constexpr useconds_t minIdleWaitUsec{50};
+  static constexpr useconds_t maxIdleWaitUsec{10000};
+  static constexpr int stalledWaitMsec{10};
+  /* each message needs two vectors, one for the length and one for the message itself */
+  const size_t maxMessagesPerWrite = std::min(static_cast<size_t>(IOV_MAX), static_cast<size_t>(1024)) / 2;
+
+  try {
+#ifdef RECURSOR
+    string threadName = "rec/remlog";
+#else
+    string threadName = "dnsdist/remLog";
+#endif
+    setThreadName(threadName);
+
+    std::vector<std::shared_ptr<ThreadQueue>> queues;
+    std::vector<struct iovec> iov;
+    std::vector<uint16_t> lengths;
+    iov.reserve(maxMessagesPerWrite * 2);
+    lengths.reserve(maxMessagesPerWrite);
+    /* the remaining part of a message that was only partially written, which
+       has to be sent before anything else */
+    std::string pending;
+    useconds_t idleWait = minIdleWaitUsec;
+
+    while (!d_exiting) {
+      int fileDesc = -1;
+      {
+        auto runtime = d_runtime.lock();
+        if (runtime->d_socket) {
+          fileDesc = runtime->d_socket->getHandle();
+        }
+      }
+
+      if (fileDesc == -1) {
+        /* the messages stay in the queues until we are connected again,
+           but a partial one cannot be sent over a new connection */
+        pending.clear();
+        if (!reconnect()) {
+          sleep(d_reconnectWaitTime);
+        }
+        continue;
+      }
+
+      if (queues.size() != d_threadQueuesCount.load(std::memory_order_acquire)) {
+        queues = *(d_threadQueues.lock());
+      }
+
+      bool wroteSomething = false;
+      bool stalled = false;
+      bool exitedProducers = false;
+      try {
+        if (!pending.empty()) {
+          struct iovec vec{pending.data(), pending.size()};
+          auto written = writeVectors(fileDesc, &vec, 1);
+          pending.erase(0, written);
+          wroteSomething = written > 0;
+          stalled = !pending.empty();
+        }
+
+        for (const auto& queue : queues) {
+          if (stalled) {
+            break;
+          }
+          const auto tail = queue->d_tail.load(std::memory_order_relaxed);
+          const auto head = queue->d_head.load(std::memory_order_acquire);
+          const auto count = std::min(head - tail, maxMessagesPerWrite);
+          if (count == 0) {
+            if (queue->d_producerGone.load(std::memory_order_acquire) && queue->d_head.load(std::memory_order_acquire) == tail) {
+              exitedProducers = true;
+            }
+            continue;
+          }
+
+          iov.clear();
+          lengths.clear();
+          for (size_t idx = 0; idx < count; idx++) {
+            auto& slot = queue->d_slots.at((tail + idx) & queue->d_mask);
+            lengths.push_back(htons(static_cast<uint16_t>(slot.size())));
+            iov.push_back({&lengths.back(), sizeof(uint16_t)});
+            iov.push_back({slot.data(), slot.size()});
+          }
+
+          auto written = writeVectors(fileDesc, iov.data(), static_cast<int>(iov.size()));
+          if (written == 0) {
+            stalled = true;
+            break;
+          }
+          wroteSomething = true;
+
+          size_t consumed = 0;
+          for (; consumed < count; consumed++) {
+            auto& slot = queue->d_slots.at((tail + consumed) & queue->d_mask);
+            const size_t frameSize = sizeof(uint16_t) + slot.size();
+            if (written < frameSize) {
+              if (written > 0) {
+                /* keep the part that has not been sent yet */
+                if (written < sizeof(uint16_t)) {
+                  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                  const auto* lenPtr = reinterpret_cast<const char*>(&lengths.at(consumed));
+                  pending.assign(lenPtr + written, sizeof(uint16_t) - written);
+                  pending.append(slot);
+                }
+                else {
+                  pending.assign(slot, written - sizeof(uint16_t));
+                }
+                slot.clear();
+                consumed++;
+              }
+              stalled = true;
+              break;
+            }
+            written -= frameSize;
+            /* clear() keeps the memory around, the producer will get it back
+               when it swaps its next message into this slot */
+            slot.clear();
+          }
+          queue->d_tail.store(tail + consumed, std::memory_order_release);
+        }
+
+        if (exitedProducers) {
+          /* the queues of threads that are gone have been drained, we can forget about them */
+          auto registered = d_threadQueues.lock();
+          auto removed = std::stable_partition(registered->begin(), registered->end(), [](const auto& queue) { return !queue->d_producerGone.load(std::memory_order_acquire) || queue->d_head.load(std::memory_order_acquire) != queue->d_tail.load(std::memory_order_relaxed); });
+          {
+            /* keep their counters around */
+            auto runtime = d_runtime.lock();
+            for (auto queueIt = removed; queueIt != registered->end(); ++queueIt) {
+              runtime->d_stats.d_queued += (*queueIt)->d_queued.load(std::memory_order_relaxed);
+              runtime->d_stats.d_pipeFull += (*queueIt)->d_pipeFull.load(std::memory_order_relaxed);
+              runtime->d_stats.d_tooLarge += (*queueIt)->d_tooLarge.load(std::memory_order_relaxed);
+            }
+          }
+          registered->erase(removed, registered->end());
+          d_threadQueuesCount.store(registered->size(), std::memory_order_release);
+          queues = *registered;
+        }
+      }
+      catch (const std::exception& e) {
+        auto runtime = d_runtime.lock();
+        runtime->d_socket.reset();
+        ++runtime->d_stats.d_otherError;
+        continue;
+      }
+
+      if (stalled) {
+        ++d_writeStalls;
+        idleWait = minIdleWaitUsec;
+        waitForRWData(fileDesc, false, 0, stalledWaitMsec);
+      }
+      else if (wroteSomething) {
+        idleWait = minIdleWaitUsec;
+      }
+      else {
+        usleep(idleWait);
+        idleWait = std::min(idleWait * 2, maxIdleWaitUsec);
+      }
+    }
+  }
+  catch (const std::exception& e)
+  {
+    SLOG(cerr << "Remote Logger's writer thread died on: " << e.what() << endl,
+         g_slog->withName("protobuf")->error(Logr::Error, e.what(), "Remote Logger's writer thread died"));
+  }
+  catch (...) {
+    SLOG(cerr << "Remote Logger's writer thread died on unknown exception" << endl,
+         g_slog->withName("protobuf")->info(Logr::Error, "Remote Logger's writer thread died"));
+  }
+}
+
+RemoteLoggerInterface::Stats RemoteLogger::getStats()
+{
+  if (d_perThreadQueueSize == 0) {
+    return d_runtime.lock()->d_stats;
+  }
+
+  /* same locking order than the writer, which moves the counters of a queue to
+     the runtime ones when it forgets about that queue */
+  auto queues = d_threadQueues.lock();
+  auto stats = d_runtime.lock()->d_stats;
+  for (const auto& queue : *queues) {
+    stats.d_queued += queue->d_queued.load(std::memory_order_relaxed);
+    stats.d_pipeFull += queue->d_pipeFull.load(std::memory_order_relaxed);
+    stats.d_tooLarge += queue->d_tooLarge.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+std::string RemoteLogger::toString()
+{
+  auto stats = getStats();
+  auto result = d_remote.toStringWithPort() + " (" + std::to_string(stats.d_queued) + " processed, " + std::to_string(stats.d_pipeFull + stats.d_tooLarge + stats.d_otherError) + " dropped";
+  if (d_perThreadQueueSize > 0) {
+    result += ", " + std::to_string(d_writeStalls.load()) + " write stalls";
+  }
+  return result + ")";
+}
+
 RemoteLogger::~RemoteLogger()
 {
   d_exiting = true;
 
   d_thread.join();
+
+  for (const auto& queue : *(d_threadQueues.lock())) {
+    queue->d_loggerGone.store(true, std::memory_order_relaxed);
+  }
 }
 
@@ -25,8 +25,10 @@
 #endif
 
 #include <atomic>
+#include <memory>
 #include <queue>
 #include <thread>
+#include <vector>
 
 #include "iputils.hh"
 #include "circular_buffer.hh"
@@ -66,6 +68,13 @@ public:
 
   virtual ~RemoteLoggerInterface() {};
   virtual Result queueData(const std::string& data) = 0;
+  /* same as queueData() but the logger is allowed to take the content of data instead of
+     copying it, leaving data in a valid but unspecified state, usually an empty string
+     with some capacity that the caller can reuse */
+  virtual Result queueOwnedData(std::string& data)
+  {
+    return queueData(data);
+  }
   [[nodiscard]] virtual std::string address() const = 0;
   [[nodiscard]] virtual std::string toString() = 0;
   [[nodiscard]] virtual std::string name() const = 0;
@@ -108,6 +117,14 @@ private:
    Runs a reconnection thread that also periodicall flushes.
    Note that the buffer only runs as long as there is a connection.
    If there is no connection we don't buffer a thing
+
+   If perThreadQueueSize is not zero, each thread submitting messages gets its own
+   single-producer single-consumer queue of up to perThreadQueueSize messages instead,
+   and the thread sending them to the remote end drains all these queues as soon
+   as possible, gathering as many messages as it can into a single writev() call.
+   Submitting a message then never takes a lock, and does not copy it when
+   queueOwnedData() is used. Messages are kept in the queues while the connection
+   is down, and dropped when the queue of the submitting thread is full.
 */
 class RemoteLogger : public RemoteLoggerInterface
 {
@@ -115,8 +132,13 @@ public:
   RemoteLogger(const ComboAddress& remote, uint16_t timeout=2,
                uint64_t maxQueuedBytes=100000,
                uint8_t reconnectWaitTime=1,
-               bool asyncConnect=false);
+               bool asyncConnect=false,
+               size_t perThreadQueueSize=0);
   ~RemoteLogger();
+  RemoteLogger(const RemoteLogger&) = delete;
+  RemoteLogger(RemoteLogger&&) = delete;
+  RemoteLogger& operator=(const RemoteLogger&) = delete;
+  RemoteLogger& operator=(RemoteLogger&&) = delete;
 
   std::string address() const override
   {
@@ -124,20 +146,13 @@ public:
   }
 
   [[nodiscard]] Result queueData(const std::string& data) override;
+  [[nodiscard]] Result queueOwnedData(std::string& data) override;
   [[nodiscard]] std::string name() const override
   {
     return "protobuf";
   }
-  [[nodiscard]] std::string toString() override
-  {
-    auto runtime = d_runtime.lock();
-    return d_remote.toStringWithPort() + " (" + std::to_string(runtime->d_stats.d_queued) + " processed, " + std::to_string(runtime->d_stats.d_pipeFull + runtime->d_stats.d_tooLarge + runtime->d_stats.d_otherError) + " dropped)";
-  }
-
-  [[nodiscard]] RemoteLoggerInterface::Stats getStats() override
-  {
-    return d_runtime.lock()->d_stats;
-  }
+  [[nodiscard]] std::string toString() override;
+  [[nodiscard]] RemoteLoggerInterface::Stats getStats() override;
 
   void stop()
   {
@@ -145,8 +160,14 @@ public:
   }
 
 private:
+  struct ThreadQueue;
+  struct ThreadQueues;
+
   bool reconnect();
   void maintenanceThread();
+  void queuesWriterThread();
+  ThreadQueue& getThreadQueue();
+  Result pushToThreadQueue(const std::string* data, std::string* ownedData);
 
   struct RuntimeData
   {
@@ -162,6 +183,13 @@ private:
   bool d_asyncConnect{false};
 
   LockGuarded<RuntimeData> d_runtime;
+  /* only used when per-thread queues are enabled */
+  LockGuarded<std::vector<std::shared_ptr<ThreadQueue>>> d_threadQueues;
+  std::atomic<size_t> d_threadQueuesCount{0};
+  /* number of times the writer thread found the outgoing TCP buffer full */
+  std::atomic<uint64_t> d_writeStalls{0};
+  const uint64_t d_instanceID;
+  const size_t d_perThreadQueueSize;
   std::thread d_thread;
 };
 
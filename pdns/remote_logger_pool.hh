@@ -37,6 +37,7 @@ public:
   RemoteLoggerPool& operator=(const RemoteLoggerPool&) = delete;
   RemoteLoggerPool& operator=(RemoteLoggerPool&&) = delete;
   [[nodiscard]] RemoteLoggerInterface::Result queueData(const std::string& data) override;
+  [[nodiscard]] RemoteLoggerInterface::Result queueOwnedData(std::string& data) override;
 
   [[nodiscard]] std::string address() const override
   {
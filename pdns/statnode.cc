@@ -57,7 +57,40 @@ void StatNode::submit(const DNSName& domain, int rcode, unsigned int bytes, bool
   }
 
   auto last = tmp.end() - 1;
-  children[*last].submit(last, tmp.begin(), "", rcode, bytes, remote, 1, hit);
+  auto& node = children[*last].getNode(last, tmp.begin(), "", 1);
+  node.s.queries++;
+  node.s.bytes += bytes;
+  if (rcode < 0) {
+    node.s.drops++;
+  }
+  else if (rcode == RCode::NoError) {
+    node.s.noerrors++;
+  }
+  else if (rcode == RCode::ServFail) {
+    node.s.servfails++;
+  }
+  else if (rcode == RCode::NXDomain) {
+    node.s.nxdomains++;
+  }
+
+  if (remote) {
+    node.s.remotes[*remote]++;
+  }
+
+  if (hit) {
+    ++node.s.hits;
+  }
+}
+
+void StatNode::submit(const DNSName& domain, const Stat& stat)
+{
+  std::vector<string> tmp = domain.getRawLabels();
+  if (tmp.empty()) {
+    return;
+  }
+
+  auto last = tmp.end() - 1;
+  children[*last].getNode(last, tmp.begin(), "", 1).s += stat;
 }
 
 /* www.powerdns.com. -> 
@@ -67,7 +100,7 @@ void StatNode::submit(const DNSName& domain, int rcode, unsigned int bytes, bool
    www.powerdns.com. 
 */
 
-void StatNode::submit(std::vector<string>::const_iterator end, std::vector<string>::const_iterator begin, const std::string& domain, int rcode, unsigned int bytes, const std::optional<ComboAddress>& remote, unsigned int count, bool hit)
+StatNode& StatNode::getNode(std::vector<string>::const_iterator end, std::vector<string>::const_iterator begin, const std::string& domain, unsigned int count)
 {
   //  cerr<<"Submit called for domain='"<<domain<<"': ";
   //  for(const std::string& n :  labels) 
@@ -82,54 +115,23 @@ void StatNode::submit(std::vector<string>::const_iterator end, std::vector<strin
     //    cerr<<"Short name was already set to '"<<name<<"'"<<endl;
   }
 
-  if (end == begin) {
-    if (fullname.empty()) {
-      size_t needed = name.size() + 1 + domain.size();
-      if (fullname.capacity() < needed) {
-        fullname.reserve(needed);
-      }
-      fullname = name;
-      fullname.append(".");
-      fullname.append(domain);
-      labelsCount = count;
-    }
-    //    cerr<<"Hit the end, set our fullname to '"<<fullname<<"'"<<endl<<endl;
-    s.queries++;
-    s.bytes += bytes;
-    if (rcode < 0) {
-      s.drops++;
-    }
-    else if (rcode == RCode::NoError) {
-      s.noerrors++;
-    }
-    else if (rcode == RCode::ServFail) {
-      s.servfails++;
-    }
-    else if (rcode == RCode::NXDomain) {
-      s.nxdomains++;
-    }
-
-    if (remote) {
-      s.remotes[*remote]++;
-    }
-
-    if (hit) {
-      ++s.hits;
+  if (fullname.empty()) {
+    size_t needed = name.size() + 1 + domain.size();
+    if (fullname.capacity() < needed) {
+      fullname.reserve(needed);
     }
+    fullname = name;
+    fullname.append(".");
+    fullname.append(domain);
+    labelsCount = count;
   }
-  else {
-    if (fullname.empty()) {
-      size_t needed = name.size() + 1 + domain.size();
-      if (fullname.capacity() < needed) {
-        fullname.reserve(needed);
-      }
-      fullname = name;
-      fullname.append(".");
-      fullname.append(domain);
-      labelsCount = count;
-    }
-    //    cerr<<"Not yet end, set our fullname to '"<<fullname<<"', recursing"<<endl;
-    --end;
-    children[*end].submit(end, begin, fullname, rcode, bytes, remote, count+1, hit);
+
+  if (end == begin) {
+    //    cerr<<"Hit the end, set our fullname to '"<<fullname<<"'"<<endl<<endl;
+    return *this;
   }
+
+  //    cerr<<"Not yet end, set our fullname to '"<<fullname<<"', recursing"<<endl;
+  --end;
+  return children[*end].getNode(end, begin, fullname, count+1);
 }
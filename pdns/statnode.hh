@@ -66,6 +66,8 @@ public:
   uint8_t labelsCount{0};
 
   void submit(const DNSName& domain, int rcode, unsigned int bytes, bool hit, const std::optional<ComboAddress>& remote);
+  /* add already aggregated statistics for that domain */
+  void submit(const DNSName& domain, const Stat& stat);
   Stat print(unsigned int depth=0, Stat newstat=Stat(), bool silent=false) const;
   void visit(const visitor_t& visitor, Stat& newstat, unsigned int depth = 0) const;
   bool empty() const
@@ -75,5 +77,5 @@ public:
   children_t children;
 
 private:
-  void submit(std::vector<string>::const_iterator end, std::vector<string>::const_iterator begin, const std::string& domain, int rcode, unsigned int bytes, const std::optional<ComboAddress>& remote, unsigned int count, bool hit);
+  StatNode& getNode(std::vector<string>::const_iterator end, std::vector<string>::const_iterator begin, const std::string& domain, unsigned int count);
 };
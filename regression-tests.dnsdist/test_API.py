@@ -43,7 +43,8 @@ class APITestsBase(DNSDistTest):
                         'udp6-in-errors', 'udp6-recvbuf-errors', 'udp6-sndbuf-errors', 'udp6-noport-errors', 'udp6-in-csum-errors',
                         'doh-query-pipe-full', 'doh-response-pipe-full', 'doq-response-pipe-full', 'doh3-response-pipe-full', 'proxy-protocol-invalid', 'tcp-listen-overflows',
                         'outgoing-doh-query-pipe-full', 'tcp-query-pipe-full', 'tcp-cross-protocol-query-pipe-full',
-                        'tcp-cross-protocol-response-pipe-full']
+                        'tcp-cross-protocol-response-pipe-full', 'udp-responder-recv-batches', 'udp-responder-recv-batched',
+                        'udp-responder-send-batches', 'udp-responder-send-batched', 'udp-gro-segments', 'udp-gso-segments']
     _verboseMode = True
 
     @classmethod
@@ -164,10 +165,10 @@ class TestAPIBasics(APITestsBase):
                 self.assertGreaterEqual(frontend[key], 0)
 
         for pool in content['pools']:
-            for key in ['id', 'name', 'cacheSize', 'cacheEntries', 'cacheHits', 'cacheMisses', 'cacheDeferredInserts', 'cacheDeferredLookups', 'cacheLookupCollisions', 'cacheInsertCollisions', 'cacheTTLTooShorts', 'cacheCleanupCount']:
+            for key in ['id', 'name', 'cacheSize', 'cacheEntries', 'cacheHits', 'cacheMisses', 'cacheDeferredInserts', 'cacheDeferredLookups', 'cacheLookupCollisions', 'cacheInsertCollisions', 'cacheTTLTooShorts', 'cacheCleanupCount', 'cacheMemoryAllocated', 'cacheMemoryUsed', 'cacheEvictions']:
                 self.assertIn(key, pool)
 
-            for key in ['id', 'cacheSize', 'cacheEntries', 'cacheHits', 'cacheMisses', 'cacheDeferredInserts', 'cacheDeferredLookups', 'cacheLookupCollisions', 'cacheInsertCollisions', 'cacheTTLTooShorts', 'cacheCleanupCount']:
+            for key in ['id', 'cacheSize', 'cacheEntries', 'cacheHits', 'cacheMisses', 'cacheDeferredInserts', 'cacheDeferredLookups', 'cacheLookupCollisions', 'cacheInsertCollisions', 'cacheTTLTooShorts', 'cacheCleanupCount', 'cacheMemoryAllocated', 'cacheMemoryUsed', 'cacheEvictions']:
                 self.assertGreaterEqual(pool[key], 0)
 
         stats = content['statistics']
@@ -181,3 +181,26 @@ class TestRuleMetricsRecvmmsg(RuleMetricsTest, DNSDistTest):
     _config_template = RuleMetricsTest._config_template + """
         setUDPMultipleMessagesVectorSize(10)
     """
+
+    def testResponderBatches(self):
+        """
+        Metrics: Responses from the backend are received and sent in batches
+        """
+        name = 'responder-batches.metrics.tests.powerdns.com.'
+        query = dns.message.make_query(name, 'A', 'IN')
+        response = dns.message.make_response(query)
+
+        recvBatchesBefore = self.getMetric('udp-responder-recv-batches')
+        recvBatchedBefore = self.getMetric('udp-responder-recv-batched')
+        sendBatchesBefore = self.getMetric('udp-responder-send-batches')
+        sendBatchedBefore = self.getMetric('udp-responder-send-batched')
+
+        (receivedQuery, receivedResponse) = self.sendUDPQuery(query, response)
+        receivedQuery.id = query.id
+        self.assertEqual(query, receivedQuery)
+        self.assertEqual(receivedResponse, response)
+
+        self.assertEqual(self.getMetric('udp-responder-recv-batches'), recvBatchesBefore + 1)
+        self.assertEqual(self.getMetric('udp-responder-recv-batched'), recvBatchedBefore + 1)
+        self.assertEqual(self.getMetric('udp-responder-send-batches'), sendBatchesBefore + 1)
+        self.assertEqual(self.getMetric('udp-responder-send-batched'), sendBatchedBefore + 1)